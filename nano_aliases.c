@@ -0,0 +1,441 @@
+/* nano_aliases.c
+* Alias book: labels for known accounts
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* An alias book names accounts: representatives, exchanges, faucets. The
+* text form has one account per line, an address or 64 hex digits followed
+* by the label, with # starting a comment:
+*
+*   nano_3abc...xyz Some Exchange hot wallet
+*   # faucets
+*   0a1b...9f, Faucet
+*
+* Parsing tens of thousands of lines and checking their address checksums
+* takes a while, so a book can be converted once into a prebuilt form:
+*
+*   tshark -o nano.alias_book:aliases.txt -z nano,aliases,aliases.bin -r <any capture>
+*
+* which is memory mapped and used as it is. Both end up in the same layout,
+* in host byte order:
+*
+*   header
+*   index    257 x guint32, where the entries starting with each first byte begin
+*   keys     the first 8 bytes of every account as a big endian guint64, sorted
+*   entries  account and label offset, in the same order
+*   labels   NUL terminated
+*
+* A lookup narrows the keys to the accounts sharing the first byte, then
+* binary searches them without branches; the keys are packed so the search
+* touches few cache lines.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/stat_tap_ui.h>
+#include <wsutil/file_util.h>
+#include <wsutil/pint.h>
+#include <wsutil/report_message.h>
+
+#include "packet-nano.h"
+#include "nano_aliases.h"
+
+#define NANO_ALIASES_MAGIC "NANOALS"
+#define NANO_ALIASES_VERSION 1
+#define NANO_ALIASES_BYTE_ORDER 0x01020304
+
+#define NANO_ALIASES_INDEX_SIZE 257
+#define NANO_ALIASES_MAX_LABEL 255
+
+#define NANO_ALIASES_ALIGN(n) (((n) + 7) & ~(gsize) 7)
+
+struct nano_aliases_header {
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 count;
+    guint32 labels_size;
+};
+
+struct nano_alias {
+    guint8 account[32];
+    guint32 label;
+    guint32 reserved;
+};
+
+// the book in use, pointing into either a mapping or a blob built from the text form
+static struct {
+    gchar *path;
+    GMappedFile *mapped;
+    GByteArray *built;
+
+    const guint8 *data;
+    gsize length;
+
+    guint32 count;
+    const guint32 *index;
+    const guint64 *keys;
+    const struct nano_alias *entries;
+    const char *labels;
+    guint32 labels_size;
+} nano_book;
+
+static gsize nano_aliases_keys_offset (void) {
+    return NANO_ALIASES_ALIGN(sizeof(struct nano_aliases_header) + NANO_ALIASES_INDEX_SIZE * sizeof(guint32));
+}
+
+static void nano_aliases_unload (void) {
+    if (nano_book.mapped) {
+        g_mapped_file_unref(nano_book.mapped);
+    }
+    if (nano_book.built) {
+        g_byte_array_free(nano_book.built, TRUE);
+    }
+    g_free(nano_book.path);
+    memset(&nano_book, 0, sizeof(nano_book));
+}
+
+// points the book into data if it is a complete alias book
+static gboolean nano_aliases_use (const guint8 *data, gsize length) {
+    const struct nano_aliases_header *header = (const struct nano_aliases_header *) data;
+    gsize keys_offset = nano_aliases_keys_offset();
+
+    if (length < keys_offset || memcmp(header->magic, NANO_ALIASES_MAGIC, sizeof(NANO_ALIASES_MAGIC)) ||
+            header->version != NANO_ALIASES_VERSION || header->byte_order != NANO_ALIASES_BYTE_ORDER) {
+        return FALSE;
+    }
+
+    gsize entries_offset = keys_offset + (gsize) header->count * sizeof(guint64);
+    gsize labels_offset = entries_offset + (gsize) header->count * sizeof(struct nano_alias);
+
+    if (labels_offset > length || header->labels_size > length - labels_offset ||
+            header->labels_size == 0 || data[labels_offset + header->labels_size - 1] != '\0') {
+        return FALSE;
+    }
+
+    const guint32 *index = (const guint32 *) (data + sizeof(*header));
+    if (index[0] != 0 || index[NANO_ALIASES_INDEX_SIZE - 1] != header->count) {
+        return FALSE;
+    }
+    for (int i = 1; i < NANO_ALIASES_INDEX_SIZE; i++) {
+        if (index[i] < index[i - 1]) {
+            return FALSE;
+        }
+    }
+
+    nano_book.data = data;
+    nano_book.length = length;
+    nano_book.count = header->count;
+    nano_book.index = index;
+    nano_book.keys = (const guint64 *) (data + keys_offset);
+    nano_book.entries = (const struct nano_alias *) (data + entries_offset);
+    nano_book.labels = (const char *) (data + labels_offset);
+    nano_book.labels_size = header->labels_size;
+
+    return TRUE;
+}
+
+//
+// Text form
+//
+static int nano_alias_compare (const void *a, const void *b) {
+    return memcmp(((const struct nano_alias *) a)->account, ((const struct nano_alias *) b)->account, 32);
+}
+
+static gboolean nano_aliases_parse_account (const char *text, gsize length, guint8 *account) {
+    if (length == 64) {
+        for (int i = 0; i < 32; i++) {
+            int high = g_ascii_xdigit_value(text[i * 2]);
+            int low = g_ascii_xdigit_value(text[i * 2 + 1]);
+
+            if (high < 0 || low < 0) {
+                return FALSE;
+            }
+            account[i] = (guint8) (high << 4 | low);
+        }
+        return TRUE;
+    }
+
+    char address[NANO_ADDRESS_LENGTH + 1];
+    if (length >= sizeof(address)) {
+        return FALSE;
+    }
+    memcpy(address, text, length);
+    address[length] = '\0';
+
+    return nano_address_to_account(address, account);
+}
+
+// the layout described at the top of the file, built from entries in any order
+static GByteArray *nano_aliases_pack (GArray *entries, GByteArray *labels) {
+    struct nano_aliases_header header;
+    guint32 index[NANO_ALIASES_INDEX_SIZE];
+    guint32 count = 0;
+    GByteArray *blob = g_byte_array_new();
+
+    g_array_sort(entries, nano_alias_compare);
+
+    // an account named twice is a mistake in the book, one of its labels is kept
+    for (guint i = 0; i < entries->len; i++) {
+        if (count && !nano_alias_compare(&g_array_index(entries, struct nano_alias, count - 1), &g_array_index(entries, struct nano_alias, i))) {
+            continue;
+        }
+        g_array_index(entries, struct nano_alias, count++) = g_array_index(entries, struct nano_alias, i);
+    }
+
+    memset(index, 0, sizeof(index));
+    for (guint32 i = 0; i < count; i++) {
+        index[g_array_index(entries, struct nano_alias, i).account[0] + 1]++;
+    }
+    for (int i = 1; i < NANO_ALIASES_INDEX_SIZE; i++) {
+        index[i] += index[i - 1];
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NANO_ALIASES_MAGIC, sizeof(NANO_ALIASES_MAGIC));
+    header.version = NANO_ALIASES_VERSION;
+    header.byte_order = NANO_ALIASES_BYTE_ORDER;
+    header.count = count;
+    header.labels_size = labels->len;
+
+    g_byte_array_set_size(blob, (guint) nano_aliases_keys_offset());
+    memset(blob->data, 0, blob->len);
+    memcpy(blob->data, &header, sizeof(header));
+    memcpy(blob->data + sizeof(header), index, sizeof(index));
+
+    for (guint32 i = 0; i < count; i++) {
+        guint64 key = pntoh64(g_array_index(entries, struct nano_alias, i).account);
+
+        g_byte_array_append(blob, (const guint8 *) &key, sizeof(key));
+    }
+    g_byte_array_append(blob, (const guint8 *) entries->data, count * (guint) sizeof(struct nano_alias));
+    g_byte_array_append(blob, labels->data, labels->len);
+
+    return blob;
+}
+
+static GByteArray *nano_aliases_parse (const char *path, const char *text, gsize length) {
+    GArray *entries = g_array_new(FALSE, FALSE, sizeof(struct nano_alias));
+    GByteArray *labels = g_byte_array_new();
+    const char *end = text + length;
+    guint line_number = 0;
+    guint rejected = 0, first_rejected = 0;
+
+    // offset 0 is the empty label
+    g_byte_array_append(labels, (const guint8 *) "", 1);
+
+    while (text < end) {
+        const char *line_end = memchr(text, '\n', end - text);
+        const char *account, *label;
+        gsize account_length, label_length;
+        struct nano_alias entry;
+
+        if (!line_end) {
+            line_end = end;
+        }
+        line_number++;
+
+        // account, whitespace or a comma, label up to a comment or the end of the line
+        while (text < line_end && g_ascii_isspace(*text)) {
+            text++;
+        }
+        account = text;
+        while (text < line_end && !g_ascii_isspace(*text) && *text != ',' && *text != '#') {
+            text++;
+        }
+        account_length = text - account;
+        while (text < line_end && (g_ascii_isspace(*text) || *text == ',')) {
+            text++;
+        }
+        label = text;
+        while (text < line_end && *text != '#') {
+            text++;
+        }
+        label_length = text - label;
+        while (label_length && g_ascii_isspace(label[label_length - 1])) {
+            label_length--;
+        }
+
+        text = line_end + 1;
+
+        if (account_length == 0) {
+            continue;
+        }
+        if (label_length == 0 || !nano_aliases_parse_account(account, account_length, entry.account)) {
+            if (rejected++ == 0) {
+                first_rejected = line_number;
+            }
+            continue;
+        }
+
+        entry.label = labels->len;
+        entry.reserved = 0;
+        g_byte_array_append(labels, (const guint8 *) label, (guint) MIN(label_length, NANO_ALIASES_MAX_LABEL));
+        g_byte_array_append(labels, (const guint8 *) "", 1);
+        g_array_append_val(entries, entry);
+    }
+
+    if (rejected) {
+        report_failure("Nano alias book %s: %u lines without a valid account and label, the first is line %u", path, rejected, first_rejected);
+    }
+
+    GByteArray *blob = nano_aliases_pack(entries, labels);
+
+    g_array_free(entries, TRUE);
+    g_byte_array_free(labels, TRUE);
+
+    return blob;
+}
+
+void nano_aliases_load (const char *path) {
+    GError *error = NULL;
+
+    if (!path || !*path) {
+        nano_aliases_unload();
+        return;
+    }
+    if (nano_book.path && !strcmp(nano_book.path, path)) {
+        return;
+    }
+
+    nano_aliases_unload();
+    nano_book.path = g_strdup(path);
+
+    nano_book.mapped = g_mapped_file_new(path, FALSE, &error);
+    if (!nano_book.mapped) {
+        report_failure("Couldn't open Nano alias book %s: %s", path, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    const guint8 *contents = (const guint8 *) g_mapped_file_get_contents(nano_book.mapped);
+    gsize length = g_mapped_file_get_length(nano_book.mapped);
+
+    // the prebuilt form is used in place
+    if (length >= sizeof(NANO_ALIASES_MAGIC) && !memcmp(contents, NANO_ALIASES_MAGIC, sizeof(NANO_ALIASES_MAGIC))) {
+        if (!nano_aliases_use(contents, length)) {
+            report_failure("Nano alias book %s is damaged or was built on a machine of another byte order", path);
+            g_mapped_file_unref(nano_book.mapped);
+            nano_book.mapped = NULL;
+        }
+        return;
+    }
+
+    nano_book.built = nano_aliases_parse(path, (const char *) contents, length);
+    g_mapped_file_unref(nano_book.mapped);
+    nano_book.mapped = NULL;
+
+    nano_aliases_use(nano_book.built->data, nano_book.built->len);
+}
+
+//
+// Lookup
+//
+const char *nano_aliases_lookup (const guint8 *account) {
+    if (!nano_book.count) {
+        return NULL;
+    }
+
+    guint64 key = pntoh64(account);
+    guint32 first = nano_book.index[account[0]];
+    guint32 count = nano_book.index[account[0] + 1] - first;
+    const guint64 *base = nano_book.keys + first;
+
+    if (count == 0) {
+        return NULL;
+    }
+
+    // lower bound, the compiler turns the select into a conditional move
+    while (count > 1) {
+        guint32 half = count / 2;
+
+        base = base[half - 1] < key ? base + half : base;
+        count -= half;
+    }
+    base += *base < key;
+
+    // 8 byte prefixes may collide, the entries have the whole account
+    for (guint32 i = (guint32) (base - nano_book.keys); i < nano_book.count && nano_book.keys[i] == key; i++) {
+        const struct nano_alias *entry = &nano_book.entries[i];
+
+        if (!memcmp(entry->account, account, 32)) {
+            return entry->label < nano_book.labels_size ? nano_book.labels + entry->label : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+guint32 nano_aliases_count (void) {
+    return nano_book.count;
+}
+
+//
+// Prebuilt form
+//
+static void nano_aliases_write_init (const char *opt_arg, void *userdata _U_) {
+    const char *args = opt_arg + strlen("nano,aliases");
+    FILE *fh;
+
+    if (*args != ',' || args[1] == '\0') {
+        report_failure("Usage: -z nano,aliases,<output file>, with the text alias book in the nano.alias_book preference");
+        return;
+    }
+    args++;
+
+    if (!nano_book.data) {
+        report_failure("No Nano alias book is loaded, set the nano.alias_book preference");
+        return;
+    }
+
+    fh = ws_fopen(args, "wb");
+    if (!fh) {
+        report_open_failure(args, errno, TRUE);
+        return;
+    }
+
+    if (fwrite(nano_book.data, 1, nano_book.length, fh) != nano_book.length) {
+        report_write_failure(args, errno);
+    }
+    if (ws_fclose(fh) != 0) {
+        report_write_failure(args, errno);
+    }
+}
+
+static stat_tap_ui nano_aliases_write_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,aliases",
+    nano_aliases_write_init,
+    0,
+    NULL
+};
+
+void nano_register_aliases(void)
+{
+    register_stat_tap_ui(&nano_aliases_write_ui, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
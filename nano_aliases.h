@@ -0,0 +1,38 @@
+/* nano_aliases.h
+* Alias book: labels for known accounts
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_ALIASES_H__
+#define __NANO_ALIASES_H__
+
+#include <glib.h>
+
+// loads a text or prebuilt alias book, replacing the current one; an empty path unloads it
+void nano_aliases_load(const char *path);
+
+// label of account, NULL if it has none; points into the book, nothing is allocated
+const char *nano_aliases_lookup(const guint8 *account);
+guint32 nano_aliases_count(void);
+
+void nano_register_aliases(void);
+
+#endif /* __NANO_ALIASES_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
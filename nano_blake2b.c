@@ -0,0 +1,164 @@
+/* nano_blake2b.c
+* BLAKE2b (RFC 7693) with variable digest length
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* libgcrypt only offers the 160/256/384/512 bit variants, Nano also needs
+* 40 bit (account checksum) and 64 bit (proof of work) digests, which are not
+* truncations of the longer ones because the length is part of the parameter
+* block.
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include "nano_blake2b.h"
+
+static const guint64 nano_blake2b_iv[8] = {
+    G_GUINT64_CONSTANT(0x6a09e667f3bcc908), G_GUINT64_CONSTANT(0xbb67ae8584caa73b),
+    G_GUINT64_CONSTANT(0x3c6ef372fe94f82b), G_GUINT64_CONSTANT(0xa54ff53a5f1d36f1),
+    G_GUINT64_CONSTANT(0x510e527fade682d1), G_GUINT64_CONSTANT(0x9b05688c2b3e6c1f),
+    G_GUINT64_CONSTANT(0x1f83d9abfb41bd6b), G_GUINT64_CONSTANT(0x5be0cd19137e2179)
+};
+
+static const guint8 nano_blake2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+#define NANO_BLAKE2B_ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define NANO_BLAKE2B_G(a, b, c, d, x, y) \
+    G_STMT_START { \
+        v[a] = v[a] + v[b] + (x); \
+        v[d] = NANO_BLAKE2B_ROTR64(v[d] ^ v[a], 32); \
+        v[c] = v[c] + v[d]; \
+        v[b] = NANO_BLAKE2B_ROTR64(v[b] ^ v[c], 24); \
+        v[a] = v[a] + v[b] + (y); \
+        v[d] = NANO_BLAKE2B_ROTR64(v[d] ^ v[a], 16); \
+        v[c] = v[c] + v[d]; \
+        v[b] = NANO_BLAKE2B_ROTR64(v[b] ^ v[c], 63); \
+    } G_STMT_END
+
+static guint64 nano_blake2b_load64 (const guint8 *p) {
+    return (guint64) p[0] | ((guint64) p[1] << 8) | ((guint64) p[2] << 16) | ((guint64) p[3] << 24) |
+        ((guint64) p[4] << 32) | ((guint64) p[5] << 40) | ((guint64) p[6] << 48) | ((guint64) p[7] << 56);
+}
+
+static void nano_blake2b_compress (nano_blake2b_state *state, const guint8 *block, gboolean last) {
+    guint64 v[16], m[16];
+
+    for (int i = 0; i < 8; i++) {
+        v[i] = state->h[i];
+        v[i + 8] = nano_blake2b_iv[i];
+    }
+    v[12] ^= state->t[0];
+    v[13] ^= state->t[1];
+    if (last) {
+        v[14] = ~v[14];
+    }
+
+    for (int i = 0; i < 16; i++) {
+        m[i] = nano_blake2b_load64(block + 8 * i);
+    }
+
+    for (int round = 0; round < 12; round++) {
+        const guint8 *s = nano_blake2b_sigma[round];
+
+        NANO_BLAKE2B_G(0, 4,  8, 12, m[s[0]], m[s[1]]);
+        NANO_BLAKE2B_G(1, 5,  9, 13, m[s[2]], m[s[3]]);
+        NANO_BLAKE2B_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+        NANO_BLAKE2B_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+        NANO_BLAKE2B_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+        NANO_BLAKE2B_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        NANO_BLAKE2B_G(2, 7,  8, 13, m[s[12]], m[s[13]]);
+        NANO_BLAKE2B_G(3, 4,  9, 14, m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        state->h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+static void nano_blake2b_increment (nano_blake2b_state *state, gsize length) {
+    state->t[0] += length;
+    if (state->t[0] < length) {
+        state->t[1]++;
+    }
+}
+
+void nano_blake2b_init (nano_blake2b_state *state, gsize digest_length) {
+    memset(state, 0, sizeof(*state));
+
+    for (int i = 0; i < 8; i++) {
+        state->h[i] = nano_blake2b_iv[i];
+    }
+    // parameter block: digest length, no key, fanout 1, depth 1
+    state->h[0] ^= 0x01010000 ^ digest_length;
+    state->digest_length = digest_length;
+}
+
+void nano_blake2b_update (nano_blake2b_state *state, const guint8 *data, gsize length) {
+    while (length > 0) {
+        // the last block is only compressed in final, when we know it is the last one
+        if (state->buf_len == NANO_BLAKE2B_BLOCK_LENGTH) {
+            nano_blake2b_increment(state, NANO_BLAKE2B_BLOCK_LENGTH);
+            nano_blake2b_compress(state, state->buf, FALSE);
+            state->buf_len = 0;
+        }
+
+        gsize chunk = MIN(length, NANO_BLAKE2B_BLOCK_LENGTH - state->buf_len);
+        memcpy(state->buf + state->buf_len, data, chunk);
+        state->buf_len += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void nano_blake2b_final (nano_blake2b_state *state, guint8 *digest) {
+    nano_blake2b_increment(state, state->buf_len);
+    memset(state->buf + state->buf_len, 0, NANO_BLAKE2B_BLOCK_LENGTH - state->buf_len);
+    nano_blake2b_compress(state, state->buf, TRUE);
+
+    for (gsize i = 0; i < state->digest_length; i++) {
+        digest[i] = (guint8) (state->h[i / 8] >> (8 * (i % 8)));
+    }
+}
+
+void nano_blake2b (guint8 *digest, gsize digest_length, const guint8 *data, gsize length) {
+    nano_blake2b_state state;
+
+    nano_blake2b_init(&state, digest_length);
+    nano_blake2b_update(&state, data, length);
+    nano_blake2b_final(&state, digest);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,48 @@
+/* nano_blake2b.h
+* BLAKE2b (RFC 7693) with variable digest length, as used for Nano block
+* hashes, account checksums and proof of work
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_BLAKE2B_H__
+#define __NANO_BLAKE2B_H__
+
+#include <glib.h>
+
+#define NANO_BLAKE2B_BLOCK_LENGTH 128
+#define NANO_BLAKE2B_MAX_DIGEST_LENGTH 64
+
+typedef struct _nano_blake2b_state {
+    guint64 h[8];
+    guint64 t[2];
+    guint8 buf[NANO_BLAKE2B_BLOCK_LENGTH];
+    gsize buf_len;
+    gsize digest_length;
+} nano_blake2b_state;
+
+// digest_length is 1 to NANO_BLAKE2B_MAX_DIGEST_LENGTH bytes, no key
+void nano_blake2b_init(nano_blake2b_state *state, gsize digest_length);
+void nano_blake2b_update(nano_blake2b_state *state, const guint8 *data, gsize length);
+void nano_blake2b_final(nano_blake2b_state *state, guint8 *digest);
+
+void nano_blake2b(guint8 *digest, gsize digest_length, const guint8 *data, gsize length);
+
+#endif /* __NANO_BLAKE2B_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,625 @@
+/* nano_bpf.c
+* Capture filters that keep or drop Nano messages by type
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+ * A capture filter only sees single packets, so it decides on the first bytes
+ * of each TCP segment: a segment whose payload starts with a Nano header
+ * ('R', a known network, three version bytes, the message type at offset 5)
+ * is kept or dropped by that type, everything else on the port is kept.
+ *
+ * What this misses:
+ *  - messages that do not start a segment. Only the first message of a
+ *    segment is looked at, the ones packed behind it share its fate, and the
+ *    continuation segments of a dropped message are kept.
+ *  - headerless payloads: bulk pull and frontier responses, bulk push blocks.
+ *    They are kept whatever the selection says about their request.
+ *  - IPv4 fragments after the first one, which are dropped, and IPv6
+ *    extension headers, which hide the TCP header so the packet is dropped.
+ *    The expression reads IPv6 payloads through ip6[] behind the fixed
+ *    header, as tcp[] only looks into IPv4, and makes the same choice.
+ *
+ * Dropped segments leave holes in the TCP stream. The dissector resynchronizes
+ * on the next header, but state carried from request to response (the
+ * expected headerless type, the handshake cookie) is lost with the request.
+ */
+
+#include <string.h>
+
+#include "packet-nano.h"
+#include "nano_bpf.h"
+
+// classic BPF opcodes, as in pcap/bpf.h
+#define BPF_LD    0x00
+#define BPF_LDX   0x01
+#define BPF_ST    0x02
+#define BPF_STX   0x03
+#define BPF_ALU   0x04
+#define BPF_JMP   0x05
+#define BPF_RET   0x06
+#define BPF_MISC  0x07
+#define BPF_CLASS(code) ((code) & 0x07)
+
+#define BPF_W     0x00
+#define BPF_H     0x08
+#define BPF_B     0x10
+#define BPF_SIZE(code) ((code) & 0x18)
+
+#define BPF_IMM   0x00
+#define BPF_ABS   0x20
+#define BPF_IND   0x40
+#define BPF_MEM   0x60
+#define BPF_LEN   0x80
+#define BPF_MSH   0xa0
+#define BPF_MODE(code) ((code) & 0xe0)
+
+#define BPF_ADD   0x00
+#define BPF_SUB   0x10
+#define BPF_MUL   0x20
+#define BPF_DIV   0x30
+#define BPF_OR    0x40
+#define BPF_AND   0x50
+#define BPF_LSH   0x60
+#define BPF_RSH   0x70
+#define BPF_NEG   0x80
+#define BPF_MOD   0x90
+#define BPF_XOR   0xa0
+#define BPF_JA    0x00
+#define BPF_JEQ   0x10
+#define BPF_JGT   0x20
+#define BPF_JGE   0x30
+#define BPF_JSET  0x40
+#define BPF_OP(code) ((code) & 0xf0)
+
+#define BPF_K     0x00
+#define BPF_X     0x08
+#define BPF_A     0x10
+#define BPF_SRC(code) ((code) & 0x08)
+#define BPF_RVAL(code) ((code) & 0x18)
+
+#define BPF_TAX   0x00
+#define BPF_TXA   0x80
+#define BPF_MISCOP(code) ((code) & 0xf8)
+
+#define BPF_MEMWORDS 16
+
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86dd
+#define IP_PROTO_TCP 6
+
+#define ETH_HEADER_LENGTH 14
+#define IPV6_HEADER_LENGTH 40
+
+#define NANO_BPF_ALL_TYPES (((1u << (NANO_PACKET_TYPE_MAX + 1)) - 1) & ~((1u << NANO_PACKET_TYPE_KEEPALIVE) - 1))
+
+#define NANO_BPF_TYPE(type) (1u << NANO_PACKET_TYPE_##type)
+
+#define NANO_BPF_REALTIME (NANO_BPF_TYPE(KEEPALIVE) | NANO_BPF_TYPE(PUBLISH) | NANO_BPF_TYPE(CONFIRM_REQ) | NANO_BPF_TYPE(CONFIRM_ACK) | \
+                           NANO_BPF_TYPE(TELEMETRY_REQ) | NANO_BPF_TYPE(TELEMETRY_ACK))
+
+#define NANO_BPF_BOOTSTRAP (NANO_BPF_TYPE(BULK_PULL) | NANO_BPF_TYPE(BULK_PUSH) | NANO_BPF_TYPE(FRONTIER_REQ) | NANO_BPF_TYPE(BULK_PULL_BLOCKS) | \
+                            NANO_BPF_TYPE(BULK_PULL_ACCOUNT) | NANO_BPF_TYPE(ASC_PULL_REQ) | NANO_BPF_TYPE(ASC_PULL_ACK))
+
+static const char * const nano_bpf_type_names[NANO_PACKET_TYPE_MAX + 1] = {
+    [NANO_PACKET_TYPE_KEEPALIVE] = "keepalive",
+    [NANO_PACKET_TYPE_PUBLISH] = "publish",
+    [NANO_PACKET_TYPE_CONFIRM_REQ] = "confirm_req",
+    [NANO_PACKET_TYPE_CONFIRM_ACK] = "confirm_ack",
+    [NANO_PACKET_TYPE_BULK_PULL] = "bulk_pull",
+    [NANO_PACKET_TYPE_BULK_PUSH] = "bulk_push",
+    [NANO_PACKET_TYPE_FRONTIER_REQ] = "frontier_req",
+    [NANO_PACKET_TYPE_BULK_PULL_BLOCKS] = "bulk_pull_blocks",
+    [NANO_PACKET_TYPE_NODE_ID_HANDSHAKE] = "node_id_handshake",
+    [NANO_PACKET_TYPE_BULK_PULL_ACCOUNT] = "bulk_pull_account",
+    [NANO_PACKET_TYPE_TELEMETRY_REQ] = "telemetry_req",
+    [NANO_PACKET_TYPE_TELEMETRY_ACK] = "telemetry_ack",
+    [NANO_PACKET_TYPE_ASC_PULL_REQ] = "asc_pull_req",
+    [NANO_PACKET_TYPE_ASC_PULL_ACK] = "asc_pull_ack",
+};
+
+static const guint8 nano_bpf_networks[] = { 'A', 'B', 'C', 'X' };
+
+const char *nano_bpf_type_name (int type) {
+    if (type < NANO_PACKET_TYPE_KEEPALIVE || type > NANO_PACKET_TYPE_MAX) {
+        return NULL;
+    }
+
+    return nano_bpf_type_names[type];
+}
+
+static guint32 nano_bpf_word_types (const char *word) {
+    if (strcmp(word, "all") == 0) {
+        return NANO_BPF_ALL_TYPES;
+    }
+    if (strcmp(word, "realtime") == 0) {
+        return NANO_BPF_REALTIME;
+    }
+    if (strcmp(word, "bootstrap") == 0) {
+        return NANO_BPF_BOOTSTRAP;
+    }
+
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        if (strcmp(word, nano_bpf_type_names[type]) == 0) {
+            return 1u << type;
+        }
+    }
+
+    return 0;
+}
+
+gboolean nano_bpf_parse_selection (const char *text, guint16 port, nano_bpf_selection_t *selection, gchar **error) {
+    gchar *lower = g_ascii_strdown(text, -1);
+    gchar **words = g_strsplit_set(g_strdelimit(lower, "-", '_'), " \t,;", -1);
+    guint32 keep = 0, drop = 0;
+    gboolean keeping = TRUE, any_keep = FALSE, any_drop = FALSE;
+    gboolean ok = TRUE;
+
+    for (gchar **word = words; *word != NULL; word++) {
+        if (**word == '\0' || strcmp(*word, "and") == 0) {
+            continue;
+        }
+
+        if (strcmp(*word, "keep") == 0) {
+            keeping = TRUE;
+            continue;
+        }
+        if (strcmp(*word, "drop") == 0) {
+            keeping = FALSE;
+            continue;
+        }
+
+        guint32 types = nano_bpf_word_types(*word);
+        if (types == 0) {
+            *error = g_strdup_printf("unknown message type \"%s\"", *word);
+            ok = FALSE;
+            break;
+        }
+
+        // a later word overrides an earlier one: "drop all, keep publish"
+        if (keeping) {
+            keep |= types;
+            drop &= ~types;
+            any_keep = TRUE;
+        } else {
+            drop |= types;
+            keep &= ~types;
+            any_drop = TRUE;
+        }
+    }
+
+    g_strfreev(words);
+    g_free(lower);
+
+    if (!ok) {
+        return FALSE;
+    }
+
+    selection->port = port;
+    if (any_drop) {
+        selection->keep = NANO_BPF_ALL_TYPES & ~drop;
+    } else if (any_keep) {
+        selection->keep = keep;
+    } else {
+        selection->keep = NANO_BPF_ALL_TYPES;
+    }
+
+    return TRUE;
+}
+
+
+// jump targets are labels while the program is built, NANO_BPF_NEXT falls through
+enum {
+    NANO_BPF_NEXT,
+    NANO_BPF_IPV4,
+    NANO_BPF_PORTS4,
+    NANO_BPF_IPV6,
+    NANO_BPF_PORTS6,
+    NANO_BPF_PAYLOAD,
+    NANO_BPF_NETWORK,
+    NANO_BPF_KEEP,
+    NANO_BPF_DROP,
+    NANO_BPF_LABELS
+};
+
+typedef struct _nano_bpf_builder {
+    GArray *program;
+    guint labels[NANO_BPF_LABELS];
+} nano_bpf_builder_t;
+
+static void nano_bpf_emit (nano_bpf_builder_t *builder, guint16 code, guint32 k, guint8 jt, guint8 jf) {
+    nano_bpf_insn_t insn = { code, jt, jf, k };
+
+    g_array_append_val(builder->program, insn);
+}
+
+static void nano_bpf_label (nano_bpf_builder_t *builder, int label) {
+    builder->labels[label] = builder->program->len;
+}
+
+// the program is a few dozen instructions, every forward jump fits in the 8 bit offsets
+static void nano_bpf_resolve (nano_bpf_builder_t *builder) {
+    for (guint i = 0; i < builder->program->len; i++) {
+        nano_bpf_insn_t *insn = &g_array_index(builder->program, nano_bpf_insn_t, i);
+
+        if (insn->code == (BPF_JMP | BPF_JA)) {
+            insn->k = builder->labels[insn->k] - (i + 1);
+            continue;
+        }
+        if (BPF_CLASS(insn->code) != BPF_JMP) {
+            continue;
+        }
+
+        if (insn->jt != NANO_BPF_NEXT) {
+            insn->jt = (guint8) (builder->labels[insn->jt] - (i + 1));
+        }
+        if (insn->jf != NANO_BPF_NEXT) {
+            insn->jf = (guint8) (builder->labels[insn->jf] - (i + 1));
+        }
+    }
+}
+
+GArray *nano_bpf_compile (const nano_bpf_selection_t *selection) {
+    nano_bpf_builder_t builder;
+
+    builder.program = g_array_new(FALSE, FALSE, sizeof(nano_bpf_insn_t));
+    memset(builder.labels, 0, sizeof(builder.labels));
+
+    nano_bpf_emit(&builder, BPF_LD | BPF_H | BPF_ABS, 12, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IPV4, NANO_BPF_IPV4, NANO_BPF_NEXT);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IPV6, NANO_BPF_IPV6, NANO_BPF_DROP);
+
+    // IPv4: TCP, first fragment, either port; X = IP header length
+    nano_bpf_label(&builder, NANO_BPF_IPV4);
+    nano_bpf_emit(&builder, BPF_LD | BPF_B | BPF_ABS, ETH_HEADER_LENGTH + 9, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, IP_PROTO_TCP, NANO_BPF_NEXT, NANO_BPF_DROP);
+    nano_bpf_emit(&builder, BPF_LD | BPF_H | BPF_ABS, ETH_HEADER_LENGTH + 6, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JSET | BPF_K, 0x1fff, NANO_BPF_DROP, NANO_BPF_NEXT);
+    nano_bpf_emit(&builder, BPF_LDX | BPF_B | BPF_MSH, ETH_HEADER_LENGTH, 0, 0);
+    nano_bpf_emit(&builder, BPF_LD | BPF_H | BPF_IND, ETH_HEADER_LENGTH, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, selection->port, NANO_BPF_PORTS4, NANO_BPF_NEXT);
+    nano_bpf_emit(&builder, BPF_LD | BPF_H | BPF_IND, ETH_HEADER_LENGTH + 2, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, selection->port, NANO_BPF_NEXT, NANO_BPF_DROP);
+
+    // X = IP and TCP header lengths, A = total length less the headers
+    nano_bpf_label(&builder, NANO_BPF_PORTS4);
+    nano_bpf_emit(&builder, BPF_LD | BPF_B | BPF_IND, ETH_HEADER_LENGTH + 12, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_AND | BPF_K, 0xf0, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_RSH | BPF_K, 2, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0);
+    nano_bpf_emit(&builder, BPF_MISC | BPF_TAX, 0, 0, 0);
+    nano_bpf_emit(&builder, BPF_LD | BPF_H | BPF_ABS, ETH_HEADER_LENGTH + 2, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_SUB | BPF_X, 0, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JA, NANO_BPF_PAYLOAD, 0, 0);
+
+    // IPv6 without extension headers
+    nano_bpf_label(&builder, NANO_BPF_IPV6);
+    nano_bpf_emit(&builder, BPF_LD | BPF_B | BPF_ABS, ETH_HEADER_LENGTH + 6, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, IP_PROTO_TCP, NANO_BPF_NEXT, NANO_BPF_DROP);
+    nano_bpf_emit(&builder, BPF_LD | BPF_H | BPF_ABS, ETH_HEADER_LENGTH + IPV6_HEADER_LENGTH, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, selection->port, NANO_BPF_PORTS6, NANO_BPF_NEXT);
+    nano_bpf_emit(&builder, BPF_LD | BPF_H | BPF_ABS, ETH_HEADER_LENGTH + IPV6_HEADER_LENGTH + 2, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, selection->port, NANO_BPF_NEXT, NANO_BPF_DROP);
+
+    // payload length counts the TCP header but not the fixed IPv6 header
+    nano_bpf_label(&builder, NANO_BPF_PORTS6);
+    nano_bpf_emit(&builder, BPF_LD | BPF_B | BPF_ABS, ETH_HEADER_LENGTH + IPV6_HEADER_LENGTH + 12, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_AND | BPF_K, 0xf0, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_RSH | BPF_K, 2, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_ADD | BPF_K, IPV6_HEADER_LENGTH, 0, 0);
+    nano_bpf_emit(&builder, BPF_MISC | BPF_TAX, 0, 0, 0);
+    nano_bpf_emit(&builder, BPF_LD | BPF_H | BPF_ABS, ETH_HEADER_LENGTH + 4, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_ADD | BPF_K, IPV6_HEADER_LENGTH, 0, 0);
+    nano_bpf_emit(&builder, BPF_ALU | BPF_SUB | BPF_X, 0, 0, 0);
+
+    // A = TCP payload length, X = its offset behind the Ethernet header; pure ACKs and short segments are kept
+    nano_bpf_label(&builder, NANO_BPF_PAYLOAD);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JGE | BPF_K, NANO_BPF_HEADER_BYTES, NANO_BPF_NEXT, NANO_BPF_KEEP);
+    nano_bpf_emit(&builder, BPF_LD | BPF_B | BPF_IND, ETH_HEADER_LENGTH, 0, 0);
+    nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, 'R', NANO_BPF_NEXT, NANO_BPF_KEEP);
+    nano_bpf_emit(&builder, BPF_LD | BPF_B | BPF_IND, ETH_HEADER_LENGTH + 1, 0, 0);
+    for (guint i = 0; i < G_N_ELEMENTS(nano_bpf_networks); i++) {
+        gboolean last = i + 1 == G_N_ELEMENTS(nano_bpf_networks);
+
+        nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, nano_bpf_networks[i], NANO_BPF_NETWORK, last ? NANO_BPF_KEEP : NANO_BPF_NEXT);
+    }
+
+    // test whichever list is shorter, types outside the known range are kept
+    nano_bpf_label(&builder, NANO_BPF_NETWORK);
+    nano_bpf_emit(&builder, BPF_LD | BPF_B | BPF_IND, ETH_HEADER_LENGTH + 5, 0, 0);
+
+    guint32 keep = selection->keep & NANO_BPF_ALL_TYPES;
+    guint32 drop = NANO_BPF_ALL_TYPES & ~keep;
+    int kept_count = 0, dropped_count = 0;
+
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        if (keep & (1u << type)) {
+            kept_count++;
+        } else {
+            dropped_count++;
+        }
+    }
+
+    if (kept_count < dropped_count) {
+        nano_bpf_emit(&builder, BPF_JMP | BPF_JGT | BPF_K, NANO_PACKET_TYPE_MAX, NANO_BPF_KEEP, NANO_BPF_NEXT);
+        nano_bpf_emit(&builder, BPF_JMP | BPF_JGE | BPF_K, NANO_PACKET_TYPE_KEEPALIVE, kept_count > 0 ? NANO_BPF_NEXT : NANO_BPF_DROP, NANO_BPF_KEEP);
+        for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+            if (keep & (1u << type)) {
+                nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, type, NANO_BPF_KEEP, --kept_count > 0 ? NANO_BPF_NEXT : NANO_BPF_DROP);
+            }
+        }
+    } else {
+        for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+            if (drop & (1u << type)) {
+                nano_bpf_emit(&builder, BPF_JMP | BPF_JEQ | BPF_K, type, NANO_BPF_DROP, NANO_BPF_NEXT);
+            }
+        }
+    }
+
+    nano_bpf_label(&builder, NANO_BPF_KEEP);
+    nano_bpf_emit(&builder, BPF_RET | BPF_K, NANO_BPF_SNAPLEN, 0, 0);
+    nano_bpf_label(&builder, NANO_BPF_DROP);
+    nano_bpf_emit(&builder, BPF_RET | BPF_K, 0, 0, 0);
+
+    nano_bpf_resolve(&builder);
+
+    return builder.program;
+}
+
+// TCP payload in an expression: its length, and the prefix of a byte at an offset into it
+typedef struct _nano_bpf_family {
+    const char *name;
+    const char *payload_length;
+    const char *payload;
+} nano_bpf_family_t;
+
+// tcp[] only looks into IPv4, IPv6 is read through ip6[] past a fixed header, as the compiled program does
+static const nano_bpf_family_t nano_bpf_families[] = {
+    { "ip", "ip[2:2] - ((ip[0] & 0x0f) << 2) - ((tcp[12] & 0xf0) >> 2)", "tcp[((tcp[12] & 0xf0) >> 2)" },
+    { "ip6", "ip6[4:2] - ((ip6[52] & 0xf0) >> 2)", "ip6[40 + ((ip6[52] & 0xf0) >> 2)" },
+};
+
+static void nano_bpf_append_byte (GString *expression, const nano_bpf_family_t *family, int offset) {
+    if (offset > 0) {
+        g_string_append_printf(expression, "%s + %d]", family->payload, offset);
+    } else {
+        g_string_append_printf(expression, "%s]", family->payload);
+    }
+}
+
+// segments of the family that start with a Nano header of a dropped type
+static void nano_bpf_append_dropped (GString *expression, const nano_bpf_family_t *family, guint32 keep, int kept_count, int dropped_count) {
+    // a load past the end of the packet rejects it, so the length goes first
+    g_string_append_printf(expression, "%s >= %u and ", family->payload_length, NANO_BPF_HEADER_BYTES);
+    nano_bpf_append_byte(expression, family, 0);
+    g_string_append(expression, " = 0x52 and (");
+    for (guint i = 0; i < G_N_ELEMENTS(nano_bpf_networks); i++) {
+        g_string_append(expression, i > 0 ? " or " : "");
+        nano_bpf_append_byte(expression, family, 1);
+        g_string_append_printf(expression, " = 0x%02x", nano_bpf_networks[i]);
+    }
+    g_string_append(expression, ")");
+
+    if (kept_count < dropped_count) {
+        g_string_append(expression, " and ");
+        nano_bpf_append_byte(expression, family, 5);
+        g_string_append_printf(expression, " >= %u and ", NANO_PACKET_TYPE_KEEPALIVE);
+        nano_bpf_append_byte(expression, family, 5);
+        g_string_append_printf(expression, " <= %u", NANO_PACKET_TYPE_MAX);
+        if (kept_count > 0) {
+            const char *separator = " and not (";
+
+            for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+                if (keep & (1u << type)) {
+                    g_string_append(expression, separator);
+                    nano_bpf_append_byte(expression, family, 5);
+                    g_string_append_printf(expression, " = %d", type);
+                    separator = " or ";
+                }
+            }
+            g_string_append(expression, ")");
+        }
+    } else {
+        const char *separator = " and (";
+
+        for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+            if (!(keep & (1u << type))) {
+                g_string_append(expression, separator);
+                nano_bpf_append_byte(expression, family, 5);
+                g_string_append_printf(expression, " = %d", type);
+                separator = " or ";
+            }
+        }
+        g_string_append(expression, ")");
+    }
+}
+
+gchar *nano_bpf_expression (const nano_bpf_selection_t *selection) {
+    GString *expression = g_string_new(NULL);
+    guint32 keep = selection->keep & NANO_BPF_ALL_TYPES;
+    int kept_count = 0, dropped_count = 0;
+
+    g_string_append_printf(expression, "tcp port %u", selection->port);
+    if (keep == NANO_BPF_ALL_TYPES) {
+        return g_string_free(expression, FALSE);
+    }
+
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        if (keep & (1u << type)) {
+            kept_count++;
+        } else {
+            dropped_count++;
+        }
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS(nano_bpf_families); i++) {
+        g_string_append_printf(expression, "%s(%s and not (", i > 0 ? " or " : " and (", nano_bpf_families[i].name);
+        nano_bpf_append_dropped(expression, &nano_bpf_families[i], keep, kept_count, dropped_count);
+        g_string_append(expression, "))");
+    }
+    g_string_append(expression, ")");
+
+    return g_string_free(expression, FALSE);
+}
+
+// big endian load of size bytes at offset, FALSE past the end of the packet
+static gboolean nano_bpf_load (const guint8 *packet, guint32 length, guint64 offset, int size, guint32 *value) {
+    if (offset + size > length) {
+        return FALSE;
+    }
+
+    *value = 0;
+    for (int i = 0; i < size; i++) {
+        *value = (*value << 8) | packet[offset + i];
+    }
+
+    return TRUE;
+}
+
+guint32 nano_bpf_run (const nano_bpf_insn_t *program, guint count, const guint8 *packet, guint32 length) {
+    guint32 a = 0, x = 0;
+    guint32 mem[BPF_MEMWORDS] = { 0 };
+
+    for (guint pc = 0; pc < count; pc++) {
+        const nano_bpf_insn_t *insn = &program[pc];
+        guint32 k = insn->k;
+        int size = BPF_SIZE(insn->code) == BPF_W ? 4 : BPF_SIZE(insn->code) == BPF_H ? 2 : 1;
+
+        switch (BPF_CLASS(insn->code)) {
+            case BPF_LD:
+                switch (BPF_MODE(insn->code)) {
+                    case BPF_IMM:
+                        a = k;
+                        break;
+                    case BPF_ABS:
+                        if (!nano_bpf_load(packet, length, k, size, &a)) {
+                            return 0;
+                        }
+                        break;
+                    case BPF_IND:
+                        if (!nano_bpf_load(packet, length, (guint64) x + k, size, &a)) {
+                            return 0;
+                        }
+                        break;
+                    case BPF_MEM:
+                        if (k >= BPF_MEMWORDS) {
+                            return 0;
+                        }
+                        a = mem[k];
+                        break;
+                    case BPF_LEN:
+                        a = length;
+                        break;
+                    default:
+                        return 0;
+                }
+                break;
+            case BPF_LDX:
+                switch (BPF_MODE(insn->code)) {
+                    case BPF_IMM:
+                        x = k;
+                        break;
+                    case BPF_MEM:
+                        if (k >= BPF_MEMWORDS) {
+                            return 0;
+                        }
+                        x = mem[k];
+                        break;
+                    case BPF_LEN:
+                        x = length;
+                        break;
+                    case BPF_MSH:
+                        if (!nano_bpf_load(packet, length, k, 1, &x)) {
+                            return 0;
+                        }
+                        x = (x & 0x0f) << 2;
+                        break;
+                    default:
+                        return 0;
+                }
+                break;
+            case BPF_ST:
+            case BPF_STX:
+                if (k >= BPF_MEMWORDS) {
+                    return 0;
+                }
+                mem[k] = BPF_CLASS(insn->code) == BPF_ST ? a : x;
+                break;
+            case BPF_ALU: {
+                guint32 operand = BPF_SRC(insn->code) == BPF_X ? x : k;
+
+                switch (BPF_OP(insn->code)) {
+                    case BPF_ADD: a += operand; break;
+                    case BPF_SUB: a -= operand; break;
+                    case BPF_MUL: a *= operand; break;
+                    case BPF_OR: a |= operand; break;
+                    case BPF_AND: a &= operand; break;
+                    case BPF_XOR: a ^= operand; break;
+                    case BPF_LSH: a = operand < 32 ? a << operand : 0; break;
+                    case BPF_RSH: a = operand < 32 ? a >> operand : 0; break;
+                    case BPF_NEG: a = 0u - a; break;
+                    case BPF_DIV:
+                    case BPF_MOD:
+                        if (operand == 0) {
+                            return 0;
+                        }
+                        a = BPF_OP(insn->code) == BPF_DIV ? a / operand : a % operand;
+                        break;
+                    default:
+                        return 0;
+                }
+                break;
+            }
+            case BPF_JMP: {
+                guint32 operand = BPF_SRC(insn->code) == BPF_X ? x : k;
+                gboolean taken;
+
+                switch (BPF_OP(insn->code)) {
+                    case BPF_JA:
+                        pc += k;
+                        continue;
+                    case BPF_JEQ: taken = a == operand; break;
+                    case BPF_JGT: taken = a > operand; break;
+                    case BPF_JGE: taken = a >= operand; break;
+                    case BPF_JSET: taken = (a & operand) != 0; break;
+                    default:
+                        return 0;
+                }
+                pc += taken ? insn->jt : insn->jf;
+                break;
+            }
+            case BPF_RET:
+                return BPF_RVAL(insn->code) == BPF_A ? a : k;
+            case BPF_MISC:
+                if (BPF_MISCOP(insn->code) == BPF_TAX) {
+                    x = a;
+                } else if (BPF_MISCOP(insn->code) == BPF_TXA) {
+                    a = x;
+                } else {
+                    return 0;
+                }
+                break;
+        }
+    }
+
+    // fell off the end, the kernel would not have accepted the program
+    return 0;
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
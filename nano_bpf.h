@@ -0,0 +1,71 @@
+/* nano_bpf.h
+* Capture filters that keep or drop Nano messages by type
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_BPF_H__
+#define __NANO_BPF_H__
+
+#include <glib.h>
+
+// snapshot length returned for accepted packets
+#define NANO_BPF_SNAPLEN 262144
+
+// header bytes the filter reads: magic, network, versions, type; shorter payloads are kept
+#define NANO_BPF_HEADER_BYTES 6
+
+// a classic BPF instruction, laid out like struct bpf_insn and struct sock_filter
+typedef struct _nano_bpf_insn {
+    guint16 code;
+    guint8 jt;
+    guint8 jf;
+    guint32 k;
+} nano_bpf_insn_t;
+
+typedef struct _nano_bpf_selection {
+    guint16 port;
+    // bit (1 << NANO_PACKET_TYPE_*) set for the message types that are captured
+    guint32 keep;
+} nano_bpf_selection_t;
+
+/*
+ * Parses a selection like "drop confirm_ack, keep publish and bootstrap".
+ * Words are message types (confirm_ack, telemetry_req, ...), the groups
+ * realtime, bootstrap and all, and the verbs drop and keep that apply to the
+ * words after them. Types the selection does not name are captured if it
+ * drops anything and dropped if it only keeps. Returns FALSE and sets error
+ * (to be freed with g_free) on an unknown word.
+ */
+gboolean nano_bpf_parse_selection(const char *text, guint16 port, nano_bpf_selection_t *selection, gchar **error);
+
+// name used in selections, NULL outside the known message types
+const char *nano_bpf_type_name(int type);
+
+// program for Ethernet captures of IPv4 and IPv6, an array of nano_bpf_insn_t to be freed with g_array_free
+GArray *nano_bpf_compile(const nano_bpf_selection_t *selection);
+
+// the same selection as a libpcap filter expression for any link type
+gchar *nano_bpf_expression(const nano_bpf_selection_t *selection);
+
+// runs program on a packet, returns the number of bytes to keep, 0 drops it
+guint32 nano_bpf_run(const nano_bpf_insn_t *program, guint count, const guint8 *packet, guint32 length);
+
+#endif /* __NANO_BPF_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,964 @@
+/* nano_chains.c
+* Account chain index rebuilt from bootstrap block streams
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* Bulk pull responses walk an account chain from its head back towards the
+* open block, asc_pull_ack payloads walk it forwards. Both are folded into one
+* index while the first pass dissects them.
+*
+* A chain keeps its block hashes oldest first in one array with room at both
+* ends, so either direction is an amortized O(1) insert. Two open addressing
+* tables map the first 8 bytes of an account or a block hash to a chain id.
+* That comes to roughly 64 bytes per block and one allocation per chain, which
+* is what lets a full ledger bootstrap fit.
+*
+* Results are shown by the "Nano/Account Chains" statistics tree and written by
+* tshark -z nano,chains,<file> as CSV, one row per block.
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stats_tree.h>
+#include <epan/stat_tap_ui.h>
+#include <wsutil/file_util.h>
+#include <wsutil/pint.h>
+#include <wsutil/report_message.h>
+#include <wsutil/to_str.h>
+
+#include "packet-nano.h"
+#include "nano_chains.h"
+
+#define NANO_CHAIN_TABLE_MIN_SLOTS 1024
+#define NANO_CHAIN_SLOT_EMPTY 0
+#define NANO_CHAIN_SLOT_DELETED G_MAXUINT32
+
+#define NANO_CHAIN_MIN_CAPACITY 8
+
+#define NANO_CHAINS_WRITE_BUFFER (4 * 1024 * 1024)
+
+typedef guint8 nano_chain_hash[32];
+
+// key prefix to chain id with linear probing, keys are blake2b output or public keys and need no further mixing
+struct nano_chain_table {
+    guint64 *keys;
+    guint32 *chains;
+    guint32 mask;
+    guint32 used;
+    guint32 deleted;
+};
+
+// hashes[index] has a previous block the chain has not seen
+struct nano_chain_gap {
+    guint32 index;
+    nano_chain_hash missing;
+};
+
+struct nano_chain {
+    nano_chain_hash account;
+    guint32 id;
+    guint8 flags;
+
+    // created from a bulk_pull start, which is either an account or a block hash
+    gboolean provisional;
+
+    // block hashes oldest first in hashes[first] .. hashes[first + count - 1]
+    nano_chain_hash *hashes;
+    guint32 first;
+    guint32 count;
+    guint32 capacity;
+
+    // previous of the oldest block, zero once the chain reaches its open block
+    nano_chain_hash oldest_previous;
+
+    struct nano_chain_gap *gaps;
+    guint32 gap_count;
+    guint32 gap_capacity;
+
+    gint64 last_seen;
+    struct nano_chain *lru_prev;
+    struct nano_chain *lru_next;
+};
+
+struct nano_chain_pull {
+    nano_chain_stream_t stream;
+    nano_chain_hash end;
+    guint32 count;
+    gboolean active;
+    // bumped when the slot is released, so handles of the pulls it held before stop matching
+    guint32 generation;
+    // next released slot + 1, 0 ends the free list
+    guint32 next_free;
+};
+
+// a pull handle is the slot + 1 in its low bits and the generation of the slot above them
+#define NANO_CHAIN_PULL_SLOT_BITS 20
+#define NANO_CHAIN_PULL_SLOT_MASK ((1u << NANO_CHAIN_PULL_SLOT_BITS) - 1)
+#define NANO_CHAIN_PULL_GENERATION_MASK (G_MAXUINT32 >> NANO_CHAIN_PULL_SLOT_BITS)
+
+enum nano_chain_placement {
+    NANO_CHAIN_PLACED_NEWEST,   // appended, its previous is the newest block
+    NANO_CHAIN_PLACED_OLDEST,   // prepended, it is the previous of the oldest block
+    NANO_CHAIN_PLACED_FILLED,   // inserted into a gap
+    NANO_CHAIN_PLACED_DETACHED  // does not link to anything we have, a new gap was opened
+};
+
+static struct nano_chain_table nano_chain_accounts;
+static struct nano_chain_table nano_chain_blocks;
+
+// indexed by chain id, id 0 is never used and dropped chains leave a NULL
+static struct nano_chain **nano_chains_by_id;
+static guint32 nano_chain_ids;
+static guint32 nano_chain_ids_capacity;
+
+// slots of pulls that ended or lost their chain are reused, the array only grows with concurrent pulls
+static struct nano_chain_pull *nano_chain_pulls;
+static guint32 nano_chain_pull_count;
+static guint32 nano_chain_pull_capacity;
+static guint32 nano_chain_pull_free;
+
+// most recently used first
+static struct nano_chain *nano_chain_lru_head;
+static struct nano_chain *nano_chain_lru_tail;
+
+static nano_chain_stats_t nano_chain_stats;
+static gsize nano_chain_bytes;
+
+void nano_chains_reset (void) {
+    memset(&nano_chain_accounts, 0, sizeof(nano_chain_accounts));
+    memset(&nano_chain_blocks, 0, sizeof(nano_chain_blocks));
+
+    nano_chains_by_id = NULL;
+    nano_chain_ids = 1;
+    nano_chain_ids_capacity = 0;
+
+    nano_chain_pulls = NULL;
+    nano_chain_pull_count = 0;
+    nano_chain_pull_capacity = 0;
+    nano_chain_pull_free = 0;
+
+    nano_chain_lru_head = NULL;
+    nano_chain_lru_tail = NULL;
+
+    memset(&nano_chain_stats, 0, sizeof(nano_chain_stats));
+    nano_chain_bytes = 0;
+}
+
+static struct nano_chain *nano_chain_get (guint32 id) {
+    return id > 0 && id < nano_chain_ids ? nano_chains_by_id[id] : NULL;
+}
+
+//
+// Prefix tables
+//
+static void nano_chain_table_place (struct nano_chain_table *table, guint64 key, guint32 chain) {
+    guint32 i = (guint32) key & table->mask;
+
+    while (table->chains[i] != NANO_CHAIN_SLOT_EMPTY && table->chains[i] != NANO_CHAIN_SLOT_DELETED) {
+        i = (i + 1) & table->mask;
+    }
+
+    if (table->chains[i] == NANO_CHAIN_SLOT_DELETED) {
+        table->deleted--;
+    }
+    table->keys[i] = key;
+    table->chains[i] = chain;
+    table->used++;
+}
+
+static void nano_chain_table_resize (struct nano_chain_table *table, guint32 slots) {
+    guint64 *keys = table->keys;
+    guint32 *chains = table->chains;
+    guint32 old_slots = table->mask ? table->mask + 1 : 0;
+
+    table->keys = wmem_alloc_array(wmem_file_scope(), guint64, slots);
+    table->chains = wmem_alloc0_array(wmem_file_scope(), guint32, slots);
+    table->mask = slots - 1;
+    table->used = 0;
+    table->deleted = 0;
+
+    for (guint32 i = 0; i < old_slots; i++) {
+        if (chains[i] != NANO_CHAIN_SLOT_EMPTY && chains[i] != NANO_CHAIN_SLOT_DELETED) {
+            nano_chain_table_place(table, keys[i], chains[i]);
+        }
+    }
+
+    wmem_free(wmem_file_scope(), keys);
+    wmem_free(wmem_file_scope(), chains);
+    nano_chain_bytes += ((gsize) slots - old_slots) * (sizeof(guint64) + sizeof(guint32));
+}
+
+// account lookups compare the whole account, block lookups trust the 64 bit prefix
+static guint32 nano_chain_table_lookup (const struct nano_chain_table *table, const guint8 *key_bytes, gboolean is_account) {
+    if (!table->mask) {
+        return 0;
+    }
+
+    guint64 key = pletoh64(key_bytes);
+
+    for (guint32 i = (guint32) key & table->mask; table->chains[i] != NANO_CHAIN_SLOT_EMPTY; i = (i + 1) & table->mask) {
+        guint32 chain = table->chains[i];
+
+        if (chain != NANO_CHAIN_SLOT_DELETED && table->keys[i] == key &&
+                (!is_account || !memcmp(nano_chains_by_id[chain]->account, key_bytes, 32))) {
+            return chain;
+        }
+    }
+
+    return 0;
+}
+
+static void nano_chain_table_insert (struct nano_chain_table *table, const guint8 *key_bytes, guint32 chain) {
+    guint32 slots = table->mask ? table->mask + 1 : 0;
+
+    // keep probes short: rehash at 70% including tombstones, into a table at most half full
+    if ((guint64) (table->used + table->deleted + 1) * 10 > (guint64) slots * 7) {
+        guint32 new_slots = MAX(slots, NANO_CHAIN_TABLE_MIN_SLOTS);
+
+        while ((guint64) (table->used + 1) * 2 > new_slots) {
+            new_slots *= 2;
+        }
+        nano_chain_table_resize(table, new_slots);
+    }
+
+    nano_chain_table_place(table, pletoh64(key_bytes), chain);
+}
+
+static void nano_chain_table_remove (struct nano_chain_table *table, const guint8 *key_bytes, guint32 chain) {
+    if (!table->mask) {
+        return;
+    }
+
+    guint64 key = pletoh64(key_bytes);
+
+    for (guint32 i = (guint32) key & table->mask; table->chains[i] != NANO_CHAIN_SLOT_EMPTY; i = (i + 1) & table->mask) {
+        if (table->chains[i] == chain && table->keys[i] == key) {
+            table->chains[i] = NANO_CHAIN_SLOT_DELETED;
+            table->used--;
+            table->deleted++;
+            return;
+        }
+    }
+}
+
+//
+// Chains
+//
+static guint nano_chain_length_bucket (guint32 count) {
+    guint bucket = 0;
+
+    for (guint32 limit = 10; bucket < NANO_CHAIN_LENGTH_BUCKETS - 1 && count >= limit; limit *= 10) {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+// keep chains, length buckets and the missing blocks counter in step with a chain's shape
+static void nano_chain_account_shape (const struct nano_chain *chain, gint delta) {
+    if (chain->count == 0) {
+        return;
+    }
+
+    nano_chain_stats.chains += delta;
+    nano_chain_stats.length_buckets[nano_chain_length_bucket(chain->count)] += delta;
+    if (chain->gap_count > 0) {
+        nano_chain_stats.chains_with_missing_blocks += delta;
+    }
+}
+
+static void nano_chain_lru_unlink (struct nano_chain *chain) {
+    if (chain->lru_prev) {
+        chain->lru_prev->lru_next = chain->lru_next;
+    } else if (nano_chain_lru_head == chain) {
+        nano_chain_lru_head = chain->lru_next;
+    }
+
+    if (chain->lru_next) {
+        chain->lru_next->lru_prev = chain->lru_prev;
+    } else if (nano_chain_lru_tail == chain) {
+        nano_chain_lru_tail = chain->lru_prev;
+    }
+
+    chain->lru_prev = NULL;
+    chain->lru_next = NULL;
+}
+
+static void nano_chain_touch (struct nano_chain *chain, gint64 now) {
+    chain->last_seen = now;
+
+    if (nano_chain_lru_head == chain) {
+        return;
+    }
+
+    nano_chain_lru_unlink(chain);
+
+    chain->lru_next = nano_chain_lru_head;
+    if (nano_chain_lru_head) {
+        nano_chain_lru_head->lru_prev = chain;
+    }
+    nano_chain_lru_head = chain;
+
+    if (!nano_chain_lru_tail) {
+        nano_chain_lru_tail = chain;
+    }
+}
+
+static struct nano_chain *nano_chain_new (const guint8 *account, gboolean provisional, gint64 now) {
+    struct nano_chain *chain = wmem_new0(wmem_file_scope(), struct nano_chain);
+
+    if (nano_chain_ids == nano_chain_ids_capacity || !nano_chains_by_id) {
+        guint32 capacity = MAX(nano_chain_ids_capacity * 2, 1024);
+
+        nano_chains_by_id = wmem_realloc_array(wmem_file_scope(), nano_chains_by_id, struct nano_chain *, capacity);
+        nano_chain_bytes += (capacity - nano_chain_ids_capacity) * sizeof(struct nano_chain *);
+        nano_chain_ids_capacity = capacity;
+    }
+
+    memcpy(chain->account, account, 32);
+    chain->provisional = provisional;
+    chain->id = nano_chain_ids++;
+    nano_chains_by_id[chain->id] = chain;
+    nano_chain_bytes += sizeof(struct nano_chain);
+
+    nano_chain_table_insert(&nano_chain_accounts, account, chain->id);
+    nano_chain_touch(chain, now);
+
+    return chain;
+}
+
+static void nano_chain_rename (struct nano_chain *chain, const guint8 *account) {
+    nano_chain_table_remove(&nano_chain_accounts, chain->account, chain->id);
+    memcpy(chain->account, account, 32);
+    nano_chain_table_insert(&nano_chain_accounts, account, chain->id);
+    chain->provisional = FALSE;
+}
+
+static nano_chain_hash *nano_chain_at (const struct nano_chain *chain, guint32 index) {
+    return &chain->hashes[chain->first + index];
+}
+
+// make room for one more hash in front of or behind the chain, new room goes where it was asked for
+static void nano_chain_reserve (struct nano_chain *chain, gboolean front) {
+    guint32 tail_room = chain->capacity - chain->first - chain->count;
+
+    if (front ? chain->first > 0 : tail_room > 0) {
+        return;
+    }
+
+    guint32 capacity = MAX(chain->capacity * 2, NANO_CHAIN_MIN_CAPACITY);
+    guint32 first = front ? capacity - chain->count - tail_room : chain->first;
+    nano_chain_hash *hashes = wmem_alloc_array(wmem_file_scope(), nano_chain_hash, capacity);
+
+    if (chain->count) {
+        memcpy(hashes + first, chain->hashes + chain->first, chain->count * sizeof(nano_chain_hash));
+    }
+    wmem_free(wmem_file_scope(), chain->hashes);
+
+    nano_chain_bytes += (capacity - chain->capacity) * sizeof(nano_chain_hash);
+    chain->hashes = hashes;
+    chain->first = first;
+    chain->capacity = capacity;
+}
+
+static void nano_chain_add_gap (struct nano_chain *chain, guint32 index, const guint8 *missing) {
+    if (chain->gap_count == chain->gap_capacity) {
+        guint32 capacity = MAX(chain->gap_capacity * 2, 2);
+
+        chain->gaps = wmem_realloc_array(wmem_file_scope(), chain->gaps, struct nano_chain_gap, capacity);
+        nano_chain_bytes += (capacity - chain->gap_capacity) * sizeof(struct nano_chain_gap);
+        chain->gap_capacity = capacity;
+    }
+
+    chain->gaps[chain->gap_count].index = index;
+    memcpy(chain->gaps[chain->gap_count].missing, missing, 32);
+    chain->gap_count++;
+}
+
+// shift gaps at or after index by one, after a hash was inserted at index
+static void nano_chain_shift_gaps (struct nano_chain *chain, guint32 index) {
+    for (guint32 i = 0; i < chain->gap_count; i++) {
+        if (chain->gaps[i].index >= index) {
+            chain->gaps[i].index++;
+        }
+    }
+}
+
+static enum nano_chain_placement nano_chain_place (struct nano_chain *chain, const guint8 *hash, const guint8 *previous, gboolean prefer_newest) {
+    if (chain->count == 0 || !memcmp(previous, nano_chain_at(chain, chain->count - 1), 32)) {
+        if (chain->count == 0) {
+            memcpy(chain->oldest_previous, previous, 32);
+        }
+
+        nano_chain_reserve(chain, FALSE);
+        memcpy(nano_chain_at(chain, chain->count), hash, 32);
+        chain->count++;
+        return NANO_CHAIN_PLACED_NEWEST;
+    }
+
+    if (!memcmp(hash, chain->oldest_previous, 32)) {
+        nano_chain_reserve(chain, TRUE);
+        chain->first--;
+        chain->count++;
+        memcpy(nano_chain_at(chain, 0), hash, 32);
+        memcpy(chain->oldest_previous, previous, 32);
+        nano_chain_shift_gaps(chain, 0);
+        return NANO_CHAIN_PLACED_OLDEST;
+    }
+
+    for (guint32 i = 0; i < chain->gap_count; i++) {
+        struct nano_chain_gap *gap = &chain->gaps[i];
+        guint32 index = gap->index;
+
+        if (memcmp(hash, gap->missing, 32)) {
+            continue;
+        }
+
+        // the block goes right before the one that was missing it
+        nano_chain_reserve(chain, FALSE);
+        memmove(nano_chain_at(chain, index + 1), nano_chain_at(chain, index), (chain->count - index) * sizeof(nano_chain_hash));
+        memcpy(nano_chain_at(chain, index), hash, 32);
+        chain->count++;
+
+        nano_chain_shift_gaps(chain, index + 1);
+
+        if (index > 0 && !memcmp(previous, nano_chain_at(chain, index - 1), 32)) {
+            *gap = chain->gaps[--chain->gap_count];
+        } else {
+            memcpy(gap->missing, previous, 32);
+        }
+        return NANO_CHAIN_PLACED_FILLED;
+    }
+
+    if (prefer_newest) {
+        nano_chain_reserve(chain, FALSE);
+        memcpy(nano_chain_at(chain, chain->count), hash, 32);
+        nano_chain_add_gap(chain, chain->count, previous);
+        chain->count++;
+    } else {
+        nano_chain_reserve(chain, TRUE);
+        chain->first--;
+        chain->count++;
+        memcpy(nano_chain_at(chain, 0), hash, 32);
+        nano_chain_shift_gaps(chain, 0);
+        nano_chain_add_gap(chain, 1, chain->oldest_previous);
+        memcpy(chain->oldest_previous, previous, 32);
+    }
+
+    return NANO_CHAIN_PLACED_DETACHED;
+}
+
+//
+// Block streams
+//
+
+// previous and, for open and state blocks, the account
+static const guint8 *nano_chain_block_fields (int block_type, const guint8 *block, guint8 *previous) {
+    switch (block_type) {
+        case NANO_BLOCK_TYPE_SEND:
+        case NANO_BLOCK_TYPE_RECEIVE:
+        case NANO_BLOCK_TYPE_CHANGE:
+            memcpy(previous, block, 32);
+            return NULL;
+        case NANO_BLOCK_TYPE_OPEN:
+            memset(previous, 0, 32);
+            return block + 32 + 32;
+        case NANO_BLOCK_TYPE_STATE:
+            memcpy(previous, block + 32, 32);
+            return block;
+    }
+
+    return NULL;
+}
+
+// the chain a block goes to: its own account, else the stream's chain, else the chain holding its previous
+static struct nano_chain *nano_chain_resolve (nano_chain_stream_t *stream, const guint8 *account, const guint8 *hash, const guint8 *previous, gint64 now) {
+    struct nano_chain *chain = nano_chain_get(stream->chain);
+
+    if (account) {
+        if (chain && !memcmp(chain->account, account, 32)) {
+            chain->provisional = FALSE;
+            return chain;
+        }
+
+        struct nano_chain *owner = nano_chain_get(nano_chain_table_lookup(&nano_chain_accounts, account, TRUE));
+
+        if (!owner && chain && chain->provisional && chain->count == 0) {
+            nano_chain_rename(chain, account);
+            owner = chain;
+        } else if (!owner) {
+            owner = nano_chain_new(account, FALSE, now);
+        }
+
+        stream->chain = owner->id;
+        return owner;
+    }
+
+    if (!chain) {
+        chain = nano_chain_get(nano_chain_table_lookup(&nano_chain_blocks, hash, FALSE));
+    }
+    if (!chain) {
+        chain = nano_chain_get(nano_chain_table_lookup(&nano_chain_blocks, previous, FALSE));
+    }
+    if (chain) {
+        stream->chain = chain->id;
+    }
+
+    return chain;
+}
+
+static guint8 nano_chain_stream_block (nano_chain_stream_t *stream, gboolean descending, int block_type, const guint8 *block, gint64 now) {
+    guint8 hash[32];
+    guint8 previous[32];
+    const guint8 *account = nano_chain_block_fields(block_type, block, previous);
+    gboolean first = stream->received == 0;
+    gboolean in_order = TRUE;
+    guint8 flags = 0;
+
+    nano_block_hash(block_type, block, hash);
+
+    if (stream->expected_known) {
+        in_order = !memcmp(descending ? hash : previous, stream->expected, 32);
+    }
+    memcpy(stream->expected, descending ? previous : hash, 32);
+    stream->expected_known = TRUE;
+    stream->received++;
+
+    struct nano_chain *chain = nano_chain_resolve(stream, account, hash, previous, now);
+    if (!chain) {
+        nano_chain_stats.unattributed_blocks++;
+        return NANO_CHAIN_UNATTRIBUTED;
+    }
+    nano_chain_touch(chain, now);
+
+    if (nano_chain_table_lookup(&nano_chain_blocks, hash, FALSE)) {
+        nano_chain_stats.duplicate_blocks++;
+        return NANO_CHAIN_DUPLICATE;
+    }
+
+    nano_chain_account_shape(chain, -1);
+    // the first block of a bulk pull is the head, everything after it is older
+    enum nano_chain_placement placement = nano_chain_place(chain, hash, previous, !descending || first);
+    nano_chain_account_shape(chain, 1);
+
+    nano_chain_table_insert(&nano_chain_blocks, hash, chain->id);
+    nano_chain_stats.blocks++;
+
+    if (!in_order) {
+        gboolean belongs_earlier = placement == NANO_CHAIN_PLACED_FILLED ||
+            placement == (descending ? NANO_CHAIN_PLACED_NEWEST : NANO_CHAIN_PLACED_OLDEST);
+
+        if (belongs_earlier) {
+            flags = NANO_CHAIN_OUT_OF_ORDER;
+            nano_chain_stats.out_of_order_blocks++;
+        } else {
+            flags = NANO_CHAIN_GAP;
+            nano_chain_stats.gap_blocks++;
+        }
+        chain->flags |= flags;
+    }
+
+    return flags;
+}
+
+static void nano_chain_pull_release (guint32 slot) {
+    struct nano_chain_pull *pull = &nano_chain_pulls[slot];
+
+    pull->active = FALSE;
+    pull->generation = (pull->generation + 1) & NANO_CHAIN_PULL_GENERATION_MASK;
+    pull->next_free = nano_chain_pull_free;
+    nano_chain_pull_free = slot + 1;
+}
+
+// a pull streaming into a dropped chain has lost the blocks its gaps are checked against, it goes with the chain
+static void nano_chain_pulls_release_chain (guint32 chain) {
+    for (guint32 slot = 0; slot < nano_chain_pull_count; slot++) {
+        if (nano_chain_pulls[slot].active && nano_chain_pulls[slot].stream.chain == chain) {
+            nano_chain_pull_release(slot);
+        }
+    }
+}
+
+// returns 0, an untracked pull, once every slot a handle can name is busy
+guint32 nano_chains_pull_start (const guint8 *start, const guint8 *end, guint32 count, gint64 now) {
+    guint32 slot;
+
+    if (nano_chain_pull_free) {
+        slot = nano_chain_pull_free - 1;
+        nano_chain_pull_free = nano_chain_pulls[slot].next_free;
+    } else {
+        if (nano_chain_pull_count == NANO_CHAIN_PULL_SLOT_MASK) {
+            return 0;
+        }
+        if (nano_chain_pull_count == nano_chain_pull_capacity) {
+            guint32 capacity = MIN(MAX(nano_chain_pull_capacity * 2, 64), NANO_CHAIN_PULL_SLOT_MASK);
+
+            nano_chain_pulls = wmem_realloc_array(wmem_file_scope(), nano_chain_pulls, struct nano_chain_pull, capacity);
+            nano_chain_bytes += (capacity - nano_chain_pull_capacity) * sizeof(struct nano_chain_pull);
+            nano_chain_pull_capacity = capacity;
+        }
+        slot = nano_chain_pull_count++;
+        nano_chain_pulls[slot].generation = 0;
+    }
+
+    struct nano_chain_pull *pull = &nano_chain_pulls[slot];
+    guint32 generation = pull->generation;
+
+    memset(pull, 0, sizeof(*pull));
+    memcpy(pull->end, end, 32);
+    pull->count = count;
+    pull->active = TRUE;
+    pull->generation = generation;
+
+    guint32 chain = nano_chain_table_lookup(&nano_chain_blocks, start, FALSE);
+    if (chain) {
+        // pulling from a block we know, the response has to start with it
+        pull->stream.chain = chain;
+        memcpy(pull->stream.expected, start, 32);
+        pull->stream.expected_known = TRUE;
+    } else {
+        chain = nano_chain_table_lookup(&nano_chain_accounts, start, TRUE);
+        pull->stream.chain = chain ? chain : nano_chain_new(start, TRUE, now)->id;
+    }
+
+    nano_chain_stats.pulls++;
+
+    return (generation << NANO_CHAIN_PULL_SLOT_BITS) | (slot + 1);
+}
+
+// NULL for a handle whose pull ended or was released since
+static struct nano_chain_pull *nano_chain_pull_get (guint32 pull_id) {
+    guint32 slot = (pull_id & NANO_CHAIN_PULL_SLOT_MASK) - 1;
+
+    if (slot >= nano_chain_pull_count || !nano_chain_pulls[slot].active ||
+            nano_chain_pulls[slot].generation != pull_id >> NANO_CHAIN_PULL_SLOT_BITS) {
+        return NULL;
+    }
+
+    return &nano_chain_pulls[slot];
+}
+
+guint8 nano_chains_pull_block (guint32 pull_id, int block_type, const guint8 *block, gint64 now) {
+    struct nano_chain_pull *pull = nano_chain_pull_get(pull_id);
+
+    if (!pull) {
+        return 0;
+    }
+
+    return nano_chain_stream_block(&pull->stream, TRUE, block_type, block, now);
+}
+
+// the last block's previous has to be the requested end, a zero end asks for the whole chain down to the open block
+guint8 nano_chains_pull_end (guint32 pull_id) {
+    struct nano_chain_pull *pull = nano_chain_pull_get(pull_id);
+
+    if (!pull) {
+        return 0;
+    }
+    nano_chain_pull_release((pull_id & NANO_CHAIN_PULL_SLOT_MASK) - 1);
+
+    // the slot is free again, its contents stay until the next pull takes it
+    if (pull->stream.received == 0 || (pull->count && pull->stream.received >= pull->count)) {
+        return 0;
+    }
+
+    if (!memcmp(pull->stream.expected, pull->end, 32)) {
+        return 0;
+    }
+
+    struct nano_chain *chain = nano_chain_get(pull->stream.chain);
+    if (chain) {
+        chain->flags |= NANO_CHAIN_INCOMPLETE;
+    }
+    nano_chain_stats.incomplete_pulls++;
+
+    return NANO_CHAIN_INCOMPLETE;
+}
+
+void nano_chains_stream_init (nano_chain_stream_t *stream) {
+    memset(stream, 0, sizeof(*stream));
+}
+
+guint8 nano_chains_ascending_block (nano_chain_stream_t *stream, int block_type, const guint8 *block, gint64 now) {
+    return nano_chain_stream_block(stream, FALSE, block_type, block, now);
+}
+
+gboolean nano_chains_block_account (const guint8 *hash, guint8 *account) {
+    struct nano_chain *chain = nano_chain_get(nano_chain_table_lookup(&nano_chain_blocks, hash, FALSE));
+
+    if (!chain || chain->provisional) {
+        return FALSE;
+    }
+
+    memcpy(account, chain->account, 32);
+    return TRUE;
+}
+
+//
+// Bounded memory mode
+//
+gsize nano_chains_memory (void) {
+    return nano_chain_bytes;
+}
+
+gboolean nano_chains_oldest (gint64 *last_seen) {
+    if (!nano_chain_lru_tail) {
+        return FALSE;
+    }
+
+    *last_seen = nano_chain_lru_tail->last_seen;
+    return TRUE;
+}
+
+void nano_chains_drop_oldest (void) {
+    struct nano_chain *chain = nano_chain_lru_tail;
+
+    if (!chain) {
+        return;
+    }
+
+    nano_chain_lru_unlink(chain);
+    nano_chain_account_shape(chain, -1);
+
+    for (guint32 i = 0; i < chain->count; i++) {
+        nano_chain_table_remove(&nano_chain_blocks, *nano_chain_at(chain, i), chain->id);
+    }
+    nano_chain_table_remove(&nano_chain_accounts, chain->account, chain->id);
+    nano_chains_by_id[chain->id] = NULL;
+    nano_chain_pulls_release_chain(chain->id);
+
+    nano_chain_bytes -= chain->capacity * sizeof(nano_chain_hash) + chain->gap_capacity * sizeof(struct nano_chain_gap) + sizeof(struct nano_chain);
+    wmem_free(wmem_file_scope(), chain->hashes);
+    wmem_free(wmem_file_scope(), chain->gaps);
+    wmem_free(wmem_file_scope(), chain);
+
+    nano_chain_stats.chains_expired++;
+}
+
+const nano_chain_stats_t *nano_chains_stats (void) {
+    return &nano_chain_stats;
+}
+
+//
+// Statistics tree
+//
+static const char *st_str_chains = "Account Chains";
+static const char *st_str_chain_length = "Chain Length";
+static const char *st_str_blocks = "Blocks";
+static const char *st_str_pulls = "Bulk Pulls";
+
+static const char *nano_chain_length_names[NANO_CHAIN_LENGTH_BUCKETS] = {
+    "1 block", "2-9 blocks", "10-99 blocks", "100-999 blocks", "1000+ blocks"
+};
+
+static int st_node_chains = -1;
+static int st_node_chain_length = -1;
+static int st_node_blocks = -1;
+static int st_node_pulls = -1;
+
+static void nano_chains_stats_tree_init (stats_tree *st) {
+    st_node_chains = stats_tree_create_node(st, st_str_chains, 0, STAT_DT_INT, TRUE);
+    st_node_chain_length = stats_tree_create_node(st, st_str_chain_length, st_node_chains, STAT_DT_INT, TRUE);
+    st_node_blocks = stats_tree_create_node(st, st_str_blocks, 0, STAT_DT_INT, TRUE);
+    st_node_pulls = stats_tree_create_node(st, st_str_pulls, 0, STAT_DT_INT, TRUE);
+}
+
+static gint nano_chains_stat_value (guint64 value) {
+    return (gint) MIN(value, (guint64) G_MAXINT);
+}
+
+// the index is built by the dissector, every tapped message just copies its current totals
+static tap_packet_status nano_chains_stats_tree_packet (stats_tree *st, packet_info *pinfo _U_, epan_dissect_t *edt _U_, const void *data _U_, tap_flags_t flags _U_) {
+    const nano_chain_stats_t *stats = &nano_chain_stats;
+
+    set_int_stat_node(st, st_str_chains, 0, FALSE, nano_chains_stat_value(stats->chains));
+    set_int_stat_node(st, "With missing blocks", st_node_chains, FALSE, nano_chains_stat_value(stats->chains_with_missing_blocks));
+    set_int_stat_node(st, "Expired", st_node_chains, FALSE, nano_chains_stat_value(stats->chains_expired));
+    set_int_stat_node(st, st_str_chain_length, st_node_chains, FALSE, nano_chains_stat_value(stats->chains));
+    for (guint i = 0; i < NANO_CHAIN_LENGTH_BUCKETS; i++) {
+        set_int_stat_node(st, nano_chain_length_names[i], st_node_chain_length, FALSE, nano_chains_stat_value(stats->length_buckets[i]));
+    }
+
+    set_int_stat_node(st, st_str_blocks, 0, FALSE, nano_chains_stat_value(stats->blocks));
+    set_int_stat_node(st, "Duplicate", st_node_blocks, FALSE, nano_chains_stat_value(stats->duplicate_blocks));
+    set_int_stat_node(st, "Unattributed", st_node_blocks, FALSE, nano_chains_stat_value(stats->unattributed_blocks));
+    set_int_stat_node(st, "After a gap", st_node_blocks, FALSE, nano_chains_stat_value(stats->gap_blocks));
+    set_int_stat_node(st, "Out of order", st_node_blocks, FALSE, nano_chains_stat_value(stats->out_of_order_blocks));
+
+    set_int_stat_node(st, st_str_pulls, 0, FALSE, nano_chains_stat_value(stats->pulls));
+    set_int_stat_node(st, "Incomplete", st_node_pulls, FALSE, nano_chains_stat_value(stats->incomplete_pulls));
+
+    return TAP_PACKET_REDRAW;
+}
+
+//
+// Chain export
+//
+typedef struct {
+    gchar *path;
+} nano_chains_export_t;
+
+static void nano_chains_export_flags (GString *line, const struct nano_chain *chain) {
+    static const struct {
+        guint8 flag;
+        const char *name;
+    } names[] = {
+        { NANO_CHAIN_GAP, "gap" },
+        { NANO_CHAIN_OUT_OF_ORDER, "out_of_order" },
+        { NANO_CHAIN_INCOMPLETE, "incomplete" }
+    };
+    gsize start = line->len;
+
+    if (chain->provisional) {
+        g_string_append(line, "provisional");
+    }
+    if (chain->gap_count > 0) {
+        if (line->len != start) {
+            g_string_append_c(line, '|');
+        }
+        g_string_append(line, "missing_blocks");
+    }
+    for (guint i = 0; i < G_N_ELEMENTS(names); i++) {
+        if (chain->flags & names[i].flag) {
+            if (line->len != start) {
+                g_string_append_c(line, '|');
+            }
+            g_string_append(line, names[i].name);
+        }
+    }
+}
+
+static gboolean nano_chains_export_gap_before (const struct nano_chain *chain, guint32 index) {
+    for (guint32 i = 0; i < chain->gap_count; i++) {
+        if (chain->gaps[i].index == index) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// account,position,hash,gap_before,chain_flags with positions counted from the oldest block we have,
+// a provisional chain has no account we can name yet, so its account is left empty
+static void nano_chains_export_write (nano_chains_export_t *exporter) {
+    static const char header[] = "account,position,hash,gap_before,chain_flags\n";
+    char address[NANO_ADDRESS_LENGTH + 1];
+    char hash[64 + 1];
+    GString *flags = g_string_new(NULL);
+    GString *line = g_string_new(NULL);
+    FILE *fh = ws_fopen(exporter->path, "w");
+
+    if (!fh) {
+        report_open_failure(exporter->path, errno, TRUE);
+        g_string_free(flags, TRUE);
+        g_string_free(line, TRUE);
+        return;
+    }
+    setvbuf(fh, NULL, _IOFBF, NANO_CHAINS_WRITE_BUFFER);
+    fwrite(header, 1, sizeof(header) - 1, fh);
+
+    for (guint32 id = 1; id < nano_chain_ids; id++) {
+        const struct nano_chain *chain = nano_chains_by_id[id];
+
+        if (!chain || chain->count == 0) {
+            continue;
+        }
+
+        if (chain->provisional) {
+            address[0] = '\0';
+        } else {
+            nano_account_to_address(chain->account, address);
+        }
+        g_string_truncate(flags, 0);
+        nano_chains_export_flags(flags, chain);
+
+        for (guint32 i = 0; i < chain->count; i++) {
+            *bytes_to_hexstr(hash, *nano_chain_at(chain, i), 32) = '\0';
+
+            g_string_printf(line, "%s,%u,%s,%u,%s\n", address, i, hash, nano_chains_export_gap_before(chain, i), flags->str);
+            fwrite(line->str, 1, line->len, fh);
+        }
+    }
+
+    if (ws_fclose(fh) != 0) {
+        report_write_failure(exporter->path, errno);
+    }
+
+    g_string_free(flags, TRUE);
+    g_string_free(line, TRUE);
+}
+
+static tap_packet_status nano_chains_export_packet (void *tapdata _U_, packet_info *pinfo _U_, epan_dissect_t *edt _U_, const void *data _U_, tap_flags_t flags _U_) {
+    return TAP_PACKET_DONT_REDRAW;
+}
+
+// the index lives in file scope, so it is written while drawing, before the capture file is closed
+static void nano_chains_export_draw (void *tapdata) {
+    nano_chains_export_write((nano_chains_export_t *) tapdata);
+}
+
+static void nano_chains_export_finish (void *tapdata) {
+    nano_chains_export_t *exporter = (nano_chains_export_t *) tapdata;
+
+    g_free(exporter->path);
+    g_free(exporter);
+}
+
+static void nano_chains_export_init (const char *opt_arg, void *userdata _U_) {
+    const char *args = opt_arg + strlen("nano,chains");
+    nano_chains_export_t *exporter;
+    GString *error_string;
+
+    if (*args != ',' || args[1] == '\0') {
+        report_failure("Usage: -z nano,chains,<output file>");
+        return;
+    }
+
+    exporter = g_new0(nano_chains_export_t, 1);
+    exporter->path = g_strdup(args + 1);
+
+    error_string = register_tap_listener("nano", exporter, NULL, TL_REQUIRES_NOTHING, NULL, nano_chains_export_packet, nano_chains_export_draw, nano_chains_export_finish);
+    if (error_string) {
+        report_failure("Couldn't register nano,chains tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        nano_chains_export_finish(exporter);
+    }
+}
+
+static stat_tap_ui nano_chains_export_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,chains",
+    nano_chains_export_init,
+    0,
+    NULL
+};
+
+void nano_register_chains(void)
+{
+    stats_tree_register_plugin("nano", "nano_chains", "Nano/Account Chains", 0, nano_chains_stats_tree_packet, nano_chains_stats_tree_init, NULL);
+    register_stat_tap_ui(&nano_chains_export_ui, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,88 @@
+/* nano_chains.h
+* Account chain index rebuilt from bootstrap block streams
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_CHAINS_H__
+#define __NANO_CHAINS_H__
+
+#include <glib.h>
+
+// returned per block or per stream end, also kept per chain
+#define NANO_CHAIN_GAP          0x01    // the block is not the one the stream had to send next
+#define NANO_CHAIN_OUT_OF_ORDER 0x02    // the block belongs before one the stream already sent
+#define NANO_CHAIN_INCOMPLETE   0x04    // a bulk pull ended before reaching its end hash or the open block
+#define NANO_CHAIN_DUPLICATE    0x08    // the block was already indexed
+#define NANO_CHAIN_UNATTRIBUTED 0x10    // neither the block nor the stream tell which account it belongs to
+
+// chains by number of known blocks: 1, 2-9, 10-99, 100-999, 1000 and more
+#define NANO_CHAIN_LENGTH_BUCKETS 5
+
+typedef struct _nano_chain_stats {
+    guint32 chains;
+    guint32 chains_with_missing_blocks;
+    guint32 chains_expired;
+    guint32 length_buckets[NANO_CHAIN_LENGTH_BUCKETS];
+
+    guint64 blocks;
+    guint64 duplicate_blocks;
+    guint64 unattributed_blocks;
+    guint64 gap_blocks;
+    guint64 out_of_order_blocks;
+
+    guint32 pulls;
+    guint32 incomplete_pulls;
+} nano_chain_stats_t;
+
+// one block stream into the index, bulk pulls keep theirs in the index, asc_pull_ack payloads on the stack
+typedef struct _nano_chain_stream {
+    guint32 chain;
+    guint32 received;
+    // descending: previous of the last block, ascending: hash of the last block
+    guint8 expected[32];
+    gboolean expected_known;
+} nano_chain_stream_t;
+
+void nano_chains_reset(void);
+
+// bulk_pull: start is an account or a block hash, a zero end walks back to the open block, count 0 is unlimited
+guint32 nano_chains_pull_start(const guint8 *start, const guint8 *end, guint32 count, gint64 now);
+guint8 nano_chains_pull_block(guint32 pull, int block_type, const guint8 *block, gint64 now);
+guint8 nano_chains_pull_end(guint32 pull);
+
+// asc_pull_ack blocks, oldest first
+void nano_chains_stream_init(nano_chain_stream_t *stream);
+guint8 nano_chains_ascending_block(nano_chain_stream_t *stream, int block_type, const guint8 *block, gint64 now);
+
+// account of the chain holding the block, FALSE if no chain has it or its account is not known yet
+gboolean nano_chains_block_account(const guint8 *hash, guint8 *account);
+
+// bytes held by the index, for the bounded memory mode
+gsize nano_chains_memory(void);
+// least recently used chain, dropped to stay within the memory limit or the correlation window
+gboolean nano_chains_oldest(gint64 *last_seen);
+void nano_chains_drop_oldest(void);
+
+const nano_chain_stats_t *nano_chains_stats(void);
+
+void nano_register_chains(void);
+
+#endif /* __NANO_CHAINS_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,631 @@
+/* nano_elections.c
+* Election timelines and time to quorum
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* An election starts the first time a block hash shows up in a publish,
+* confirm_req or confirm_ack. Its timeline is the first publish, the first
+* confirm_req, the first vote of every representative and the moment the
+* weight of the representatives that voted crossed the quorum: a share of
+* the total weight in the weights file, which stands in for the online
+* weight.
+*
+* Everything is built from "nano" tap messages, so it follows sampling: with
+* confirm_acks sampled, quorum is reached late or not at all.
+*
+* Elections are closed once they are older than the election window, which
+* bounds the memory to the elections of one window. The Nano/Elections
+* statistics show the time to quorum distribution; -z nano,elections,<file>
+* writes the timelines of the slowest elections.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <epan/stats_tree.h>
+#include <wsutil/file_util.h>
+#include <wsutil/pint.h>
+#include <wsutil/report_message.h>
+#include <wsutil/to_str.h>
+
+#include "packet-nano.h"
+#include "nano_elections.h"
+
+#define NANO_ELECTIONS_DEFAULT_SLOWEST 20
+
+#define NANO_ELECTIONS_WRITE_BUFFER (64 * 1024)
+
+//
+// Representative weights
+//
+struct nano_rep_weight {
+    guint64 key;
+    gdouble weight;
+};
+
+// sorted by key, the first 8 bytes of the account
+static struct nano_rep_weight *nano_weights;
+static guint32 nano_weight_count;
+static gdouble nano_weight_total;
+static gchar *nano_weights_path;
+
+static guint nano_elections_window = 300;
+static guint nano_elections_quorum_percent = 67;
+
+static int nano_rep_weight_compare (const void *a, const void *b) {
+    guint64 key_a = ((const struct nano_rep_weight *) a)->key;
+    guint64 key_b = ((const struct nano_rep_weight *) b)->key;
+
+    return key_a < key_b ? -1 : key_a > key_b;
+}
+
+static gdouble nano_rep_weight (const guint8 *account) {
+    struct nano_rep_weight key = { pntoh64(account), 0 };
+    const struct nano_rep_weight *found;
+
+    if (!nano_weight_count) {
+        return 0;
+    }
+
+    found = (const struct nano_rep_weight *) bsearch(&key, nano_weights, nano_weight_count, sizeof(key), nano_rep_weight_compare);
+    return found ? found->weight : 0;
+}
+
+void nano_elections_load_weights (const char *path) {
+    gchar *contents;
+    gsize length;
+    GError *error = NULL;
+    GArray *weights;
+
+    if (nano_weights_path && path && !strcmp(nano_weights_path, path)) {
+        return;
+    }
+
+    g_free(nano_weights);
+    g_free(nano_weights_path);
+    nano_weights = NULL;
+    nano_weights_path = NULL;
+    nano_weight_count = 0;
+    nano_weight_total = 0;
+
+    if (!path || !*path) {
+        return;
+    }
+    nano_weights_path = g_strdup(path);
+
+    // a few thousand representatives, read in one go
+    if (!g_file_get_contents(path, &contents, &length, &error)) {
+        report_failure("Couldn't open Nano representative weights %s: %s", path, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    weights = g_array_new(FALSE, FALSE, sizeof(struct nano_rep_weight));
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (gchar **line = lines; *line; line++) {
+        gchar **fields;
+        guint8 account[32];
+        struct nano_rep_weight entry;
+
+        g_strdelimit(*line, ",\t\r", ' ');
+        if (strchr(*line, '#')) {
+            *strchr(*line, '#') = '\0';
+        }
+        fields = g_strsplit(g_strstrip(*line), " ", 2);
+
+        if (fields[0] && fields[1] && nano_address_to_account(fields[0], account)) {
+            entry.key = pntoh64(account);
+            entry.weight = g_ascii_strtod(g_strstrip(fields[1]), NULL);
+            if (entry.weight > 0) {
+                g_array_append_val(weights, entry);
+                nano_weight_total += entry.weight;
+            }
+        }
+
+        g_strfreev(fields);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+
+    g_array_sort(weights, nano_rep_weight_compare);
+    nano_weight_count = weights->len;
+    nano_weights = (struct nano_rep_weight *) g_array_free(weights, FALSE);
+}
+
+void nano_elections_set_window (guint seconds) {
+    nano_elections_window = seconds;
+}
+
+void nano_elections_set_quorum (guint percent) {
+    nano_elections_quorum_percent = MIN(percent, 100);
+}
+
+static gdouble nano_elections_quorum_weight (void) {
+    return nano_weight_total * nano_elections_quorum_percent / 100;
+}
+
+//
+// Election tracking
+//
+
+// the first vote of one representative
+typedef struct {
+    guint8 rep[32];
+    nstime_t at;
+    guint32 frame;
+} nano_election_vote_t;
+
+// frame 0 marks a step of the timeline that did not happen
+typedef struct {
+    guint8 hash[32];
+    nstime_t first_seen;
+    guint32 first_frame;
+    guint32 publish_frame;
+    nstime_t publish;
+    guint32 confirm_req_frame;
+    nstime_t confirm_req;
+    guint32 quorum_frame;
+    nstime_t quorum;
+    gdouble weight;
+    GArray *votes;
+} nano_election_t;
+
+typedef struct _nano_elections nano_elections_t;
+
+struct _nano_elections {
+    // by block hash, and in the order they started for the window
+    GHashTable *open;
+    GQueue order;
+
+    void (*started)(nano_elections_t *elections, const nano_election_t *election);
+    void (*reached_quorum)(nano_elections_t *elections, const nano_election_t *election);
+    // the election is taken over when this returns TRUE, freed otherwise
+    gboolean (*closed)(nano_elections_t *elections, nano_election_t *election);
+    void *user;
+};
+
+static guint nano_election_hash_hash (gconstpointer key) {
+    return pletoh32(key);
+}
+
+static gboolean nano_election_hash_equal (gconstpointer a, gconstpointer b) {
+    return !memcmp(a, b, 32);
+}
+
+static void nano_election_free (nano_election_t *election) {
+    g_array_free(election->votes, TRUE);
+    g_free(election);
+}
+
+static void nano_elections_init_tracker (nano_elections_t *elections) {
+    elections->open = g_hash_table_new(nano_election_hash_hash, nano_election_hash_equal);
+    g_queue_init(&elections->order);
+}
+
+static void nano_elections_close (nano_elections_t *elections, nano_election_t *election) {
+    g_hash_table_remove(elections->open, election->hash);
+    if (!elections->closed || !elections->closed(elections, election)) {
+        nano_election_free(election);
+    }
+}
+
+static void nano_elections_clear (nano_elections_t *elections) {
+    nano_election_t *election;
+
+    while ((election = (nano_election_t *) g_queue_pop_head(&elections->order))) {
+        g_hash_table_remove(elections->open, election->hash);
+        nano_election_free(election);
+    }
+}
+
+static void nano_elections_free_tracker (nano_elections_t *elections) {
+    nano_elections_clear(elections);
+    g_hash_table_destroy(elections->open);
+}
+
+static void nano_elections_expire (nano_elections_t *elections, const nstime_t *now) {
+    nano_election_t *election;
+
+    if (nano_elections_window == 0) {
+        return;
+    }
+
+    while ((election = (nano_election_t *) g_queue_peek_head(&elections->order))) {
+        if (now->secs - election->first_seen.secs <= (gint64) nano_elections_window) {
+            break;
+        }
+        g_queue_pop_head(&elections->order);
+        nano_elections_close(elections, election);
+    }
+}
+
+static nano_election_t *nano_elections_get (nano_elections_t *elections, const guint8 *hash, packet_info *pinfo) {
+    nano_election_t *election = (nano_election_t *) g_hash_table_lookup(elections->open, hash);
+
+    if (election) {
+        return election;
+    }
+
+    election = g_new0(nano_election_t, 1);
+    memcpy(election->hash, hash, 32);
+    election->first_seen = pinfo->abs_ts;
+    election->first_frame = pinfo->num;
+    election->votes = g_array_new(FALSE, FALSE, sizeof(nano_election_vote_t));
+
+    g_hash_table_insert(elections->open, election->hash, election);
+    g_queue_push_tail(&elections->order, election);
+    if (elections->started) {
+        elections->started(elections, election);
+    }
+
+    return election;
+}
+
+static void nano_elections_vote (nano_elections_t *elections, const guint8 *hash, const guint8 *rep, packet_info *pinfo) {
+    nano_election_t *election = nano_elections_get(elections, hash, pinfo);
+    nano_election_vote_t vote;
+
+    // a representative counts once, later votes are rebroadcasts or final votes
+    for (guint i = 0; i < election->votes->len; i++) {
+        if (!memcmp(g_array_index(election->votes, nano_election_vote_t, i).rep, rep, 32)) {
+            return;
+        }
+    }
+
+    memcpy(vote.rep, rep, 32);
+    vote.at = pinfo->abs_ts;
+    vote.frame = pinfo->num;
+    g_array_append_val(election->votes, vote);
+
+    election->weight += nano_rep_weight(rep);
+    if (!election->quorum_frame && nano_weight_total > 0 && election->weight >= nano_elections_quorum_weight()) {
+        election->quorum_frame = pinfo->num;
+        election->quorum = pinfo->abs_ts;
+        if (elections->reached_quorum) {
+            elections->reached_quorum(elections, election);
+        }
+    }
+}
+
+static void nano_elections_packet (nano_elections_t *elections, packet_info *pinfo, const nano_tap_info_t *tap_info) {
+    nano_election_t *election;
+    guint8 hash[32];
+
+    nano_elections_expire(elections, &pinfo->abs_ts);
+
+    switch (tap_info->packet_type) {
+        case NANO_PACKET_TYPE_PUBLISH:
+            if (!tap_info->block) {
+                break;
+            }
+            nano_block_hash(tap_info->block_type, tap_info->block, hash);
+            election = nano_elections_get(elections, hash, pinfo);
+            if (!election->publish_frame) {
+                election->publish_frame = pinfo->num;
+                election->publish = pinfo->abs_ts;
+            }
+            break;
+
+        case NANO_PACKET_TYPE_CONFIRM_REQ:
+            for (guint32 i = 0; i <= tap_info->hash_pair_count; i++) {
+                if (i < tap_info->hash_pair_count) {
+                    memcpy(hash, tap_info->hash_pairs + i * 64, 32);
+                } else if (tap_info->block) {
+                    nano_block_hash(tap_info->block_type, tap_info->block, hash);
+                } else {
+                    break;
+                }
+
+                election = nano_elections_get(elections, hash, pinfo);
+                if (!election->confirm_req_frame) {
+                    election->confirm_req_frame = pinfo->num;
+                    election->confirm_req = pinfo->abs_ts;
+                }
+            }
+            break;
+
+        case NANO_PACKET_TYPE_CONFIRM_ACK:
+            if (!tap_info->vote_account) {
+                break;
+            }
+            for (guint32 i = 0; i < tap_info->vote_hash_count; i++) {
+                nano_elections_vote(elections, tap_info->vote_hashes + i * 32, tap_info->vote_account, pinfo);
+            }
+            if (tap_info->block) {
+                nano_block_hash(tap_info->block_type, tap_info->block, hash);
+                nano_elections_vote(elections, hash, tap_info->vote_account, pinfo);
+            }
+            break;
+    }
+}
+
+static gint nano_election_ms (const nstime_t *from, const nstime_t *to) {
+    nstime_t delta;
+
+    nstime_delta(&delta, to, from);
+    return (gint) (delta.secs * 1000 + delta.nsecs / 1000000);
+}
+
+//
+// Nano/Elections statistics
+//
+static const char *st_str_elections = "Elections";
+static const char *st_str_quorum = "Reached Quorum";
+static const char *st_str_no_quorum = "Closed Without Quorum";
+static const char *st_str_time_to_quorum = "Time to Quorum (ms)";
+
+static int st_node_elections = -1;
+static int st_node_time_to_quorum = -1;
+
+static nano_elections_t nano_elections_stats;
+
+static void nano_elections_stats_started (nano_elections_t *elections, const nano_election_t *election _U_) {
+    tick_stat_node((stats_tree *) elections->user, st_str_elections, 0, FALSE);
+}
+
+static void nano_elections_stats_quorum (nano_elections_t *elections, const nano_election_t *election) {
+    stats_tree *st = (stats_tree *) elections->user;
+
+    tick_stat_node(st, st_str_quorum, st_node_elections, FALSE);
+    stats_tree_tick_range(st, st_str_time_to_quorum, 0, nano_election_ms(&election->first_seen, &election->quorum));
+}
+
+static gboolean nano_elections_stats_closed (nano_elections_t *elections, nano_election_t *election) {
+    if (!election->quorum_frame) {
+        tick_stat_node((stats_tree *) elections->user, st_str_no_quorum, st_node_elections, FALSE);
+    }
+
+    return FALSE;
+}
+
+static void nano_elections_stats_init (stats_tree *st) {
+    st_node_elections = stats_tree_create_node(st, st_str_elections, 0, STAT_DT_INT, TRUE);
+    stats_tree_create_node(st, st_str_quorum, st_node_elections, STAT_DT_INT, FALSE);
+    stats_tree_create_node(st, st_str_no_quorum, st_node_elections, STAT_DT_INT, FALSE);
+    st_node_time_to_quorum = stats_tree_create_range_node(st, st_str_time_to_quorum, 0,
+        "0-99", "100-249", "250-499", "500-999", "1000-1999", "2000-4999", "5000-9999", "10000-", NULL);
+
+    if (nano_elections_stats.open) {
+        nano_elections_free_tracker(&nano_elections_stats);
+    }
+    memset(&nano_elections_stats, 0, sizeof(nano_elections_stats));
+    nano_elections_init_tracker(&nano_elections_stats);
+    nano_elections_stats.started = nano_elections_stats_started;
+    nano_elections_stats.reached_quorum = nano_elections_stats_quorum;
+    nano_elections_stats.closed = nano_elections_stats_closed;
+}
+
+static tap_packet_status nano_elections_stats_packet (stats_tree *st, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    nano_elections_stats.user = st;
+    nano_elections_packet(&nano_elections_stats, pinfo, (const nano_tap_info_t *) data);
+
+    return TAP_PACKET_REDRAW;
+}
+
+static void nano_elections_stats_cleanup (stats_tree *st _U_) {
+    if (nano_elections_stats.open) {
+        nano_elections_free_tracker(&nano_elections_stats);
+        memset(&nano_elections_stats, 0, sizeof(nano_elections_stats));
+    }
+}
+
+//
+// Slowest elections
+//
+typedef struct {
+    nano_elections_t elections;
+    gchar *path;
+    guint slowest;
+    // closed elections that are among the slowest so far
+    GPtrArray *kept;
+} nano_elections_export_t;
+
+static gint nano_election_time_to_quorum (const nano_election_t *election) {
+    return election->quorum_frame ? nano_election_ms(&election->first_seen, &election->quorum) : -1;
+}
+
+static gboolean nano_elections_export_closed (nano_elections_t *elections, nano_election_t *election) {
+    nano_elections_export_t *exporter = (nano_elections_export_t *) elections->user;
+    guint fastest = 0;
+
+    if (!election->quorum_frame) {
+        return FALSE;
+    }
+    if (exporter->kept->len < exporter->slowest) {
+        g_ptr_array_add(exporter->kept, election);
+        return TRUE;
+    }
+
+    for (guint i = 1; i < exporter->kept->len; i++) {
+        if (nano_election_time_to_quorum((const nano_election_t *) g_ptr_array_index(exporter->kept, i)) <
+                nano_election_time_to_quorum((const nano_election_t *) g_ptr_array_index(exporter->kept, fastest))) {
+            fastest = i;
+        }
+    }
+    if (nano_election_time_to_quorum((const nano_election_t *) g_ptr_array_index(exporter->kept, fastest)) >= nano_election_time_to_quorum(election)) {
+        return FALSE;
+    }
+
+    nano_election_free((nano_election_t *) g_ptr_array_index(exporter->kept, fastest));
+    g_ptr_array_index(exporter->kept, fastest) = election;
+    return TRUE;
+}
+
+static void nano_elections_export_reset (void *tapdata) {
+    nano_elections_export_t *exporter = (nano_elections_export_t *) tapdata;
+
+    nano_elections_clear(&exporter->elections);
+    for (guint i = 0; i < exporter->kept->len; i++) {
+        nano_election_free((nano_election_t *) g_ptr_array_index(exporter->kept, i));
+    }
+    g_ptr_array_set_size(exporter->kept, 0);
+}
+
+static tap_packet_status nano_elections_export_packet (void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    nano_elections_export_t *exporter = (nano_elections_export_t *) tapdata;
+
+    nano_elections_packet(&exporter->elections, pinfo, (const nano_tap_info_t *) data);
+
+    return TAP_PACKET_DONT_REDRAW;
+}
+
+static int nano_elections_slowest_first (const void *a, const void *b) {
+    gint time_a = nano_election_time_to_quorum(*(const nano_election_t * const *) a);
+    gint time_b = nano_election_time_to_quorum(*(const nano_election_t * const *) b);
+
+    return time_a > time_b ? -1 : time_a < time_b;
+}
+
+static void nano_elections_export_time (GString *line, guint32 frame, const nstime_t *at, const nstime_t *start) {
+    if (frame) {
+        g_string_append_printf(line, "%u,%.3f,", frame, nano_election_ms(start, at) / 1000.0);
+    } else {
+        g_string_append(line, ",,");
+    }
+}
+
+// hash,first_frame,first_seen,publish_frame,publish,confirm_req_frame,confirm_req,quorum_frame,time_to_quorum,
+// votes,weight,timeline with times in seconds after first_seen and the timeline as +time:address entries
+static void nano_elections_export_draw (void *tapdata) {
+    static const char header[] = "hash,first_frame,first_seen,publish_frame,publish,confirm_req_frame,confirm_req,quorum_frame,time_to_quorum,votes,weight,timeline\n";
+    nano_elections_export_t *exporter = (nano_elections_export_t *) tapdata;
+    GPtrArray *slowest = g_ptr_array_new();
+    GString *line = g_string_new(NULL);
+    char address[NANO_ADDRESS_LENGTH + 1];
+    char hash[64 + 1];
+    FILE *fh;
+
+    // kept closed ones and the ones still open
+    for (guint i = 0; i < exporter->kept->len; i++) {
+        g_ptr_array_add(slowest, g_ptr_array_index(exporter->kept, i));
+    }
+    for (GList *item = exporter->elections.order.head; item; item = item->next) {
+        if (((const nano_election_t *) item->data)->quorum_frame) {
+            g_ptr_array_add(slowest, item->data);
+        }
+    }
+    g_ptr_array_sort(slowest, nano_elections_slowest_first);
+
+    fh = ws_fopen(exporter->path, "w");
+    if (!fh) {
+        report_open_failure(exporter->path, errno, TRUE);
+        g_ptr_array_free(slowest, TRUE);
+        g_string_free(line, TRUE);
+        return;
+    }
+    setvbuf(fh, NULL, _IOFBF, NANO_ELECTIONS_WRITE_BUFFER);
+    fwrite(header, 1, sizeof(header) - 1, fh);
+
+    for (guint i = 0; i < MIN(slowest->len, exporter->slowest); i++) {
+        const nano_election_t *election = (const nano_election_t *) g_ptr_array_index(slowest, i);
+
+        *bytes_to_hexstr(hash, election->hash, 32) = '\0';
+        g_string_printf(line, "%s,%u,%" G_GINT64_FORMAT ".%06d,", hash, election->first_frame, election->first_seen.secs, election->first_seen.nsecs / 1000);
+        nano_elections_export_time(line, election->publish_frame, &election->publish, &election->first_seen);
+        nano_elections_export_time(line, election->confirm_req_frame, &election->confirm_req, &election->first_seen);
+        nano_elections_export_time(line, election->quorum_frame, &election->quorum, &election->first_seen);
+        g_string_append_printf(line, "%u,%.0f,", election->votes->len, election->weight);
+
+        for (guint j = 0; j < election->votes->len; j++) {
+            const nano_election_vote_t *vote = &g_array_index(election->votes, nano_election_vote_t, j);
+
+            nano_account_to_address(vote->rep, address);
+            g_string_append_printf(line, j ? " +%.3f:%s" : "+%.3f:%s", nano_election_ms(&election->first_seen, &vote->at) / 1000.0, address);
+        }
+        g_string_append_c(line, '\n');
+
+        fwrite(line->str, 1, line->len, fh);
+    }
+
+    if (ws_fclose(fh) != 0) {
+        report_write_failure(exporter->path, errno);
+    }
+
+    g_ptr_array_free(slowest, TRUE);
+    g_string_free(line, TRUE);
+}
+
+static void nano_elections_export_finish (void *tapdata) {
+    nano_elections_export_t *exporter = (nano_elections_export_t *) tapdata;
+
+    nano_elections_export_reset(exporter);
+    nano_elections_free_tracker(&exporter->elections);
+    g_ptr_array_free(exporter->kept, TRUE);
+    g_free(exporter->path);
+    g_free(exporter);
+}
+
+static void nano_elections_export_init (const char *opt_arg, void *userdata _U_) {
+    const char *args = opt_arg + strlen("nano,elections");
+    nano_elections_export_t *exporter;
+    GString *error_string;
+    gchar **fields;
+
+    if (*args != ',' || args[1] == '\0') {
+        report_failure("Usage: -z nano,elections,<output file>[,<number of slowest elections>]");
+        return;
+    }
+
+    fields = g_strsplit(args + 1, ",", 2);
+
+    exporter = g_new0(nano_elections_export_t, 1);
+    exporter->path = g_strdup(fields[0]);
+    exporter->slowest = fields[1] ? (guint) strtoul(fields[1], NULL, 10) : NANO_ELECTIONS_DEFAULT_SLOWEST;
+    exporter->kept = g_ptr_array_new();
+    nano_elections_init_tracker(&exporter->elections);
+    exporter->elections.closed = nano_elections_export_closed;
+    exporter->elections.user = exporter;
+    g_strfreev(fields);
+
+    if (exporter->slowest == 0) {
+        exporter->slowest = NANO_ELECTIONS_DEFAULT_SLOWEST;
+    }
+
+    error_string = register_tap_listener("nano", exporter, NULL, TL_REQUIRES_NOTHING, nano_elections_export_reset, nano_elections_export_packet, nano_elections_export_draw, nano_elections_export_finish);
+    if (error_string) {
+        report_failure("Couldn't register nano,elections tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        nano_elections_export_finish(exporter);
+    }
+}
+
+static stat_tap_ui nano_elections_export_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,elections",
+    nano_elections_export_init,
+    0,
+    NULL
+};
+
+void nano_register_elections(void)
+{
+    stats_tree_register_plugin("nano", "nano_elections", "Nano/Elections", 0, nano_elections_stats_packet, nano_elections_stats_init, nano_elections_stats_cleanup);
+    register_stat_tap_ui(&nano_elections_export_ui, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
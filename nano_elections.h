@@ -0,0 +1,38 @@
+/* nano_elections.h
+* Election timelines and time to quorum
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_ELECTIONS_H__
+#define __NANO_ELECTIONS_H__
+
+#include <glib.h>
+
+// representative weights, one address and its weight in Nano per line; an empty path unloads them
+void nano_elections_load_weights(const char *path);
+// elections are closed this many seconds after they were first seen, 0 keeps them open to the end
+void nano_elections_set_window(guint seconds);
+// share of the total weight in the weights file that confirms a block
+void nano_elections_set_quorum(guint percent);
+
+void nano_register_elections(void);
+
+#endif /* __NANO_ELECTIONS_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,897 @@
+/* nano_export.c
+* Columnar export of decoded Nano messages (Arrow IPC stream or CSV)
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* tshark -z nano,export,<arrow|csv>,<output prefix>
+*
+* Writes three tables next to each other, <prefix>.messages, <prefix>.blocks
+* and <prefix>.votes (".arrows" for Arrow IPC streams, ".csv" otherwise).
+* Rows are collected in column buffers and written as record batches of
+* NANO_EXPORT_BATCH_ROWS rows through a large stdio buffer.
+*/
+
+#include <config.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <wsutil/file_util.h>
+#include <wsutil/report_message.h>
+
+#include "packet-nano.h"
+
+#define NANO_EXPORT_BATCH_ROWS (64 * 1024)
+#define NANO_EXPORT_WRITE_BUFFER (4 * 1024 * 1024)
+
+typedef enum {
+    NANO_EXPORT_TIMESTAMP,  // nanoseconds since the epoch
+    NANO_EXPORT_UINT8,
+    NANO_EXPORT_UINT32,
+    NANO_EXPORT_UINT64,
+    NANO_EXPORT_BINARY,     // fixed size binary of width bytes
+    NANO_EXPORT_HASH_LIST   // list of 32 byte hashes
+} nano_export_type;
+
+typedef struct {
+    const char *name;
+    nano_export_type type;
+    guint width;
+    gboolean nullable;
+} nano_export_field;
+
+static const nano_export_field nano_export_message_fields[] = {
+    { "time", NANO_EXPORT_TIMESTAMP, 8, FALSE },
+    { "frame", NANO_EXPORT_UINT32, 4, FALSE },
+    { "conversation", NANO_EXPORT_UINT32, 4, FALSE },
+    { "from_server", NANO_EXPORT_UINT8, 1, FALSE },
+    { "headerless", NANO_EXPORT_UINT8, 1, FALSE },
+    { "packet_type", NANO_EXPORT_UINT8, 1, FALSE },
+    { "block_type", NANO_EXPORT_UINT8, 1, FALSE },
+    { "length", NANO_EXPORT_UINT32, 4, FALSE },
+    { "sample_weight", NANO_EXPORT_UINT32, 4, FALSE },
+};
+
+enum {
+    NANO_EXPORT_BLOCK_TIME,
+    NANO_EXPORT_BLOCK_FRAME,
+    NANO_EXPORT_BLOCK_CONVERSATION,
+    NANO_EXPORT_BLOCK_PACKET_TYPE,
+    NANO_EXPORT_BLOCK_BLOCK_TYPE,
+    NANO_EXPORT_BLOCK_ACCOUNT,
+    NANO_EXPORT_BLOCK_PREVIOUS,
+    NANO_EXPORT_BLOCK_REPRESENTATIVE,
+    NANO_EXPORT_BLOCK_BALANCE,
+    NANO_EXPORT_BLOCK_LINK,
+    NANO_EXPORT_BLOCK_SIGNATURE,
+    NANO_EXPORT_BLOCK_WORK
+};
+
+static const nano_export_field nano_export_block_fields[] = {
+    { "time", NANO_EXPORT_TIMESTAMP, 8, FALSE },
+    { "frame", NANO_EXPORT_UINT32, 4, FALSE },
+    { "conversation", NANO_EXPORT_UINT32, 4, FALSE },
+    { "packet_type", NANO_EXPORT_UINT8, 1, FALSE },
+    { "block_type", NANO_EXPORT_UINT8, 1, FALSE },
+    { "account", NANO_EXPORT_BINARY, 32, TRUE },
+    { "previous", NANO_EXPORT_BINARY, 32, TRUE },
+    { "representative", NANO_EXPORT_BINARY, 32, TRUE },
+    { "balance", NANO_EXPORT_BINARY, 16, TRUE },
+    { "link", NANO_EXPORT_BINARY, 32, TRUE },
+    { "signature", NANO_EXPORT_BINARY, 64, FALSE },
+    { "work", NANO_EXPORT_BINARY, 8, FALSE },
+};
+
+static const nano_export_field nano_export_vote_fields[] = {
+    { "time", NANO_EXPORT_TIMESTAMP, 8, FALSE },
+    { "frame", NANO_EXPORT_UINT32, 4, FALSE },
+    { "conversation", NANO_EXPORT_UINT32, 4, FALSE },
+    { "account", NANO_EXPORT_BINARY, 32, FALSE },
+    { "signature", NANO_EXPORT_BINARY, 64, FALSE },
+    { "sequence", NANO_EXPORT_UINT64, 8, FALSE },
+    { "block_type", NANO_EXPORT_UINT8, 1, FALSE },
+    { "hashes", NANO_EXPORT_HASH_LIST, 32, FALSE },
+};
+
+// offsets of the exported fields in each block type, -1 where the block type does not have the field
+typedef struct {
+    gint account;
+    gint previous;
+    gint representative;
+    gint balance;
+    gint link;  // destination for send blocks, source for receive and open blocks
+    gint signature;
+    gint work;
+} nano_export_block_layout;
+
+static const nano_export_block_layout nano_export_block_layouts[] = {
+    [NANO_BLOCK_TYPE_SEND]    = { -1,  0, -1, 64,  32,  80, 144 },
+    [NANO_BLOCK_TYPE_RECEIVE] = { -1,  0, -1, -1,  32,  64, 128 },
+    [NANO_BLOCK_TYPE_OPEN]    = { 64, -1, 32, -1,   0,  96, 160 },
+    [NANO_BLOCK_TYPE_CHANGE]  = { -1,  0, 32, -1,  -1,  64, 128 },
+    [NANO_BLOCK_TYPE_STATE]   = {  0, 32, 64, 96, 112, 144, 208 },
+};
+
+typedef struct {
+    GByteArray *validity;
+    GByteArray *values;
+    GByteArray *offsets;  // hash lists only
+    guint null_count;
+} nano_export_column;
+
+typedef struct {
+    const char *name;
+    const nano_export_field *fields;
+    guint field_count;
+    nano_export_column *columns;
+    guint rows;
+    FILE *fh;
+} nano_export_table;
+
+typedef struct {
+    gboolean csv;
+    gchar *prefix;
+    nano_export_table messages;
+    nano_export_table blocks;
+    nano_export_table votes;
+} nano_export_t;
+
+//
+// Minimal flatbuffers writer for the Arrow IPC metadata
+//
+// Tables are written parent first, children follow and the parent's offset
+// slots are patched afterwards, so every uoffset points forward as required.
+//
+
+// Arrow MetadataVersion.V5 and MessageHeader / Type union members
+#define NANO_ARROW_METADATA_V5 4
+#define NANO_ARROW_HEADER_SCHEMA 1
+#define NANO_ARROW_HEADER_RECORD_BATCH 3
+#define NANO_ARROW_TYPE_INT 2
+#define NANO_ARROW_TYPE_TIMESTAMP 10
+#define NANO_ARROW_TYPE_LIST 12
+#define NANO_ARROW_TYPE_FIXED_SIZE_BINARY 15
+#define NANO_ARROW_TIME_UNIT_NANOSECOND 3
+
+#define NANO_FB_MAX_FIELDS 8
+
+typedef struct {
+    guint8 id;
+    guint8 size;
+    gboolean is_offset;
+    guint64 value;
+} nano_fb_field;
+
+static void nano_fb_put (GByteArray *fb, gsize pos, guint64 value, guint size) {
+    for (guint i = 0; i < size; i++) {
+        fb->data[pos + i] = (guint8) (value >> (8 * i));
+    }
+}
+
+static gsize nano_fb_grow (GByteArray *fb, guint len) {
+    gsize pos = fb->len;
+
+    g_byte_array_set_size(fb, fb->len + len);
+    memset(fb->data + pos, 0, len);
+
+    return pos;
+}
+
+static void nano_fb_align (GByteArray *fb, guint align, guint phase) {
+    if (fb->len % align != phase) {
+        nano_fb_grow(fb, (align + phase - fb->len % align) % align);
+    }
+}
+
+static void nano_fb_patch (GByteArray *fb, gsize slot, gsize target) {
+    nano_fb_put(fb, slot, target - slot, 4);
+}
+
+// write a vtable and its table, offset fields get their slot position stored in slots
+static gsize nano_fb_table (GByteArray *fb, const nano_fb_field *fields, guint count, gsize *slots) {
+    guint offsets[NANO_FB_MAX_FIELDS];
+    guint table_size = 4;
+    guint entries = 0;
+
+    // the table starts 4 bytes before an 8 byte boundary, widest fields first keeps them all aligned
+    for (guint size = 8; size >= 1; size /= 2) {
+        for (guint i = 0; i < count; i++) {
+            if (fields[i].size != size) {
+                continue;
+            }
+
+            while (size == 8 ? table_size % 8 != 4 : table_size % size != 0) {
+                table_size++;
+            }
+            offsets[i] = table_size;
+            table_size += size;
+        }
+    }
+
+    for (guint i = 0; i < count; i++) {
+        entries = MAX(entries, (guint) fields[i].id + 1);
+    }
+
+    nano_fb_align(fb, 2, 0);
+    gsize vtable = nano_fb_grow(fb, 4 + 2 * entries);
+    nano_fb_put(fb, vtable, 4 + 2 * entries, 2);
+    nano_fb_put(fb, vtable + 2, table_size, 2);
+    for (guint i = 0; i < count; i++) {
+        nano_fb_put(fb, vtable + 4 + 2 * fields[i].id, offsets[i], 2);
+    }
+
+    nano_fb_align(fb, 8, 4);
+    gsize table = nano_fb_grow(fb, table_size);
+    nano_fb_put(fb, table, table - vtable, 4);
+
+    for (guint i = 0; i < count; i++) {
+        if (fields[i].is_offset) {
+            slots[i] = table + offsets[i];
+        } else {
+            nano_fb_put(fb, table + offsets[i], fields[i].value, fields[i].size);
+        }
+    }
+
+    return table;
+}
+
+// vector of structs made of two longs (FieldNode, Buffer)
+static gsize nano_fb_long_pair_vector (GByteArray *fb, const guint64 *values, guint count) {
+    nano_fb_align(fb, 8, 4);
+    gsize pos = nano_fb_grow(fb, 4 + 16 * count);
+
+    nano_fb_put(fb, pos, count, 4);
+    for (guint i = 0; i < 2 * count; i++) {
+        nano_fb_put(fb, pos + 4 + 8 * i, values[i], 8);
+    }
+
+    return pos;
+}
+
+static gsize nano_fb_offset_vector (GByteArray *fb, guint count, gsize *slots) {
+    nano_fb_align(fb, 4, 0);
+    gsize pos = nano_fb_grow(fb, 4 + 4 * count);
+
+    nano_fb_put(fb, pos, count, 4);
+    for (guint i = 0; i < count; i++) {
+        slots[i] = pos + 4 + 4 * i;
+    }
+
+    return pos;
+}
+
+static gsize nano_fb_string (GByteArray *fb, const char *str) {
+    guint len = (guint) strlen(str);
+
+    nano_fb_align(fb, 4, 0);
+    gsize pos = nano_fb_grow(fb, 4 + len + 1);
+
+    nano_fb_put(fb, pos, len, 4);
+    memcpy(fb->data + pos + 4, str, len);
+
+    return pos;
+}
+
+//
+// Arrow IPC stream
+//
+static gsize nano_export_schema_field (GByteArray *fb, const char *name, nano_export_type type, guint width, gboolean nullable) {
+    static const guint int_bits[] = { 0, 8, 32, 64 };
+    guint type_type;
+
+    switch (type) {
+        case NANO_EXPORT_TIMESTAMP:
+            type_type = NANO_ARROW_TYPE_TIMESTAMP;
+            break;
+        case NANO_EXPORT_BINARY:
+            type_type = NANO_ARROW_TYPE_FIXED_SIZE_BINARY;
+            break;
+        case NANO_EXPORT_HASH_LIST:
+            type_type = NANO_ARROW_TYPE_LIST;
+            break;
+        default:
+            type_type = NANO_ARROW_TYPE_INT;
+            break;
+    }
+
+    const nano_fb_field field[] = {
+        { 0, 4, TRUE, 0 },                  // name
+        { 1, 1, FALSE, nullable ? 1 : 0 },  // nullable
+        { 2, 1, FALSE, type_type },         // type_type
+        { 3, 4, TRUE, 0 },                  // type
+        { 5, 4, TRUE, 0 },                  // children
+    };
+    gsize field_slots[G_N_ELEMENTS(field)];
+    gsize slots[2];
+    gsize pos, child_slot;
+
+    gsize field_pos = nano_fb_table(fb, field, G_N_ELEMENTS(field), field_slots);
+
+    nano_fb_patch(fb, field_slots[0], nano_fb_string(fb, name));
+
+    switch (type) {
+        case NANO_EXPORT_TIMESTAMP:
+            {
+                const nano_fb_field timestamp[] = {
+                    { 0, 2, FALSE, NANO_ARROW_TIME_UNIT_NANOSECOND },
+                    { 1, 4, TRUE, 0 },  // timezone
+                };
+
+                pos = nano_fb_table(fb, timestamp, G_N_ELEMENTS(timestamp), slots);
+                nano_fb_patch(fb, slots[1], nano_fb_string(fb, "UTC"));
+                break;
+            }
+        case NANO_EXPORT_BINARY:
+            {
+                const nano_fb_field fixed_size_binary[] = {
+                    { 0, 4, FALSE, width },
+                };
+
+                pos = nano_fb_table(fb, fixed_size_binary, G_N_ELEMENTS(fixed_size_binary), slots);
+                break;
+            }
+        case NANO_EXPORT_HASH_LIST:
+            pos = nano_fb_table(fb, NULL, 0, slots);
+            break;
+        default:
+            {
+                const nano_fb_field integer[] = {
+                    { 0, 4, FALSE, int_bits[type] },
+                    { 1, 1, FALSE, 0 },  // is_signed
+                };
+
+                pos = nano_fb_table(fb, integer, G_N_ELEMENTS(integer), slots);
+                break;
+            }
+    }
+    nano_fb_patch(fb, field_slots[3], pos);
+
+    if (type == NANO_EXPORT_HASH_LIST) {
+        pos = nano_fb_offset_vector(fb, 1, &child_slot);
+        nano_fb_patch(fb, field_slots[4], pos);
+        nano_fb_patch(fb, child_slot, nano_export_schema_field(fb, "item", NANO_EXPORT_BINARY, width, FALSE));
+    } else {
+        nano_fb_patch(fb, field_slots[4], nano_fb_offset_vector(fb, 0, NULL));
+    }
+
+    return field_pos;
+}
+
+// start a Message table, returns the slot of its header
+static gsize nano_export_message_table (GByteArray *fb, guint header_type, guint64 body_length) {
+    const nano_fb_field message[] = {
+        { 0, 2, FALSE, NANO_ARROW_METADATA_V5 },
+        { 1, 1, FALSE, header_type },
+        { 2, 4, TRUE, 0 },  // header
+        { 3, 8, FALSE, body_length },
+    };
+    gsize slots[G_N_ELEMENTS(message)];
+
+    gsize root = nano_fb_grow(fb, 4);
+    nano_fb_patch(fb, root, nano_fb_table(fb, message, G_N_ELEMENTS(message), slots));
+
+    return slots[2];
+}
+
+// write an encapsulated IPC message: continuation marker, metadata size, metadata, body
+static void nano_export_write_message (FILE *fh, GByteArray *fb) {
+    guint8 prefix[8];
+
+    nano_fb_align(fb, 8, 0);
+
+    memset(prefix, 0xff, 4);
+    prefix[4] = (guint8) fb->len;
+    prefix[5] = (guint8) (fb->len >> 8);
+    prefix[6] = (guint8) (fb->len >> 16);
+    prefix[7] = (guint8) (fb->len >> 24);
+
+    fwrite(prefix, 1, sizeof(prefix), fh);
+    fwrite(fb->data, 1, fb->len, fh);
+}
+
+static void nano_export_write_schema (nano_export_table *table) {
+    GByteArray *fb = g_byte_array_new();
+    gsize *field_slots = g_new(gsize, table->field_count);
+    gsize schema_slot;
+
+    gsize header_slot = nano_export_message_table(fb, NANO_ARROW_HEADER_SCHEMA, 0);
+
+    const nano_fb_field schema[] = {
+        { 1, 4, TRUE, 0 },  // fields
+    };
+    nano_fb_patch(fb, header_slot, nano_fb_table(fb, schema, G_N_ELEMENTS(schema), &schema_slot));
+    nano_fb_patch(fb, schema_slot, nano_fb_offset_vector(fb, table->field_count, field_slots));
+
+    for (guint i = 0; i < table->field_count; i++) {
+        const nano_export_field *field = &table->fields[i];
+
+        nano_fb_patch(fb, field_slots[i], nano_export_schema_field(fb, field->name, field->type, field->width, field->nullable));
+    }
+
+    nano_export_write_message(table->fh, fb);
+
+    g_free(field_slots);
+    g_byte_array_free(fb, TRUE);
+}
+
+static void nano_export_write_record_batch (nano_export_table *table) {
+    static const guint8 padding[8];
+    // per column at most a node and two buffers for itself and for its list items
+    guint64 *nodes = g_new0(guint64, 4 * table->field_count);
+    guint64 *buffers = g_new0(guint64, 8 * table->field_count);
+    const guint8 **buffer_data = g_new0(const guint8 *, 4 * table->field_count);
+    guint node_count = 0, buffer_count = 0;
+    guint64 body_length = 0;
+
+#define NANO_EXPORT_ADD_BUFFER(data, len) \
+    G_STMT_START { \
+        buffer_data[buffer_count] = (data); \
+        buffers[2 * buffer_count] = body_length; \
+        buffers[2 * buffer_count + 1] = (len); \
+        body_length += ((len) + 7) & ~(guint64) 7; \
+        buffer_count++; \
+    } G_STMT_END
+
+    for (guint i = 0; i < table->field_count; i++) {
+        nano_export_column *column = &table->columns[i];
+
+        nodes[2 * node_count] = table->rows;
+        nodes[2 * node_count + 1] = column->null_count;
+        node_count++;
+
+        if (table->fields[i].nullable) {
+            NANO_EXPORT_ADD_BUFFER(column->validity->data, column->validity->len);
+        } else {
+            NANO_EXPORT_ADD_BUFFER(NULL, 0);
+        }
+
+        if (table->fields[i].type == NANO_EXPORT_HASH_LIST) {
+            NANO_EXPORT_ADD_BUFFER(column->offsets->data, column->offsets->len);
+
+            nodes[2 * node_count] = column->values->len / table->fields[i].width;
+            nodes[2 * node_count + 1] = 0;
+            node_count++;
+
+            NANO_EXPORT_ADD_BUFFER(NULL, 0);
+        }
+
+        NANO_EXPORT_ADD_BUFFER(column->values->data, column->values->len);
+    }
+
+#undef NANO_EXPORT_ADD_BUFFER
+
+    GByteArray *fb = g_byte_array_new();
+    gsize slots[3];
+
+    gsize header_slot = nano_export_message_table(fb, NANO_ARROW_HEADER_RECORD_BATCH, body_length);
+
+    const nano_fb_field record_batch[] = {
+        { 0, 8, FALSE, table->rows },  // length
+        { 1, 4, TRUE, 0 },             // nodes
+        { 2, 4, TRUE, 0 },             // buffers
+    };
+    nano_fb_patch(fb, header_slot, nano_fb_table(fb, record_batch, G_N_ELEMENTS(record_batch), slots));
+    nano_fb_patch(fb, slots[1], nano_fb_long_pair_vector(fb, nodes, node_count));
+    nano_fb_patch(fb, slots[2], nano_fb_long_pair_vector(fb, buffers, buffer_count));
+
+    nano_export_write_message(table->fh, fb);
+
+    for (guint i = 0; i < buffer_count; i++) {
+        guint64 len = buffers[2 * i + 1];
+
+        if (len) {
+            fwrite(buffer_data[i], 1, len, table->fh);
+        }
+        fwrite(padding, 1, (8 - len % 8) % 8, table->fh);
+    }
+
+    g_byte_array_free(fb, TRUE);
+    g_free(buffer_data);
+    g_free(buffers);
+    g_free(nodes);
+}
+
+static void nano_export_write_end_of_stream (FILE *fh) {
+    static const guint8 end_of_stream[8] = { 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0 };
+
+    fwrite(end_of_stream, 1, sizeof(end_of_stream), fh);
+}
+
+//
+// CSV
+//
+static void nano_export_csv_hex (GString *line, const guint8 *data, guint len) {
+    static const char hex[] = "0123456789abcdef";
+
+    for (guint i = 0; i < len; i++) {
+        g_string_append_c(line, hex[data[i] >> 4]);
+        g_string_append_c(line, hex[data[i] & 0xf]);
+    }
+}
+
+static guint64 nano_export_get_uint (const guint8 *data, guint width) {
+    guint64 value = 0;
+
+    for (guint i = 0; i < width; i++) {
+        value |= (guint64) data[i] << (8 * i);
+    }
+
+    return value;
+}
+
+static void nano_export_write_csv_header (nano_export_table *table) {
+    GString *header = g_string_new(NULL);
+
+    for (guint i = 0; i < table->field_count; i++) {
+        g_string_append_printf(header, "%s%s", i ? "," : "", table->fields[i].name);
+    }
+    g_string_append_c(header, '\n');
+
+    fwrite(header->str, 1, header->len, table->fh);
+    g_string_free(header, TRUE);
+}
+
+static void nano_export_write_csv_rows (nano_export_table *table) {
+    GString *out = g_string_sized_new(NANO_EXPORT_WRITE_BUFFER + 4096);
+
+    for (guint row = 0; row < table->rows; row++) {
+        for (guint i = 0; i < table->field_count; i++) {
+            const nano_export_field *field = &table->fields[i];
+            nano_export_column *column = &table->columns[i];
+            const guint8 *value = column->values->data + (gsize) row * field->width;
+
+            if (i) {
+                g_string_append_c(out, ',');
+            }
+
+            if (field->nullable && !(column->validity->data[row / 8] & (1 << (row % 8)))) {
+                continue;
+            }
+
+            switch (field->type) {
+                case NANO_EXPORT_TIMESTAMP:
+                    {
+                        gint64 ns = (gint64) nano_export_get_uint(value, 8);
+                        g_string_append_printf(out, "%" G_GINT64_MODIFIER "d.%09d", ns / 1000000000, (int) (ns % 1000000000));
+                        break;
+                    }
+                case NANO_EXPORT_UINT8:
+                case NANO_EXPORT_UINT32:
+                case NANO_EXPORT_UINT64:
+                    g_string_append_printf(out, "%" G_GINT64_MODIFIER "u", nano_export_get_uint(value, field->width));
+                    break;
+                case NANO_EXPORT_BINARY:
+                    nano_export_csv_hex(out, value, field->width);
+                    break;
+                case NANO_EXPORT_HASH_LIST:
+                    {
+                        guint32 first = (guint32) nano_export_get_uint(column->offsets->data + 4 * row, 4);
+                        guint32 last = (guint32) nano_export_get_uint(column->offsets->data + 4 * (row + 1), 4);
+
+                        for (guint32 item = first; item < last; item++) {
+                            if (item != first) {
+                                g_string_append_c(out, ' ');
+                            }
+                            nano_export_csv_hex(out, column->values->data + (gsize) item * field->width, field->width);
+                        }
+                        break;
+                    }
+            }
+        }
+        g_string_append_c(out, '\n');
+
+        if (out->len >= NANO_EXPORT_WRITE_BUFFER) {
+            fwrite(out->str, 1, out->len, table->fh);
+            g_string_truncate(out, 0);
+        }
+    }
+
+    fwrite(out->str, 1, out->len, table->fh);
+    g_string_free(out, TRUE);
+}
+
+//
+// Tables
+//
+static void nano_export_table_clear (nano_export_table *table) {
+    static const guint8 zero_offset[4];
+
+    for (guint i = 0; i < table->field_count; i++) {
+        nano_export_column *column = &table->columns[i];
+
+        g_byte_array_set_size(column->validity, 0);
+        g_byte_array_set_size(column->values, 0);
+        g_byte_array_set_size(column->offsets, 0);
+        if (table->fields[i].type == NANO_EXPORT_HASH_LIST) {
+            g_byte_array_append(column->offsets, zero_offset, sizeof(zero_offset));
+        }
+        column->null_count = 0;
+    }
+
+    table->rows = 0;
+}
+
+static gboolean nano_export_table_open (nano_export_t *exporter, nano_export_table *table, const char *name, const nano_export_field *fields, guint field_count) {
+    gchar *path = g_strdup_printf("%s.%s.%s", exporter->prefix, name, exporter->csv ? "csv" : "arrows");
+
+    table->name = name;
+    table->fields = fields;
+    table->field_count = field_count;
+    table->columns = g_new0(nano_export_column, field_count);
+
+    for (guint i = 0; i < field_count; i++) {
+        table->columns[i].validity = g_byte_array_new();
+        table->columns[i].values = g_byte_array_sized_new(NANO_EXPORT_BATCH_ROWS * fields[i].width);
+        table->columns[i].offsets = g_byte_array_new();
+    }
+    nano_export_table_clear(table);
+
+    table->fh = ws_fopen(path, "wb");
+    if (!table->fh) {
+        report_open_failure(path, errno, TRUE);
+        g_free(path);
+        return FALSE;
+    }
+    setvbuf(table->fh, NULL, _IOFBF, NANO_EXPORT_WRITE_BUFFER);
+    g_free(path);
+
+    if (exporter->csv) {
+        nano_export_write_csv_header(table);
+    } else {
+        nano_export_write_schema(table);
+    }
+
+    return TRUE;
+}
+
+static void nano_export_table_flush (nano_export_t *exporter, nano_export_table *table) {
+    if (!table->fh || table->rows == 0) {
+        return;
+    }
+
+    if (exporter->csv) {
+        nano_export_write_csv_rows(table);
+    } else {
+        nano_export_write_record_batch(table);
+    }
+
+    nano_export_table_clear(table);
+}
+
+static void nano_export_table_close (nano_export_t *exporter, nano_export_table *table) {
+    if (table->fh) {
+        nano_export_table_flush(exporter, table);
+
+        if (!exporter->csv) {
+            nano_export_write_end_of_stream(table->fh);
+        }
+
+        ws_fclose(table->fh);
+        table->fh = NULL;
+    }
+
+    for (guint i = 0; table->columns && i < table->field_count; i++) {
+        g_byte_array_free(table->columns[i].validity, TRUE);
+        g_byte_array_free(table->columns[i].values, TRUE);
+        g_byte_array_free(table->columns[i].offsets, TRUE);
+    }
+    g_free(table->columns);
+    table->columns = NULL;
+}
+
+// record whether the current row has a value in a nullable column
+static void nano_export_set_valid (nano_export_table *table, guint index, gboolean valid) {
+    nano_export_column *column = &table->columns[index];
+    guint row = table->rows;
+
+    if (!table->fields[index].nullable) {
+        return;
+    }
+
+    if (row % 8 == 0) {
+        static const guint8 zero = 0;
+        g_byte_array_append(column->validity, &zero, 1);
+    }
+
+    if (valid) {
+        column->validity->data[row / 8] |= 1 << (row % 8);
+    } else {
+        column->null_count++;
+    }
+}
+
+static void nano_export_add_uint (nano_export_table *table, guint index, guint64 value) {
+    guint8 data[8];
+    guint width = table->fields[index].width;
+
+    for (guint i = 0; i < width; i++) {
+        data[i] = (guint8) (value >> (8 * i));
+    }
+
+    nano_export_set_valid(table, index, TRUE);
+    g_byte_array_append(table->columns[index].values, data, width);
+}
+
+// data may be NULL for a missing value, which is stored as zeros
+static void nano_export_add_bytes (nano_export_table *table, guint index, const guint8 *data) {
+    static const guint8 zeros[64];
+
+    nano_export_set_valid(table, index, data != NULL);
+    g_byte_array_append(table->columns[index].values, data ? data : zeros, table->fields[index].width);
+}
+
+static void nano_export_add_hashes (nano_export_table *table, guint index, const guint8 *hashes, guint32 count) {
+    nano_export_column *column = &table->columns[index];
+    guint8 end[4];
+
+    if (count) {
+        g_byte_array_append(column->values, hashes, count * table->fields[index].width);
+    }
+
+    guint32 items = column->values->len / table->fields[index].width;
+    for (guint i = 0; i < 4; i++) {
+        end[i] = (guint8) (items >> (8 * i));
+    }
+
+    nano_export_set_valid(table, index, TRUE);
+    g_byte_array_append(column->offsets, end, sizeof(end));
+}
+
+static void nano_export_end_row (nano_export_t *exporter, nano_export_table *table) {
+    table->rows++;
+
+    if (table->rows >= NANO_EXPORT_BATCH_ROWS) {
+        nano_export_table_flush(exporter, table);
+    }
+}
+
+static const guint8 *nano_export_block_field (const nano_tap_info_t *tap_info, gint offset) {
+    return offset < 0 ? NULL : tap_info->block + offset;
+}
+
+//
+// Tap listener
+//
+static void nano_export_reset (void *tapdata) {
+    nano_export_t *exporter = (nano_export_t *) tapdata;
+
+    nano_export_table_clear(&exporter->messages);
+    nano_export_table_clear(&exporter->blocks);
+    nano_export_table_clear(&exporter->votes);
+}
+
+static tap_packet_status nano_export_packet (void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    nano_export_t *exporter = (nano_export_t *) tapdata;
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+    guint64 time = (guint64) pinfo->abs_ts.secs * 1000000000 + pinfo->abs_ts.nsecs;
+    nano_export_table *table;
+    guint i = 0;
+
+    table = &exporter->messages;
+    nano_export_add_uint(table, i++, time);
+    nano_export_add_uint(table, i++, pinfo->num);
+    nano_export_add_uint(table, i++, tap_info->conversation);
+    nano_export_add_uint(table, i++, tap_info->from_server);
+    nano_export_add_uint(table, i++, tap_info->headerless);
+    nano_export_add_uint(table, i++, tap_info->packet_type);
+    nano_export_add_uint(table, i++, tap_info->block_type);
+    nano_export_add_uint(table, i++, tap_info->length);
+    nano_export_add_uint(table, i++, tap_info->sample_weight);
+    nano_export_end_row(exporter, table);
+
+    if (tap_info->block && tap_info->block_type < G_N_ELEMENTS(nano_export_block_layouts)) {
+        const nano_export_block_layout *layout = &nano_export_block_layouts[tap_info->block_type];
+
+        table = &exporter->blocks;
+        nano_export_add_uint(table, NANO_EXPORT_BLOCK_TIME, time);
+        nano_export_add_uint(table, NANO_EXPORT_BLOCK_FRAME, pinfo->num);
+        nano_export_add_uint(table, NANO_EXPORT_BLOCK_CONVERSATION, tap_info->conversation);
+        nano_export_add_uint(table, NANO_EXPORT_BLOCK_PACKET_TYPE, tap_info->packet_type);
+        nano_export_add_uint(table, NANO_EXPORT_BLOCK_BLOCK_TYPE, tap_info->block_type);
+        nano_export_add_bytes(table, NANO_EXPORT_BLOCK_ACCOUNT, nano_export_block_field(tap_info, layout->account));
+        nano_export_add_bytes(table, NANO_EXPORT_BLOCK_PREVIOUS, nano_export_block_field(tap_info, layout->previous));
+        nano_export_add_bytes(table, NANO_EXPORT_BLOCK_REPRESENTATIVE, nano_export_block_field(tap_info, layout->representative));
+        nano_export_add_bytes(table, NANO_EXPORT_BLOCK_BALANCE, nano_export_block_field(tap_info, layout->balance));
+        nano_export_add_bytes(table, NANO_EXPORT_BLOCK_LINK, nano_export_block_field(tap_info, layout->link));
+        nano_export_add_bytes(table, NANO_EXPORT_BLOCK_SIGNATURE, nano_export_block_field(tap_info, layout->signature));
+        nano_export_add_bytes(table, NANO_EXPORT_BLOCK_WORK, nano_export_block_field(tap_info, layout->work));
+        nano_export_end_row(exporter, table);
+    }
+
+    if (tap_info->vote_account) {
+        i = 0;
+        table = &exporter->votes;
+        nano_export_add_uint(table, i++, time);
+        nano_export_add_uint(table, i++, pinfo->num);
+        nano_export_add_uint(table, i++, tap_info->conversation);
+        nano_export_add_bytes(table, i++, tap_info->vote_account);
+        nano_export_add_bytes(table, i++, tap_info->vote_signature);
+        nano_export_add_uint(table, i++, tap_info->vote_sequence);
+        nano_export_add_uint(table, i++, tap_info->block_type);
+        nano_export_add_hashes(table, i++, tap_info->vote_hashes, tap_info->vote_hash_count);
+        nano_export_end_row(exporter, table);
+    }
+
+    return TAP_PACKET_DONT_REDRAW;
+}
+
+static void nano_export_finish (void *tapdata) {
+    nano_export_t *exporter = (nano_export_t *) tapdata;
+
+    nano_export_table_close(exporter, &exporter->messages);
+    nano_export_table_close(exporter, &exporter->blocks);
+    nano_export_table_close(exporter, &exporter->votes);
+
+    g_free(exporter->prefix);
+    g_free(exporter);
+}
+
+static void nano_export_init (const char *opt_arg, void *userdata _U_) {
+    const char *args = opt_arg + strlen("nano,export");
+    const char *prefix;
+    nano_export_t *exporter;
+    GString *error_string;
+
+    if (*args != ',' || (prefix = strchr(args + 1, ',')) == NULL || prefix[1] == '\0') {
+        report_failure("Usage: -z nano,export,<arrow|csv>,<output prefix>");
+        return;
+    }
+
+    exporter = g_new0(nano_export_t, 1);
+
+    if (!strncmp(args + 1, "csv,", 4)) {
+        exporter->csv = TRUE;
+    } else if (strncmp(args + 1, "arrow,", 6)) {
+        report_failure("nano,export: unknown format, use arrow or csv");
+        g_free(exporter);
+        return;
+    }
+    exporter->prefix = g_strdup(prefix + 1);
+
+    if (!nano_export_table_open(exporter, &exporter->messages, "messages", nano_export_message_fields, G_N_ELEMENTS(nano_export_message_fields)) ||
+        !nano_export_table_open(exporter, &exporter->blocks, "blocks", nano_export_block_fields, G_N_ELEMENTS(nano_export_block_fields)) ||
+        !nano_export_table_open(exporter, &exporter->votes, "votes", nano_export_vote_fields, G_N_ELEMENTS(nano_export_vote_fields))) {
+        nano_export_finish(exporter);
+        return;
+    }
+
+    error_string = register_tap_listener("nano", exporter, NULL, TL_REQUIRES_NOTHING, nano_export_reset, nano_export_packet, NULL, nano_export_finish);
+    if (error_string) {
+        report_failure("Couldn't register nano,export tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        nano_export_finish(exporter);
+    }
+}
+
+static stat_tap_ui nano_export_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,export",
+    nano_export_init,
+    0,
+    NULL
+};
+
+void nano_register_export(void)
+{
+    register_stat_tap_ui(&nano_export_ui, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,575 @@
+/* nano_forks.c
+* Fork detection: different blocks on the same root
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* The root of a block is its previous block, or its account for the first
+* block of a chain. Two different blocks on one root are a fork. The first
+* pass remembers the first block hash seen on every root in a flat open
+* addressing table keyed by the first 8 bytes of the root, 48 bytes a root.
+*
+* In bounded memory mode the table comes in two generations. New roots go to
+* the current one; once it is older than the correlation window, or memory
+* runs short, the previous generation is dropped and the current one takes
+* its place.
+*
+* Blocks that turned out to be a side of a fork get an id, which the
+* nano,forks tap uses to collect the frames each side appeared in and the
+* representatives that voted for it. A single pass only sees what comes after
+* the fork was found, tshark -2 and the GUI see all of it.
+*/
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <wsutil/file_util.h>
+#include <wsutil/pint.h>
+#include <wsutil/report_message.h>
+#include <wsutil/to_str.h>
+
+#include "packet-nano.h"
+#include "nano_forks.h"
+
+#define NANO_FORK_TABLE_MIN_SLOTS 1024
+
+#define NANO_FORKS_WRITE_BUFFER (64 * 1024)
+
+// frame 0 marks an empty slot, frame numbers start at 1
+struct nano_fork_root {
+    guint64 root;
+    guint32 frame;
+    guint8 first[32];
+};
+
+struct nano_fork_roots {
+    struct nano_fork_root *slots;
+    guint32 mask;
+    guint32 used;
+    gint64 started;
+};
+
+static struct nano_fork_roots nano_fork_generations[2];
+static guint nano_fork_current;
+// the current generation points into a sidecar mapping, copied before the first insert
+static gboolean nano_fork_roots_mapped;
+
+// side ids index nano_fork_sides from 1, the map finds them by block hash
+static wmem_array_t *nano_fork_sides;
+static wmem_map_t *nano_fork_sides_by_hash;
+static guint32 nano_fork_count;
+
+static gsize nano_fork_bytes;
+
+static guint nano_fork_hash_hash (gconstpointer key) {
+    // block hashes are blake2b output
+    return pletoh32(key);
+}
+
+static gboolean nano_fork_hash_equal (gconstpointer a, gconstpointer b) {
+    return !memcmp(a, b, 32);
+}
+
+void nano_forks_reset (void) {
+    memset(nano_fork_generations, 0, sizeof(nano_fork_generations));
+    nano_fork_current = 0;
+    nano_fork_roots_mapped = FALSE;
+
+    nano_fork_sides = wmem_array_new(wmem_file_scope(), sizeof(nano_fork_side_t *));
+    nano_fork_sides_by_hash = wmem_map_new(wmem_file_scope(), nano_fork_hash_hash, nano_fork_hash_equal);
+    nano_fork_count = 0;
+
+    nano_fork_bytes = 0;
+}
+
+//
+// Root table
+//
+static struct nano_fork_root *nano_fork_roots_find (const struct nano_fork_roots *table, guint64 root) {
+    if (!table->slots) {
+        return NULL;
+    }
+
+    for (guint32 i = (guint32) root & table->mask; table->slots[i].frame != 0; i = (i + 1) & table->mask) {
+        if (table->slots[i].root == root) {
+            return &table->slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+static struct nano_fork_root *nano_fork_roots_slot (struct nano_fork_roots *table, guint64 root) {
+    guint32 i = (guint32) root & table->mask;
+
+    while (table->slots[i].frame != 0) {
+        i = (i + 1) & table->mask;
+    }
+
+    return &table->slots[i];
+}
+
+static void nano_fork_roots_resize (struct nano_fork_roots *table, guint32 slots) {
+    struct nano_fork_root *old = table->slots;
+    guint32 old_slots = old ? table->mask + 1 : 0;
+
+    table->slots = wmem_alloc0_array(wmem_file_scope(), struct nano_fork_root, slots);
+    table->mask = slots - 1;
+    table->used = 0;
+
+    for (guint32 i = 0; i < old_slots; i++) {
+        if (old[i].frame != 0) {
+            *nano_fork_roots_slot(table, old[i].root) = old[i];
+            table->used++;
+        }
+    }
+
+    if (nano_fork_roots_mapped) {
+        nano_fork_roots_mapped = FALSE;
+        old_slots = 0;
+    } else {
+        wmem_free(wmem_file_scope(), old);
+    }
+    nano_fork_bytes += ((gsize) slots - old_slots) * sizeof(struct nano_fork_root);
+}
+
+static void nano_fork_roots_insert (struct nano_fork_roots *table, guint64 root, const guint8 *first, guint32 frame, gint64 now) {
+    guint32 slots = table->slots ? table->mask + 1 : 0;
+
+    if (!table->slots) {
+        table->started = now;
+    }
+
+    // nothing is ever removed, so 70% is only ever reached by inserting
+    if ((guint64) (table->used + 1) * 10 > (guint64) slots * 7) {
+        nano_fork_roots_resize(table, MAX(slots * 2, NANO_FORK_TABLE_MIN_SLOTS));
+    } else if (nano_fork_roots_mapped && table == &nano_fork_generations[nano_fork_current]) {
+        nano_fork_roots_resize(table, slots);
+    }
+
+    struct nano_fork_root *entry = nano_fork_roots_slot(table, root);
+    entry->root = root;
+    entry->frame = frame;
+    memcpy(entry->first, first, 32);
+    table->used++;
+}
+
+static const struct nano_fork_root *nano_fork_roots_lookup (guint64 root) {
+    const struct nano_fork_root *entry = nano_fork_roots_find(&nano_fork_generations[nano_fork_current], root);
+
+    if (!entry) {
+        entry = nano_fork_roots_find(&nano_fork_generations[!nano_fork_current], root);
+    }
+
+    return entry;
+}
+
+//
+// Fork sides
+//
+guint32 nano_forks_side (const guint8 *hash) {
+    if (!nano_fork_sides_by_hash) {
+        return 0;
+    }
+
+    return GPOINTER_TO_UINT(wmem_map_lookup(nano_fork_sides_by_hash, hash));
+}
+
+static void nano_fork_add_side (const guint8 *hash, const guint8 *root, guint32 fork, guint32 frame) {
+    nano_fork_side_t *side = wmem_new(wmem_file_scope(), nano_fork_side_t);
+
+    memcpy(side->hash, hash, 32);
+    memcpy(side->root, root, 32);
+    side->fork = fork;
+    side->first_frame = frame;
+
+    wmem_array_append_one(nano_fork_sides, side);
+    wmem_map_insert(nano_fork_sides_by_hash, side->hash, GUINT_TO_POINTER(wmem_array_get_count(nano_fork_sides)));
+    nano_fork_bytes += sizeof(nano_fork_side_t) + sizeof(nano_fork_side_t *);
+}
+
+const nano_fork_side_t *nano_forks_get_side (guint32 id) {
+    if (id == 0 || id > nano_forks_side_count()) {
+        return NULL;
+    }
+
+    return *(nano_fork_side_t **) wmem_array_index(nano_fork_sides, id - 1);
+}
+
+guint32 nano_forks_side_count (void) {
+    return nano_fork_sides ? wmem_array_get_count(nano_fork_sides) : 0;
+}
+
+guint32 nano_forks_count (void) {
+    return nano_fork_count;
+}
+
+const guint8 *nano_forks_observe (const guint8 *root, const guint8 *hash, guint32 frame, gint64 now) {
+    guint64 key = pletoh64(root);
+    const struct nano_fork_root *entry = nano_fork_roots_lookup(key);
+
+    if (!entry) {
+        nano_fork_roots_insert(&nano_fork_generations[nano_fork_current], key, hash, frame, now);
+        return NULL;
+    }
+
+    if (!memcmp(entry->first, hash, 32)) {
+        return NULL;
+    }
+
+    if (!nano_forks_side(hash)) {
+        guint32 first_side = nano_forks_side(entry->first);
+        guint32 fork;
+
+        if (first_side) {
+            fork = nano_forks_get_side(first_side)->fork;
+        } else {
+            fork = ++nano_fork_count;
+            nano_fork_add_side(entry->first, root, fork, entry->frame);
+        }
+        nano_fork_add_side(hash, root, fork, frame);
+    }
+
+    return entry->first;
+}
+
+const guint8 *nano_forks_lookup (const guint8 *root, const guint8 *hash) {
+    const struct nano_fork_root *entry = nano_fork_roots_lookup(pletoh64(root));
+
+    if (!entry || !memcmp(entry->first, hash, 32)) {
+        return NULL;
+    }
+
+    return entry->first;
+}
+
+//
+// Bounded memory mode
+//
+gsize nano_forks_memory (void) {
+    return nano_fork_bytes;
+}
+
+guint32 nano_forks_expire (gint64 now, guint window, gboolean over_limit) {
+    struct nano_fork_roots *current = &nano_fork_generations[nano_fork_current];
+    struct nano_fork_roots *previous = &nano_fork_generations[!nano_fork_current];
+
+    if (current->used == 0) {
+        return 0;
+    }
+    if (!over_limit && (window == 0 || now - current->started <= (gint64) window)) {
+        return 0;
+    }
+
+    // every root in the previous generation was first seen before the current one started
+    guint32 dropped = previous->used;
+
+    if (previous->slots) {
+        nano_fork_bytes -= (gsize) (previous->mask + 1) * sizeof(struct nano_fork_root);
+        wmem_free(wmem_file_scope(), previous->slots);
+    }
+    memset(previous, 0, sizeof(*previous));
+    nano_fork_current = !nano_fork_current;
+
+    // a mapped table is never freed, so it is not worth keeping track of which generation has it
+    if (nano_fork_roots_mapped) {
+        nano_fork_roots_resize(&nano_fork_generations[!nano_fork_current], nano_fork_generations[!nano_fork_current].mask + 1);
+    }
+
+    return dropped;
+}
+
+//
+// Sidecar
+//
+guint32 nano_forks_root_record_size (void) {
+    return sizeof(struct nano_fork_root);
+}
+
+void nano_forks_export (GByteArray **roots, GByteArray **sides) {
+    guint32 used = nano_fork_generations[0].used + nano_fork_generations[1].used;
+    guint32 slots = NANO_FORK_TABLE_MIN_SLOTS;
+    struct nano_fork_roots merged;
+
+    *roots = g_byte_array_new();
+    *sides = g_byte_array_new();
+
+    // both generations in one table, stored the way it is looked up
+    if (used) {
+        while ((guint64) used * 10 > (guint64) slots * 7) {
+            slots *= 2;
+        }
+        g_byte_array_set_size(*roots, slots * (guint) sizeof(struct nano_fork_root));
+        memset((*roots)->data, 0, (*roots)->len);
+
+        memset(&merged, 0, sizeof(merged));
+        merged.slots = (struct nano_fork_root *) (*roots)->data;
+        merged.mask = slots - 1;
+
+        for (int g = 0; g < 2; g++) {
+            const struct nano_fork_roots *table = &nano_fork_generations[g];
+
+            for (guint32 i = 0; table->slots && i <= table->mask; i++) {
+                if (table->slots[i].frame != 0 && !nano_fork_roots_find(&merged, table->slots[i].root)) {
+                    *nano_fork_roots_slot(&merged, table->slots[i].root) = table->slots[i];
+                }
+            }
+        }
+    }
+
+    for (guint32 id = 1; id <= nano_forks_side_count(); id++) {
+        g_byte_array_append(*sides, (const guint8 *) nano_forks_get_side(id), sizeof(nano_fork_side_t));
+    }
+}
+
+void nano_forks_load (const void *roots, guint32 root_count, const void *sides, guint32 side_count) {
+    const nano_fork_side_t *side = (const nano_fork_side_t *) sides;
+
+    nano_forks_reset();
+
+    // a power of two written by nano_forks_export, or nothing
+    if (root_count && !(root_count & (root_count - 1))) {
+        nano_fork_generations[0].slots = (struct nano_fork_root *) roots;
+        nano_fork_generations[0].mask = root_count - 1;
+        nano_fork_roots_mapped = TRUE;
+    }
+
+    for (guint32 i = 0; i < side_count; i++) {
+        nano_fork_add_side(side[i].hash, side[i].root, side[i].fork, side[i].first_frame);
+        nano_fork_count = MAX(nano_fork_count, side[i].fork);
+    }
+}
+
+//
+// Fork listing
+//
+
+// what the tap saw of one fork side
+typedef struct {
+    GArray *frames;
+    GByteArray *voters;
+} nano_forks_seen_t;
+
+typedef struct {
+    gchar *path;
+    // by side id - 1
+    GPtrArray *seen;
+} nano_forks_export_t;
+
+static void nano_forks_seen_free (gpointer data) {
+    nano_forks_seen_t *seen = (nano_forks_seen_t *) data;
+
+    if (seen) {
+        g_array_free(seen->frames, TRUE);
+        g_byte_array_free(seen->voters, TRUE);
+        g_free(seen);
+    }
+}
+
+static void nano_forks_export_note (nano_forks_export_t *exporter, const guint8 *hash, guint32 frame, const guint8 *voter) {
+    guint32 id = nano_forks_side(hash);
+
+    if (id == 0) {
+        return;
+    }
+
+    if (exporter->seen->len < id) {
+        g_ptr_array_set_size(exporter->seen, id);
+    }
+
+    nano_forks_seen_t *seen = (nano_forks_seen_t *) g_ptr_array_index(exporter->seen, id - 1);
+    if (!seen) {
+        seen = g_new(nano_forks_seen_t, 1);
+        seen->frames = g_array_new(FALSE, FALSE, sizeof(guint32));
+        seen->voters = g_byte_array_new();
+        g_ptr_array_index(exporter->seen, id - 1) = seen;
+    }
+
+    if (seen->frames->len == 0 || g_array_index(seen->frames, guint32, seen->frames->len - 1) != frame) {
+        g_array_append_val(seen->frames, frame);
+    }
+
+    if (!voter) {
+        return;
+    }
+    for (guint i = 0; i < seen->voters->len; i += 32) {
+        if (!memcmp(seen->voters->data + i, voter, 32)) {
+            return;
+        }
+    }
+    g_byte_array_append(seen->voters, voter, 32);
+}
+
+static void nano_forks_export_reset (void *tapdata) {
+    nano_forks_export_t *exporter = (nano_forks_export_t *) tapdata;
+
+    g_ptr_array_set_size(exporter->seen, 0);
+}
+
+static tap_packet_status nano_forks_export_packet (void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    nano_forks_export_t *exporter = (nano_forks_export_t *) tapdata;
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+    guint32 frame = pinfo->num;
+
+    if (nano_forks_side_count() == 0) {
+        return TAP_PACKET_DONT_REDRAW;
+    }
+
+    if (tap_info->block) {
+        guint8 hash[32];
+
+        nano_block_hash(tap_info->block_type, tap_info->block, hash);
+        nano_forks_export_note(exporter, hash, frame, tap_info->vote_account);
+    }
+    for (guint32 i = 0; i < tap_info->vote_hash_count; i++) {
+        nano_forks_export_note(exporter, tap_info->vote_hashes + i * 32, frame, tap_info->vote_account);
+    }
+    for (guint32 i = 0; i < tap_info->hash_pair_count; i++) {
+        nano_forks_export_note(exporter, tap_info->hash_pairs + i * 64, frame, NULL);
+    }
+
+    return TAP_PACKET_DONT_REDRAW;
+}
+
+static int nano_forks_side_compare (const void *a, const void *b) {
+    guint32 id_a = *(const guint32 *) a;
+    guint32 id_b = *(const guint32 *) b;
+    guint32 fork_a = nano_forks_get_side(id_a)->fork;
+    guint32 fork_b = nano_forks_get_side(id_b)->fork;
+
+    if (fork_a != fork_b) {
+        return fork_a < fork_b ? -1 : 1;
+    }
+
+    return id_a < id_b ? -1 : id_a > id_b;
+}
+
+// fork,root,hash,first_frame,frames,voters with frames and voter addresses separated by spaces
+static void nano_forks_export_write (nano_forks_export_t *exporter) {
+    static const char header[] = "fork,root,hash,first_frame,frames,voters\n";
+    char address[NANO_ADDRESS_LENGTH + 1];
+    char root[64 + 1];
+    char hash[64 + 1];
+    guint32 side_count = nano_forks_side_count();
+    guint32 *ids = g_new(guint32, side_count ? side_count : 1);
+    GString *line = g_string_new(NULL);
+    FILE *fh = ws_fopen(exporter->path, "w");
+
+    if (!fh) {
+        report_open_failure(exporter->path, errno, TRUE);
+        g_free(ids);
+        g_string_free(line, TRUE);
+        return;
+    }
+    setvbuf(fh, NULL, _IOFBF, NANO_FORKS_WRITE_BUFFER);
+    fwrite(header, 1, sizeof(header) - 1, fh);
+
+    // a third block on a root gets its id long after the first two
+    for (guint32 i = 0; i < side_count; i++) {
+        ids[i] = i + 1;
+    }
+    qsort(ids, side_count, sizeof(guint32), nano_forks_side_compare);
+
+    for (guint32 i = 0; i < side_count; i++) {
+        const nano_fork_side_t *side = nano_forks_get_side(ids[i]);
+        const nano_forks_seen_t *seen = ids[i] <= exporter->seen->len ? (const nano_forks_seen_t *) g_ptr_array_index(exporter->seen, ids[i] - 1) : NULL;
+
+        *bytes_to_hexstr(root, side->root, 32) = '\0';
+        *bytes_to_hexstr(hash, side->hash, 32) = '\0';
+        g_string_printf(line, "%u,%s,%s,%u,", side->fork, root, hash, side->first_frame);
+
+        for (guint j = 0; seen && j < seen->frames->len; j++) {
+            g_string_append_printf(line, j ? " %u" : "%u", g_array_index(seen->frames, guint32, j));
+        }
+        g_string_append_c(line, ',');
+        for (guint j = 0; seen && j < seen->voters->len; j += 32) {
+            nano_account_to_address(seen->voters->data + j, address);
+            if (j) {
+                g_string_append_c(line, ' ');
+            }
+            g_string_append(line, address);
+        }
+        g_string_append_c(line, '\n');
+
+        fwrite(line->str, 1, line->len, fh);
+    }
+
+    if (ws_fclose(fh) != 0) {
+        report_write_failure(exporter->path, errno);
+    }
+
+    g_free(ids);
+    g_string_free(line, TRUE);
+}
+
+// the sides live in file scope, so they are written while drawing, before the capture file is closed
+static void nano_forks_export_draw (void *tapdata) {
+    nano_forks_export_write((nano_forks_export_t *) tapdata);
+}
+
+static void nano_forks_export_finish (void *tapdata) {
+    nano_forks_export_t *exporter = (nano_forks_export_t *) tapdata;
+
+    g_ptr_array_free(exporter->seen, TRUE);
+    g_free(exporter->path);
+    g_free(exporter);
+}
+
+static void nano_forks_export_init (const char *opt_arg, void *userdata _U_) {
+    const char *args = opt_arg + strlen("nano,forks");
+    nano_forks_export_t *exporter;
+    GString *error_string;
+
+    if (*args != ',' || args[1] == '\0') {
+        report_failure("Usage: -z nano,forks,<output file>");
+        return;
+    }
+
+    exporter = g_new0(nano_forks_export_t, 1);
+    exporter->path = g_strdup(args + 1);
+    exporter->seen = g_ptr_array_new_with_free_func(nano_forks_seen_free);
+
+    error_string = register_tap_listener("nano", exporter, NULL, TL_REQUIRES_NOTHING, nano_forks_export_reset, nano_forks_export_packet, nano_forks_export_draw, nano_forks_export_finish);
+    if (error_string) {
+        report_failure("Couldn't register nano,forks tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        nano_forks_export_finish(exporter);
+    }
+}
+
+static stat_tap_ui nano_forks_export_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,forks",
+    nano_forks_export_init,
+    0,
+    NULL
+};
+
+void nano_register_forks(void)
+{
+    register_stat_tap_ui(&nano_forks_export_ui, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
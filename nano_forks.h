@@ -0,0 +1,63 @@
+/* nano_forks.h
+* Fork detection: different blocks on the same root
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_FORKS_H__
+#define __NANO_FORKS_H__
+
+#include <glib.h>
+
+// one of the competing blocks of a fork
+typedef struct _nano_fork_side {
+    guint8 hash[32];
+    guint8 root[32];
+    // forks are numbered from 1 in the order they were found
+    guint32 fork;
+    guint32 first_frame;
+} nano_fork_side_t;
+
+void nano_forks_reset(void);
+
+// first pass: records the first block seen on root, returns the hash of that block if this one differs
+const guint8 *nano_forks_observe(const guint8 *root, const guint8 *hash, guint32 frame, gint64 now);
+// revisits: the same answer without recording anything
+const guint8 *nano_forks_lookup(const guint8 *root, const guint8 *hash);
+
+// side id of a block hash that is part of a fork, 0 if it is not
+guint32 nano_forks_side(const guint8 *hash);
+guint32 nano_forks_side_count(void);
+const nano_fork_side_t *nano_forks_get_side(guint32 id);
+guint32 nano_forks_count(void);
+
+// bytes held by the root table, for the bounded memory mode
+gsize nano_forks_memory(void);
+// drops roots first seen more than window seconds ago, or the older half early when over_limit, returns how many
+guint32 nano_forks_expire(gint64 now, guint window, gboolean over_limit);
+
+// the root table and the sides for a sidecar, and back again; loaded roots are used in place
+guint32 nano_forks_root_record_size(void);
+void nano_forks_export(GByteArray **roots, GByteArray **sides);
+void nano_forks_load(const void *roots, guint32 root_count, const void *sides, guint32 side_count);
+
+void nano_register_forks(void);
+
+#endif /* __NANO_FORKS_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,454 @@
+/* nano_frontiers.c
+* Frontier differences between peers, by merging their frontier responses
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* A frontier response lists a peer's accounts in ascending order with the
+* hash of each account's latest block. When a node bootstraps from several
+* peers at once, merging their responses by account shows where the peers'
+* ledgers differ:
+*
+*   missing  a peer left out an account that others listed, between the first
+*            and the last account its response returned
+*   differs  a peer's frontier is not the one most peers listed
+*
+* Entries wait in a queue per response until every running response has
+* reached their account, then the smallest account is compared across all of
+* them and dropped. A response that stalls while another one runs more than
+* the window ahead is left out of the comparison until it catches up; what it
+* sends for accounts already compared is counted as late. Memory is the
+* window per peer, the responses themselves are never kept.
+*
+* Responses compared are the ones running at the same time; once all of them
+* have ended, the next ones start a new comparison. The peers are few, so the
+* smallest account is found by a scan over them.
+*
+* -z nano,frontiers,<file>[,<window>] writes the differences as they are
+* found, and a total per peer at the end.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <epan/to_str.h>
+#include <wsutil/file_util.h>
+#include <wsutil/report_message.h>
+#include <wsutil/to_str.h>
+
+#include "packet-nano.h"
+
+#define NANO_FRONTIERS_DEFAULT_WINDOW 4096
+
+#define NANO_FRONTIERS_WRITE_BUFFER (64 * 1024)
+
+// one frontier response entry
+typedef struct {
+    guint8 account[32];
+    guint8 frontier[32];
+} nano_frontier_entry_t;
+
+// the frontier responses of one bootstrap connection
+typedef struct {
+    gchar *peer;
+
+    // waiting entries start at queue_head
+    GArray *queue;
+    guint queue_head;
+
+    // the running response: first and last account it returned and whether its end was seen,
+    // a frontier_req limited by count ends long before the last account
+    gboolean running;
+    gboolean ended;
+    guint8 first[32];
+    guint8 last[32];
+
+    guint64 entries;
+    guint64 missing;
+    guint64 differs;
+    guint64 late;
+} nano_frontier_stream_t;
+
+typedef struct {
+    gchar *path;
+    FILE *fh;
+    guint window;
+
+    // by conversation index
+    GHashTable *streams;
+    GPtrArray *stream_list;
+
+    // every account up to this one has been compared
+    gboolean merged_any;
+    guint8 merged[32];
+
+    GString *line;
+} nano_frontiers_t;
+
+static guint nano_frontier_stream_length (const nano_frontier_stream_t *stream) {
+    return stream->queue->len - stream->queue_head;
+}
+
+static const nano_frontier_entry_t *nano_frontier_stream_head (const nano_frontier_stream_t *stream) {
+    return nano_frontier_stream_length(stream) ? &g_array_index(stream->queue, nano_frontier_entry_t, stream->queue_head) : NULL;
+}
+
+static void nano_frontier_stream_pop (nano_frontier_stream_t *stream) {
+    stream->queue_head++;
+
+    // compacted once half of it is consumed, the queue never holds much more than the window
+    if (stream->queue_head == stream->queue->len) {
+        g_array_set_size(stream->queue, 0);
+        stream->queue_head = 0;
+    } else if (stream->queue_head > stream->queue->len / 2) {
+        g_array_remove_range(stream->queue, 0, stream->queue_head);
+        stream->queue_head = 0;
+    }
+}
+
+// the account lies between the first and the last account the running response returned
+static gboolean nano_frontier_stream_covers (const nano_frontier_stream_t *stream, const guint8 *account) {
+    return stream->running && memcmp(stream->first, account, 32) <= 0 && memcmp(account, stream->last, 32) <= 0;
+}
+
+static void nano_frontiers_write_difference (nano_frontiers_t *frontiers, const nano_frontier_stream_t *stream, const char *kind, const guint8 *account, const guint8 *frontier, const guint8 *expected) {
+    char address[NANO_ADDRESS_LENGTH + 1];
+    char hash[64 + 1];
+
+    if (!frontiers->fh) {
+        return;
+    }
+
+    nano_account_to_address(account, address);
+    g_string_printf(frontiers->line, "%s,%s,%s,", stream->peer, kind, address);
+    if (frontier) {
+        *bytes_to_hexstr(hash, frontier, 32) = '\0';
+        g_string_append(frontiers->line, hash);
+    }
+    g_string_append_c(frontiers->line, ',');
+    *bytes_to_hexstr(hash, expected, 32) = '\0';
+    g_string_append_printf(frontiers->line, "%s,\n", hash);
+
+    fwrite(frontiers->line->str, 1, frontiers->line->len, frontiers->fh);
+}
+
+// the frontier most of the peers that listed account agree on
+static const guint8 *nano_frontiers_majority (nano_frontiers_t *frontiers, const guint8 *account) {
+    const guint8 *majority = NULL;
+    guint majority_votes = 0;
+
+    for (guint i = 0; i < frontiers->stream_list->len; i++) {
+        const nano_frontier_entry_t *head = nano_frontier_stream_head((nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, i));
+        guint votes = 0;
+
+        if (!head || memcmp(head->account, account, 32)) {
+            continue;
+        }
+        for (guint j = 0; j < frontiers->stream_list->len; j++) {
+            const nano_frontier_entry_t *other = nano_frontier_stream_head((nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, j));
+
+            if (other && !memcmp(other->account, account, 32) && !memcmp(other->frontier, head->frontier, 32)) {
+                votes++;
+            }
+        }
+        if (votes > majority_votes) {
+            majority = head->frontier;
+            majority_votes = votes;
+        }
+    }
+
+    return majority;
+}
+
+// compares the smallest waiting account across the responses, FALSE if it has to wait for more entries
+static gboolean nano_frontiers_merge_one (nano_frontiers_t *frontiers, gboolean flush) {
+    const guint8 *account = NULL;
+    gboolean over_window = FALSE;
+    guint running = 0;
+    guint covering = 0;
+
+    for (guint i = 0; i < frontiers->stream_list->len; i++) {
+        const nano_frontier_stream_t *stream = (const nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, i);
+        const nano_frontier_entry_t *head = nano_frontier_stream_head(stream);
+
+        if (head && (!account || memcmp(head->account, account, 32) < 0)) {
+            account = head->account;
+        }
+        over_window |= nano_frontier_stream_length(stream) > frontiers->window;
+        running += stream->running;
+    }
+
+    if (!account) {
+        return FALSE;
+    }
+
+    // a single response waits for another peer to start, up to the window
+    if (!flush && !over_window && running < 2) {
+        return FALSE;
+    }
+
+    // a running response without waiting entries may still list the account
+    for (guint i = 0; !flush && !over_window && i < frontiers->stream_list->len; i++) {
+        const nano_frontier_stream_t *stream = (const nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, i);
+
+        if (stream->running && !stream->ended && !nano_frontier_stream_length(stream)) {
+            return FALSE;
+        }
+    }
+
+    // responses whose returned range holds the account
+    for (guint i = 0; i < frontiers->stream_list->len; i++) {
+        covering += nano_frontier_stream_covers((const nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, i), account);
+    }
+
+    guint8 merged[32];
+    guint8 majority[32];
+
+    memcpy(merged, account, 32);
+    memcpy(majority, nano_frontiers_majority(frontiers, merged), 32);
+
+    for (guint i = 0; i < frontiers->stream_list->len; i++) {
+        nano_frontier_stream_t *stream = (nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, i);
+        const nano_frontier_entry_t *head = nano_frontier_stream_head(stream);
+
+        if (head && !memcmp(head->account, merged, 32)) {
+            if (covering > 1 && memcmp(head->frontier, majority, 32)) {
+                stream->differs++;
+                nano_frontiers_write_difference(frontiers, stream, "differs", merged, head->frontier, majority);
+            }
+            nano_frontier_stream_pop(stream);
+        } else if (covering > 1 && nano_frontier_stream_covers(stream, merged)) {
+            stream->missing++;
+            nano_frontiers_write_difference(frontiers, stream, "missing", merged, NULL, majority);
+        }
+    }
+
+    frontiers->merged_any = TRUE;
+    memcpy(frontiers->merged, merged, 32);
+
+    return TRUE;
+}
+
+static void nano_frontiers_merge (nano_frontiers_t *frontiers, gboolean flush) {
+    while (nano_frontiers_merge_one(frontiers, flush)) {
+    }
+
+    for (guint i = 0; i < frontiers->stream_list->len; i++) {
+        const nano_frontier_stream_t *stream = (const nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, i);
+
+        if (stream->running && !stream->ended) {
+            return;
+        }
+    }
+
+    // every response has ended, the next ones are a new bootstrap attempt and compared among themselves
+    while (nano_frontiers_merge_one(frontiers, TRUE)) {
+    }
+    for (guint i = 0; i < frontiers->stream_list->len; i++) {
+        ((nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, i))->running = FALSE;
+    }
+    frontiers->merged_any = FALSE;
+}
+
+static nano_frontier_stream_t *nano_frontiers_stream (nano_frontiers_t *frontiers, packet_info *pinfo, guint32 conversation) {
+    nano_frontier_stream_t *stream = (nano_frontier_stream_t *) g_hash_table_lookup(frontiers->streams, GUINT_TO_POINTER(conversation));
+
+    if (stream) {
+        return stream;
+    }
+
+    // frontier responses come from the server
+    gchar *address = address_to_str(NULL, &pinfo->src);
+
+    stream = g_new0(nano_frontier_stream_t, 1);
+    stream->peer = g_strdup_printf("%s:%u", address, pinfo->srcport);
+    stream->queue = g_array_new(FALSE, FALSE, sizeof(nano_frontier_entry_t));
+    wmem_free(NULL, address);
+
+    g_hash_table_insert(frontiers->streams, GUINT_TO_POINTER(conversation), stream);
+    g_ptr_array_add(frontiers->stream_list, stream);
+
+    return stream;
+}
+
+static tap_packet_status nano_frontiers_packet (void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    nano_frontiers_t *frontiers = (nano_frontiers_t *) tapdata;
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+    nano_frontier_stream_t *stream;
+    nano_frontier_entry_t entry;
+    static const guint8 zero[32 + 32];
+
+    if (!tap_info->frontier) {
+        return TAP_PACKET_DONT_REDRAW;
+    }
+
+    stream = nano_frontiers_stream(frontiers, pinfo, tap_info->conversation);
+
+    if (!memcmp(tap_info->frontier, zero, sizeof(zero))) {
+        stream->ended = TRUE;
+        nano_frontiers_merge(frontiers, FALSE);
+        return TAP_PACKET_DONT_REDRAW;
+    }
+
+    memcpy(entry.account, tap_info->frontier, 32);
+    memcpy(entry.frontier, tap_info->frontier + 32, 32);
+    stream->entries++;
+
+    // the next frontier_req on the connection, entries the last one left waiting are dropped since
+    // the new response starts over from a lower account and would put the queue out of order
+    if (stream->ended || !stream->running) {
+        g_array_set_size(stream->queue, 0);
+        stream->queue_head = 0;
+        stream->running = TRUE;
+        stream->ended = FALSE;
+        memcpy(stream->first, entry.account, 32);
+    }
+    memcpy(stream->last, entry.account, 32);
+
+    if (frontiers->merged_any && memcmp(entry.account, frontiers->merged, 32) <= 0) {
+        stream->late++;
+        return TAP_PACKET_DONT_REDRAW;
+    }
+
+    g_array_append_val(stream->queue, entry);
+    nano_frontiers_merge(frontiers, FALSE);
+
+    return TAP_PACKET_DONT_REDRAW;
+}
+
+static void nano_frontiers_stream_free (gpointer data) {
+    nano_frontier_stream_t *stream = (nano_frontier_stream_t *) data;
+
+    g_array_free(stream->queue, TRUE);
+    g_free(stream->peer);
+    g_free(stream);
+}
+
+static void nano_frontiers_reset (void *tapdata) {
+    nano_frontiers_t *frontiers = (nano_frontiers_t *) tapdata;
+
+    g_hash_table_remove_all(frontiers->streams);
+    g_ptr_array_set_size(frontiers->stream_list, 0);
+    frontiers->merged_any = FALSE;
+}
+
+// the rest of every queue, then peer,total,,,,<divergence> and peer,late,,,,<count> for each peer
+static void nano_frontiers_draw (void *tapdata) {
+    nano_frontiers_t *frontiers = (nano_frontiers_t *) tapdata;
+
+    if (!frontiers->fh) {
+        return;
+    }
+
+    nano_frontiers_merge(frontiers, TRUE);
+
+    for (guint i = 0; i < frontiers->stream_list->len; i++) {
+        const nano_frontier_stream_t *stream = (const nano_frontier_stream_t *) g_ptr_array_index(frontiers->stream_list, i);
+
+        g_string_printf(frontiers->line, "%s,total,,,,%" G_GUINT64_FORMAT "\n", stream->peer, stream->missing + stream->differs);
+        if (stream->late) {
+            g_string_append_printf(frontiers->line, "%s,late,,,,%" G_GUINT64_FORMAT "\n", stream->peer, stream->late);
+        }
+        fwrite(frontiers->line->str, 1, frontiers->line->len, frontiers->fh);
+    }
+
+    if (ws_fclose(frontiers->fh) != 0) {
+        report_write_failure(frontiers->path, errno);
+    }
+    frontiers->fh = NULL;
+}
+
+static void nano_frontiers_finish (void *tapdata) {
+    nano_frontiers_t *frontiers = (nano_frontiers_t *) tapdata;
+
+    if (frontiers->fh) {
+        ws_fclose(frontiers->fh);
+    }
+    g_ptr_array_free(frontiers->stream_list, TRUE);
+    g_hash_table_destroy(frontiers->streams);
+    g_string_free(frontiers->line, TRUE);
+    g_free(frontiers->path);
+    g_free(frontiers);
+}
+
+static void nano_frontiers_init (const char *opt_arg, void *userdata _U_) {
+    static const char header[] = "peer,kind,account,frontier,expected,count\n";
+    const char *args = opt_arg + strlen("nano,frontiers");
+    nano_frontiers_t *frontiers;
+    GString *error_string;
+    gchar **fields;
+
+    if (*args != ',' || args[1] == '\0') {
+        report_failure("Usage: -z nano,frontiers,<output file>[,<entries waiting per peer>]");
+        return;
+    }
+
+    fields = g_strsplit(args + 1, ",", 2);
+
+    frontiers = g_new0(nano_frontiers_t, 1);
+    frontiers->path = g_strdup(fields[0]);
+    frontiers->window = fields[1] ? (guint) strtoul(fields[1], NULL, 10) : NANO_FRONTIERS_DEFAULT_WINDOW;
+    frontiers->streams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, nano_frontiers_stream_free);
+    frontiers->stream_list = g_ptr_array_new();
+    frontiers->line = g_string_new(NULL);
+    g_strfreev(fields);
+
+    if (frontiers->window == 0) {
+        frontiers->window = NANO_FRONTIERS_DEFAULT_WINDOW;
+    }
+
+    // differences are written as they are found
+    frontiers->fh = ws_fopen(frontiers->path, "w");
+    if (!frontiers->fh) {
+        report_open_failure(frontiers->path, errno, TRUE);
+        nano_frontiers_finish(frontiers);
+        return;
+    }
+    setvbuf(frontiers->fh, NULL, _IOFBF, NANO_FRONTIERS_WRITE_BUFFER);
+    fwrite(header, 1, sizeof(header) - 1, frontiers->fh);
+
+    error_string = register_tap_listener("nano", frontiers, NULL, TL_REQUIRES_NOTHING, nano_frontiers_reset, nano_frontiers_packet, nano_frontiers_draw, nano_frontiers_finish);
+    if (error_string) {
+        report_failure("Couldn't register nano,frontiers tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        nano_frontiers_finish(frontiers);
+    }
+}
+
+static stat_tap_ui nano_frontiers_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,frontiers",
+    nano_frontiers_init,
+    0,
+    NULL
+};
+
+void nano_register_frontiers(void)
+{
+    register_stat_tap_ui(&nano_frontiers_ui, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,258 @@
+/* nano_heavyhitters.c
+* Peers sending the most bytes and messages, in fixed memory
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* -z nano,heavyhitters,<file>[,<k>[,<epsilon>[,<delta>]]] ranks the sending
+* peer endpoints of each class of messages (votes, publishes, bootstrap,
+* keepalives, telemetry) by bytes and by messages and writes the top k of
+* each ranking.
+*
+* Every ranking is a nano_topk sketch keyed by the peer endpoint, so memory
+* is set by epsilon and delta and stays the same however many peers show up.
+* A count is at most epsilon times the class total too high, the max_error
+* column has the bound for each entry. Headerless bootstrap payloads count
+* for the bootstrap class, data skipped while resynchronizing for none.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <wsutil/file_util.h>
+#include <wsutil/report_message.h>
+
+#include "packet-nano.h"
+#include "nano_topk.h"
+
+#define NANO_HEAVYHITTERS_DEFAULT_K 20
+#define NANO_HEAVYHITTERS_DEFAULT_EPSILON 0.001
+#define NANO_HEAVYHITTERS_DEFAULT_DELTA 0.01
+
+enum {
+    NANO_HEAVYHITTERS_VOTES,
+    NANO_HEAVYHITTERS_PUBLISHES,
+    NANO_HEAVYHITTERS_BOOTSTRAP,
+    NANO_HEAVYHITTERS_KEEPALIVE,
+    NANO_HEAVYHITTERS_TELEMETRY,
+    NANO_HEAVYHITTERS_CLASSES
+};
+
+static const char *nano_heavyhitters_classes[NANO_HEAVYHITTERS_CLASSES] = { "votes", "publishes", "bootstrap", "keepalive", "telemetry" };
+
+enum {
+    NANO_HEAVYHITTERS_BYTES,
+    NANO_HEAVYHITTERS_MESSAGES,
+    NANO_HEAVYHITTERS_RANKINGS
+};
+
+static const char *nano_heavyhitters_rankings[NANO_HEAVYHITTERS_RANKINGS] = { "bytes", "messages" };
+
+// sketch key, zero padded so equal endpoints compare equal
+typedef struct {
+    guint8 address_type;
+    guint8 address_length;
+    guint16 port;
+    guint8 address[16];
+} nano_heavyhitters_peer_t;
+
+typedef struct {
+    gchar *path;
+    guint k;
+    nano_topk_t *sketches[NANO_HEAVYHITTERS_CLASSES][NANO_HEAVYHITTERS_RANKINGS];
+} nano_heavyhitters_t;
+
+static int nano_heavyhitters_class (guint8 packet_type) {
+    switch (packet_type) {
+        case NANO_PACKET_TYPE_CONFIRM_ACK:
+            return NANO_HEAVYHITTERS_VOTES;
+        case NANO_PACKET_TYPE_PUBLISH:
+            return NANO_HEAVYHITTERS_PUBLISHES;
+        case NANO_PACKET_TYPE_BULK_PULL:
+        case NANO_PACKET_TYPE_BULK_PUSH:
+        case NANO_PACKET_TYPE_FRONTIER_REQ:
+        case NANO_PACKET_TYPE_BULK_PULL_BLOCKS:
+        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
+        case NANO_PACKET_TYPE_ASC_PULL_REQ:
+        case NANO_PACKET_TYPE_ASC_PULL_ACK:
+            return NANO_HEAVYHITTERS_BOOTSTRAP;
+        case NANO_PACKET_TYPE_KEEPALIVE:
+            return NANO_HEAVYHITTERS_KEEPALIVE;
+        case NANO_PACKET_TYPE_TELEMETRY_REQ:
+        case NANO_PACKET_TYPE_TELEMETRY_ACK:
+            return NANO_HEAVYHITTERS_TELEMETRY;
+    }
+
+    return -1;
+}
+
+static tap_packet_status nano_heavyhitters_packet (void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    nano_heavyhitters_t *heavyhitters = (nano_heavyhitters_t *) tapdata;
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+    int class = nano_heavyhitters_class(tap_info->packet_type);
+    nano_heavyhitters_peer_t peer;
+
+    if (class < 0) {
+        return TAP_PACKET_DONT_REDRAW;
+    }
+
+    memset(&peer, 0, sizeof(peer));
+    peer.address_type = (guint8) pinfo->src.type;
+    peer.address_length = (guint8) MIN(pinfo->src.len, (int) sizeof(peer.address));
+    peer.port = (guint16) pinfo->srcport;
+    if (peer.address_length) {
+        memcpy(peer.address, pinfo->src.data, peer.address_length);
+    }
+
+    nano_topk_add(heavyhitters->sketches[class][NANO_HEAVYHITTERS_BYTES], &peer, tap_info->length);
+    nano_topk_add(heavyhitters->sketches[class][NANO_HEAVYHITTERS_MESSAGES], &peer, 1);
+
+    return TAP_PACKET_DONT_REDRAW;
+}
+
+static void nano_heavyhitters_reset (void *tapdata) {
+    nano_heavyhitters_t *heavyhitters = (nano_heavyhitters_t *) tapdata;
+
+    for (int class = 0; class < NANO_HEAVYHITTERS_CLASSES; class++) {
+        for (int ranking = 0; ranking < NANO_HEAVYHITTERS_RANKINGS; ranking++) {
+            nano_topk_reset(heavyhitters->sketches[class][ranking]);
+        }
+    }
+}
+
+// class,ranking,rank,peer,count,max_error for the top k of every ranking
+static void nano_heavyhitters_draw (void *tapdata) {
+    static const char header[] = "class,ranking,rank,peer,count,max_error\n";
+    nano_heavyhitters_t *heavyhitters = (nano_heavyhitters_t *) tapdata;
+    nano_topk_entry_t *entries = g_new(nano_topk_entry_t, heavyhitters->k);
+    GString *line = g_string_new(NULL);
+    FILE *fh = ws_fopen(heavyhitters->path, "w");
+
+    if (!fh) {
+        report_open_failure(heavyhitters->path, errno, TRUE);
+        g_string_free(line, TRUE);
+        g_free(entries);
+        return;
+    }
+
+    fwrite(header, 1, sizeof(header) - 1, fh);
+
+    for (int class = 0; class < NANO_HEAVYHITTERS_CLASSES; class++) {
+        for (int ranking = 0; ranking < NANO_HEAVYHITTERS_RANKINGS; ranking++) {
+            guint count = nano_topk_top(heavyhitters->sketches[class][ranking], heavyhitters->k, entries);
+
+            g_string_truncate(line, 0);
+            for (guint i = 0; i < count; i++) {
+                const nano_heavyhitters_peer_t *peer = (const nano_heavyhitters_peer_t *) entries[i].key;
+                address peer_address;
+                gchar *address_string;
+
+                set_address(&peer_address, peer->address_type, peer->address_length, peer->address);
+                address_string = address_to_str(NULL, &peer_address);
+                g_string_append_printf(line, "%s,%s,%u,%s%s%s:%u,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT "\n",
+                                       nano_heavyhitters_classes[class], nano_heavyhitters_rankings[ranking], i + 1,
+                                       peer->address_type == AT_IPv6 ? "[" : "", address_string, peer->address_type == AT_IPv6 ? "]" : "",
+                                       peer->port, entries[i].count, entries[i].error);
+                wmem_free(NULL, address_string);
+            }
+            fwrite(line->str, 1, line->len, fh);
+        }
+    }
+
+    if (ws_fclose(fh) != 0) {
+        report_write_failure(heavyhitters->path, errno);
+    }
+
+    g_string_free(line, TRUE);
+    g_free(entries);
+}
+
+static void nano_heavyhitters_finish (void *tapdata) {
+    nano_heavyhitters_t *heavyhitters = (nano_heavyhitters_t *) tapdata;
+
+    for (int class = 0; class < NANO_HEAVYHITTERS_CLASSES; class++) {
+        for (int ranking = 0; ranking < NANO_HEAVYHITTERS_RANKINGS; ranking++) {
+            nano_topk_free(heavyhitters->sketches[class][ranking]);
+        }
+    }
+    g_free(heavyhitters->path);
+    g_free(heavyhitters);
+}
+
+static void nano_heavyhitters_init (const char *opt_arg, void *userdata _U_) {
+    const char *args = opt_arg + strlen("nano,heavyhitters");
+    nano_heavyhitters_t *heavyhitters;
+    GString *error_string;
+    gchar **fields;
+    double epsilon, delta;
+
+    if (*args != ',' || args[1] == '\0') {
+        report_failure("Usage: -z nano,heavyhitters,<output file>[,<top k>[,<epsilon>[,<delta>]]]");
+        return;
+    }
+
+    fields = g_strsplit(args + 1, ",", 4);
+
+    heavyhitters = g_new0(nano_heavyhitters_t, 1);
+    heavyhitters->path = g_strdup(fields[0]);
+    heavyhitters->k = fields[1] ? (guint) strtoul(fields[1], NULL, 10) : NANO_HEAVYHITTERS_DEFAULT_K;
+    epsilon = fields[1] && fields[2] ? g_ascii_strtod(fields[2], NULL) : NANO_HEAVYHITTERS_DEFAULT_EPSILON;
+    delta = fields[1] && fields[2] && fields[3] ? g_ascii_strtod(fields[3], NULL) : NANO_HEAVYHITTERS_DEFAULT_DELTA;
+    g_strfreev(fields);
+
+    if (heavyhitters->k == 0) {
+        heavyhitters->k = NANO_HEAVYHITTERS_DEFAULT_K;
+    }
+
+    // nano_topk_new falls back to its own defaults for values out of range
+    for (int class = 0; class < NANO_HEAVYHITTERS_CLASSES; class++) {
+        for (int ranking = 0; ranking < NANO_HEAVYHITTERS_RANKINGS; ranking++) {
+            heavyhitters->sketches[class][ranking] = nano_topk_new(sizeof(nano_heavyhitters_peer_t), epsilon, delta);
+        }
+    }
+
+    error_string = register_tap_listener("nano", heavyhitters, NULL, TL_REQUIRES_NOTHING, nano_heavyhitters_reset, nano_heavyhitters_packet, nano_heavyhitters_draw, nano_heavyhitters_finish);
+    if (error_string) {
+        report_failure("Couldn't register nano,heavyhitters tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        nano_heavyhitters_finish(heavyhitters);
+    }
+}
+
+static stat_tap_ui nano_heavyhitters_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,heavyhitters",
+    nano_heavyhitters_init,
+    0,
+    NULL
+};
+
+void nano_register_heavyhitters(void)
+{
+    register_stat_tap_ui(&nano_heavyhitters_ui, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
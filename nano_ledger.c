@@ -0,0 +1,198 @@
+/* nano_ledger.c
+* Ledger snapshot: which blocks our own node knows and has confirmed
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* A snapshot lists the block hashes in the ledger of our own node, exported
+* from it, so blocks and votes in a capture can be told apart as known,
+* unknown or already confirmed there. It is written once by the node, so its
+* header is little endian whatever machine reads it:
+*
+*   magic    "NANOLDG" and a NUL
+*   version  guint32, 1
+*   reserved guint32
+*   count    guint64
+*   reserved guint64
+*   hashes   count x 32 bytes, sorted in byte order
+*   flags    count x 1 byte, bit 0 set for a confirmed block
+*
+* Snapshots run to hundreds of millions of hashes, so the file is memory
+* mapped and searched in place; only the pages a lookup touches are read.
+* Block hashes are uniformly distributed, so a few interpolation steps on
+* their first 8 bytes land next to the hash, and a binary search without
+* branches finishes within what is left.
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include <epan/packet.h>
+#include <wsutil/pint.h>
+#include <wsutil/report_message.h>
+
+#include "nano_ledger.h"
+
+#define NANO_LEDGER_MAGIC "NANOLDG"
+#define NANO_LEDGER_VERSION 1
+#define NANO_LEDGER_HEADER_SIZE 32
+
+#define NANO_LEDGER_FLAG_CONFIRMED 0x01
+
+// interpolation stops after this many steps, or once the range is short enough to bisect
+#define NANO_LEDGER_INTERPOLATION_STEPS 4
+#define NANO_LEDGER_BISECT_SPAN 64
+
+// keys compared when a snapshot is mapped, a cheap check that it is sorted
+#define NANO_LEDGER_ORDER_SAMPLES 1024
+
+static struct {
+    gchar *path;
+    GMappedFile *mapped;
+
+    guint64 count;
+    const guint8 *hashes;
+    const guint8 *flags;
+} nano_ledger;
+
+static inline guint64 nano_ledger_key (guint64 i) {
+    return pntoh64(nano_ledger.hashes + i * 32);
+}
+
+static void nano_ledger_unmap (void) {
+    if (nano_ledger.mapped) {
+        g_mapped_file_unref(nano_ledger.mapped);
+    }
+    g_free(nano_ledger.path);
+    memset(&nano_ledger, 0, sizeof(nano_ledger));
+}
+
+static gboolean nano_ledger_use (const guint8 *data, gsize length) {
+    guint64 count;
+
+    if (length < NANO_LEDGER_HEADER_SIZE || memcmp(data, NANO_LEDGER_MAGIC, sizeof(NANO_LEDGER_MAGIC)) ||
+            pletoh32(data + 8) != NANO_LEDGER_VERSION) {
+        return FALSE;
+    }
+
+    count = pletoh64(data + 16);
+    if (count > (length - NANO_LEDGER_HEADER_SIZE) / 33 || count * 33 != length - NANO_LEDGER_HEADER_SIZE) {
+        return FALSE;
+    }
+
+    nano_ledger.hashes = data + NANO_LEDGER_HEADER_SIZE;
+    nano_ledger.flags = nano_ledger.hashes + count * 32;
+
+    // reading every key would page in the whole file, a sample catches a snapshot that was not sorted
+    guint64 stride = MAX(count / NANO_LEDGER_ORDER_SAMPLES, 1);
+    for (guint64 i = stride; i < count; i += stride) {
+        if (nano_ledger_key(i - stride) > nano_ledger_key(i)) {
+            return FALSE;
+        }
+    }
+
+    nano_ledger.count = count;
+
+    return TRUE;
+}
+
+void nano_ledger_load (const char *path) {
+    GError *error = NULL;
+
+    if (!path || !*path) {
+        nano_ledger_unmap();
+        return;
+    }
+    if (nano_ledger.path && !strcmp(nano_ledger.path, path)) {
+        return;
+    }
+
+    nano_ledger_unmap();
+    nano_ledger.path = g_strdup(path);
+
+    nano_ledger.mapped = g_mapped_file_new(path, FALSE, &error);
+    if (!nano_ledger.mapped) {
+        report_failure("Couldn't open Nano ledger snapshot %s: %s", path, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    if (!nano_ledger_use((const guint8 *) g_mapped_file_get_contents(nano_ledger.mapped), g_mapped_file_get_length(nano_ledger.mapped))) {
+        report_failure("%s is not a Nano ledger snapshot, or its hashes are not sorted", path);
+        g_mapped_file_unref(nano_ledger.mapped);
+        nano_ledger.mapped = NULL;
+    }
+}
+
+guint64 nano_ledger_count (void) {
+    return nano_ledger.count;
+}
+
+nano_ledger_status_t nano_ledger_lookup (const guint8 *hash) {
+    guint64 key = pntoh64(hash);
+    guint64 low = 0, high = nano_ledger.count;
+
+    if (!nano_ledger.count) {
+        return NANO_LEDGER_UNKNOWN;
+    }
+
+    // the first hash not below key stays within [low, high)
+    for (int step = 0; step < NANO_LEDGER_INTERPOLATION_STEPS && high - low > NANO_LEDGER_BISECT_SPAN; step++) {
+        guint64 first = nano_ledger_key(low);
+        guint64 last = nano_ledger_key(high - 1);
+
+        if (key < first || key > last) {
+            return NANO_LEDGER_UNKNOWN;
+        }
+        if (first == last) {
+            break;
+        }
+
+        guint64 probe = low + (guint64) ((gdouble) (key - first) / (gdouble) (last - first) * (gdouble) (high - 1 - low));
+
+        if (nano_ledger_key(probe) < key) {
+            low = probe + 1;
+        } else {
+            high = probe + 1;
+        }
+    }
+
+    // lower bound, the compiler turns the select into a conditional move
+    guint64 base = low, remaining = high - low;
+
+    while (remaining > 1) {
+        guint64 half = remaining / 2;
+
+        base = nano_ledger_key(base + half - 1) < key ? base + half : base;
+        remaining -= half;
+    }
+    base += nano_ledger_key(base) < key;
+
+    // 8 byte prefixes may collide, the whole hash decides
+    for (guint64 i = base; i < nano_ledger.count && nano_ledger_key(i) == key; i++) {
+        if (!memcmp(nano_ledger.hashes + i * 32, hash, 32)) {
+            return nano_ledger.flags[i] & NANO_LEDGER_FLAG_CONFIRMED ? NANO_LEDGER_CONFIRMED : NANO_LEDGER_KNOWN;
+        }
+    }
+
+    return NANO_LEDGER_UNKNOWN;
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,43 @@
+/* nano_ledger.h
+* Ledger snapshot: which blocks our own node knows and has confirmed
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_LEDGER_H__
+#define __NANO_LEDGER_H__
+
+#include <glib.h>
+
+typedef enum {
+    NANO_LEDGER_UNKNOWN,
+    NANO_LEDGER_KNOWN,
+    NANO_LEDGER_CONFIRMED
+} nano_ledger_status_t;
+
+// maps a snapshot, replacing the current one; an empty path unmaps it
+void nano_ledger_load(const char *path);
+
+// hashes in the mapped snapshot, 0 when there is none
+guint64 nano_ledger_count(void);
+
+nano_ledger_status_t nano_ledger_lookup(const guint8 *hash);
+
+#endif /* __NANO_LEDGER_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,386 @@
+/* nano_nodeids.c
+* Node ID registry: node IDs learned from handshakes, by endpoint
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* A node_id_handshake response carries the node ID of whoever sent it. The
+* dissector keeps it with the conversation, and hands it here together with
+* the endpoint it came from. The listening side of a connection is known by
+* address and port; the connecting side uses a new port every time, so it is
+* known by its address alone, port 0.
+*
+* With the nano.node_registry preference set, the node IDs are also looked up
+* in a registry file, so connections whose handshake was not captured get
+* them too. With nano.node_registry_update on, what the first pass learned is
+* merged into that file at the end of the pass. The file is memory mapped and
+* used as it is, in host byte order:
+*
+*   header
+*   records  IPv6 or IPv4 mapped address, port, node ID, first and last seen,
+*            sorted by address and port
+*
+* A lookup binary searches the records; the node ID last seen at an endpoint
+* replaces an older one when the files are merged.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <wsutil/file_util.h>
+#include <wsutil/report_message.h>
+
+#include "nano_nodeids.h"
+
+#define NANO_NODEIDS_MAGIC "NANONID"
+#define NANO_NODEIDS_VERSION 1
+#define NANO_NODEIDS_BYTE_ORDER 0x01020304
+
+struct nano_nodeids_header {
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 count;
+    guint32 reserved;
+};
+
+struct nano_nodeid_record {
+    guint8 address[16];
+    guint32 port;
+    guint32 reserved;
+    guint8 node_id[32];
+    gint64 first_seen;
+    gint64 last_seen;
+};
+
+// the mapped registry, and the node IDs learned since the last reset
+static struct {
+    gchar *path;
+    GMappedFile *mapped;
+
+    guint32 count;
+    const struct nano_nodeid_record *records;
+
+    GHashTable *learned;
+    gboolean dirty;
+} nano_registry;
+
+static int nano_nodeids_compare (const void *a, const void *b) {
+    const struct nano_nodeid_record *x = (const struct nano_nodeid_record *) a;
+    const struct nano_nodeid_record *y = (const struct nano_nodeid_record *) b;
+    int order = memcmp(x->address, y->address, sizeof(x->address));
+
+    if (order) {
+        return order;
+    }
+    if (x->port != y->port) {
+        return x->port < y->port ? -1 : 1;
+    }
+
+    // the most recent last, merging keeps it
+    return x->last_seen < y->last_seen ? -1 : x->last_seen > y->last_seen;
+}
+
+static guint nano_nodeids_hash (gconstpointer key) {
+    const struct nano_nodeid_record *record = (const struct nano_nodeid_record *) key;
+    guint32 hash = 0x811c9dc5 ^ record->port;
+
+    for (int i = 0; i < 16; i++) {
+        hash = (hash ^ record->address[i]) * 0x01000193;
+    }
+
+    return hash;
+}
+
+static gboolean nano_nodeids_equal (gconstpointer a, gconstpointer b) {
+    const struct nano_nodeid_record *x = (const struct nano_nodeid_record *) a;
+    const struct nano_nodeid_record *y = (const struct nano_nodeid_record *) b;
+
+    return x->port == y->port && !memcmp(x->address, y->address, sizeof(x->address));
+}
+
+// IPv4 addresses are stored IPv4 mapped, other address types are not kept
+static gboolean nano_nodeids_address (const address *addr, guint8 *mapped) {
+    if (addr->type == AT_IPv4 && addr->len == 4) {
+        memset(mapped, 0, 10);
+        mapped[10] = mapped[11] = 0xff;
+        memcpy(mapped + 12, addr->data, 4);
+        return TRUE;
+    }
+    if (addr->type == AT_IPv6 && addr->len == 16) {
+        memcpy(mapped, addr->data, 16);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+//
+// Mapped registry
+//
+static void nano_nodeids_unmap (void) {
+    if (nano_registry.mapped) {
+        g_mapped_file_unref(nano_registry.mapped);
+    }
+    nano_registry.mapped = NULL;
+    nano_registry.records = NULL;
+    nano_registry.count = 0;
+}
+
+static gboolean nano_nodeids_use (const guint8 *data, gsize length) {
+    const struct nano_nodeids_header *header = (const struct nano_nodeids_header *) data;
+
+    if (length < sizeof(*header) || memcmp(header->magic, NANO_NODEIDS_MAGIC, sizeof(NANO_NODEIDS_MAGIC)) ||
+            header->version != NANO_NODEIDS_VERSION || header->byte_order != NANO_NODEIDS_BYTE_ORDER ||
+            (length - sizeof(*header)) / sizeof(struct nano_nodeid_record) != header->count ||
+            (length - sizeof(*header)) % sizeof(struct nano_nodeid_record) != 0) {
+        return FALSE;
+    }
+
+    const struct nano_nodeid_record *records = (const struct nano_nodeid_record *) (data + sizeof(*header));
+
+    // the search relies on the order, and on every endpoint appearing once
+    for (guint32 i = 1; i < header->count; i++) {
+        if (memcmp(records[i - 1].address, records[i].address, 16) > 0 ||
+                (!memcmp(records[i - 1].address, records[i].address, 16) && records[i - 1].port >= records[i].port)) {
+            return FALSE;
+        }
+    }
+
+    nano_registry.records = records;
+    nano_registry.count = header->count;
+
+    return TRUE;
+}
+
+static void nano_nodeids_map (void) {
+    GError *error = NULL;
+
+    nano_registry.mapped = g_mapped_file_new(nano_registry.path, FALSE, &error);
+    if (!nano_registry.mapped) {
+        // a registry still to be written by nano.node_registry_update
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            report_failure("Couldn't open Nano node registry %s: %s", nano_registry.path, error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+
+    if (!nano_nodeids_use((const guint8 *) g_mapped_file_get_contents(nano_registry.mapped), g_mapped_file_get_length(nano_registry.mapped))) {
+        report_failure("Nano node registry %s is damaged or was written on a machine of another byte order", nano_registry.path);
+        nano_nodeids_unmap();
+    }
+}
+
+void nano_nodeids_load (const char *path) {
+    if (!path || !*path) {
+        nano_nodeids_unmap();
+        g_free(nano_registry.path);
+        nano_registry.path = NULL;
+        return;
+    }
+    if (nano_registry.path && !strcmp(nano_registry.path, path)) {
+        return;
+    }
+
+    nano_nodeids_unmap();
+    g_free(nano_registry.path);
+    nano_registry.path = g_strdup(path);
+
+    nano_nodeids_map();
+}
+
+//
+// Learned node IDs
+//
+void nano_nodeids_reset (void) {
+    if (!nano_registry.learned) {
+        nano_registry.learned = g_hash_table_new_full(nano_nodeids_hash, nano_nodeids_equal, g_free, NULL);
+    }
+
+    g_hash_table_remove_all(nano_registry.learned);
+    nano_registry.dirty = FALSE;
+}
+
+void nano_nodeids_observe (const address *addr, guint32 port, const guint8 *node_id, const nstime_t *when) {
+    struct nano_nodeid_record key, *record;
+
+    memset(&key, 0, sizeof(key));
+    if (!nano_registry.learned || !nano_nodeids_address(addr, key.address)) {
+        return;
+    }
+    key.port = port;
+
+    record = (struct nano_nodeid_record *) g_hash_table_lookup(nano_registry.learned, &key);
+    if (!record) {
+        record = g_new(struct nano_nodeid_record, 1);
+        *record = key;
+        memcpy(record->node_id, node_id, 32);
+        record->first_seen = when->secs;
+        g_hash_table_add(nano_registry.learned, record);
+    } else if (memcmp(record->node_id, node_id, 32)) {
+        // the endpoint was handed on to another node
+        memcpy(record->node_id, node_id, 32);
+        record->first_seen = when->secs;
+    }
+
+    record->first_seen = MIN(record->first_seen, when->secs);
+    record->last_seen = MAX(record->last_seen, when->secs);
+    nano_registry.dirty = TRUE;
+}
+
+static const struct nano_nodeid_record *nano_nodeids_find (const struct nano_nodeid_record *key) {
+    const struct nano_nodeid_record *record = NULL;
+
+    if (nano_registry.learned) {
+        record = (const struct nano_nodeid_record *) g_hash_table_lookup(nano_registry.learned, key);
+    }
+    if (record || !nano_registry.count) {
+        return record;
+    }
+
+    const struct nano_nodeid_record *base = nano_registry.records;
+    guint32 count = nano_registry.count;
+
+    // lower bound by endpoint
+    while (count > 1) {
+        guint32 half = count / 2;
+        const struct nano_nodeid_record *middle = base + half - 1;
+        int order = memcmp(middle->address, key->address, 16);
+
+        base = order < 0 || (order == 0 && middle->port < key->port) ? base + half : base;
+        count -= half;
+    }
+
+    return nano_nodeids_equal(base, key) ? base : NULL;
+}
+
+gboolean nano_nodeids_lookup (const address *addr, guint32 port, nano_nodeid_t *nodeid) {
+    struct nano_nodeid_record key;
+    const struct nano_nodeid_record *record;
+
+    if (!nano_registry.count && (!nano_registry.learned || !g_hash_table_size(nano_registry.learned))) {
+        return FALSE;
+    }
+
+    memset(&key, 0, sizeof(key));
+    if (!nano_nodeids_address(addr, key.address)) {
+        return FALSE;
+    }
+    key.port = port;
+
+    record = nano_nodeids_find(&key);
+    if (!record && port != 0) {
+        key.port = 0;
+        record = nano_nodeids_find(&key);
+    }
+    if (!record) {
+        return FALSE;
+    }
+
+    memcpy(nodeid->node_id, record->node_id, 32);
+    nodeid->first_seen = record->first_seen;
+    nodeid->last_seen = record->last_seen;
+
+    return TRUE;
+}
+
+guint32 nano_nodeids_count (void) {
+    return nano_registry.count + (nano_registry.learned ? g_hash_table_size(nano_registry.learned) : 0);
+}
+
+//
+// Merging into the file
+//
+static void nano_nodeids_collect (gpointer key, gpointer value _U_, gpointer user_data) {
+    g_array_append_vals((GArray *) user_data, key, 1);
+}
+
+void nano_nodeids_write (void) {
+    struct nano_nodeids_header header;
+    GArray *records;
+    guint32 count = 0;
+    gboolean ok;
+
+    if (!nano_registry.path || !nano_registry.dirty) {
+        return;
+    }
+    nano_registry.dirty = FALSE;
+
+    records = g_array_sized_new(FALSE, FALSE, sizeof(struct nano_nodeid_record), nano_nodeids_count());
+    g_array_append_vals(records, nano_registry.records, nano_registry.count);
+    g_hash_table_foreach(nano_registry.learned, nano_nodeids_collect, records);
+    g_array_sort(records, nano_nodeids_compare);
+
+    for (guint i = 0; i < records->len; i++) {
+        struct nano_nodeid_record *record = &g_array_index(records, struct nano_nodeid_record, i);
+        struct nano_nodeid_record *merged = count ? &g_array_index(records, struct nano_nodeid_record, count - 1) : NULL;
+
+        if (!merged || !nano_nodeids_equal(merged, record)) {
+            g_array_index(records, struct nano_nodeid_record, count++) = *record;
+        } else if (!memcmp(merged->node_id, record->node_id, 32)) {
+            merged->first_seen = MIN(merged->first_seen, record->first_seen);
+            merged->last_seen = MAX(merged->last_seen, record->last_seen);
+        } else {
+            *merged = *record;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NANO_NODEIDS_MAGIC, sizeof(NANO_NODEIDS_MAGIC));
+    header.version = NANO_NODEIDS_VERSION;
+    header.byte_order = NANO_NODEIDS_BYTE_ORDER;
+    header.count = count;
+
+    // readers of the old file never see a half written one
+    gchar *temp_path = g_strdup_printf("%s.tmp", nano_registry.path);
+    FILE *fh = ws_fopen(temp_path, "wb");
+
+    if (!fh) {
+        report_open_failure(temp_path, errno, TRUE);
+        g_free(temp_path);
+        g_array_free(records, TRUE);
+        return;
+    }
+
+    ok = fwrite(&header, 1, sizeof(header), fh) == sizeof(header) &&
+        fwrite(records->data, sizeof(struct nano_nodeid_record), count, fh) == count;
+    g_array_free(records, TRUE);
+
+    // the old file stays mapped until it is replaced, which Windows does not allow
+    nano_nodeids_unmap();
+
+    if (ws_fclose(fh) != 0 || !ok) {
+        report_write_failure(temp_path, errno);
+        ws_unlink(temp_path);
+    } else if (ws_rename(temp_path, nano_registry.path) != 0) {
+        report_failure("Could not rename %s to %s: %s", temp_path, nano_registry.path, g_strerror(errno));
+        ws_unlink(temp_path);
+    }
+
+    g_free(temp_path);
+
+    nano_nodeids_map();
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,54 @@
+/* nano_nodeids.h
+* Node ID registry: node IDs learned from handshakes, by endpoint
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_NODEIDS_H__
+#define __NANO_NODEIDS_H__
+
+#include <glib.h>
+
+#include <epan/address.h>
+#include <wsutil/nstime.h>
+
+typedef struct _nano_nodeid {
+    guint8 node_id[32];
+    // packet time in seconds
+    gint64 first_seen;
+    gint64 last_seen;
+} nano_nodeid_t;
+
+// maps a registry file, replacing the current one; an empty path unloads it
+void nano_nodeids_load(const char *path);
+// forgets the node IDs learned from the capture, the mapped registry stays
+void nano_nodeids_reset(void);
+
+// port 0 stands for any port of the address, used for the connecting side of a connection
+void nano_nodeids_observe(const address *addr, guint32 port, const guint8 *node_id, const nstime_t *when);
+
+// node ID last seen at addr and port, or at addr with port 0; learned ones first, then the mapped registry
+gboolean nano_nodeids_lookup(const address *addr, guint32 port, nano_nodeid_t *nodeid);
+guint32 nano_nodeids_count(void);
+
+// merges what was learned into the registry file and maps the result, nothing happens when nothing was learned
+void nano_nodeids_write(void);
+
+#endif /* __NANO_NODEIDS_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
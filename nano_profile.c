@@ -0,0 +1,422 @@
+/* nano_profile.c
+* Dissector self-profiling: time and memory per call, by packet type
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* With nano.profile on, the dissector takes a probe before and after each
+* timed call: the monotonic clock in nanoseconds, the time stamp counter on
+* x86, and the file scope bytes the dissector accounts for (conversations,
+* chain and fork indexes, the balance cache). Packet scope memory goes with
+* the packet and wmem keeps no count of it. Times are inclusive, the message
+* includes its header and body, a body includes its blocks.
+*
+* Samples wait here until the dissector hands the message to the tap, which
+* carries them to -z nano,profile[,<file>] (a table on stdout by default) and
+* to the Nano/Profile statistics. Either profiles for as long as it is open,
+* asking for the numbers is opting in.
+*
+* With nano.profile off and nothing listening a timed call costs two branches
+* on nano_profile_on, one as its probe starts and one as it stops, and
+* dissect_nano tests it once more to learn the packet type and once before
+* handing samples to the tap. The flag is recomputed when the preference is
+* applied or a listener opens or closes, never per probe.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define NANO_PROFILE_HAVE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <epan/stats_tree.h>
+#include <wsutil/file_util.h>
+#include <wsutil/report_message.h>
+
+#include "packet-nano.h"
+#include "nano_profile.h"
+
+// samples kept for a message at most, a resync through a huge segment should not grow this without end
+#define NANO_PROFILE_MAX_PENDING 4096
+
+gboolean nano_profile_enabled = FALSE;
+gboolean nano_profile_on = FALSE;
+
+// -z nano,profile and Nano/Profile statistics that are open, each profiles while it runs
+static guint nano_profile_listeners = 0;
+
+static const char * const nano_profile_function_names[NANO_PROFILE_FUNCTIONS] = {
+    [NANO_PROFILE_GET_MESSAGE_LEN] = "get_nano_message_len",
+    [NANO_PROFILE_MESSAGE] = "dissect_nano_message",
+    [NANO_PROFILE_HEADER] = "dissect_nano_header",
+    [NANO_PROFILE_RESYNC] = "dissect_nano_resync",
+    [NANO_PROFILE_HEADERLESS] = "dissect_headerless_packet",
+    [NANO_PROFILE_KEEPALIVE] = "dissect_nano_keepalive",
+    [NANO_PROFILE_PUBLISH] = "dissect_nano_publish",
+    [NANO_PROFILE_CONFIRM_REQ] = "dissect_nano_confirm_req",
+    [NANO_PROFILE_CONFIRM_ACK] = "dissect_nano_confirm_ack",
+    [NANO_PROFILE_BULK_PULL] = "dissect_nano_bulk_pull_request",
+    [NANO_PROFILE_FRONTIER_REQ] = "dissect_nano_frontier_req",
+    [NANO_PROFILE_NODE_ID_HANDSHAKE] = "dissect_nano_node_id_handshake",
+    [NANO_PROFILE_BULK_PULL_ACCOUNT] = "dissect_nano_bulk_pull_account_request",
+    [NANO_PROFILE_TELEMETRY_REQ] = "dissect_nano_telemetry_req",
+    [NANO_PROFILE_TELEMETRY_ACK] = "dissect_nano_telemetry_ack",
+    [NANO_PROFILE_ASC_PULL_REQ] = "dissect_nano_asc_pull_req",
+    [NANO_PROFILE_ASC_PULL_ACK] = "dissect_nano_asc_pull_ack",
+    [NANO_PROFILE_BLOCK] = "dissect_nano_block",
+};
+
+static GArray *nano_profile_pending;
+
+void nano_profile_update (void) {
+    nano_profile_on = nano_profile_enabled || nano_profile_listeners > 0;
+}
+
+static void nano_profile_listen (gboolean open) {
+    if (open) {
+        nano_profile_listeners++;
+    } else {
+        nano_profile_listeners--;
+    }
+    nano_profile_update();
+}
+
+const char *nano_profile_function_name (int function) {
+    return function >= 0 && function < NANO_PROFILE_FUNCTIONS ? nano_profile_function_names[function] : "unknown";
+}
+
+int nano_profile_body_function (guint packet_type) {
+    switch (packet_type) {
+        case NANO_PACKET_TYPE_KEEPALIVE:
+            return NANO_PROFILE_KEEPALIVE;
+        case NANO_PACKET_TYPE_PUBLISH:
+            return NANO_PROFILE_PUBLISH;
+        case NANO_PACKET_TYPE_CONFIRM_REQ:
+            return NANO_PROFILE_CONFIRM_REQ;
+        case NANO_PACKET_TYPE_CONFIRM_ACK:
+            return NANO_PROFILE_CONFIRM_ACK;
+        case NANO_PACKET_TYPE_BULK_PULL:
+            return NANO_PROFILE_BULK_PULL;
+        case NANO_PACKET_TYPE_FRONTIER_REQ:
+            return NANO_PROFILE_FRONTIER_REQ;
+        case NANO_PACKET_TYPE_NODE_ID_HANDSHAKE:
+            return NANO_PROFILE_NODE_ID_HANDSHAKE;
+        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
+            return NANO_PROFILE_BULK_PULL_ACCOUNT;
+        case NANO_PACKET_TYPE_TELEMETRY_REQ:
+            return NANO_PROFILE_TELEMETRY_REQ;
+        case NANO_PACKET_TYPE_TELEMETRY_ACK:
+            return NANO_PROFILE_TELEMETRY_ACK;
+        case NANO_PACKET_TYPE_ASC_PULL_REQ:
+            return NANO_PROFILE_ASC_PULL_REQ;
+        case NANO_PACKET_TYPE_ASC_PULL_ACK:
+            return NANO_PROFILE_ASC_PULL_ACK;
+    }
+
+    return NANO_PROFILE_FUNCTIONS;
+}
+
+static guint64 nano_profile_clock_ns (void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+
+    return (guint64) ((double) now.QuadPart * 1e9 / (double) frequency.QuadPart);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (guint64) now.tv_sec * G_GUINT64_CONSTANT(1000000000) + (guint64) now.tv_nsec;
+#endif
+}
+
+static guint64 nano_profile_cycles (void) {
+#ifdef NANO_PROFILE_HAVE_TSC
+    return (guint64) __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+void nano_profile_start (nano_profile_probe_t *probe, guint64 bytes) {
+    probe->bytes = bytes;
+    probe->ns = nano_profile_clock_ns();
+    probe->cycles = nano_profile_cycles();
+}
+
+void nano_profile_stop (const nano_profile_probe_t *probe, guint64 bytes, int function, guint packet_type) {
+    guint64 cycles = nano_profile_cycles();
+    guint64 ns = nano_profile_clock_ns();
+    nano_profile_sample_t sample;
+
+    if (function < 0 || function >= NANO_PROFILE_FUNCTIONS) {
+        return;
+    }
+
+    if (!nano_profile_pending) {
+        nano_profile_pending = g_array_new(FALSE, FALSE, sizeof(nano_profile_sample_t));
+    }
+    if (nano_profile_pending->len >= NANO_PROFILE_MAX_PENDING) {
+        return;
+    }
+
+    sample.function = (guint8) function;
+    sample.packet_type = (guint8) MIN(packet_type, G_MAXUINT8);
+    sample.ns = ns - probe->ns;
+    sample.cycles = cycles - probe->cycles;
+    sample.bytes = (gint64) (bytes - probe->bytes);
+
+    g_array_append_val(nano_profile_pending, sample);
+}
+
+const nano_profile_sample_t *nano_profile_take (guint32 *count) {
+    nano_profile_sample_t *samples;
+
+    if (!nano_profile_pending || nano_profile_pending->len == 0) {
+        *count = 0;
+        return NULL;
+    }
+
+    *count = nano_profile_pending->len;
+    samples = (nano_profile_sample_t *) wmem_memdup(wmem_packet_scope(), nano_profile_pending->data, *count * sizeof(nano_profile_sample_t));
+    g_array_set_size(nano_profile_pending, 0);
+
+    return samples;
+}
+
+void nano_profile_discard (void) {
+    if (nano_profile_pending) {
+        g_array_set_size(nano_profile_pending, 0);
+    }
+}
+
+
+//
+// -z nano,profile[,<file>]
+//
+typedef struct {
+    guint64 calls;
+    guint64 ns;
+    guint64 cycles;
+    gint64 bytes;
+    guint64 max_ns;
+} nano_profile_totals_t;
+
+typedef struct {
+    gchar *path;
+    nano_profile_totals_t *totals;
+} nano_profile_t;
+
+static nano_profile_totals_t *nano_profile_totals_of (nano_profile_t *profile, int function, int packet_type) {
+    return &profile->totals[function * (G_MAXUINT8 + 1) + packet_type];
+}
+
+static tap_packet_status nano_profile_packet (void *tapdata, packet_info *pinfo _U_, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    nano_profile_t *profile = (nano_profile_t *) tapdata;
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+
+    for (guint32 i = 0; i < tap_info->profile_count; i++) {
+        const nano_profile_sample_t *sample = &tap_info->profile[i];
+        nano_profile_totals_t *totals = nano_profile_totals_of(profile, sample->function, sample->packet_type);
+
+        totals->calls++;
+        totals->ns += sample->ns;
+        totals->cycles += sample->cycles;
+        totals->bytes += sample->bytes;
+        totals->max_ns = MAX(totals->max_ns, sample->ns);
+    }
+
+    return tap_info->profile_count ? TAP_PACKET_REDRAW : TAP_PACKET_DONT_REDRAW;
+}
+
+static void nano_profile_reset (void *tapdata) {
+    nano_profile_t *profile = (nano_profile_t *) tapdata;
+
+    memset(profile->totals, 0, NANO_PROFILE_FUNCTIONS * (G_MAXUINT8 + 1) * sizeof(nano_profile_totals_t));
+}
+
+static void nano_profile_draw (void *tapdata) {
+    nano_profile_t *profile = (nano_profile_t *) tapdata;
+    GString *out = g_string_new(NULL);
+    FILE *fh = stdout;
+
+    g_string_append(out, "\n===================================================================================================================\n");
+    g_string_append(out, "Nano Dissector Profile (inclusive, per call)\n");
+    g_string_append_printf(out, "%-40s %-20s %10s %12s %12s %12s %12s\n", "Function", "Packet Type", "Calls", "ns", "Cycles", "Max ns", "Bytes");
+
+    for (int function = 0; function < NANO_PROFILE_FUNCTIONS; function++) {
+        for (int packet_type = 0; packet_type <= G_MAXUINT8; packet_type++) {
+            const nano_profile_totals_t *totals = nano_profile_totals_of(profile, function, packet_type);
+
+            if (!totals->calls) {
+                continue;
+            }
+
+            g_string_append_printf(out, "%-40s %-20s %10" G_GUINT64_FORMAT " %12.1f ", nano_profile_function_name(function),
+                                   nano_packet_type_name(packet_type), totals->calls, (double) totals->ns / (double) totals->calls);
+            if (totals->cycles) {
+                g_string_append_printf(out, "%12.1f ", (double) totals->cycles / (double) totals->calls);
+            } else {
+                g_string_append_printf(out, "%12s ", "-");
+            }
+            g_string_append_printf(out, "%12" G_GUINT64_FORMAT " %12.1f\n", totals->max_ns, (double) totals->bytes / (double) totals->calls);
+        }
+    }
+    g_string_append(out, "===================================================================================================================\n");
+
+    if (profile->path) {
+        fh = ws_fopen(profile->path, "w");
+        if (!fh) {
+            report_open_failure(profile->path, errno, TRUE);
+            g_string_free(out, TRUE);
+            return;
+        }
+    }
+
+    fwrite(out->str, 1, out->len, fh);
+
+    if (profile->path && ws_fclose(fh) != 0) {
+        report_write_failure(profile->path, errno);
+    }
+
+    g_string_free(out, TRUE);
+}
+
+static void nano_profile_free (nano_profile_t *profile) {
+    g_free(profile->totals);
+    g_free(profile->path);
+    g_free(profile);
+}
+
+static void nano_profile_finish (void *tapdata) {
+    nano_profile_listen(FALSE);
+    nano_profile_free((nano_profile_t *) tapdata);
+}
+
+static void nano_profile_init (const char *opt_arg, void *userdata _U_) {
+    const char *args = opt_arg + strlen("nano,profile");
+    nano_profile_t *profile;
+    GString *error_string;
+
+    if (*args != '\0' && (*args != ',' || args[1] == '\0')) {
+        report_failure("Usage: -z nano,profile[,<output file>]");
+        return;
+    }
+
+    profile = g_new0(nano_profile_t, 1);
+    profile->path = *args ? g_strdup(args + 1) : NULL;
+    profile->totals = g_new0(nano_profile_totals_t, NANO_PROFILE_FUNCTIONS * (G_MAXUINT8 + 1));
+
+    error_string = register_tap_listener("nano", profile, NULL, TL_REQUIRES_NOTHING, nano_profile_reset, nano_profile_packet, nano_profile_draw, nano_profile_finish);
+    if (error_string) {
+        report_failure("Couldn't register nano,profile tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        nano_profile_free(profile);
+        return;
+    }
+
+    nano_profile_listen(TRUE);
+}
+
+static stat_tap_ui nano_profile_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,profile",
+    nano_profile_init,
+    0,
+    NULL
+};
+
+
+//
+// Nano/Profile statistics, time per call by function and packet type
+//
+static const char *st_str_time = "Time per Call (ns)";
+static const char *st_str_bytes = "File Scope Bytes per Call";
+
+static int st_node_time = -1;
+static int st_node_bytes = -1;
+static int st_node_time_functions[NANO_PROFILE_FUNCTIONS];
+static int st_node_bytes_functions[NANO_PROFILE_FUNCTIONS];
+
+static void nano_profile_stats_init (stats_tree *st) {
+    st_node_time = stats_tree_create_node(st, st_str_time, 0, STAT_DT_INT, TRUE);
+    st_node_bytes = stats_tree_create_node(st, st_str_bytes, 0, STAT_DT_INT, TRUE);
+
+    for (int function = 0; function < NANO_PROFILE_FUNCTIONS; function++) {
+        st_node_time_functions[function] = stats_tree_create_node(st, nano_profile_function_names[function], st_node_time, STAT_DT_INT, TRUE);
+        st_node_bytes_functions[function] = stats_tree_create_node(st, nano_profile_function_names[function], st_node_bytes, STAT_DT_INT, TRUE);
+    }
+
+    nano_profile_listen(TRUE);
+}
+
+static void nano_profile_stats_cleanup (stats_tree *st _U_) {
+    nano_profile_listen(FALSE);
+}
+
+static tap_packet_status nano_profile_stats_packet (stats_tree *st, packet_info *pinfo _U_, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+
+    for (guint32 i = 0; i < tap_info->profile_count; i++) {
+        const nano_profile_sample_t *sample = &tap_info->profile[i];
+        const char *function_name = nano_profile_function_names[sample->function];
+        const char *type_name = nano_packet_type_name(sample->packet_type);
+        gint ns = (gint) MIN(sample->ns, G_MAXINT);
+        gint bytes = (gint) CLAMP(sample->bytes, G_MININT, G_MAXINT);
+
+        avg_stat_node_add_value_int(st, function_name, st_node_time, TRUE, ns);
+        avg_stat_node_add_value_int(st, type_name, st_node_time_functions[sample->function], FALSE, ns);
+
+        avg_stat_node_add_value_int(st, function_name, st_node_bytes, TRUE, bytes);
+        avg_stat_node_add_value_int(st, type_name, st_node_bytes_functions[sample->function], FALSE, bytes);
+    }
+
+    return tap_info->profile_count ? TAP_PACKET_REDRAW : TAP_PACKET_DONT_REDRAW;
+}
+
+void nano_register_profile(void)
+{
+    register_stat_tap_ui(&nano_profile_ui, NULL);
+    stats_tree_register_plugin("nano", "nano_profile", "Nano/Profile", 0, nano_profile_stats_packet, nano_profile_stats_init, nano_profile_stats_cleanup);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,90 @@
+/* nano_profile.h
+* Dissector self-profiling: time and memory per call, by packet type
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_PROFILE_H__
+#define __NANO_PROFILE_H__
+
+#include <glib.h>
+
+// the dissector functions that are timed, nano_profile_function_name has their names
+typedef enum {
+    NANO_PROFILE_GET_MESSAGE_LEN,
+    NANO_PROFILE_MESSAGE,
+    NANO_PROFILE_HEADER,
+    NANO_PROFILE_RESYNC,
+    NANO_PROFILE_HEADERLESS,
+    NANO_PROFILE_KEEPALIVE,
+    NANO_PROFILE_PUBLISH,
+    NANO_PROFILE_CONFIRM_REQ,
+    NANO_PROFILE_CONFIRM_ACK,
+    NANO_PROFILE_BULK_PULL,
+    NANO_PROFILE_FRONTIER_REQ,
+    NANO_PROFILE_NODE_ID_HANDSHAKE,
+    NANO_PROFILE_BULK_PULL_ACCOUNT,
+    NANO_PROFILE_TELEMETRY_REQ,
+    NANO_PROFILE_TELEMETRY_ACK,
+    NANO_PROFILE_ASC_PULL_REQ,
+    NANO_PROFILE_ASC_PULL_ACK,
+    NANO_PROFILE_BLOCK,
+    NANO_PROFILE_FUNCTIONS
+} nano_profile_function_t;
+
+// taken when a timed call starts
+typedef struct _nano_profile_probe {
+    guint64 ns;
+    guint64 cycles;
+    guint64 bytes;
+} nano_profile_probe_t;
+
+// one timed call; cycles is 0 where there is no cycle counter
+typedef struct _nano_profile_sample {
+    guint8 function;
+    guint8 packet_type;
+    guint64 ns;
+    guint64 cycles;
+    gint64 bytes;
+} nano_profile_sample_t;
+
+// the nano.profile preference
+extern gboolean nano_profile_enabled;
+// nano.profile is on or a listener is open, the one thing the probes test
+extern gboolean nano_profile_on;
+
+// recomputes nano_profile_on after the preference changed
+void nano_profile_update(void);
+
+const char *nano_profile_function_name(int function);
+
+// function dissecting the body of a message of packet_type, NANO_PROFILE_FUNCTIONS if there is none
+int nano_profile_body_function(guint packet_type);
+
+void nano_profile_start(nano_profile_probe_t *probe, guint64 bytes);
+void nano_profile_stop(const nano_profile_probe_t *probe, guint64 bytes, int function, guint packet_type);
+
+// samples recorded since the last call, in packet scope, for the tap
+const nano_profile_sample_t *nano_profile_take(guint32 *count);
+void nano_profile_discard(void);
+
+void nano_register_profile(void);
+
+#endif /* __NANO_PROFILE_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,431 @@
+/* nano_prometheus.c
+* Metrics for the node_exporter textfile collector
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* -z nano,prometheus,<file>[,<seconds>] keeps a .prom file with message counts
+* and bytes per type and direction, votes, bootstrap bytes and data skipped
+* while resynchronizing, for tshark running against a live interface.
+*
+* The packet callback only adds to the counters of the current interval, it
+* allocates nothing and does no IO. When an interval is over, its counters are
+* added to the totals and a copy of them is handed, under the only lock, to a
+* writer thread. That thread formats the file, writes it next to the old one
+* and renames it over it, so the collector never reads half a file. Intervals
+* go by packet time. Wireshark redraws taps every few seconds and each redraw
+* ends an interval early; tshark only draws at the end, so there the first
+* packet past the interval ends it. Write errors are reported on the next
+* redraw, or when the tap finishes.
+*
+* Counters are totals since the tap started, as Prometheus expects; the
+* _per_second gauges are over the last interval only.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <wsutil/file_util.h>
+#include <wsutil/report_message.h>
+
+#include "packet-nano.h"
+
+#define NANO_PROMETHEUS_DEFAULT_INTERVAL 15
+
+enum {
+    NANO_PROMETHEUS_FROM_CLIENT,
+    NANO_PROMETHEUS_FROM_SERVER,
+    NANO_PROMETHEUS_DIRECTIONS
+};
+
+static const char *nano_prometheus_directions[NANO_PROMETHEUS_DIRECTIONS] = { "from_client", "from_server" };
+
+typedef struct {
+    // by packet type, NANO_PACKET_TYPE_INVALID for data skipped while resynchronizing
+    guint64 messages[NANO_PACKET_TYPE_MAX + 1][NANO_PROMETHEUS_DIRECTIONS];
+    guint64 bytes[NANO_PACKET_TYPE_MAX + 1][NANO_PROMETHEUS_DIRECTIONS];
+
+    // extrapolated when confirm_acks are sampled
+    guint64 votes;
+    guint64 vote_hashes;
+
+    guint64 bootstrap_bytes[NANO_PROMETHEUS_DIRECTIONS];
+} nano_prometheus_counters_t;
+
+// what one file shows
+typedef struct {
+    nano_prometheus_counters_t totals;
+    double votes_per_second;
+    double bootstrap_bytes_per_second[NANO_PROMETHEUS_DIRECTIONS];
+    // packet time of the last message counted
+    nstime_t last;
+} nano_prometheus_snapshot_t;
+
+typedef enum {
+    NANO_PROMETHEUS_WRITTEN,
+    NANO_PROMETHEUS_OPEN_FAILED,
+    NANO_PROMETHEUS_WRITE_FAILED,
+    NANO_PROMETHEUS_RENAME_FAILED
+} nano_prometheus_result_t;
+
+typedef struct {
+    gchar *path;
+    gchar *temp_path;
+    guint interval;
+
+    nano_prometheus_counters_t current;
+
+    // packet time of the first and last message of the current interval
+    gboolean started;
+    gboolean pending;
+    nstime_t interval_start;
+
+    // totals so far, kept by the tap callbacks
+    nano_prometheus_snapshot_t state;
+
+    // the writer thread; what it writes next and how its last write went are shared under lock
+    GThread *writer;
+    GMutex lock;
+    GCond wake;
+    nano_prometheus_snapshot_t handed;
+    gboolean due;
+    gboolean stopping;
+    nano_prometheus_result_t result;
+    int result_errno;
+} nano_prometheus_t;
+
+static gboolean nano_prometheus_is_bootstrap (guint8 packet_type) {
+    switch (packet_type) {
+        case NANO_PACKET_TYPE_BULK_PULL:
+        case NANO_PACKET_TYPE_BULK_PUSH:
+        case NANO_PACKET_TYPE_FRONTIER_REQ:
+        case NANO_PACKET_TYPE_BULK_PULL_BLOCKS:
+        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
+        case NANO_PACKET_TYPE_ASC_PULL_REQ:
+        case NANO_PACKET_TYPE_ASC_PULL_ACK:
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void nano_prometheus_help (GString *text, const char *name, const char *type, const char *help) {
+    g_string_append_printf(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void nano_prometheus_format (const nano_prometheus_snapshot_t *snapshot, GString *text) {
+    const nano_prometheus_counters_t *totals = &snapshot->totals;
+
+    g_string_truncate(text, 0);
+
+    nano_prometheus_help(text, "nano_messages_total", "counter", "Nano messages by type and the side of the connection that sent them.");
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        for (int direction = 0; direction < NANO_PROMETHEUS_DIRECTIONS; direction++) {
+            g_string_append_printf(text, "nano_messages_total{type=\"%s\",direction=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                                   nano_packet_type_name(type), nano_prometheus_directions[direction], totals->messages[type][direction]);
+        }
+    }
+
+    nano_prometheus_help(text, "nano_message_bytes_total", "counter", "Bytes of Nano messages by type and the side of the connection that sent them.");
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        for (int direction = 0; direction < NANO_PROMETHEUS_DIRECTIONS; direction++) {
+            g_string_append_printf(text, "nano_message_bytes_total{type=\"%s\",direction=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                                   nano_packet_type_name(type), nano_prometheus_directions[direction], totals->bytes[type][direction]);
+        }
+    }
+
+    nano_prometheus_help(text, "nano_votes_total", "counter", "Votes received in confirm_ack messages.");
+    g_string_append_printf(text, "nano_votes_total %" G_GUINT64_FORMAT "\n", totals->votes);
+    nano_prometheus_help(text, "nano_vote_hashes_total", "counter", "Block hashes voted on in confirm_ack messages.");
+    g_string_append_printf(text, "nano_vote_hashes_total %" G_GUINT64_FORMAT "\n", totals->vote_hashes);
+    nano_prometheus_help(text, "nano_votes_per_second", "gauge", "Votes per second over the last interval.");
+    g_string_append_printf(text, "nano_votes_per_second %.3f\n", snapshot->votes_per_second);
+
+    nano_prometheus_help(text, "nano_bootstrap_bytes_total", "counter", "Bytes of bootstrap requests and responses.");
+    for (int direction = 0; direction < NANO_PROMETHEUS_DIRECTIONS; direction++) {
+        g_string_append_printf(text, "nano_bootstrap_bytes_total{direction=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                               nano_prometheus_directions[direction], totals->bootstrap_bytes[direction]);
+    }
+    nano_prometheus_help(text, "nano_bootstrap_bytes_per_second", "gauge", "Bootstrap throughput over the last interval.");
+    for (int direction = 0; direction < NANO_PROMETHEUS_DIRECTIONS; direction++) {
+        g_string_append_printf(text, "nano_bootstrap_bytes_per_second{direction=\"%s\"} %.3f\n",
+                               nano_prometheus_directions[direction], snapshot->bootstrap_bytes_per_second[direction]);
+    }
+
+    nano_prometheus_help(text, "nano_dissector_errors_total", "counter", "Stretches of data the dissector skipped to find the next message header.");
+    g_string_append_printf(text, "nano_dissector_errors_total{kind=\"resync_skipped\"} %" G_GUINT64_FORMAT "\n",
+                           totals->messages[NANO_PACKET_TYPE_INVALID][NANO_PROMETHEUS_FROM_CLIENT] + totals->messages[NANO_PACKET_TYPE_INVALID][NANO_PROMETHEUS_FROM_SERVER]);
+    nano_prometheus_help(text, "nano_dissector_skipped_bytes_total", "counter", "Bytes the dissector skipped to find the next message header.");
+    g_string_append_printf(text, "nano_dissector_skipped_bytes_total %" G_GUINT64_FORMAT "\n",
+                           totals->bytes[NANO_PACKET_TYPE_INVALID][NANO_PROMETHEUS_FROM_CLIENT] + totals->bytes[NANO_PACKET_TYPE_INVALID][NANO_PROMETHEUS_FROM_SERVER]);
+
+    nano_prometheus_help(text, "nano_capture_timestamp_seconds", "gauge", "Time of the last message counted.");
+    g_string_append_printf(text, "nano_capture_timestamp_seconds %.3f\n", nstime_to_sec(&snapshot->last));
+}
+
+// runs on the writer thread, errors are left for the main thread to report
+static nano_prometheus_result_t nano_prometheus_write (const nano_prometheus_t *prometheus, const GString *text, int *err) {
+    FILE *fh = ws_fopen(prometheus->temp_path, "w");
+
+    if (!fh) {
+        *err = errno;
+        return NANO_PROMETHEUS_OPEN_FAILED;
+    }
+
+    gboolean written = fwrite(text->str, 1, text->len, fh) == text->len;
+
+    if (ws_fclose(fh) != 0 || !written) {
+        *err = errno;
+        ws_unlink(prometheus->temp_path);
+        return NANO_PROMETHEUS_WRITE_FAILED;
+    }
+    if (ws_rename(prometheus->temp_path, prometheus->path) != 0) {
+        *err = errno;
+        ws_unlink(prometheus->temp_path);
+        return NANO_PROMETHEUS_RENAME_FAILED;
+    }
+
+    return NANO_PROMETHEUS_WRITTEN;
+}
+
+static gpointer nano_prometheus_writer (gpointer data) {
+    nano_prometheus_t *prometheus = (nano_prometheus_t *) data;
+    nano_prometheus_snapshot_t snapshot;
+    GString *text = g_string_new(NULL);
+
+    for (;;) {
+        g_mutex_lock(&prometheus->lock);
+        while (!prometheus->due && !prometheus->stopping) {
+            g_cond_wait(&prometheus->wake, &prometheus->lock);
+        }
+        if (!prometheus->due) {
+            g_mutex_unlock(&prometheus->lock);
+            break;
+        }
+        snapshot = prometheus->handed;
+        prometheus->due = FALSE;
+        g_mutex_unlock(&prometheus->lock);
+
+        int err = 0;
+
+        nano_prometheus_format(&snapshot, text);
+        nano_prometheus_result_t result = nano_prometheus_write(prometheus, text, &err);
+
+        if (result != NANO_PROMETHEUS_WRITTEN) {
+            g_mutex_lock(&prometheus->lock);
+            prometheus->result = result;
+            prometheus->result_errno = err;
+            g_mutex_unlock(&prometheus->lock);
+        }
+    }
+
+    g_string_free(text, TRUE);
+
+    return NULL;
+}
+
+// a failed write of the writer thread, once
+static void nano_prometheus_report (nano_prometheus_t *prometheus) {
+    g_mutex_lock(&prometheus->lock);
+    nano_prometheus_result_t result = prometheus->result;
+    int err = prometheus->result_errno;
+    prometheus->result = NANO_PROMETHEUS_WRITTEN;
+    g_mutex_unlock(&prometheus->lock);
+
+    switch (result) {
+        case NANO_PROMETHEUS_OPEN_FAILED:
+            report_open_failure(prometheus->temp_path, err, TRUE);
+            break;
+        case NANO_PROMETHEUS_WRITE_FAILED:
+            report_write_failure(prometheus->temp_path, err);
+            break;
+        case NANO_PROMETHEUS_RENAME_FAILED:
+            report_failure("Could not rename %s to %s: %s", prometheus->temp_path, prometheus->path, g_strerror(err));
+            break;
+        case NANO_PROMETHEUS_WRITTEN:
+            break;
+    }
+}
+
+// ends the current interval: adds its counters to the totals and hands them to the writer thread
+static void nano_prometheus_flush (nano_prometheus_t *prometheus) {
+    nano_prometheus_counters_t *current = &prometheus->current;
+    nano_prometheus_snapshot_t *state = &prometheus->state;
+    guint64 *from = (guint64 *) current;
+    guint64 *to = (guint64 *) &state->totals;
+    nstime_t elapsed;
+    double seconds;
+
+    if (!prometheus->pending) {
+        return;
+    }
+
+    for (gsize i = 0; i < sizeof(nano_prometheus_counters_t) / sizeof(guint64); i++) {
+        to[i] += from[i];
+    }
+
+    nstime_delta(&elapsed, &state->last, &prometheus->interval_start);
+    seconds = nstime_to_sec(&elapsed);
+    if (seconds > 0) {
+        state->votes_per_second = current->votes / seconds;
+        for (int direction = 0; direction < NANO_PROMETHEUS_DIRECTIONS; direction++) {
+            state->bootstrap_bytes_per_second[direction] = current->bootstrap_bytes[direction] / seconds;
+        }
+    }
+
+    memset(current, 0, sizeof(*current));
+    prometheus->pending = FALSE;
+    prometheus->interval_start = state->last;
+
+    g_mutex_lock(&prometheus->lock);
+    prometheus->handed = *state;
+    prometheus->due = TRUE;
+    g_cond_signal(&prometheus->wake);
+    g_mutex_unlock(&prometheus->lock);
+}
+
+static tap_packet_status nano_prometheus_packet (void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    nano_prometheus_t *prometheus = (nano_prometheus_t *) tapdata;
+    nano_prometheus_counters_t *current = &prometheus->current;
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+    int direction = tap_info->from_server ? NANO_PROMETHEUS_FROM_SERVER : NANO_PROMETHEUS_FROM_CLIENT;
+    guint8 type = tap_info->packet_type <= NANO_PACKET_TYPE_MAX ? tap_info->packet_type : NANO_PACKET_TYPE_INVALID;
+
+    if (!prometheus->started) {
+        prometheus->started = TRUE;
+        prometheus->interval_start = pinfo->abs_ts;
+    } else if (pinfo->abs_ts.secs - prometheus->interval_start.secs >= (gint64) prometheus->interval) {
+        nano_prometheus_flush(prometheus);
+    }
+    prometheus->state.last = pinfo->abs_ts;
+    prometheus->pending = TRUE;
+
+    current->messages[type][direction]++;
+    current->bytes[type][direction] += tap_info->length;
+
+    if (tap_info->vote_account) {
+        current->votes += tap_info->sample_weight;
+        current->vote_hashes += (guint64) tap_info->sample_weight * MAX(tap_info->vote_hash_count, 1);
+    }
+
+    if (nano_prometheus_is_bootstrap(type)) {
+        current->bootstrap_bytes[direction] += tap_info->length;
+    }
+
+    return TAP_PACKET_REDRAW;
+}
+
+static void nano_prometheus_reset (void *tapdata) {
+    nano_prometheus_t *prometheus = (nano_prometheus_t *) tapdata;
+
+    memset(&prometheus->current, 0, sizeof(prometheus->current));
+    memset(&prometheus->state, 0, sizeof(prometheus->state));
+    prometheus->started = FALSE;
+    prometheus->pending = FALSE;
+}
+
+static void nano_prometheus_draw (void *tapdata) {
+    nano_prometheus_t *prometheus = (nano_prometheus_t *) tapdata;
+
+    nano_prometheus_flush(prometheus);
+    nano_prometheus_report(prometheus);
+}
+
+static void nano_prometheus_free (nano_prometheus_t *prometheus) {
+    g_mutex_clear(&prometheus->lock);
+    g_cond_clear(&prometheus->wake);
+    g_free(prometheus->temp_path);
+    g_free(prometheus->path);
+    g_free(prometheus);
+}
+
+// the writer finishes what it was handed before it stops
+static void nano_prometheus_finish (void *tapdata) {
+    nano_prometheus_t *prometheus = (nano_prometheus_t *) tapdata;
+
+    nano_prometheus_flush(prometheus);
+
+    g_mutex_lock(&prometheus->lock);
+    prometheus->stopping = TRUE;
+    g_cond_signal(&prometheus->wake);
+    g_mutex_unlock(&prometheus->lock);
+    g_thread_join(prometheus->writer);
+
+    nano_prometheus_report(prometheus);
+    nano_prometheus_free(prometheus);
+}
+
+static void nano_prometheus_init (const char *opt_arg, void *userdata _U_) {
+    const char *args = opt_arg + strlen("nano,prometheus");
+    nano_prometheus_t *prometheus;
+    GString *error_string;
+    gchar **fields;
+
+    if (*args != ',' || args[1] == '\0') {
+        report_failure("Usage: -z nano,prometheus,<output file>[,<seconds between updates>]");
+        return;
+    }
+
+    fields = g_strsplit(args + 1, ",", 2);
+
+    prometheus = g_new0(nano_prometheus_t, 1);
+    prometheus->path = g_strdup(fields[0]);
+    // the collector only reads *.prom, so the file being written is not picked up
+    prometheus->temp_path = g_strdup_printf("%s.tmp", prometheus->path);
+    prometheus->interval = fields[1] ? (guint) strtoul(fields[1], NULL, 10) : NANO_PROMETHEUS_DEFAULT_INTERVAL;
+    g_mutex_init(&prometheus->lock);
+    g_cond_init(&prometheus->wake);
+    g_strfreev(fields);
+
+    if (prometheus->interval == 0) {
+        prometheus->interval = NANO_PROMETHEUS_DEFAULT_INTERVAL;
+    }
+
+    error_string = register_tap_listener("nano", prometheus, NULL, TL_REQUIRES_NOTHING, nano_prometheus_reset, nano_prometheus_packet, nano_prometheus_draw, nano_prometheus_finish);
+    if (error_string) {
+        report_failure("Couldn't register nano,prometheus tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        nano_prometheus_free(prometheus);
+        return;
+    }
+
+    prometheus->writer = g_thread_new("nano prometheus", nano_prometheus_writer, prometheus);
+}
+
+static stat_tap_ui nano_prometheus_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "nano,prometheus",
+    nano_prometheus_init,
+    0,
+    NULL
+};
+
+void nano_register_prometheus(void)
+{
+    register_stat_tap_ui(&nano_prometheus_ui, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,448 @@
+/* nano_sidecar.c
+* Persisted first pass results, memory mapped when a capture is reopened
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* The first pass over a large capture spends most of its time hashing blocks
+* for fork detection and state block classification. With a sidecar file
+* configured, the first pass writes what it found: the session state a frame
+* starts in, per block results and the fork tables. Reopening the capture maps
+* the file and answers from it instead.
+*
+* The file is a header followed by 8 byte aligned sections of fixed size
+* records in host byte order, so it is used in place and nothing is parsed.
+* Per frame sections are in frame order and found by binary search. The
+* header records the preferences and record layouts it was written with.
+* The fingerprint only covers the frame records, so every record is handed
+* to a check from the dissector when the file is mapped, and one it rejects
+* gets the whole file rewritten.
+*
+* Epan does not tell dissectors which file they are reading, so the sidecar
+* is matched to the capture frame by frame: every frame the dissector sees has
+* a record with its length and a digest of its first bytes, checked before the
+* frame is answered from the file. A sidecar for another capture fails on the
+* first frame and this pass writes a new one. A frame that does not match
+* later on ends the use of the sidecar for the rest of the pass, and the file
+* is replaced on the next open.
+*/
+
+#include <config.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <wsutil/file_util.h>
+#include <wsutil/report_message.h>
+#include <wsutil/wslog.h>
+
+#include "nano_sidecar.h"
+
+#define NANO_SIDECAR_MAGIC "NANOIDX"
+#define NANO_SIDECAR_VERSION 1
+#define NANO_SIDECAR_BYTE_ORDER 0x01020304
+
+// section 0 holds the frame records, the others follow the public section ids
+#define NANO_SIDECAR_FRAMES 0
+#define NANO_SIDECAR_ALL_SECTIONS (1 + NANO_SIDECAR_SECTIONS)
+
+#define NANO_SIDECAR_ALIGN(n) (((n) + 7) & ~(gsize) 7)
+
+struct nano_sidecar_frame {
+    guint32 frame;
+    guint32 length;
+    guint32 digest;
+    guint32 reserved;
+};
+
+struct nano_sidecar_section_entry {
+    guint32 record_size;
+    guint32 count;
+    guint64 offset;
+};
+
+struct nano_sidecar_header {
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 header_size;
+    guint32 reserved;
+    guint32 settings[NANO_SIDECAR_SETTINGS];
+    // FNV-1a over the frame records, catches a truncated or overwritten file
+    guint64 fingerprint;
+    struct nano_sidecar_section_entry sections[NANO_SIDECAR_ALL_SECTIONS];
+};
+
+static gchar *nano_sidecar_path;
+static guint32 nano_sidecar_settings[NANO_SIDECAR_SETTINGS];
+static guint32 nano_sidecar_record_sizes[NANO_SIDECAR_ALL_SECTIONS];
+// the size of the caller's struct, record_sizes rounds it up
+static guint32 nano_sidecar_struct_sizes[NANO_SIDECAR_ALL_SECTIONS];
+static nano_sidecar_record_check_t nano_sidecar_check;
+
+// reading
+static GMappedFile *nano_sidecar_map;
+static const struct nano_sidecar_header *nano_sidecar_mapped_header;
+static gboolean nano_sidecar_is_active;
+static gboolean nano_sidecar_is_stale;
+static gboolean nano_sidecar_accepted;
+static guint32 nano_sidecar_covered_frame;
+
+// writing
+static GByteArray *nano_sidecar_collected[NANO_SIDECAR_ALL_SECTIONS];
+static guint32 nano_sidecar_last_frame;
+
+static guint64 nano_sidecar_fnv1a (const guint8 *data, gsize length) {
+    guint64 hash = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+
+    for (gsize i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * G_GUINT64_CONSTANT(0x100000001b3);
+    }
+
+    return hash;
+}
+
+static const guint8 *nano_sidecar_base (void) {
+    return (const guint8 *) g_mapped_file_get_contents(nano_sidecar_map);
+}
+
+static gboolean nano_sidecar_is_valid (const guint8 *contents, gsize length) {
+    const struct nano_sidecar_header *header = (const struct nano_sidecar_header *) contents;
+
+    if (length < sizeof(*header) || memcmp(header->magic, NANO_SIDECAR_MAGIC, sizeof(NANO_SIDECAR_MAGIC)) ||
+            header->version != NANO_SIDECAR_VERSION || header->byte_order != NANO_SIDECAR_BYTE_ORDER ||
+            header->header_size != sizeof(*header)) {
+        return FALSE;
+    }
+
+    if (memcmp(header->settings, nano_sidecar_settings, sizeof(nano_sidecar_settings))) {
+        return FALSE;
+    }
+
+    for (int i = 0; i < NANO_SIDECAR_ALL_SECTIONS; i++) {
+        const struct nano_sidecar_section_entry *section = &header->sections[i];
+
+        if (section->record_size != nano_sidecar_record_sizes[i] || section->offset % 8 != 0 ||
+                section->offset > length || (guint64) section->count * section->record_size > length - section->offset) {
+            return FALSE;
+        }
+    }
+
+    const struct nano_sidecar_section_entry *frames = &header->sections[NANO_SIDECAR_FRAMES];
+    if (nano_sidecar_fnv1a(contents + frames->offset, (gsize) frames->count * frames->record_size) != header->fingerprint) {
+        return FALSE;
+    }
+
+    for (int i = 0; nano_sidecar_check && i < NANO_SIDECAR_SECTIONS; i++) {
+        const struct nano_sidecar_section_entry *section = &header->sections[1 + i];
+
+        for (guint32 r = 0; r < section->count; r++) {
+            if (!nano_sidecar_check(i, contents + section->offset + (gsize) r * section->record_size)) {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+static void nano_sidecar_start_collecting (void) {
+    if (nano_sidecar_map) {
+        g_mapped_file_unref(nano_sidecar_map);
+        nano_sidecar_map = NULL;
+    }
+    nano_sidecar_mapped_header = NULL;
+    nano_sidecar_is_active = FALSE;
+
+    for (int i = 0; i < NANO_SIDECAR_ALL_SECTIONS; i++) {
+        nano_sidecar_collected[i] = g_byte_array_new();
+    }
+}
+
+void nano_sidecar_open (const char *path, const guint32 *settings, const guint32 *record_sizes, nano_sidecar_record_check_t check) {
+    nano_sidecar_close();
+
+    if (!path || !*path) {
+        return;
+    }
+
+    nano_sidecar_path = g_strdup(path);
+    memcpy(nano_sidecar_settings, settings, sizeof(nano_sidecar_settings));
+    nano_sidecar_check = check;
+    nano_sidecar_record_sizes[NANO_SIDECAR_FRAMES] = sizeof(struct nano_sidecar_frame);
+    nano_sidecar_struct_sizes[NANO_SIDECAR_FRAMES] = sizeof(struct nano_sidecar_frame);
+    for (int i = 0; i < NANO_SIDECAR_SECTIONS; i++) {
+        nano_sidecar_record_sizes[1 + i] = (guint32) NANO_SIDECAR_ALIGN(record_sizes[i]);
+        nano_sidecar_struct_sizes[1 + i] = record_sizes[i];
+    }
+
+    nano_sidecar_map = g_mapped_file_new(path, FALSE, NULL);
+    if (nano_sidecar_map && nano_sidecar_is_valid(nano_sidecar_base(), g_mapped_file_get_length(nano_sidecar_map))) {
+        nano_sidecar_mapped_header = (const struct nano_sidecar_header *) nano_sidecar_base();
+        nano_sidecar_is_active = TRUE;
+        return;
+    }
+
+    nano_sidecar_start_collecting();
+}
+
+void nano_sidecar_close (void) {
+    if (nano_sidecar_map) {
+        g_mapped_file_unref(nano_sidecar_map);
+        nano_sidecar_map = NULL;
+
+        // the next open writes a new one
+        if (nano_sidecar_is_stale) {
+            ws_unlink(nano_sidecar_path);
+        }
+    }
+    nano_sidecar_mapped_header = NULL;
+    nano_sidecar_is_active = FALSE;
+    nano_sidecar_is_stale = FALSE;
+    nano_sidecar_accepted = FALSE;
+    nano_sidecar_covered_frame = 0;
+
+    for (int i = 0; i < NANO_SIDECAR_ALL_SECTIONS; i++) {
+        if (nano_sidecar_collected[i]) {
+            g_byte_array_free(nano_sidecar_collected[i], TRUE);
+            nano_sidecar_collected[i] = NULL;
+        }
+    }
+    nano_sidecar_last_frame = 0;
+
+    g_free(nano_sidecar_path);
+    nano_sidecar_path = NULL;
+}
+
+gboolean nano_sidecar_active (void) {
+    return nano_sidecar_is_active;
+}
+
+gboolean nano_sidecar_collecting (void) {
+    return nano_sidecar_collected[NANO_SIDECAR_FRAMES] != NULL;
+}
+
+//
+// Reading
+//
+const void *nano_sidecar_section (int section, guint32 *count) {
+    if (!nano_sidecar_mapped_header) {
+        *count = 0;
+        return NULL;
+    }
+
+    const struct nano_sidecar_section_entry *entry = &nano_sidecar_mapped_header->sections[1 + section];
+
+    *count = entry->count;
+    return nano_sidecar_base() + entry->offset;
+}
+
+// index of the first record of frame or after it, records start with the frame number
+static guint32 nano_sidecar_lower_bound (const guint8 *records, guint32 record_size, guint32 count, guint32 frame) {
+    guint32 low = 0, high = count;
+
+    while (low < high) {
+        guint32 middle = low + (high - low) / 2;
+        guint32 middle_frame;
+
+        memcpy(&middle_frame, records + (gsize) middle * record_size, sizeof(middle_frame));
+        if (middle_frame < frame) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+const void *nano_sidecar_frame_records (int section, guint32 frame, guint32 *count) {
+    const struct nano_sidecar_section_entry *entry;
+    const guint8 *records;
+    guint32 first, last;
+
+    *count = 0;
+    if (!nano_sidecar_mapped_header) {
+        return NULL;
+    }
+
+    entry = &nano_sidecar_mapped_header->sections[1 + section];
+    records = nano_sidecar_base() + entry->offset;
+    first = nano_sidecar_lower_bound(records, entry->record_size, entry->count, frame);
+
+    for (last = first; last < entry->count; last++) {
+        guint32 record_frame;
+
+        memcpy(&record_frame, records + (gsize) last * entry->record_size, sizeof(record_frame));
+        if (record_frame != frame) {
+            break;
+        }
+    }
+
+    *count = last - first;
+    return *count ? records + (gsize) first * entry->record_size : NULL;
+}
+
+gboolean nano_sidecar_check_frame (guint32 frame, guint32 length, guint32 digest) {
+    const struct nano_sidecar_section_entry *entry;
+    const struct nano_sidecar_frame *frames;
+    guint32 index;
+
+    if (!nano_sidecar_is_active) {
+        return FALSE;
+    }
+    if (frame == nano_sidecar_covered_frame) {
+        return TRUE;
+    }
+
+    entry = &nano_sidecar_mapped_header->sections[NANO_SIDECAR_FRAMES];
+    frames = (const struct nano_sidecar_frame *) (nano_sidecar_base() + entry->offset);
+    index = nano_sidecar_lower_bound((const guint8 *) frames, entry->record_size, entry->count, frame);
+
+    if (index == entry->count || frames[index].frame != frame || frames[index].length != length || frames[index].digest != digest) {
+        if (!nano_sidecar_accepted) {
+            // written for another capture, nothing was taken from it yet so this pass can replace it
+            nano_sidecar_start_collecting();
+            return FALSE;
+        }
+
+        // records handed out for earlier frames point into the mapping, it stays until the file is closed
+        ws_warning("Nano sidecar %s does not match frame %u of this capture, ignoring it", nano_sidecar_path, frame);
+        nano_sidecar_is_active = FALSE;
+        nano_sidecar_is_stale = TRUE;
+        nano_sidecar_covered_frame = 0;
+        return FALSE;
+    }
+
+    nano_sidecar_accepted = TRUE;
+    nano_sidecar_covered_frame = frame;
+    return TRUE;
+}
+
+gboolean nano_sidecar_covers (guint32 frame) {
+    return nano_sidecar_is_active && frame == nano_sidecar_covered_frame;
+}
+
+//
+// Writing
+//
+void nano_sidecar_add_frame (guint32 frame, guint32 length, guint32 digest) {
+    struct nano_sidecar_frame record = { frame, length, digest, 0 };
+
+    if (!nano_sidecar_collecting() || frame == nano_sidecar_last_frame) {
+        return;
+    }
+
+    g_byte_array_append(nano_sidecar_collected[NANO_SIDECAR_FRAMES], (const guint8 *) &record, sizeof(record));
+    nano_sidecar_last_frame = frame;
+}
+
+void nano_sidecar_add (int section, const void *record) {
+    GByteArray *records;
+    guint32 record_size = nano_sidecar_record_sizes[1 + section];
+
+    if (!nano_sidecar_collecting()) {
+        return;
+    }
+
+    // the record size was rounded up to keep records aligned, only the struct is copied and the padding is zero
+    records = nano_sidecar_collected[1 + section];
+    g_byte_array_set_size(records, records->len + record_size);
+    memset(records->data + records->len - record_size, 0, record_size);
+    memcpy(records->data + records->len - record_size, record, nano_sidecar_struct_sizes[1 + section]);
+}
+
+void nano_sidecar_set_section (int section, GByteArray *records) {
+    if (!nano_sidecar_collecting()) {
+        g_byte_array_free(records, TRUE);
+        return;
+    }
+
+    g_byte_array_free(nano_sidecar_collected[1 + section], TRUE);
+    nano_sidecar_collected[1 + section] = records;
+}
+
+static gboolean nano_sidecar_write_bytes (FILE *fh, const void *data, gsize length) {
+    return length == 0 || fwrite(data, 1, length, fh) == length;
+}
+
+void nano_sidecar_write (void) {
+    static const guint8 padding[8];
+    struct nano_sidecar_header header;
+    gboolean ok = TRUE;
+
+    if (!nano_sidecar_collecting() || nano_sidecar_collected[NANO_SIDECAR_FRAMES]->len == 0) {
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NANO_SIDECAR_MAGIC, sizeof(NANO_SIDECAR_MAGIC));
+    header.version = NANO_SIDECAR_VERSION;
+    header.byte_order = NANO_SIDECAR_BYTE_ORDER;
+    header.header_size = sizeof(header);
+    memcpy(header.settings, nano_sidecar_settings, sizeof(nano_sidecar_settings));
+
+    guint64 offset = NANO_SIDECAR_ALIGN(sizeof(header));
+    for (int i = 0; i < NANO_SIDECAR_ALL_SECTIONS; i++) {
+        GByteArray *records = nano_sidecar_collected[i];
+
+        header.sections[i].record_size = nano_sidecar_record_sizes[i];
+        header.sections[i].count = records->len / nano_sidecar_record_sizes[i];
+        header.sections[i].offset = offset;
+        offset += NANO_SIDECAR_ALIGN(records->len);
+    }
+    header.fingerprint = nano_sidecar_fnv1a(nano_sidecar_collected[NANO_SIDECAR_FRAMES]->data, nano_sidecar_collected[NANO_SIDECAR_FRAMES]->len);
+
+    // readers of the old file never see a half written one
+    gchar *temp_path = g_strdup_printf("%s.tmp", nano_sidecar_path);
+    FILE *fh = ws_fopen(temp_path, "wb");
+
+    if (!fh) {
+        report_open_failure(temp_path, errno, TRUE);
+        g_free(temp_path);
+        return;
+    }
+
+    ok = nano_sidecar_write_bytes(fh, &header, sizeof(header)) &&
+        nano_sidecar_write_bytes(fh, padding, NANO_SIDECAR_ALIGN(sizeof(header)) - sizeof(header));
+    for (int i = 0; ok && i < NANO_SIDECAR_ALL_SECTIONS; i++) {
+        GByteArray *records = nano_sidecar_collected[i];
+
+        ok = nano_sidecar_write_bytes(fh, records->data, records->len) &&
+            nano_sidecar_write_bytes(fh, padding, NANO_SIDECAR_ALIGN(records->len) - records->len);
+    }
+
+    if (ws_fclose(fh) != 0 || !ok) {
+        report_write_failure(temp_path, errno);
+        ws_unlink(temp_path);
+    } else if (ws_rename(temp_path, nano_sidecar_path) != 0) {
+        report_failure("Could not rename %s to %s: %s", temp_path, nano_sidecar_path, g_strerror(errno));
+        ws_unlink(temp_path);
+    }
+
+    g_free(temp_path);
+
+    // written once per pass, a redissection starts collecting again from nano_sidecar_open
+    for (int i = 0; i < NANO_SIDECAR_ALL_SECTIONS; i++) {
+        g_byte_array_free(nano_sidecar_collected[i], TRUE);
+        nano_sidecar_collected[i] = NULL;
+    }
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,73 @@
+/* nano_sidecar.h
+* Persisted first pass results, memory mapped when a capture is reopened
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_SIDECAR_H__
+#define __NANO_SIDECAR_H__
+
+#include <glib.h>
+
+// records of the per frame sections start with the guint32 frame number and are in frame order
+enum {
+    NANO_SIDECAR_SESSION_STATES,
+    NANO_SIDECAR_STATE_NOTES,
+    NANO_SIDECAR_FORK_NOTES,
+    // whole tables, as they were at the end of the first pass
+    NANO_SIDECAR_FORK_ROOTS,
+    NANO_SIDECAR_FORK_SIDES,
+    NANO_SIDECAR_SECTIONS
+};
+
+// preferences that change what the first pass records, a sidecar written with others is not used
+#define NANO_SIDECAR_SETTINGS 8
+
+// FALSE for a record the dissector cannot use as it is, such as an index out of range
+typedef gboolean (*nano_sidecar_record_check_t)(int section, const void *record);
+
+// maps path if it was written for the same settings and record layouts and check accepts every record,
+// otherwise prepares to write it
+void nano_sidecar_open(const char *path, const guint32 *settings, const guint32 *record_sizes, nano_sidecar_record_check_t check);
+void nano_sidecar_close(void);
+
+// TRUE while a mapped sidecar stands in for the first pass
+gboolean nano_sidecar_active(void);
+// TRUE while the first pass collects records to write
+gboolean nano_sidecar_collecting(void);
+
+// first pass, once per frame: checks the frame against the mapped one, a mismatch stops using the sidecar
+gboolean nano_sidecar_check_frame(guint32 frame, guint32 length, guint32 digest);
+// the last frame check_frame accepted
+gboolean nano_sidecar_covers(guint32 frame);
+
+// records of a per frame section belonging to frame, NULL if there are none
+const void *nano_sidecar_frame_records(int section, guint32 frame, guint32 *count);
+// a whole section
+const void *nano_sidecar_section(int section, guint32 *count);
+
+void nano_sidecar_add_frame(guint32 frame, guint32 length, guint32 digest);
+void nano_sidecar_add(int section, const void *record);
+void nano_sidecar_set_section(int section, GByteArray *records);
+
+// writes the collected records next to the old file and renames it into place
+void nano_sidecar_write(void);
+
+#endif /* __NANO_SIDECAR_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
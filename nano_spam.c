@@ -0,0 +1,199 @@
+/* nano_spam.c
+* Accounts publishing faster than a threshold, over a sliding window
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* Every realtime block whose account is in the block (state and open blocks)
+* counts for that account in a nano_topk sketch of blocks, and publishes in a
+* second one. Only the heaviest accounts have counters, so memory stays the
+* same during a spam wave however many accounts it uses.
+*
+* The window slides in eight steps: each time packet time moves on by an
+* eighth of the window, every count is scaled by e^(-1/8). A steady rate r
+* then settles at a count of about r * step / (1 - e^(-1/8)), which gives the
+* rate back. It works the same on a live capture and a file, with a rate
+* that reacts within a step and fades over a window.
+*
+* An account whose publish rate is above the threshold is flagged; the
+* dissector turns that into expert info, and the Nano/Spam Accounts
+* statistics count the blocks of flagged accounts and average the publish
+* rate each of them was flagged at.
+*/
+
+#include <config.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stats_tree.h>
+
+#include "packet-nano.h"
+#include "nano_aliases.h"
+#include "nano_spam.h"
+#include "nano_topk.h"
+
+#define NANO_SPAM_STEPS 8
+
+// 1024 counters for each sketch
+#define NANO_SPAM_EPSILON (1.0 / 1024)
+#define NANO_SPAM_DELTA 0.01
+
+// after this many steps without a block every count has faded to nothing
+#define NANO_SPAM_MAX_STEPS 256
+
+static guint nano_spam_window = 60;
+static guint nano_spam_threshold = 5;
+
+static nano_topk_t *nano_spam_publishes;
+static nano_topk_t *nano_spam_blocks;
+
+static gboolean nano_spam_started;
+static gdouble nano_spam_step_start;
+
+void nano_spam_configure (guint window, guint threshold) {
+    nano_spam_window = MAX(window, 1);
+    nano_spam_threshold = threshold;
+}
+
+void nano_spam_reset (void) {
+    if (!nano_spam_publishes) {
+        nano_spam_publishes = nano_topk_new(32, NANO_SPAM_EPSILON, NANO_SPAM_DELTA);
+        nano_spam_blocks = nano_topk_new(32, NANO_SPAM_EPSILON, NANO_SPAM_DELTA);
+    }
+
+    nano_topk_reset(nano_spam_publishes);
+    nano_topk_reset(nano_spam_blocks);
+    nano_spam_started = FALSE;
+}
+
+static gdouble nano_spam_step_seconds (void) {
+    return (gdouble) nano_spam_window / NANO_SPAM_STEPS;
+}
+
+// fades the counts by the steps between the last block and now
+static void nano_spam_slide (const nstime_t *now) {
+    gdouble seconds = nstime_to_sec(now);
+    gdouble step = nano_spam_step_seconds();
+
+    if (!nano_spam_started) {
+        nano_spam_started = TRUE;
+        nano_spam_step_start = seconds;
+        return;
+    }
+
+    // packets slightly out of order count for the current step
+    if (seconds < nano_spam_step_start + step) {
+        return;
+    }
+
+    guint steps = (guint) MIN(floor((seconds - nano_spam_step_start) / step), NANO_SPAM_MAX_STEPS);
+
+    if (steps == NANO_SPAM_MAX_STEPS) {
+        nano_topk_reset(nano_spam_publishes);
+        nano_topk_reset(nano_spam_blocks);
+        nano_spam_step_start = seconds;
+        return;
+    }
+
+    gdouble factor = exp(-(gdouble) steps / NANO_SPAM_STEPS);
+
+    nano_topk_decay(nano_spam_publishes, factor);
+    nano_topk_decay(nano_spam_blocks, factor);
+    nano_spam_step_start += steps * step;
+}
+
+static gfloat nano_spam_rate (guint64 count) {
+    return (gfloat) (count * (1 - exp(-1.0 / NANO_SPAM_STEPS)) / nano_spam_step_seconds());
+}
+
+gboolean nano_spam_observe (const guint8 *account, gboolean publish, guint weight, const nstime_t *now, nano_spam_rates_t *rates) {
+    if (!nano_spam_publishes || weight == 0) {
+        return FALSE;
+    }
+
+    nano_spam_slide(now);
+
+    nano_topk_add(nano_spam_blocks, account, weight);
+    if (publish) {
+        nano_topk_add(nano_spam_publishes, account, weight);
+    }
+
+    rates->publishes = nano_spam_rate(nano_topk_count(nano_spam_publishes, account));
+    rates->blocks = nano_spam_rate(nano_topk_count(nano_spam_blocks, account));
+
+    return nano_spam_threshold > 0 && rates->publishes > nano_spam_threshold;
+}
+
+
+//
+// Nano/Spam Accounts statistics
+//
+static const char *st_str_flagged_blocks = "Blocks From Flagged Accounts";
+static const char *st_str_flagged_publishes = "Publishes From Flagged Accounts";
+static const char *st_str_flagged_rate = "Publish Rate of Flagged Accounts (per second)";
+
+static int st_node_flagged_blocks = -1;
+static int st_node_flagged_publishes = -1;
+static int st_node_flagged_rate = -1;
+
+static void nano_spam_stats_init (stats_tree *st) {
+    st_node_flagged_blocks = stats_tree_create_node(st, st_str_flagged_blocks, 0, STAT_DT_INT, TRUE);
+    st_node_flagged_publishes = stats_tree_create_node(st, st_str_flagged_publishes, 0, STAT_DT_INT, TRUE);
+    st_node_flagged_rate = stats_tree_create_node(st, st_str_flagged_rate, 0, STAT_DT_FLOAT, TRUE);
+}
+
+static tap_packet_status nano_spam_stats_packet (stats_tree *st, packet_info *pinfo _U_, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+    char address[NANO_ADDRESS_LENGTH + 1];
+    const char *label;
+
+    if (!tap_info->spam_account) {
+        return TAP_PACKET_DONT_REDRAW;
+    }
+
+    label = nano_aliases_lookup(tap_info->spam_account);
+    if (!label) {
+        nano_account_to_address(tap_info->spam_account, address);
+        label = address;
+    }
+
+    increase_stat_node(st, st_str_flagged_blocks, 0, FALSE, (gint) tap_info->sample_weight);
+    increase_stat_node(st, label, st_node_flagged_blocks, FALSE, (gint) tap_info->sample_weight);
+
+    if (tap_info->packet_type == NANO_PACKET_TYPE_PUBLISH) {
+        increase_stat_node(st, st_str_flagged_publishes, 0, FALSE, (gint) tap_info->sample_weight);
+        increase_stat_node(st, label, st_node_flagged_publishes, FALSE, (gint) tap_info->sample_weight);
+    }
+
+    // the rate each flagged block was seen at, averaged per account
+    avg_stat_node_add_value_float(st, st_str_flagged_rate, 0, FALSE, tap_info->spam_rate);
+    avg_stat_node_add_value_float(st, label, st_node_flagged_rate, FALSE, tap_info->spam_rate);
+
+    return TAP_PACKET_REDRAW;
+}
+
+void nano_register_spam(void)
+{
+    stats_tree_register_plugin("nano", "nano_spam", "Nano/Spam Accounts", 0, nano_spam_stats_packet, nano_spam_stats_init, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,45 @@
+/* nano_spam.h
+* Accounts publishing faster than a threshold, over a sliding window
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_SPAM_H__
+#define __NANO_SPAM_H__
+
+#include <glib.h>
+#include <wsutil/nstime.h>
+
+// per second, over the window
+typedef struct _nano_spam_rates {
+    gfloat publishes;
+    gfloat blocks;
+} nano_spam_rates_t;
+
+// counts fade over window seconds; accounts above threshold publishes per second are flagged
+void nano_spam_configure(guint window, guint threshold);
+void nano_spam_reset(void);
+
+// first pass, in packet order: a realtime block of account standing for weight messages; TRUE if the account is over the threshold
+gboolean nano_spam_observe(const guint8 *account, gboolean publish, guint weight, const nstime_t *now, nano_spam_rates_t *rates);
+
+void nano_register_spam(void);
+
+#endif /* __NANO_SPAM_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,93 @@
+/* nano_stats.c
+* Message statistics, extrapolated where realtime messages are sampled
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* Message counts are exact, every message header is read. Blocks and votes
+* only come from messages whose body was dissected; each of those counts for
+* as many messages as it stands for, and the nodes say so when sampling is on.
+*/
+
+#include <config.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stats_tree.h>
+
+#include "packet-nano.h"
+
+static const char *st_str_messages = "Messages";
+static const char *st_str_sampled_out = "Sampled Out";
+
+// names are picked when the tree is created, from the sampling preferences at that time
+static const char *st_str_blocks;
+static const char *st_str_votes;
+static const char *st_str_vote_hashes;
+
+static int st_node_messages = -1;
+static int st_node_sampled_out = -1;
+static int st_node_blocks = -1;
+static int st_node_votes = -1;
+
+static void nano_stats_tree_init (stats_tree *st) {
+    gboolean sampled = nano_sampling_enabled();
+
+    st_str_blocks = sampled ? "Blocks (extrapolated from samples)" : "Blocks";
+    st_str_votes = sampled ? "Votes (extrapolated from samples)" : "Votes";
+    st_str_vote_hashes = sampled ? "Voted Hashes (extrapolated from samples)" : "Voted Hashes";
+
+    st_node_messages = stats_tree_create_node(st, st_str_messages, 0, STAT_DT_INT, TRUE);
+    st_node_sampled_out = stats_tree_create_node(st, st_str_sampled_out, 0, STAT_DT_INT, TRUE);
+    st_node_blocks = stats_tree_create_node(st, st_str_blocks, 0, STAT_DT_INT, TRUE);
+    st_node_votes = stats_tree_create_node(st, st_str_votes, 0, STAT_DT_INT, TRUE);
+}
+
+static tap_packet_status nano_stats_tree_packet (stats_tree *st, packet_info *pinfo _U_, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_) {
+    const nano_tap_info_t *tap_info = (const nano_tap_info_t *) data;
+    gint weight = (gint) tap_info->sample_weight;
+
+    tick_stat_node(st, st_str_messages, 0, FALSE);
+    tick_stat_node(st, nano_packet_type_name(tap_info->packet_type), st_node_messages, FALSE);
+
+    if (weight == 0) {
+        tick_stat_node(st, st_str_sampled_out, 0, FALSE);
+        tick_stat_node(st, nano_packet_type_name(tap_info->packet_type), st_node_sampled_out, FALSE);
+        return TAP_PACKET_REDRAW;
+    }
+
+    if (tap_info->block) {
+        increase_stat_node(st, st_str_blocks, 0, FALSE, weight);
+        increase_stat_node(st, nano_block_type_name(tap_info->block_type), st_node_blocks, FALSE, weight);
+    }
+
+    if (tap_info->vote_account) {
+        increase_stat_node(st, st_str_votes, 0, FALSE, weight);
+        increase_stat_node(st, st_str_vote_hashes, st_node_votes, FALSE, weight * (gint) MAX(tap_info->vote_hash_count, 1));
+    }
+
+    return TAP_PACKET_REDRAW;
+}
+
+void nano_register_stats(void)
+{
+    stats_tree_register_plugin("nano", "nano_messages", "Nano/Messages", 0, nano_stats_tree_packet, nano_stats_tree_init, NULL);
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
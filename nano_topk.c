@@ -0,0 +1,346 @@
+/* nano_topk.c
+* Heavy hitters in fixed memory: space-saving counters backed by a count-min sketch
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+* Space-saving keeps a fixed set of counters. A key that has one adds to it;
+* a new key takes over the smallest counter and starts from its count, which
+* becomes the key's error. Every key whose true count is above the smallest
+* counter has a counter, so the top keys are never lost.
+*
+* Starting from the smallest counter plus the new weight overestimates new
+* keys once the counts are high. The count-min sketch in front of the counters
+* bounds every key's count as well, so a key taking over a counter starts from
+* whichever of the two bounds is lower, but never below the count it takes
+* over: the smallest counter must not shrink, or a key evicted earlier could
+* have a true count above it without a counter.
+*
+* The smallest counter is the root of a binary min-heap; adding to a counter
+* only ever moves it down. Keys find their counter through an open addressing
+* index with linear probing, twice the size of the counter array.
+*/
+
+#include <config.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nano_topk.h"
+
+#define NANO_TOPK_EMPTY G_MAXUINT32
+
+// keeps a mistaken epsilon from asking for gigabytes
+#define NANO_TOPK_MAX_COUNTERS (1u << 20)
+#define NANO_TOPK_MAX_WIDTH (1u << 22)
+#define NANO_TOPK_MAX_DEPTH 16
+
+struct _nano_topk {
+    guint key_length;
+
+    // space-saving counters, keys are key_length bytes each
+    guint capacity;
+    guint used;
+    guint8 *keys;
+    guint64 *counts;
+    guint64 *errors;
+
+    // counter indices, the smallest count first, and each counter's place in it
+    guint32 *heap;
+    guint32 *heap_positions;
+
+    // counter index for each key, slot_mask + 1 slots
+    guint32 *index;
+    guint32 slot_mask;
+
+    // count-min rows of width cells
+    guint64 *sketch;
+    guint width;
+    guint depth;
+
+    guint64 total;
+};
+
+static guint64 nano_topk_hash (const nano_topk_t *topk, const guint8 *key) {
+    guint64 hash = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+
+    for (guint i = 0; i < topk->key_length; i++) {
+        hash = (hash ^ key[i]) * G_GUINT64_CONSTANT(0x100000001b3);
+    }
+
+    // FNV-1a leaves the high bits weak, the count-min rows need all of them
+    hash ^= hash >> 33;
+    hash *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+static const guint8 *nano_topk_key (const nano_topk_t *topk, guint32 counter) {
+    return topk->keys + (gsize) counter * topk->key_length;
+}
+
+nano_topk_t *nano_topk_new (guint key_length, double epsilon, double delta) {
+    nano_topk_t *topk = g_new0(nano_topk_t, 1);
+    guint slots = 2;
+
+    if (epsilon <= 0 || epsilon >= 1) {
+        epsilon = 0.001;
+    }
+    if (delta <= 0 || delta >= 1) {
+        delta = 0.01;
+    }
+
+    topk->key_length = key_length;
+    topk->capacity = (guint) MIN(ceil(1 / epsilon), NANO_TOPK_MAX_COUNTERS);
+    topk->width = (guint) MIN(ceil(G_E / epsilon), NANO_TOPK_MAX_WIDTH);
+    topk->depth = (guint) CLAMP(ceil(log(1 / delta)), 1, NANO_TOPK_MAX_DEPTH);
+
+    while (slots < 2 * topk->capacity) {
+        slots <<= 1;
+    }
+    topk->slot_mask = slots - 1;
+
+    topk->keys = (guint8 *) g_malloc((gsize) topk->capacity * key_length);
+    topk->counts = g_new(guint64, topk->capacity);
+    topk->errors = g_new(guint64, topk->capacity);
+    topk->heap = g_new(guint32, topk->capacity);
+    topk->heap_positions = g_new(guint32, topk->capacity);
+    topk->index = g_new(guint32, slots);
+    topk->sketch = g_new(guint64, (gsize) topk->width * topk->depth);
+
+    nano_topk_reset(topk);
+
+    return topk;
+}
+
+void nano_topk_free (nano_topk_t *topk) {
+    if (!topk) {
+        return;
+    }
+
+    g_free(topk->keys);
+    g_free(topk->counts);
+    g_free(topk->errors);
+    g_free(topk->heap);
+    g_free(topk->heap_positions);
+    g_free(topk->index);
+    g_free(topk->sketch);
+    g_free(topk);
+}
+
+void nano_topk_reset (nano_topk_t *topk) {
+    topk->used = 0;
+    topk->total = 0;
+    memset(topk->index, 0xff, (gsize) (topk->slot_mask + 1) * sizeof(guint32));
+    memset(topk->sketch, 0, (gsize) topk->width * topk->depth * sizeof(guint64));
+}
+
+static guint32 *nano_topk_slot (const nano_topk_t *topk, const guint8 *key, guint64 hash) {
+    guint32 slot = (guint32) hash & topk->slot_mask;
+
+    while (topk->index[slot] != NANO_TOPK_EMPTY && memcmp(nano_topk_key(topk, topk->index[slot]), key, topk->key_length) != 0) {
+        slot = (slot + 1) & topk->slot_mask;
+    }
+
+    return &topk->index[slot];
+}
+
+// linear probing has no tombstones, entries behind the removed one move up if their home slot allows
+static void nano_topk_index_remove (nano_topk_t *topk, guint32 *removed) {
+    guint32 hole = (guint32) (removed - topk->index);
+    guint32 slot = hole;
+
+    for (;;) {
+        slot = (slot + 1) & topk->slot_mask;
+        if (topk->index[slot] == NANO_TOPK_EMPTY) {
+            break;
+        }
+
+        guint32 home = (guint32) nano_topk_hash(topk, nano_topk_key(topk, topk->index[slot])) & topk->slot_mask;
+
+        // move it if its home is not between the hole and where it sits, cyclically
+        if (((slot - home) & topk->slot_mask) >= ((slot - hole) & topk->slot_mask)) {
+            topk->index[hole] = topk->index[slot];
+            hole = slot;
+        }
+    }
+
+    topk->index[hole] = NANO_TOPK_EMPTY;
+}
+
+static void nano_topk_heap_set (nano_topk_t *topk, guint32 position, guint32 counter) {
+    topk->heap[position] = counter;
+    topk->heap_positions[counter] = position;
+}
+
+static void nano_topk_sift_down (nano_topk_t *topk, guint32 position) {
+    guint32 counter = topk->heap[position];
+    guint64 count = topk->counts[counter];
+
+    for (;;) {
+        guint32 child = 2 * position + 1;
+
+        if (child >= topk->used) {
+            break;
+        }
+        if (child + 1 < topk->used && topk->counts[topk->heap[child + 1]] < topk->counts[topk->heap[child]]) {
+            child++;
+        }
+        if (count <= topk->counts[topk->heap[child]]) {
+            break;
+        }
+
+        nano_topk_heap_set(topk, position, topk->heap[child]);
+        position = child;
+    }
+
+    nano_topk_heap_set(topk, position, counter);
+}
+
+static void nano_topk_sift_up (nano_topk_t *topk, guint32 position) {
+    guint32 counter = topk->heap[position];
+    guint64 count = topk->counts[counter];
+
+    while (position > 0) {
+        guint32 parent = (position - 1) / 2;
+
+        if (topk->counts[topk->heap[parent]] <= count) {
+            break;
+        }
+
+        nano_topk_heap_set(topk, position, topk->heap[parent]);
+        position = parent;
+    }
+
+    nano_topk_heap_set(topk, position, counter);
+}
+
+// adds weight to the key's cells in every row and returns the smallest of them
+static guint64 nano_topk_sketch_add (nano_topk_t *topk, guint64 hash, guint64 weight) {
+    guint32 h1 = (guint32) hash;
+    guint32 h2 = (guint32) (hash >> 32) | 1;
+    guint64 estimate = G_MAXUINT64;
+
+    for (guint row = 0; row < topk->depth; row++) {
+        guint64 *cell = &topk->sketch[(gsize) row * topk->width + (h1 + row * h2) % topk->width];
+
+        *cell += weight;
+        estimate = MIN(estimate, *cell);
+    }
+
+    return estimate;
+}
+
+void nano_topk_add (nano_topk_t *topk, const void *key, guint64 weight) {
+    guint64 hash = nano_topk_hash(topk, (const guint8 *) key);
+    guint64 estimate = nano_topk_sketch_add(topk, hash, weight);
+    guint32 *slot = nano_topk_slot(topk, (const guint8 *) key, hash);
+    guint32 counter;
+
+    topk->total += weight;
+
+    if (*slot != NANO_TOPK_EMPTY) {
+        counter = *slot;
+        topk->counts[counter] += weight;
+        nano_topk_sift_down(topk, topk->heap_positions[counter]);
+        return;
+    }
+
+    if (topk->used < topk->capacity) {
+        counter = topk->used++;
+        topk->counts[counter] = weight;
+        topk->errors[counter] = 0;
+        memcpy(topk->keys + (gsize) counter * topk->key_length, key, topk->key_length);
+        *slot = counter;
+
+        topk->heap[topk->used - 1] = counter;
+        nano_topk_sift_up(topk, topk->used - 1);
+        return;
+    }
+
+    // take over the smallest counter; the slot found above may move when its key leaves the index
+    counter = topk->heap[0];
+    nano_topk_index_remove(topk, nano_topk_slot(topk, nano_topk_key(topk, counter), nano_topk_hash(topk, nano_topk_key(topk, counter))));
+
+    guint64 count = MAX(MIN(topk->counts[counter] + weight, estimate), topk->counts[counter]);
+
+    topk->counts[counter] = count;
+    topk->errors[counter] = count - weight;
+    memcpy(topk->keys + (gsize) counter * topk->key_length, key, topk->key_length);
+    *nano_topk_slot(topk, (const guint8 *) key, hash) = counter;
+
+    nano_topk_sift_down(topk, 0);
+}
+
+guint64 nano_topk_count (const nano_topk_t *topk, const void *key) {
+    guint32 *slot = nano_topk_slot(topk, (const guint8 *) key, nano_topk_hash(topk, (const guint8 *) key));
+
+    return *slot != NANO_TOPK_EMPTY ? topk->counts[*slot] : 0;
+}
+
+// scaling keeps the order of the counts, the heap stays valid
+void nano_topk_decay (nano_topk_t *topk, double factor) {
+    for (guint i = 0; i < topk->used; i++) {
+        topk->counts[i] = (guint64) (topk->counts[i] * factor);
+        topk->errors[i] = MIN((guint64) (topk->errors[i] * factor), topk->counts[i]);
+    }
+
+    for (gsize i = 0; i < (gsize) topk->width * topk->depth; i++) {
+        topk->sketch[i] = (guint64) (topk->sketch[i] * factor);
+    }
+
+    topk->total = (guint64) (topk->total * factor);
+}
+
+guint64 nano_topk_total (const nano_topk_t *topk) {
+    return topk->total;
+}
+
+static gint nano_topk_compare_entries (gconstpointer a, gconstpointer b) {
+    const nano_topk_entry_t *entry_a = (const nano_topk_entry_t *) a;
+    const nano_topk_entry_t *entry_b = (const nano_topk_entry_t *) b;
+
+    if (entry_a->count != entry_b->count) {
+        return entry_a->count < entry_b->count ? 1 : -1;
+    }
+
+    return 0;
+}
+
+guint nano_topk_top (const nano_topk_t *topk, guint k, nano_topk_entry_t *entries) {
+    nano_topk_entry_t *all = g_new(nano_topk_entry_t, MAX(topk->used, 1));
+
+    for (guint i = 0; i < topk->used; i++) {
+        all[i].key = nano_topk_key(topk, i);
+        all[i].count = topk->counts[i];
+        all[i].error = topk->errors[i];
+    }
+
+    qsort(all, topk->used, sizeof(nano_topk_entry_t), nano_topk_compare_entries);
+
+    k = MIN(k, topk->used);
+    memcpy(entries, all, k * sizeof(nano_topk_entry_t));
+    g_free(all);
+
+    return k;
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,59 @@
+/* nano_topk.h
+* Heavy hitters in fixed memory: space-saving counters backed by a count-min sketch
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __NANO_TOPK_H__
+#define __NANO_TOPK_H__
+
+#include <glib.h>
+
+typedef struct _nano_topk nano_topk_t;
+
+typedef struct _nano_topk_entry {
+    const guint8 *key;
+    guint64 count;
+    // count is at most this much above the true count
+    guint64 error;
+} nano_topk_entry_t;
+
+/*
+ * Keeps ceil(1 / epsilon) counters for keys of key_length bytes. A count is
+ * over by at most epsilon times the total weight added; with probability
+ * 1 - delta the count-min sketch makes that bound tighter for keys that take
+ * over a counter. Memory is allocated here and never grows.
+ */
+nano_topk_t *nano_topk_new(guint key_length, double epsilon, double delta);
+void nano_topk_free(nano_topk_t *topk);
+void nano_topk_reset(nano_topk_t *topk);
+
+void nano_topk_add(nano_topk_t *topk, const void *key, guint64 weight);
+// estimated count of key, 0 if it has no counter
+guint64 nano_topk_count(const nano_topk_t *topk, const void *key);
+// scales every count by factor, 0 < factor < 1, to let old weight fade
+void nano_topk_decay(nano_topk_t *topk, double factor);
+
+// total weight added, after decay
+guint64 nano_topk_total(const nano_topk_t *topk);
+// up to k entries by descending count; keys point into topk and change with the next add
+guint nano_topk_top(const nano_topk_t *topk, guint k, nano_topk_entry_t *entries);
+
+#endif /* __NANO_TOPK_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
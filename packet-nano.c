@@ -17,19 +17,38 @@
 
 #include <epan/conversation.h>
 #include <epan/dissectors/packet-tcp.h>
+#include <epan/expert.h>
+#include <epan/prefs.h>
 #include <epan/proto_data.h>
 #include <epan/packet.h>
+#include <epan/tap.h>
 #include <epan/to_str.h>
+#include <wsutil/pint.h>
 #include <wsutil/str_util.h>
 
+#include "packet-nano.h"
+#include "nano_aliases.h"
+#include "nano_blake2b.h"
+#include "nano_chains.h"
+#include "nano_elections.h"
+#include "nano_forks.h"
+#include "nano_ledger.h"
+#include "nano_nodeids.h"
+#include "nano_profile.h"
+#include "nano_sidecar.h"
+#include "nano_spam.h"
+
 void proto_reg_handoff_nano(void);
 void proto_register_nano(void);
 
 static dissector_handle_t nano_tcp_handle;
 
+static int nano_tap = -1;
+
 static int proto_nano = -1;
 
 static int hf_nano_magic_number = -1;
+static int hf_nano_network = -1;
 static int hf_nano_version_max = -1;
 static int hf_nano_version_using = -1;
 static int hf_nano_version_min = -1;
@@ -51,6 +70,18 @@ static int hf_nano_block_balance = -1;
 static int hf_nano_block_account = -1;
 static int hf_nano_block_representative_account = -1;
 static int hf_nano_block_link = -1;
+static int hf_nano_block_hash = -1;
+static int hf_nano_block_balance_nano = -1;
+static int hf_nano_block_work_difficulty = -1;
+static int hf_nano_block_fork_of = -1;
+static int hf_nano_ledger_status = -1;
+static int hf_nano_block_subtype = -1;
+static int hf_nano_block_amount = -1;
+static int hf_nano_block_publish_rate = -1;
+static int hf_nano_block_block_rate = -1;
+
+static int hf_nano_account_address = -1;
+static int hf_nano_account_alias = -1;
 
 static int hf_nano_vote_account = -1;
 static int hf_nano_vote_signature = -1;
@@ -58,6 +89,21 @@ static int hf_nano_vote_sequence = -1;
 
 static int hf_nano_bulk_pull_account = -1;
 
+static int hf_nano_resync_skipped = -1;
+
+static int hf_nano_sample_weight = -1;
+
+static int hf_nano_node_id = -1;
+static int hf_nano_peer_node_id = -1;
+static int hf_nano_node_id_learned_in = -1;
+static int hf_nano_node_id_registry_last_seen = -1;
+
+static int hf_nano_memory_in_use = -1;
+static int hf_nano_memory_conversations = -1;
+static int hf_nano_memory_conversations_evicted = -1;
+static int hf_nano_memory_packet_states_dropped = -1;
+static int hf_nano_memory_correlation_expired = -1;
+
 static gint ett_nano = -1;
 static gint ett_nano_header = -1;
 static gint ett_nano_extensions = -1;
@@ -74,23 +120,62 @@ static gint ett_nano_vote_common = -1;
 static gint ett_nano_confirm_ack_hashes = -1;
 static gint ett_nano_confirm_ack = -1;
 static gint ett_nano_bulk_pull_account_response = -1;
-
-#define NANO_PACKET_TYPE_INVALID 0
-#define NANO_PACKET_TYPE_NOT_A_TYPE 1
-#define NANO_PACKET_TYPE_KEEPALIVE 2
-#define NANO_PACKET_TYPE_PUBLISH 3
-#define NANO_PACKET_TYPE_CONFIRM_REQ 4
-#define NANO_PACKET_TYPE_CONFIRM_ACK 5
-#define NANO_PACKET_TYPE_BULK_PULL 6
-#define NANO_PACKET_TYPE_BULK_PUSH 7
-#define NANO_PACKET_TYPE_FRONTIER_REQ 8
-#define NANO_PACKET_TYPE_BULK_PULL_BLOCKS 9
-#define NANO_PACKET_TYPE_NODE_ID_HANDSHAKE 10
-#define NANO_PACKET_TYPE_BULK_PULL_ACCOUNT 11
-#define NANO_PACKET_TYPE_TELEMETRY_REQ 12
-#define NANO_PACKET_TYPE_TELEMETRY_ACK 13
-#define NANO_PACKET_TYPE_ASC_PULL_REQ 14
-#define NANO_PACKET_TYPE_ASC_PULL_ACK 15
+static gint ett_nano_memory = -1;
+static gint ett_nano_node_id = -1;
+
+static expert_field ei_nano_resync_skipped = EI_INIT;
+static expert_field ei_nano_resync_inferred = EI_INIT;
+static expert_field ei_nano_pending_overflow = EI_INIT;
+static expert_field ei_nano_chain_gap = EI_INIT;
+static expert_field ei_nano_chain_out_of_order = EI_INIT;
+static expert_field ei_nano_chain_incomplete = EI_INIT;
+static expert_field ei_nano_fork = EI_INIT;
+static expert_field ei_nano_spam = EI_INIT;
+
+// Memory limit for conversation tracking in KiB, 0 means unlimited
+static guint nano_pref_memory_limit = 0;
+// Conversations idle for longer than this (seconds) are evicted in bounded memory mode, 0 disables
+static guint nano_pref_conversation_timeout = 300;
+// Correlation table entries older than this (seconds) are expired in bounded memory mode
+static guint nano_pref_correlation_window = 600;
+
+static gboolean nano_pref_chain_index = TRUE;
+static gboolean nano_pref_fork_detection = TRUE;
+static gboolean nano_pref_state_subtypes = TRUE;
+
+// Realtime messages of these types are fully dissected 1 in N times, 1 dissects all of them
+static guint nano_pref_sample_confirm_ack = 1;
+static guint nano_pref_sample_confirm_req = 1;
+static guint nano_pref_sample_publish = 1;
+static guint nano_pref_sample_keepalive = 1;
+
+// First pass results are written here and reused when the same capture is opened again, empty disables
+static const char *nano_pref_sidecar_file = "";
+
+// Labels for known accounts, a text file or one prebuilt with -z nano,aliases
+static const char *nano_pref_alias_book = "";
+
+// Block hashes our own node has, and which of them it confirmed
+static const char *nano_pref_ledger_snapshot = "";
+
+// Node IDs by endpoint from earlier captures, and whether handshakes seen now are added to it
+static const char *nano_pref_node_registry = "";
+static gboolean nano_pref_node_registry_update = FALSE;
+
+// Representative weights for election quorum timing, and how long elections are followed (seconds)
+static const char *nano_pref_rep_weights = "";
+static guint nano_pref_election_window = 300;
+static guint nano_pref_quorum_percent = 67;
+
+// Flag accounts publishing more than the threshold per second, averaged over the window (seconds)
+static gboolean nano_pref_spam_detection = TRUE;
+static guint nano_pref_spam_window = 60;
+static guint nano_pref_spam_threshold = 5;
+
+// first pass over a frame the sidecar has the results for, block hashing and classification are skipped
+static gboolean nano_is_replay (const packet_info *pinfo) {
+    return !PINFO_FD_VISITED(pinfo) && nano_sidecar_covers(pinfo->num);
+}
 
 static const value_string nano_packet_type_strings[] = {
     { NANO_PACKET_TYPE_INVALID, "Invalid" },
@@ -112,14 +197,6 @@ static const value_string nano_packet_type_strings[] = {
     { 0, NULL },
 };
 
-#define NANO_BLOCK_TYPE_INVALID 0
-#define NANO_BLOCK_TYPE_NOT_A_BLOCK 1
-#define NANO_BLOCK_TYPE_SEND 2
-#define NANO_BLOCK_TYPE_RECEIVE 3
-#define NANO_BLOCK_TYPE_OPEN 4
-#define NANO_BLOCK_TYPE_CHANGE 5
-#define NANO_BLOCK_TYPE_STATE 6
-
 static const value_string nano_block_type_strings[] = {
     { NANO_BLOCK_TYPE_INVALID, "Invalid" },
     { NANO_BLOCK_TYPE_NOT_A_BLOCK, "Not A Block" },
@@ -131,1246 +208,3551 @@ static const value_string nano_block_type_strings[] = {
     { 0, NULL },
 };
 
-static const string_string nano_magic_numbers[] = {
-    { "RA", "Nano Dev Network" },
-    { "RB", "Nano Beta Network" },
-    { "RC", "Nano Live Network" },
-    { "RX", "Nano Test Network" },
+// the two magic bytes read as a big endian number, 'R' and the network
+static const value_string nano_magic_numbers[] = {
+    { 0x5241, "Nano Dev Network (RA)" },
+    { 0x5242, "Nano Beta Network (RB)" },
+    { 0x5243, "Nano Live Network (RC)" },
+    { 0x5258, "Nano Test Network (RX)" },
     { 0, NULL }
 };
 
-#define NANO_TCP_PORT 17075 /* Not IANA registered */
-
-#define NANO_BLOCK_SIZE_SEND    (32+32+16+64+8)
-#define NANO_BLOCK_SIZE_RECEIVE (32+32+64+8)
-#define NANO_BLOCK_SIZE_OPEN    (32+32+32+64+8)
-#define NANO_BLOCK_SIZE_CHANGE  (32+32+64+8)
-#define NANO_BLOCK_SIZE_STATE   (32+32+32+16+32+64+8)
+static const value_string nano_ledger_status_strings[] = {
+    { NANO_LEDGER_UNKNOWN, "Unknown" },
+    { NANO_LEDGER_KNOWN, "Known" },
+    { NANO_LEDGER_CONFIRMED, "Confirmed" },
+    { 0, NULL }
+};
 
-// Nano header length
-#define NANO_HEADER_LENGTH 8
+static const value_string nano_network_strings[] = {
+    { 'A', "Dev" },
+    { 'B', "Beta" },
+    { 'C', "Live" },
+    { 'X', "Test" },
+    { 0, NULL }
+};
 
-struct nano_session_state {
-    int client_packet_type;
-    guint8 bulk_pull_account_request_flags;
+//
+// Protocol generations
+//
+// Payload sizes per protocol generation, expanded from X-macro lists into
+// constant tables so framing a header is a single table lookup. A
+// conversation picks its table once, from version_using of its first header.
+//
 
-    guint32 server_port;
+// how the payload size after the header is found
+enum nano_size_rule {
+    NANO_SIZE_UNKNOWN = 0,  // the generation does not know this message
+    NANO_SIZE_FIXED,        // fixed bytes
+    NANO_SIZE_EXTENSIONS,   // fixed bytes plus the size held in extensions & extensions_mask
+    NANO_SIZE_BLOCK,        // fixed bytes plus one block of the type in the extensions
+    NANO_SIZE_CONFIRM,      // fixed bytes plus a block, or item_count items of item_size bytes
+    NANO_SIZE_FLAGS         // fixed bytes plus the size of every flag_sizes entry whose bits are all set
 };
 
-void append_info_col(column_info *cinfo, const gchar *format, ...) {
-    va_list ap;
+#define NANO_MAX_FLAG_SIZES 3
 
-    va_start(ap, format);
-    col_append_sep_fstr(cinfo, COL_INFO, " | ", format, ap);
-    va_end(ap);
-}
+struct nano_flag_size {
+    guint16 flags;
+    guint16 size;
+};
 
-//
-// Dissect Blocks
-//
-static int dissect_nano_receive_block(tvbuff_t *tvb, proto_tree *nano_tree, int offset) {
-    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_RECEIVE, ett_nano_block, NULL, "Receive Block");
+struct nano_message_layout {
+    guint8 rule;
+    guint16 fixed;
+    guint16 extensions_mask;
+    guint16 item_size;
+    struct nano_flag_size flag_sizes[NANO_MAX_FLAG_SIZES];
+};
 
-    proto_tree_add_item(block_tree, hf_nano_block_hash_previous, tvb, offset, 32, ENC_NA);
-    offset += 32;
+struct nano_protocol_layout {
+    const char *name;
+    // lowest version_using this layout applies to
+    guint8 version_using_min;
+    // confirm_req / confirm_ack counts extend to 8 bits when NANO_CONFIRM_V2_FLAG is set
+    gboolean confirm_v2_counts;
+    // node_id_handshake responses carry a salt and the genesis hash when NANO_NODE_ID_V2_FLAG is set
+    gboolean node_id_v2;
+    struct nano_message_layout messages[NANO_PACKET_TYPE_MAX + 1];
+};
 
-    proto_tree_add_item(block_tree, hf_nano_block_hash_source, tvb, offset, 32, ENC_NA);
-    offset += 32;
+#define NANO_CONFIRM_V2_FLAG 0x0001
+#define NANO_NODE_ID_QUERY_FLAG 0x0001
+#define NANO_NODE_ID_RESPONSE_FLAG 0x0002
+#define NANO_NODE_ID_V2_FLAG 0x0004
+#define NANO_BULK_PULL_EXTENDED_FLAG 0x0001
+
+#define NANO_NO_FLAG_SIZES { { 0, 0 } }
+#define NANO_FLAG_SIZES_1(f1, s1) { { f1, s1 } }
+#define NANO_FLAG_SIZES_2(f1, s1, f2, s2) { { f1, s1 }, { f2, s2 } }
+#define NANO_FLAG_SIZES_3(f1, s1, f2, s2, f3, s3) { { f1, s1 }, { f2, s2 }, { f3, s3 } }
+
+// packet type, size rule, fixed size, extensions mask, item size, flag sizes
+#define NANO_LAYOUT_BASE(X) \
+    X(KEEPALIVE,         FIXED,   (16 + 2) * 8,    0, 0,       NANO_NO_FLAG_SIZES) \
+    X(PUBLISH,           BLOCK,   0,               0, 0,       NANO_NO_FLAG_SIZES) \
+    X(CONFIRM_REQ,       CONFIRM, 0,               0, 32 + 32, NANO_NO_FLAG_SIZES) \
+    X(CONFIRM_ACK,       CONFIRM, 32 + 64 + 8,     0, 32,      NANO_NO_FLAG_SIZES) \
+    X(BULK_PULL,         FLAGS,   32 + 32,         0, 0,       NANO_FLAG_SIZES_1(NANO_BULK_PULL_EXTENDED_FLAG, 1 + 4 + 3)) \
+    X(BULK_PUSH,         FIXED,   0,               0, 0,       NANO_NO_FLAG_SIZES) \
+    X(FRONTIER_REQ,      FIXED,   32 + 4 + 4,      0, 0,       NANO_NO_FLAG_SIZES) \
+    X(BULK_PULL_ACCOUNT, FIXED,   32 + 16 + 1,     0, 0,       NANO_NO_FLAG_SIZES)
+
+// node_id_handshake query cookie / response account and signature
+#define NANO_LAYOUT_NODE_ID_V1(X) \
+    X(NODE_ID_HANDSHAKE, FLAGS,   0,               0, 0,       NANO_FLAG_SIZES_2(NANO_NODE_ID_QUERY_FLAG, 32, NANO_NODE_ID_RESPONSE_FLAG, 32 + 64))
+
+// v2 responses add a salt and the genesis hash
+#define NANO_LAYOUT_NODE_ID_V2(X) \
+    X(NODE_ID_HANDSHAKE, FLAGS,   0,               0, 0,       NANO_FLAG_SIZES_3(NANO_NODE_ID_QUERY_FLAG, 32, NANO_NODE_ID_RESPONSE_FLAG, 32 + 64, NANO_NODE_ID_RESPONSE_FLAG | NANO_NODE_ID_V2_FLAG, 32 + 32))
+
+// telemetry_ack carries its own size, newer nodes append fields older dissectors do not know
+#define NANO_LAYOUT_TELEMETRY(X) \
+    X(TELEMETRY_REQ,     FIXED,   0,               0, 0,       NANO_NO_FLAG_SIZES) \
+    X(TELEMETRY_ACK,     EXTENSIONS, 0,            0x03ff, 0,  NANO_NO_FLAG_SIZES)
+
+// ascending bootstrap: type and id, the extensions hold the payload size
+#define NANO_LAYOUT_ASC_PULL(X) \
+    X(ASC_PULL_REQ,      EXTENSIONS, 1 + 8,        0xffff, 0,  NANO_NO_FLAG_SIZES) \
+    X(ASC_PULL_ACK,      EXTENSIONS, 1 + 8,        0xffff, 0,  NANO_NO_FLAG_SIZES)
+
+#define NANO_LAYOUT_ENTRY(type, rule, fixed, mask, item_size, flag_sizes) \
+    [NANO_PACKET_TYPE_##type] = { NANO_SIZE_##rule, fixed, mask, item_size, flag_sizes },
+
+static const struct nano_protocol_layout nano_protocol_layouts[] = {
+    {
+        "Protocol 17 and older", 0, FALSE, FALSE,
+        { NANO_LAYOUT_BASE(NANO_LAYOUT_ENTRY) NANO_LAYOUT_NODE_ID_V1(NANO_LAYOUT_ENTRY) }
+    },
+    {
+        "Protocol 18 (telemetry)", 18, FALSE, FALSE,
+        { NANO_LAYOUT_BASE(NANO_LAYOUT_ENTRY) NANO_LAYOUT_NODE_ID_V1(NANO_LAYOUT_ENTRY) NANO_LAYOUT_TELEMETRY(NANO_LAYOUT_ENTRY) }
+    },
+    {
+        "Protocol 19+ (node ID v2, extended confirm counts, ascending bootstrap)", 19, TRUE, TRUE,
+        { NANO_LAYOUT_BASE(NANO_LAYOUT_ENTRY) NANO_LAYOUT_NODE_ID_V2(NANO_LAYOUT_ENTRY) NANO_LAYOUT_TELEMETRY(NANO_LAYOUT_ENTRY) NANO_LAYOUT_ASC_PULL(NANO_LAYOUT_ENTRY) }
+    },
+};
 
-    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
-    offset += 64;
+// used until a conversation has shown us a header
+#define NANO_PROTOCOL_LAYOUT_LATEST (G_N_ELEMENTS(nano_protocol_layouts) - 1)
 
-    proto_tree_add_item(block_tree, hf_nano_block_work, tvb, offset, 8, ENC_NA);
-    offset += 8;
+// item count of a confirm_req / confirm_ack by hash, newer nodes extend it to 8 bits with the v2 flag
+static guint nano_confirm_item_count (const struct nano_protocol_layout *layout, guint extensions) {
+    guint item_count = (extensions & 0xf000) >> 12;
 
-    return offset;
+    if (layout->confirm_v2_counts && (extensions & NANO_CONFIRM_V2_FLAG)) {
+        item_count = (item_count << 4) | ((extensions & 0x00f0) >> 4);
+    }
+
+    return item_count;
 }
 
-static int dissect_nano_send_block(tvbuff_t *tvb, proto_tree *nano_tree, int offset) {
-    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_SEND, ett_nano_block, NULL, "Send Block");
+// Requests that may be outstanding on one bootstrap connection before we stop tracking them
+#define NANO_MAX_PENDING_REQUESTS 16
 
-    proto_tree_add_item(block_tree, hf_nano_block_hash_previous, tvb, offset, 32, ENC_NA);
-    offset += 32;
+#define NANO_BULK_PULL_ACCOUNT_PENDING_ADDRESS_ONLY 0x01
+#define NANO_BULK_PULL_ACCOUNT_PENDING_HASH_AMOUNT_AND_ADDRESS 0x02
 
-    proto_tree_add_item(block_tree, hf_nano_block_destination_account, tvb, offset, 32, ENC_NA);
-    offset += 32;
+// a bootstrap request whose headerless response has not ended yet
+struct nano_pending_request {
+    guint8 packet_type;
+    guint8 bulk_pull_account_flags;
 
-    proto_tree_add_item(block_tree, hf_nano_block_balance, tvb, offset, 16, ENC_NA);
-    offset += 16;
+    // bulk_pull_account responses start with a single frontier entry
+    guint8 frontier_received;
 
-    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
-    offset += 64;
+    // bulk_pull response being added to the account chain index, 0 if it is not
+    guint32 chain_pull;
+};
 
-    proto_tree_add_item(block_tree, hf_nano_block_work, tvb, offset, 8, ENC_NA);
-    offset += 8;
+// kept free of pointers, a copy is stored for packets that start in the middle of a stream
+struct nano_session_state {
+    // server to client: responses come back in request order, the oldest request frames the stream
+    struct nano_pending_request pending[NANO_MAX_PENDING_REQUESTS];
+    guint8 pending_head;
+    guint8 pending_count;
 
-    return offset;
-}
+    // client to server: blocks following a bulk_push header, up to a not_a_block marker
+    gboolean bulk_push_active;
 
-static int dissect_nano_open_block(tvbuff_t *tvb, proto_tree *nano_tree, int offset) {
-    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_OPEN, ett_nano_block, NULL, "Open Block");
+    // client endpoint, learned from whoever sends the first bootstrap request
+    gboolean client_known;
+    guint8 client_address[16];
+    guint8 client_address_len;
+    guint32 client_port;
 
-    proto_tree_add_item(block_tree, hf_nano_block_hash_source, tvb, offset, 32, ENC_NA);
-    offset += 32;
+    // port that matched the dissector, taken as the server side until the client is known
+    guint32 server_port;
 
-    proto_tree_add_item(block_tree, hf_nano_block_representative_account, tvb, offset, 32, ENC_NA);
-    offset += 32;
+    // index into nano_protocol_layouts, picked from version_using of the first header
+    guint8 protocol_layout;
+    gboolean protocol_layout_selected;
 
-    proto_tree_add_item(block_tree, hf_nano_block_account, tvb, offset, 32, ENC_NA);
-    offset += 32;
+    // set by the resync scanner when the stream type was guessed from the payload
+    gboolean inferred_packet_type;
 
-    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
-    offset += 64;
+    // second magic byte of the first header, for the messages that have none; 0 until then
+    guint8 network;
+};
 
-    proto_tree_add_item(block_tree, hf_nano_block_work, tvb, offset, 8, ENC_NA);
-    offset += 8;
+// node ID an endpoint of the conversation sent in its handshake response
+struct nano_peer_identity {
+    gboolean known;
+    guint8 address[16];
+    guint8 address_len;
+    guint32 port;
+    guint8 node_id[32];
+    guint32 frame;
+};
 
-    return offset;
-}
+// per conversation data, the session state plus what we need to evict it again
+struct nano_conversation {
+    struct nano_session_state session_state;
 
-static int dissect_nano_change_block(tvbuff_t *tvb, proto_tree *nano_tree, int offset)
-{
-    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_CHANGE, ett_nano_block, NULL, "Change Block");
+    // both ends of a realtime connection introduce themselves
+    struct nano_peer_identity identities[2];
 
-    proto_tree_add_item(block_tree, hf_nano_block_hash_previous, tvb, offset, 32, ENC_NA);
-    offset += 32;
+    conversation_t *conversation;
+    nstime_t last_seen;
 
-    proto_tree_add_item(block_tree, hf_nano_block_representative_account, tvb, offset, 32, ENC_NA);
-    offset += 32;
+    // least recently used list, only maintained when the memory limit is enabled
+    struct nano_conversation *lru_prev;
+    struct nano_conversation *lru_next;
+};
 
-    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
-    offset += 64;
+struct nano_memory_stats {
+    guint64 bytes_in_use;
+    guint32 conversations;
+    guint32 conversations_evicted;
+    guint32 packet_states_dropped;
+    guint32 correlation_expired;
+};
 
-    proto_tree_add_item(block_tree, hf_nano_block_work, tvb, offset, 8, ENC_NA);
-    offset += 8;
+static struct nano_memory_stats nano_memory;
 
-    return offset;
+static struct nano_conversation *nano_lru_head = NULL;
+static struct nano_conversation *nano_lru_tail = NULL;
+
+// frame that last got the memory usage subtree
+static guint32 nano_memory_tree_frame = 0;
+
+const char *nano_packet_type_name (guint packet_type) {
+    return val_to_str_const(packet_type, nano_packet_type_strings, "Unknown");
 }
 
-static int dissect_nano_state(tvbuff_t *tvb, proto_tree *nano_tree, int offset)
-{
-    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_STATE, ett_nano_block, NULL, "State Block");
+const char *nano_block_type_name (guint block_type) {
+    return val_to_str_const(block_type, nano_block_type_strings, "Unknown");
+}
 
-    proto_tree_add_item(block_tree, hf_nano_block_account, tvb, offset, 32, ENC_NA);
-    offset += 32;
+//
+// Info column
+//
+// A segment can carry dozens of votes or bulk pull blocks. Rather than adding
+// to the Info column for each of them, the messages of a frame are counted by
+// kind and the column is written once the frame is done:
+//
+//   Confirm Ack ×37 (412 Blocks), Publish (State) ×3
+//
+// A kind is a message name and a detail, all static strings, so telling them
+// apart is a pointer comparison. Only the first few kinds get an entry and the
+// rest are counted together, which bounds what formatting a frame costs.
+//
+// The column is cleared as the frame starts and nothing else of ours writes
+// to it, so whatever it holds by then is the marker tcp_dissect_pdus left for
+// a message that threw. The summary goes in front of it.
+//
 
-    proto_tree_add_item(block_tree, hf_nano_block_hash_previous, tvb, offset, 32, ENC_NA);
-    offset += 32;
+#define NANO_INFO_MAX_ENTRIES 8
 
-    proto_tree_add_item(block_tree, hf_nano_block_representative_account, tvb, offset, 32, ENC_NA);
-    offset += 32;
+// UTF-8 multiplication sign
+#define NANO_INFO_TIMES "\xc3\x97"
 
-    proto_tree_add_item(block_tree, hf_nano_block_balance, tvb, offset, 16, ENC_NA);
-    offset += 16;
+struct nano_info_entry {
+    const char *message;
+    // NULL, a suffix, or a format taking detail_arg, or detail_value when summed
+    const char *detail;
+    const char *detail_arg;
+    gboolean summed;
+    guint32 detail_value;
+    guint32 count;
+};
 
-    proto_tree_add_item(block_tree, hf_nano_block_link, tvb, offset, 32, ENC_NA);
-    offset += 32;
+static struct {
+    struct nano_info_entry entries[NANO_INFO_MAX_ENTRIES];
+    guint entry_count;
+    // messages of kinds that found no free entry
+    guint32 others;
+    // the message being dissected, counted once the next one starts or the frame is done
+    struct nano_info_entry current;
+} nano_info;
+
+static GString *nano_info_text = NULL;
+
+static void nano_info_start (void) {
+    nano_info.entry_count = 0;
+    nano_info.others = 0;
+    nano_info.current.message = NULL;
+}
 
-    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
-    offset += 64;
+static void nano_info_commit (void) {
+    struct nano_info_entry *current = &nano_info.current;
 
-    proto_tree_add_item(block_tree, hf_nano_block_work, tvb, offset, 8, ENC_NA);
-    offset += 8;
+    if (!current->message) {
+        return;
+    }
 
-    return offset;
+    for (guint i = 0; i < nano_info.entry_count; i++) {
+        struct nano_info_entry *entry = &nano_info.entries[i];
+
+        if (entry->message == current->message && entry->detail == current->detail && entry->detail_arg == current->detail_arg) {
+            entry->count++;
+            entry->detail_value += current->detail_value;
+            current->message = NULL;
+            return;
+        }
+    }
+
+    if (nano_info.entry_count < NANO_INFO_MAX_ENTRIES) {
+        nano_info.entries[nano_info.entry_count] = *current;
+        nano_info.entries[nano_info.entry_count++].count = 1;
+    } else {
+        nano_info.others++;
+    }
+    current->message = NULL;
 }
 
-static int dissect_nano_block (int block_type, tvbuff_t* tvb, proto_tree* tree, int offset) {
-    switch (block_type) {
-        case NANO_BLOCK_TYPE_RECEIVE:
-            return dissect_nano_receive_block(tvb, tree, offset);
-        case NANO_BLOCK_TYPE_OPEN:
-            return dissect_nano_open_block(tvb, tree, offset);
-        case NANO_BLOCK_TYPE_SEND:
-            return dissect_nano_send_block(tvb, tree, offset);
-        case NANO_BLOCK_TYPE_STATE:
-            return dissect_nano_state(tvb, tree, offset);
-        case NANO_BLOCK_TYPE_CHANGE:
-            return dissect_nano_change_block(tvb, tree, offset);
+static void nano_info_message (packet_info *pinfo, const char *message) {
+    if (!pinfo->cinfo) {
+        return;
     }
 
-    return 0;
+    nano_info_commit();
+    memset(&nano_info.current, 0, sizeof(nano_info.current));
+    nano_info.current.message = message;
 }
 
-static int get_block_type_size (int block_type) {
-    switch (block_type) {
-        case NANO_BLOCK_TYPE_RECEIVE:
-            return NANO_BLOCK_SIZE_RECEIVE;
-        case NANO_BLOCK_TYPE_OPEN:
-            return NANO_BLOCK_SIZE_OPEN;
-        case NANO_BLOCK_TYPE_SEND:
-            return NANO_BLOCK_SIZE_SEND;
-        case NANO_BLOCK_TYPE_STATE:
-            return NANO_BLOCK_SIZE_STATE;
-        case NANO_BLOCK_TYPE_CHANGE:
-            return NANO_BLOCK_SIZE_CHANGE;
+static void nano_info_detail (packet_info *pinfo, const char *detail) {
+    if (pinfo->cinfo) {
+        nano_info.current.detail = detail;
     }
+}
 
-    return 0;
+// format has a %s for arg, arg must be static as well
+static void nano_info_detail_string (packet_info *pinfo, const char *format, const char *arg) {
+    if (pinfo->cinfo) {
+        nano_info.current.detail = format;
+        nano_info.current.detail_arg = arg;
+    }
 }
 
+// format has a %u for the value, which is summed over the messages of the kind
+static void nano_info_detail_sum (packet_info *pinfo, const char *format, guint32 value) {
+    if (pinfo->cinfo) {
+        nano_info.current.detail = format;
+        nano_info.current.summed = TRUE;
+        nano_info.current.detail_value = value;
+    }
+}
 
-// dissect the inside of a keepalive packet (that is, the neighbor nodes)
-static int dissect_nano_keepalive(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset)
-{
-    proto_item *ti;
-    proto_tree *peer_tree, *peer_entry_tree;
-    ws_in6_addr ip_addr;
-    guint32 port;
-    gchar buf[100];
+static void nano_info_flush (packet_info *pinfo) {
+    nano_info_commit();
 
-    peer_tree = proto_tree_add_subtree(nano_tree, tvb, offset, 8*(16+2), ett_nano_peers, NULL, "Peer List");
+    if (!pinfo->cinfo || nano_info.entry_count == 0) {
+        return;
+    }
 
-    for (int i = 0; i < 8; i++) {
-        peer_entry_tree = proto_tree_add_subtree(peer_tree, tvb, offset, 16 + 2, ett_nano_peer_details, &ti, "Peer");
+    if (!nano_info_text) {
+        nano_info_text = g_string_sized_new(COL_MAX_INFO_LEN);
+    }
+    g_string_truncate(nano_info_text, 0);
 
-        tvb_get_ipv6(tvb, offset, &ip_addr);
-        proto_tree_add_item(peer_entry_tree, hf_nano_keepalive_peer_ip, tvb, offset, 16, ENC_NA);
-        offset += 16;
+    for (guint i = 0; i < nano_info.entry_count; i++) {
+        const struct nano_info_entry *entry = &nano_info.entries[i];
 
-        proto_tree_add_item_ret_uint(peer_entry_tree, hf_nano_keepalive_peer_port, tvb, offset, 2, ENC_LITTLE_ENDIAN, &port);
-        offset += 2;
+        if (i) {
+            g_string_append(nano_info_text, ", ");
+        }
+        g_string_append(nano_info_text, entry->message);
 
-        if (!memcmp(&ip_addr, "\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0", 16)) {
-            proto_item_append_text(ti, ": (none)");
-        } else if (!memcmp(&ip_addr, "\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\xff\xff", 12)) {
-            ip_to_str_buf((gchar *) &ip_addr + 12, buf, sizeof(buf));
-            proto_item_append_text(ti, ": %s:%d", buf, port);
-        } else {
-            ip6_to_str_buf(&ip_addr, buf, sizeof(buf));
-            proto_item_append_text(ti, ": [%s]:%d", buf, port);
+        if (entry->detail && !entry->summed) {
+            if (entry->detail_arg) {
+                g_string_append_printf(nano_info_text, entry->detail, entry->detail_arg);
+            } else {
+                g_string_append(nano_info_text, entry->detail);
+            }
+        }
+        if (entry->count > 1) {
+            g_string_append_printf(nano_info_text, " " NANO_INFO_TIMES "%u", entry->count);
+        }
+        if (entry->summed) {
+            g_string_append_printf(nano_info_text, entry->detail, entry->detail_value);
         }
     }
 
-    append_info_col(pinfo->cinfo, "Keepalive");
+    if (nano_info.others) {
+        g_string_append_printf(nano_info_text, ", +%u more", nano_info.others);
+    }
 
-    return offset;
+    const gchar *markers = col_get_text(pinfo->cinfo, COL_INFO);
+    if (markers && *markers) {
+        col_prepend_fstr(pinfo->cinfo, COL_INFO, "%s ", nano_info_text->str);
+    } else {
+        col_add_str(pinfo->cinfo, COL_INFO, nano_info_text->str);
+    }
 }
 
-/*
-Each packet type has its own extensions field handler
-*/
-static int hf_nano_extensions_unused_label = -1;
+//
+// Derived fields
+//
+// Each of these costs a hash or a 128 bit conversion, so they are only
+// computed when the tree is visible or a filter, column or tap references them.
+//
 
-static int hf_nano_extensions_telemetry_size = -1;
+// 1 Nano = 10^30 raw
+#define NANO_RAW_DECIMALS 30
 
-static void dissect_nano_header_extensions_unused (proto_tree* tree, tvbuff_t* tvb, int offset) {
-    proto_tree_add_string(tree, hf_nano_extensions_unused_label, tvb, offset, 2, "Unused");
-}
+static const char nano_address_alphabet[] = "13456789abcdefghijkmnopqrstuwxyz";
 
-static void dissect_nano_header_telemetry_ack (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
-    guint32 telemetry_size = extensions & 0x3ff;
+static int get_block_type_size (int block_type);
+static gboolean nano_memory_is_limited (void);
+static guint nano_sample_weight (tvbuff_t *tvb, guint packet_type);
+static void nano_indexes_charge (void);
+static guint64 nano_profile_bytes (void);
 
-    proto_tree_add_uint64(tree, hf_nano_extensions_telemetry_size, tvb, offset, 2, telemetry_size);
-}
+//
+// Self-profiling
+//
+// Probes around the timed calls cost a branch on nano_profile_on as they
+// start and another as they stop while nothing profiles; nano_profile.c has
+// the rest.
+//
 
-static void dissect_nano_header_publish (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
-    int block_type = (extensions & 0x0f00) >> 8;
+// packet type of the message being dissected, for calls that cannot tell, only kept while profiling
+static guint nano_profile_packet_type = NANO_PACKET_TYPE_INVALID;
 
-    proto_tree_add_string(tree, hf_nano_extensions_block_type, tvb, offset, 2, val_to_str(block_type, VALS(nano_block_type_strings), "Unknown (%d)"));
-}
+#define NANO_PROFILE_START(probe) \
+    nano_profile_probe_t probe = { 0, 0, 0 }; \
+    if (G_UNLIKELY(nano_profile_on)) \
+        nano_profile_start(&probe, nano_profile_bytes())
 
-static void dissect_nano_header_confirm_req (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
-    int block_type = (extensions & 0x0f00) >> 8;
+#define NANO_PROFILE_STOP(probe, function, packet_type) \
+    do { \
+        if (G_UNLIKELY(nano_profile_on)) \
+            nano_profile_stop(&probe, nano_profile_bytes(), function, packet_type); \
+    } while (0)
 
-    proto_tree_add_string(tree, hf_nano_extensions_block_type, tvb, offset, 2, val_to_str(block_type, VALS(nano_block_type_strings), "Unknown (%d)"));
+// nano_ + base32 of the 256 bit key followed by the 40 bit blake2b checksum
+void nano_account_to_address (const guint8 *account, char *address) {
+    guint8 number[32 + 5];
+    guint8 checksum[5];
 
-    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        int item_count = (extensions & 0xf000) >> 12;
+    nano_blake2b(checksum, sizeof(checksum), account, 32);
 
-        proto_tree_add_uint(tree, hf_nano_extensions_item_count, tvb, offset, 2, item_count);
+    memcpy(number, account, 32);
+    for (int i = 0; i < 5; i++) {
+        number[32 + i] = checksum[4 - i];
     }
-}
-
-static void dissect_nano_header_confirm_ack (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
-    int block_type = (extensions & 0x0f00) >> 8;
 
-    proto_tree_add_string(tree, hf_nano_extensions_block_type, tvb, offset, 2, val_to_str(block_type, VALS(nano_block_type_strings), "Unknown (%d)"));
+    memcpy(address, "nano_", 5);
 
-    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        int item_count = (extensions & 0xf000) >> 12;
+    // 296 bits in 60 characters, the first one carries 4 bits of zero padding
+    for (int i = 0; i < 60; i++) {
+        guint value = 0;
 
-        proto_tree_add_uint(tree, hf_nano_extensions_item_count, tvb, offset, 2, item_count);
+        for (int bit = i * 5 - 4; bit < i * 5 + 1; bit++) {
+            value <<= 1;
+            if (bit >= 0) {
+                value |= (number[bit / 8] >> (7 - bit % 8)) & 1;
+            }
+        }
+        address[5 + i] = nano_address_alphabet[value];
     }
+
+    address[NANO_ADDRESS_LENGTH] = '\0';
 }
 
-static int hf_nano_extensions_is_query = -1;
-static int hf_nano_extensions_is_response = -1;
+// accepts the nano_ and the older xrb_ prefix, FALSE if address is malformed or its checksum is wrong
+gboolean nano_address_to_account (const char *address, guint8 *account) {
+    guint8 number[32 + 5];
+    guint8 checksum[5];
 
-static void dissect_nano_header_node_id_handshake (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
-    guint32 is_query = extensions & 0x0001;
-    guint32 is_response = extensions & 0x0002;
+    if (!strncmp(address, "nano_", 5)) {
+        address += 5;
+    } else if (!strncmp(address, "xrb_", 4)) {
+        address += 4;
+    } else {
+        return FALSE;
+    }
+    if (strlen(address) != 60) {
+        return FALSE;
+    }
 
-    proto_tree_add_string(tree, hf_nano_extensions_is_query, tvb, offset, 2, is_query ? "True" : "False");
-    proto_tree_add_string(tree, hf_nano_extensions_is_response, tvb, offset, 2, is_response ? "True" : "False");
-}
+    memset(number, 0, sizeof(number));
+    for (int i = 0; i < 60; i++) {
+        const char *digit = strchr(nano_address_alphabet, address[i]);
 
-static int hf_nano_extensions_confirmed_present = -1;
+        if (!digit || !*digit) {
+            return FALSE;
+        }
 
-static void dissect_nano_header_frontier_req (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
-    int confirmed_present = (extensions & 0x0002);
+        guint value = (guint) (digit - nano_address_alphabet);
+        for (int bit = i * 5 - 4; bit < i * 5 + 1; bit++) {
+            guint set = (value >> (i * 5 - bit)) & 1;
 
-    proto_tree_add_string(tree, hf_nano_extensions_confirmed_present, tvb, offset, 2, confirmed_present ? "True" : "False");
-}
+            if (bit < 0) {
+                // padding has to be zero
+                if (set) {
+                    return FALSE;
+                }
+            } else if (set) {
+                number[bit / 8] |= 0x80 >> (bit % 8);
+            }
+        }
+    }
 
-static int hf_nano_extensions_is_extended = -1;
-static void dissect_nano_header_bulk_pull (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
-    guint32 is_extended_param_present = extensions & 0x0001;
+    nano_blake2b(checksum, sizeof(checksum), number, 32);
+    for (int i = 0; i < 5; i++) {
+        if (number[32 + i] != checksum[4 - i]) {
+            return FALSE;
+        }
+    }
 
-    proto_tree_add_boolean(tree, hf_nano_extensions_is_extended, tvb, offset, 2, is_extended_param_present);
+    memcpy(account, number, 32);
+    return TRUE;
 }
 
-static void dissect_nano_extensions (proto_tree* nano_tree _U_, tvbuff_t* tvb _U_, int offset _U_, guint nano_packet_type _U_, guint64* extensions _U_) {
-    proto_tree* tree = proto_tree_add_subtree(nano_tree, tvb, offset, 2, ett_nano_extensions, NULL, "Extensions");
+// exact decimal rendering of a big endian 128 bit raw amount in Nano
+static void nano_raw_to_string (const guint8 *raw, char *out) {
+    guint32 limbs[4];
+    char digits[40];
+    int count = 0;
+    gboolean nonzero;
 
-    *extensions = tvb_get_guint16(tvb, offset, ENC_LITTLE_ENDIAN);
+    for (int i = 0; i < 4; i++) {
+        limbs[i] = pntoh32(raw + 4 * i);
+    }
 
-    switch (nano_packet_type) {
-        case NANO_PACKET_TYPE_TELEMETRY_ACK:
-            dissect_nano_header_telemetry_ack(tree, tvb, *extensions, offset);
-            break;
-        case NANO_PACKET_TYPE_PUBLISH:
-            dissect_nano_header_publish(tree, tvb, *extensions, offset);
-            break;
-        case NANO_PACKET_TYPE_CONFIRM_REQ:
-            dissect_nano_header_confirm_req(tree, tvb, *extensions, offset);
-            break;
-        case NANO_PACKET_TYPE_CONFIRM_ACK:
-            dissect_nano_header_confirm_ack(tree, tvb, *extensions, offset);
-            break;
-        case NANO_PACKET_TYPE_NODE_ID_HANDSHAKE:
-            dissect_nano_header_node_id_handshake(tree, tvb, *extensions, offset);
-            break;
-        case NANO_PACKET_TYPE_FRONTIER_REQ:
-            dissect_nano_header_frontier_req(tree, tvb, *extensions, offset);
-            break;
-        case NANO_PACKET_TYPE_BULK_PULL:
-            dissect_nano_header_bulk_pull(tree, tvb, *extensions, offset);
-            break;
+    do {
+        guint64 remainder = 0;
 
-        // Packets that dont use extensions field
-        case NANO_PACKET_TYPE_KEEPALIVE:
-        case NANO_PACKET_TYPE_BULK_PUSH:
-        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
-        case NANO_PACKET_TYPE_TELEMETRY_REQ:
-            dissect_nano_header_extensions_unused(tree, tvb, offset);
-            break;
-    }
-}
+        nonzero = FALSE;
+        for (int i = 0; i < 4; i++) {
+            guint64 current = (remainder << 32) | limbs[i];
 
-// Dissect message header
-static int dissect_nano_header(tvbuff_t *tvb, proto_tree *nano_tree, int offset, guint *nano_packet_type, guint64* extensions)
-{
-    char *nano_magic_number = tvb_get_string_enc(wmem_packet_scope(), tvb, offset, 2, ENC_ASCII);
+            limbs[i] = (guint32) (current / 10);
+            remainder = current % 10;
+            nonzero |= limbs[i] != 0;
+        }
+        digits[count++] = '0' + (char) remainder;
+    } while (nonzero);
 
-    proto_tree *header_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_HEADER_LENGTH, ett_nano_header, NULL, "Nano Protocol Header");
+    // digits are least significant first, pad to at least one integer digit
+    while (count <= NANO_RAW_DECIMALS) {
+        digits[count++] = '0';
+    }
 
-    proto_tree_add_string_format_value(header_tree, hf_nano_magic_number, tvb, 0, 2, nano_magic_number, "%s (%s)", str_to_str(nano_magic_number, nano_magic_numbers, "Unknown"), nano_magic_number);
-    offset += 2;
+    int last_fraction = 0;
+    while (last_fraction < NANO_RAW_DECIMALS && digits[last_fraction] == '0') {
+        last_fraction++;
+    }
 
-    proto_tree_add_item(header_tree, hf_nano_version_max, tvb, offset, 1, ENC_NA);
-    offset += 1;
+    for (int i = count - 1; i >= NANO_RAW_DECIMALS; i--) {
+        *out++ = digits[i];
+    }
 
-    proto_tree_add_item(header_tree, hf_nano_version_using, tvb, offset, 1, ENC_NA);
-    offset += 1;
+    if (last_fraction < NANO_RAW_DECIMALS) {
+        *out++ = '.';
+        for (int i = NANO_RAW_DECIMALS - 1; i >= last_fraction; i--) {
+            *out++ = digits[i];
+        }
+    }
 
-    proto_tree_add_item(header_tree, hf_nano_version_min, tvb, offset, 1, ENC_NA);
-    offset += 1;
+    *out = '\0';
+}
 
-    proto_tree_add_item_ret_uint(header_tree, hf_nano_packet_type, tvb, offset, 1, ENC_NA, nano_packet_type);
-    offset += 1;
+// the alias book label of the account at offset, if it has one
+static void dissect_nano_account_alias (proto_tree *tree, proto_item *account_item, tvbuff_t *tvb, int offset) {
+    if (!tree || !nano_aliases_count()) {
+        return;
+    }
 
-    dissect_nano_extensions(header_tree, tvb, offset, *nano_packet_type, extensions);
-    offset += 2;
+    const char *alias = nano_aliases_lookup(tvb_get_ptr(tvb, offset, 32));
+    if (!alias) {
+        return;
+    }
 
-    return offset;
+    proto_item_append_text(account_item, " (%s)", alias);
+    proto_item *ti = proto_tree_add_string(tree, hf_nano_account_alias, tvb, offset, 32, alias);
+    proto_item_set_generated(ti);
 }
 
-//
-// Dissect Confirm Ack
-//
-static int hf_nano_confirm_ack_vote_common_account = -1;
-static int hf_nano_confirm_ack_vote_common_signature = -1;
-static int hf_nano_confirm_ack_vote_common_sequence = -1;
-
-static int dissect_nano_vote_common (tvbuff_t* tvb, packet_info* pinfo _U_, proto_tree* tree, int offset) {
-    proto_tree* vote_tree = proto_tree_add_subtree(tree, tvb, offset, 32 + 64 + 8, ett_nano_vote_common, NULL, "Vote Common");
+static void dissect_nano_account (proto_tree *tree, int hf, tvbuff_t *tvb, int offset) {
+    char address[NANO_ADDRESS_LENGTH + 1];
 
-    proto_tree_add_item(vote_tree, hf_nano_confirm_ack_vote_common_account, tvb, offset, 32, ENC_NA);
-    offset += 32;
+    proto_item *account_item = proto_tree_add_item(tree, hf, tvb, offset, 32, ENC_NA);
+    dissect_nano_account_alias(tree, account_item, tvb, offset);
 
-    proto_tree_add_item(vote_tree, hf_nano_confirm_ack_vote_common_signature, tvb, offset, 64, ENC_NA);
-    offset += 64;
+    if (!proto_field_is_referenced(tree, hf_nano_account_address)) {
+        return;
+    }
 
-    proto_tree_add_item(vote_tree, hf_nano_confirm_ack_vote_common_sequence, tvb, offset, 8, ENC_LITTLE_ENDIAN);
-    offset += 8;
+    nano_account_to_address(tvb_get_ptr(tvb, offset, 32), address);
 
-    return offset;
+    proto_item *ti = proto_tree_add_string(tree, hf_nano_account_address, tvb, offset, 32, address);
+    proto_item_set_generated(ti);
 }
 
-static int hf_nano_confirm_ack_hash = -1;
-
-static int dissect_nano_confirm_ack (tvbuff_t* tvb, packet_info* pinfo, proto_tree* nano_tree, int offset, guint64 extensions) {
-    proto_item* pi;
+static void dissect_nano_balance (proto_tree *tree, tvbuff_t *tvb, int offset) {
+    char balance[48];
 
-    int total_size = 32 + 64 + 8;
-    int block_type = (extensions & 0x0f00) >> 8;
-    int item_count = (extensions & 0xf000) >> 12;
+    proto_tree_add_item(tree, hf_nano_block_balance, tvb, offset, 16, ENC_NA);
 
-    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        total_size += item_count * 32;
-    } else {
-        total_size += get_block_type_size(block_type);
+    if (!proto_field_is_referenced(tree, hf_nano_block_balance_nano)) {
+        return;
     }
 
-    append_info_col(pinfo->cinfo, "Confirm Ack");
+    nano_raw_to_string(tvb_get_ptr(tvb, offset, 16), balance);
 
-    proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, total_size, ett_nano_confirm_ack, NULL, "Confirm Ack");
+    // the double is for filtering, the exact value is shown
+    proto_item *ti = proto_tree_add_double_format_value(tree, hf_nano_block_balance_nano, tvb, offset, 16, g_ascii_strtod(balance, NULL), "%s", balance);
+    proto_item_set_generated(ti);
+}
 
-    offset = dissect_nano_vote_common(tvb, pinfo, tree, offset);
+// the root is the previous block, or the account for the first block of a chain
+static const guint8 *nano_block_root (int block_type, const guint8 *block) {
+    static const guint8 zero[32];
 
-    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        col_append_fstr(pinfo->cinfo, COL_INFO, " (%i Blocks)", item_count);
+    switch (block_type) {
+        case NANO_BLOCK_TYPE_OPEN:
+            return block + 64;
+        case NANO_BLOCK_TYPE_STATE:
+            return memcmp(block + 32, zero, 32) ? block + 32 : block;
+    }
 
-        proto_tree* hashes_tree = proto_tree_add_subtree(tree, tvb, offset, item_count * 32, ett_nano_confirm_ack_hashes, &pi, "Hashes List");
-        for (int i = 0; i < item_count; i++) {
-            proto_tree_add_item(hashes_tree, hf_nano_confirm_ack_hash, tvb, offset, 32, ENC_NA);
-            offset += 32;
-        }
+    return block;
+}
 
-        return offset;
-    } else {
-        col_append_fstr(pinfo->cinfo, COL_INFO, " (%s Block)", val_to_str(block_type, VALS(nano_block_type_strings), "Unknown (%d)"));
+// work is stored little endian in legacy blocks and big endian in state blocks
+static void dissect_nano_block_work (proto_tree *tree, tvbuff_t *tvb, int block_type, int offset) {
+    int block_offset = offset + 8 - get_block_type_size(block_type);
+    const guint8 *root;
+    guint8 work[8], digest[8];
+    nano_blake2b_state state;
+
+    proto_tree_add_item(tree, hf_nano_block_work, tvb, offset, 8, ENC_NA);
 
-        return dissect_nano_block(block_type, tvb, tree, offset);
+    if (!proto_field_is_referenced(tree, hf_nano_block_work_difficulty)) {
+        return;
     }
-}
 
-//
-// Dissect Confirm Req
-//
+    phtole64(work, block_type == NANO_BLOCK_TYPE_STATE ? tvb_get_ntoh64(tvb, offset) : tvb_get_letoh64(tvb, offset));
 
-static int hf_nano_hash_pair_first = -1;
-static int hf_nano_hash_pair_second = -1;
+    root = nano_block_root(block_type, tvb_get_ptr(tvb, block_offset, 32 + 32 + 32));
 
-static gint ett_nano_confirm_req = -1;
+    nano_blake2b_init(&state, sizeof(digest));
+    nano_blake2b_update(&state, work, sizeof(work));
+    nano_blake2b_update(&state, root, 32);
+    nano_blake2b_final(&state, digest);
 
-static int dissect_nano_confirm_req (tvbuff_t* tvb, packet_info* pinfo, proto_tree* nano_tree, int offset, guint64 extensions) {
-    proto_item *ti;
-    proto_tree* hash_pair_tree;
+    proto_item *ti = proto_tree_add_uint64(tree, hf_nano_block_work_difficulty, tvb, offset, 8, pletoh64(digest));
+    proto_item_set_generated(ti);
+}
 
-    int block_type = (extensions & 0x0f00) >> 8;
+// blake2b-256 over every field but the signature and the work, state blocks are prefixed with a preamble
+void nano_block_hash (int block_type, const guint8 *block, guint8 *hash) {
+    static const guint8 state_preamble[32] = { [31] = NANO_BLOCK_TYPE_STATE };
+    int hashed_length = get_block_type_size(block_type) - 64 - 8;
+    nano_blake2b_state state;
 
-    append_info_col(pinfo->cinfo, "Confirm Req");
-    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        col_append_str(pinfo->cinfo, COL_INFO, " (ReqByHash)");
+    nano_blake2b_init(&state, 32);
+    if (block_type == NANO_BLOCK_TYPE_STATE) {
+        nano_blake2b_update(&state, state_preamble, sizeof(state_preamble));
+    }
+    nano_blake2b_update(&state, block, hashed_length);
+    nano_blake2b_final(&state, hash);
+}
 
-        // Req by hash
-        int item_count = (extensions & 0xf000) >> 12;
+// sidecar record of a block found to be a fork on the first pass
+struct nano_fork_note {
+    guint32 frame;
+    guint32 pdu;
+    guint32 offset;
+    guint32 reserved;
+    guint8 fork_of[32];
+};
 
-        proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, item_count * 64, ett_nano_confirm_req, NULL, "Confirm Req");
-        proto_tree_add_uint(tree, hf_nano_extensions_item_count, tvb, offset, 0, item_count);
+static const guint8 *nano_sidecar_fork_of (packet_info *pinfo, tvbuff_t *tvb, int offset) {
+    guint32 count;
+    const struct nano_fork_note *notes = (const struct nano_fork_note *) nano_sidecar_frame_records(NANO_SIDECAR_FORK_NOTES, pinfo->num, &count);
+
+    for (guint32 i = 0; i < count; i++) {
+        if (notes[i].pdu == (guint32) tvb_raw_offset(tvb) && notes[i].offset == (guint32) offset) {
+            return notes[i].fork_of;
+        }
+    }
 
-        for (int i = 0; i < item_count; i++) {
-            hash_pair_tree = proto_tree_add_subtree(tree, tvb, offset, 64, ett_nano_hash_pair, &ti, "Hash Pair");
+    return NULL;
+}
 
-            proto_tree_add_item(hash_pair_tree, hf_nano_hash_pair_first, tvb, offset, 32, ENC_BIG_ENDIAN);
-            offset += 32;
+// a block that is not the first one seen on its root, found on the first pass and looked up again when revisiting
+static void dissect_nano_block_fork (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int block_type, int offset, const guint8 *hash) {
+    int block_size = get_block_type_size(block_type);
+    const guint8 *root = nano_block_root(block_type, tvb_get_ptr(tvb, offset, 32 + 32 + 32));
+    const guint8 *fork_of;
 
-            proto_tree_add_item(hash_pair_tree, hf_nano_hash_pair_second, tvb, offset, 32, ENC_BIG_ENDIAN);
-            offset += 32;
+    if (nano_is_replay(pinfo)) {
+        fork_of = nano_sidecar_fork_of(pinfo, tvb, offset);
+    } else if (!PINFO_FD_VISITED(pinfo)) {
+        fork_of = nano_forks_observe(root, hash, pinfo->num, pinfo->abs_ts.secs);
+        nano_indexes_charge();
+
+        if (fork_of && nano_sidecar_collecting()) {
+            struct nano_fork_note note = { pinfo->num, (guint32) tvb_raw_offset(tvb), (guint32) offset, 0, { 0 } };
+
+            memcpy(note.fork_of, fork_of, 32);
+            nano_sidecar_add(NANO_SIDECAR_FORK_NOTES, &note);
         }
     } else {
-        col_append_fstr(pinfo->cinfo, COL_INFO, " (%s Block)", val_to_str(block_type, VALS(nano_block_type_strings), "Unknown (%d)"));
-
-        int block_type_size = get_block_type_size(block_type);
-        proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, block_type_size, ett_nano_confirm_req, NULL, "Confirm Req");
+        fork_of = nano_forks_lookup(root, hash);
+    }
 
-        return dissect_nano_block(block_type, tvb, tree, offset);
+    if (!fork_of) {
+        return;
     }
 
-    return offset;
+    proto_item *ti = proto_tree_add_bytes(tree, hf_nano_block_fork_of, tvb, offset, block_size, fork_of);
+    proto_item_set_generated(ti);
+    expert_add_info(pinfo, ti, &ei_nano_fork);
 }
 
-//
-// Dissect Telemetry Req
-//
-static int dissect_nano_telemetry_req(packet_info *pinfo) {
-    append_info_col(pinfo->cinfo, "Telemetry Req");
+// where a block or vote hash stands in the ledger snapshot, when one is loaded and somebody looks
+static void dissect_nano_ledger_status (proto_tree *tree, tvbuff_t *tvb, int offset, int length, const guint8 *hash) {
+    if (!nano_ledger_count() || !proto_field_is_referenced(tree, hf_nano_ledger_status)) {
+        return;
+    }
 
-    return 0;
+    proto_item *ti = proto_tree_add_uint(tree, hf_nano_ledger_status, tvb, offset, length, nano_ledger_lookup(hash));
+    proto_item_set_generated(ti);
 }
 
-static int hf_nano_telemetry_ack_signature = -1;
-static int hf_nano_telemetry_ack_nodeid = -1;
-static int hf_nano_telemetry_ack_blockcount = -1;
-static int hf_nano_telemetry_ack_cementedcount = -1;
-static int hf_nano_telemetry_ack_uncheckedcount = -1;
-static int hf_nano_telemetry_ack_accountcount = -1;
-static int hf_nano_telemetry_ack_bandwidthcap = -1;
-static int hf_nano_telemetry_ack_uptime = -1;
-static int hf_nano_telemetry_ack_peercount = -1;
-static int hf_nano_telemetry_ack_protocolversion = -1;
-static int hf_nano_telemetry_ack_genesisblock = -1;
-static int hf_nano_telemetry_ack_majorversion = -1;
-static int hf_nano_telemetry_ack_minorversion = -1;
-static int hf_nano_telemetry_ack_patchversion = -1;
-static int hf_nano_telemetry_ack_prereleaseversion = -1;
-static int hf_nano_telemetry_ack_maker = -1;
-static int hf_nano_telemetry_ack_timestamp = -1;
-static int hf_nano_telemetry_ack_activedifficulty = -1;
-
-static gint ett_nano_telemetry_ack = -1;
-
-static int dissect_nano_telemetry_ack(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset, guint64 extensions) {
-    append_info_col(pinfo->cinfo, "Telemetry Ack");
+// fork detection needs every hash on the first pass, afterwards only trees that show or reference the fork, FALSE if hash was left alone
+static gboolean dissect_nano_block_hash (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int block_type, int offset, guint8 *hash) {
+    int hashed_length = get_block_type_size(block_type) - 64 - 8;
+    gboolean check_fork = nano_pref_fork_detection && (!PINFO_FD_VISITED(pinfo) || proto_field_is_referenced(tree, hf_nano_block_fork_of));
+    gboolean show_hash = proto_field_is_referenced(tree, hf_nano_block_hash);
+    gboolean check_ledger = nano_ledger_count() && proto_field_is_referenced(tree, hf_nano_ledger_status);
+
+    // the sidecar knows the answer without the hash
+    if (check_fork && nano_is_replay(pinfo)) {
+        dissect_nano_block_fork(tree, pinfo, tvb, block_type, offset, NULL);
+        check_fork = FALSE;
+    }
 
-    guint32 payload_size = extensions & 0x3ff;
-    proto_tree *telemetry_tree = proto_tree_add_subtree(nano_tree, tvb, offset, payload_size, ett_nano_telemetry_ack, NULL, "Telemetry Ack");
+    if (!check_fork && !show_hash && !check_ledger) {
+        return FALSE;
+    }
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_signature, tvb, offset, 64, ENC_BIG_ENDIAN);
-    offset += 64;
+    nano_block_hash(block_type, tvb_get_ptr(tvb, offset, hashed_length), hash);
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_nodeid, tvb, offset, 32, ENC_BIG_ENDIAN);
-    offset += 32;
+    if (show_hash) {
+        proto_item *ti = proto_tree_add_bytes(tree, hf_nano_block_hash, tvb, offset, hashed_length, hash);
+        proto_item_set_generated(ti);
+    }
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_blockcount, tvb, offset, 8, ENC_NA);
-    offset += 8;
+    dissect_nano_ledger_status(tree, tvb, offset, hashed_length, hash);
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_cementedcount, tvb, offset, 8, ENC_NA);
-    offset += 8;
+    if (check_fork) {
+        dissect_nano_block_fork(tree, pinfo, tvb, block_type, offset, hash);
+    }
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_uncheckedcount, tvb, offset, 8, ENC_NA);
-    offset += 8;
+    return TRUE;
+}
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_accountcount, tvb, offset, 8, ENC_NA);
-    offset += 8;
+//
+// State block subtypes
+//
+// A state block only says what it does relative to the block before it: a
+// lower balance is a send, a higher one a receive. The last balance seen for
+// every account is kept in a flat open addressing table keyed by the first 8
+// bytes of the account, 40 bytes an account. The previous balance is only
+// trusted when the cached block is this block's previous, otherwise the link
+// field has to do.
+//
+// Legacy send blocks carry a balance too, so the first state block after a
+// legacy chain can still be classified. They do not carry the account: when
+// the chain index knows it the balance goes under the account, otherwise
+// under the first 8 bytes of the send's own hash, which a state block finds
+// through its previous and a receive through its link.
+//
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_bandwidthcap, tvb, offset, 8, ENC_NA);
-    offset += 8;
+#define NANO_PROTO_DATA_STATE_NOTES 2
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_peercount, tvb, offset, 4, ENC_NA);
-    offset += 4;
+#define NANO_BALANCE_TABLE_MIN_SLOTS 1024
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_protocolversion, tvb, offset, 1, ENC_NA);
-    offset += 1;
+#define NANO_STATE_SUBTYPE_UNKNOWN 0
+#define NANO_STATE_SUBTYPE_SEND 1
+#define NANO_STATE_SUBTYPE_RECEIVE 2
+#define NANO_STATE_SUBTYPE_OPEN 3
+#define NANO_STATE_SUBTYPE_CHANGE 4
+#define NANO_STATE_SUBTYPE_EPOCH 5
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_uptime, tvb, offset, 8, ENC_NA);
-    offset += 8;
+static const value_string nano_state_subtype_strings[] = {
+    { NANO_STATE_SUBTYPE_UNKNOWN, "Send or Receive" },
+    { NANO_STATE_SUBTYPE_SEND, "Send" },
+    { NANO_STATE_SUBTYPE_RECEIVE, "Receive" },
+    { NANO_STATE_SUBTYPE_OPEN, "Open" },
+    { NANO_STATE_SUBTYPE_CHANGE, "Change" },
+    { NANO_STATE_SUBTYPE_EPOCH, "Epoch" },
+    { 0, NULL },
+};
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_genesisblock, tvb, offset, 32, ENC_NA);
-    offset += 32;
+// links of the epoch upgrade blocks, "epoch v1 block" and "epoch v2 block" zero padded
+static const guint8 nano_epoch_links[2][32] = {
+    { 'e', 'p', 'o', 'c', 'h', ' ', 'v', '1', ' ', 'b', 'l', 'o', 'c', 'k' },
+    { 'e', 'p', 'o', 'c', 'h', ' ', 'v', '2', ' ', 'b', 'l', 'o', 'c', 'k' }
+};
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_majorversion, tvb, offset, 1, ENC_NA);
-    offset += 1;
+// account 0 marks an empty slot, the burn account cannot sign blocks
+struct nano_balance {
+    // or the hash of a legacy send whose account is not known
+    guint64 account;
+    guint64 head;
+    guint8 balance[16];
+    gboolean by_hash;
+};
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_minorversion, tvb, offset, 1, ENC_NA);
-    offset += 1;
+static struct nano_balance *nano_balances;
+static guint32 nano_balance_mask;
+static guint32 nano_balance_used;
+static gsize nano_balance_bytes;
+
+// also the sidecar record, which finds notes by frame
+struct nano_state_note {
+    guint32 frame;
+    guint32 pdu;
+    guint32 offset;
+    guint8 subtype;
+    gboolean from_link;
+    gboolean amount_known;
+    guint8 amount[16];
+};
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_patchversion, tvb, offset, 1, ENC_NA);
-    offset += 1;
+static void nano_balances_reset (void) {
+    nano_balances = NULL;
+    nano_balance_mask = 0;
+    nano_balance_used = 0;
+    nano_balance_bytes = 0;
+}
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_prereleaseversion, tvb, offset, 1, ENC_NA);
-    offset += 1;
+static struct nano_balance *nano_balance_slot (guint64 account) {
+    guint32 i = (guint32) account & nano_balance_mask;
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_maker, tvb, offset, 1, ENC_NA);
-    offset += 1;
+    while (nano_balances[i].account != 0 && nano_balances[i].account != account) {
+        i = (i + 1) & nano_balance_mask;
+    }
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_timestamp, tvb, offset, 8, ENC_TIME_MSECS);
-    offset += 8;
+    return &nano_balances[i];
+}
 
-    proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_activedifficulty, tvb, offset, 8, ENC_NA);
-    offset += 8;
+// key is an account, or a block hash with by_hash
+static struct nano_balance *nano_balance_find (const guint8 *key, gboolean by_hash) {
+    if (!nano_balances) {
+        return NULL;
+    }
 
-    return offset;
+    struct nano_balance *entry = nano_balance_slot(pletoh64(key));
+    return entry->account != 0 && entry->by_hash == by_hash ? entry : NULL;
 }
 
+// grows with the number of accounts and legacy sends without one, entries are only ever replaced
+static void nano_balance_store (const guint8 *key, gboolean by_hash, const guint8 *hash, const guint8 *balance) {
+    guint32 slots = nano_balances ? nano_balance_mask + 1 : 0;
 
-//
-// Dissect Asc Pull Ack / Req
-//
-static int hf_nano_asc_pull_type = -1;
-static int hf_nano_asc_pull_req_ack_id = -1;
-static int hf_nano_asc_pull_req_blocks_payload = -1;
-static int hf_nano_asc_pull_req_account_info_payload = -1;
-static int hf_nano_asc_pull_ack_blocks_payload = -1;
-static int hf_nano_asc_pull_ack_account_info_payload = -1;
+    if ((guint64) (nano_balance_used + 1) * 10 > (guint64) slots * 7) {
+        struct nano_balance *old = nano_balances;
+        guint32 new_slots = MAX(slots * 2, NANO_BALANCE_TABLE_MIN_SLOTS);
 
-static gint ett_nano_asc_pull_req = -1;
-static gint ett_nano_asc_pull_ack = -1;
+        nano_balances = wmem_alloc0_array(wmem_file_scope(), struct nano_balance, new_slots);
+        nano_balance_mask = new_slots - 1;
+        for (guint32 i = 0; i < slots; i++) {
+            if (old[i].account != 0) {
+                *nano_balance_slot(old[i].account) = old[i];
+            }
+        }
+        wmem_free(wmem_file_scope(), old);
+        nano_balance_bytes += ((gsize) new_slots - slots) * sizeof(struct nano_balance);
+    }
 
-static int
-dissect_nano_asc_pull_req(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, gint offset)
-{
-    // Dissect the asc_pull_type
-    proto_tree_add_item(tree, hf_nano_asc_pull_type, tvb, offset, 1, ENC_BIG_ENDIAN);
-    offset += 1;
+    struct nano_balance *entry = nano_balance_slot(pletoh64(key));
+    if (entry->account == 0) {
+        entry->account = pletoh64(key);
+        nano_balance_used++;
+    }
+    entry->head = pletoh64(hash);
+    memcpy(entry->balance, balance, 16);
+    entry->by_hash = by_hash;
+}
 
-    // Dissect the req/ack ID
-    proto_tree_add_item(tree, hf_nano_asc_pull_req_ack_id, tvb, offset, 8, ENC_BIG_ENDIAN);
-    offset += 8;
+// difference of two big endian 128 bit amounts, a >= b
+static void nano_raw_subtract (const guint8 *a, const guint8 *b, guint8 *out) {
+    guint borrow = 0;
 
-    // Dissect the payload based on the asc_pull_type
-    guint8 asc_pull_type = tvb_get_guint8(tvb, offset - 9);
+    for (int i = 15; i >= 0; i--) {
+        guint difference = (guint) a[i] - b[i] - borrow;
 
-    switch (asc_pull_type) {
-        case 1: // blocks
-            proto_tree_add_item(tree, hf_nano_asc_pull_req_blocks_payload, tvb, offset, 33, ENC_NA);
-            break;
-        case 2: // account_info
-            proto_tree_add_item(tree, hf_nano_asc_pull_req_account_info_payload, tvb, offset, 32, ENC_NA);
-            break;
+        out[i] = (guint8) difference;
+        borrow = (difference >> 8) & 1;
     }
-    return offset;
 }
 
-static void
-dissect_nano_asc_pull_ack_blocks_payload(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, gint offset)
-{
-    while (tvb_get_guint8(tvb, offset) != 1) {
-        guint8 block_type = tvb_get_guint8(tvb, offset);
+static gboolean nano_is_epoch_link (const guint8 *link) {
+    return !memcmp(link, nano_epoch_links[0], 32) || !memcmp(link, nano_epoch_links[1], 32);
+}
 
-        switch (block_type) {
-            case NANO_BLOCK_TYPE_SEND:
-                dissect_nano_send_block(tvb, tree, offset);
-                offset += NANO_BLOCK_SIZE_SEND;
-                break;
-            case NANO_BLOCK_TYPE_RECEIVE:
-                dissect_nano_receive_block(tvb, tree, offset);
-                offset += NANO_BLOCK_SIZE_RECEIVE;
-                break;
-            case NANO_BLOCK_TYPE_OPEN:
-                dissect_nano_open_block(tvb, tree, offset);
-                offset += NANO_BLOCK_SIZE_OPEN;
-                break;
-            case NANO_BLOCK_TYPE_CHANGE:
-                dissect_nano_change_block(tvb, tree, offset);
-                offset += NANO_BLOCK_SIZE_CHANGE;
-                break;
-            case NANO_BLOCK_TYPE_STATE:
-                dissect_nano_state(tvb, tree, offset);
-                offset += NANO_BLOCK_SIZE_STATE;
-                break;
-            default:
-                // Unknown block type; return from the function
-                return;
+// classify a state block and remember its balance, block points at the whole block
+static void nano_state_classify (const guint8 *block, const guint8 *hash, struct nano_state_note *note) {
+    static const guint8 zero[32];
+    const guint8 *account = block;
+    const guint8 *previous = block + 32;
+    const guint8 *balance = block + 32 + 32 + 32;
+    const guint8 *link = balance + 16;
+    const guint8 *previous_balance = NULL;
+
+    if (!memcmp(previous, zero, 32)) {
+        // the first block of a chain starts from nothing
+        previous_balance = zero;
+    } else {
+        const struct nano_balance *entry = nano_balance_find(account, FALSE);
+
+        // a legacy send we could not tie to the account
+        if (!entry || entry->head != pletoh64(previous)) {
+            entry = nano_balance_find(previous, TRUE);
+        }
+        if (entry && entry->head == pletoh64(previous)) {
+            previous_balance = entry->balance;
         }
     }
-}
-
-static int
-dissect_nano_asc_pull_ack(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, gint offset)
-{
-    // Dissect the asc_pull_type
-    proto_tree_add_item(tree, hf_nano_asc_pull_type, tvb, offset, 1, ENC_BIG_ENDIAN);
-    offset += 1;
 
-    // Dissect the req/ack ID
-    proto_tree_add_item(tree, hf_nano_asc_pull_req_ack_id, tvb, offset, 8, ENC_BIG_ENDIAN);
-    offset += 8;
+    if (previous_balance) {
+        int order = memcmp(balance, previous_balance, 16);
 
-    // Dissect the payload based on the asc_pull_type
-    guint8 asc_pull_type = tvb_get_guint8(tvb, offset - 9);
+        note->amount_known = TRUE;
+        if (order < 0) {
+            note->subtype = NANO_STATE_SUBTYPE_SEND;
+            nano_raw_subtract(previous_balance, balance, note->amount);
+        } else {
+            nano_raw_subtract(balance, previous_balance, note->amount);
+            if (nano_is_epoch_link(link)) {
+                note->subtype = NANO_STATE_SUBTYPE_EPOCH;
+            } else if (previous_balance == zero) {
+                note->subtype = NANO_STATE_SUBTYPE_OPEN;
+            } else if (order > 0) {
+                note->subtype = NANO_STATE_SUBTYPE_RECEIVE;
+            } else {
+                note->subtype = NANO_STATE_SUBTYPE_CHANGE;
+            }
+        }
+    } else {
+        // sends link to an account, receives to a block hash, only our cache can tell them apart
+        note->from_link = TRUE;
+        if (nano_is_epoch_link(link)) {
+            note->subtype = NANO_STATE_SUBTYPE_EPOCH;
+        } else if (!memcmp(link, zero, 32)) {
+            note->subtype = NANO_STATE_SUBTYPE_CHANGE;
+        } else if (nano_balance_find(link, FALSE)) {
+            note->subtype = NANO_STATE_SUBTYPE_SEND;
+        } else if (nano_balance_find(link, TRUE)) {
+            note->subtype = NANO_STATE_SUBTYPE_RECEIVE;
+        } else {
+            note->subtype = NANO_STATE_SUBTYPE_UNKNOWN;
+        }
+    }
 
-    switch (asc_pull_type) {
-        case 1: // blocks
-            dissect_nano_asc_pull_ack_blocks_payload(tvb, pinfo, tree, offset);
-            break;
-        case 2: // account_info
-            proto_tree_add_item(tree, hf_nano_asc_pull_ack_account_info_payload, tvb, offset, 144, ENC_NA);
-            break;
+    // same as for legacy sends, a block older than the cached head must not replace it
+    const struct nano_balance *head = nano_balance_find(account, FALSE);
+    if (!head || head->head == pletoh64(previous)) {
+        nano_balance_store(account, FALSE, hash, balance);
     }
-    return offset;
 }
 
+// remember the balance a legacy send leaves, block points at the whole block
+static void nano_legacy_send_store (const guint8 *block, const guint8 *hash) {
+    const guint8 *previous = block;
+    const guint8 *balance = block + 32 + 32;
+    guint8 account[32];
 
-//
-// Dissect Node ID Handshake
-//
+    if (nano_chains_block_account(hash, account) || nano_chains_block_account(previous, account)) {
+        const struct nano_balance *entry = nano_balance_find(account, FALSE);
 
-static int hf_nano_node_id_handshake_is_query = -1;
-static int hf_nano_node_id_handshake_is_response = -1;
+        // a bulk pull walks back from the head, an older block must not replace what came after it
+        if (!entry || entry->head == pletoh64(previous)) {
+            nano_balance_store(account, FALSE, hash, balance);
+        }
+        return;
+    }
 
-static int hf_nano_node_id_handshake_query_cookie = -1;
+    nano_balance_store(hash, TRUE, hash, balance);
+}
 
-static int hf_nano_node_id_handshake_response_account = -1;
-static int hf_nano_node_id_handshake_response_signature = -1;
+// the cache has moved on by the time a packet is revisited, so the first pass result is kept per frame
+static void dissect_nano_state_subtype (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int offset, const guint8 *hash) {
+    wmem_array_t *notes = (wmem_array_t *) p_get_proto_data(wmem_file_scope(), pinfo, proto_nano, NANO_PROTO_DATA_STATE_NOTES);
+    guint32 pdu = (guint32) tvb_raw_offset(tvb);
+    struct nano_state_note *note = NULL;
+    struct nano_state_note first_pass;
 
-static gint ett_nano_node_id_handshake = -1;
+    if (!nano_pref_state_subtypes) {
+        return;
+    }
 
-static int dissect_nano_node_id_handshake(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset, guint64 extensions) {
-    guint total_body_size = 0;
-    guint32 is_query = extensions & 0x0001;
-    guint32 is_response = extensions & 0x0002;
+    if (nano_is_replay(pinfo)) {
+        guint32 count;
+        const struct nano_state_note *stored = (const struct nano_state_note *) nano_sidecar_frame_records(NANO_SIDECAR_STATE_NOTES, pinfo->num, &count);
+
+        for (guint32 i = 0; i < count; i++) {
+            if (stored[i].pdu == pdu && stored[i].offset == (guint32) offset) {
+                first_pass = stored[i];
+                note = &first_pass;
+                break;
+            }
+        }
+        if (!note) {
+            return;
+        }
 
-    append_info_col(pinfo->cinfo, "Node ID Handshake");
+        if (!notes) {
+            notes = wmem_array_new(wmem_file_scope(), sizeof(struct nano_state_note));
+            p_add_proto_data(wmem_file_scope(), pinfo, proto_nano, NANO_PROTO_DATA_STATE_NOTES, notes);
+        }
+        wmem_array_append_one(notes, first_pass);
+    } else if (!PINFO_FD_VISITED(pinfo)) {
+        guint8 own_hash[32];
+        const guint8 *block = tvb_get_ptr(tvb, offset, NANO_BLOCK_SIZE_STATE);
+
+        if (!hash) {
+            nano_block_hash(NANO_BLOCK_TYPE_STATE, block, own_hash);
+            hash = own_hash;
+        }
 
-    // Is query
-    if (is_query) {
-        col_append_str(pinfo->cinfo, COL_INFO, " (Query)");
-        total_body_size += 32;
+        memset(&first_pass, 0, sizeof(first_pass));
+        first_pass.frame = pinfo->num;
+        first_pass.pdu = pdu;
+        first_pass.offset = offset;
+        nano_state_classify(block, hash, &first_pass);
+        nano_indexes_charge();
+        note = &first_pass;
+        nano_sidecar_add(NANO_SIDECAR_STATE_NOTES, &first_pass);
+
+        // single pass live captures never come back to this packet
+        if (!nano_memory_is_limited()) {
+            if (!notes) {
+                notes = wmem_array_new(wmem_file_scope(), sizeof(struct nano_state_note));
+                p_add_proto_data(wmem_file_scope(), pinfo, proto_nano, NANO_PROTO_DATA_STATE_NOTES, notes);
+            }
+            wmem_array_append_one(notes, first_pass);
+        }
+    } else {
+        for (guint i = 0; notes && i < wmem_array_get_count(notes); i++) {
+            struct nano_state_note *stored = (struct nano_state_note *) wmem_array_index(notes, i);
+
+            if (stored->pdu == pdu && stored->offset == (guint32) offset) {
+                note = stored;
+                break;
+            }
+        }
     }
 
-    // Is response
-    if (is_response) {
-        col_append_str(pinfo->cinfo, COL_INFO, " (Response)");
-        total_body_size += 32 + 64;
+    if (!note || !tree) {
+        return;
     }
 
-
-    proto_tree *handshake_tree = proto_tree_add_subtree(nano_tree, tvb, offset, total_body_size, ett_nano_node_id_handshake, NULL, "Node ID Handshake");
-    proto_tree_add_boolean(handshake_tree, hf_nano_node_id_handshake_is_query, tvb, offset, 0, is_query);
-    proto_tree_add_boolean(handshake_tree, hf_nano_node_id_handshake_is_response, tvb, offset, 0, is_response);
-
-    if (is_query) {
-        proto_tree_add_item(handshake_tree, hf_nano_node_id_handshake_query_cookie, tvb, offset, 32, ENC_NA);
-        offset += 32;
+    proto_item *ti = proto_tree_add_uint(tree, hf_nano_block_subtype, tvb, offset, NANO_BLOCK_SIZE_STATE, note->subtype);
+    proto_item_set_generated(ti);
+    if (note->from_link) {
+        proto_item_append_text(ti, " (from the link, previous balance unknown)");
     }
 
-    if (is_response) {
-        proto_tree_add_item(handshake_tree, hf_nano_node_id_handshake_response_account, tvb, offset, 32, ENC_NA);
-        offset += 32;
+    if (note->amount_known && proto_field_is_referenced(tree, hf_nano_block_amount)) {
+        char amount[48];
 
-        proto_tree_add_item(handshake_tree, hf_nano_node_id_handshake_response_signature, tvb, offset, 64, ENC_NA);
-        offset += 64;
+        nano_raw_to_string(note->amount, amount);
+        ti = proto_tree_add_double_format_value(tree, hf_nano_block_amount, tvb, offset + 32 + 32 + 32, 16, g_ascii_strtod(amount, NULL), "%s", amount);
+        proto_item_set_generated(ti);
     }
-
-    return offset;
 }
 
 //
-// Dissect Publish
+// Dissect Blocks
 //
-static int dissect_nano_publish (tvbuff_t* tvb, packet_info* pinfo, proto_tree* nano_tree, int offset, guint64 extensions) {
-    int block_type = (extensions & 0x0f00) >> 8;
+static int dissect_nano_receive_block(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset) {
+    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_RECEIVE, ett_nano_block, NULL, "Receive Block");
+    guint8 hash[32];
 
-    append_info_col(pinfo->cinfo, "Publish");
-    col_append_fstr(pinfo->cinfo, COL_INFO, " (%s)", val_to_str(block_type, VALS(nano_block_type_strings), "Unknown (%d)"));
+    proto_tree_add_item(block_tree, hf_nano_block_hash_previous, tvb, offset, 32, ENC_NA);
+    offset += 32;
 
-    int block_type_size = get_block_type_size(block_type);
-    proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, block_type_size, ett_nano_confirm_req, NULL, "Publish");
+    proto_tree_add_item(block_tree, hf_nano_block_hash_source, tvb, offset, 32, ENC_NA);
+    offset += 32;
+
+    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
+    offset += 64;
 
-    return dissect_nano_block(block_type, tvb, tree, offset);
+    dissect_nano_block_work(block_tree, tvb, NANO_BLOCK_TYPE_RECEIVE, offset);
+    offset += 8;
+
+    dissect_nano_block_hash(block_tree, pinfo, tvb, NANO_BLOCK_TYPE_RECEIVE, offset - NANO_BLOCK_SIZE_RECEIVE, hash);
+
+    return offset;
 }
 
-//
-// Dissect Bulk Pull
-//
-static int hf_nano_bulk_pull_start = -1;
-static int hf_nano_bulk_pull_end = -1;
-static int hf_nano_bulk_pull_extended_zero = -1;
-static int hf_nano_bulk_pull_extended_count = -1;
-static int hf_nano_bulk_pull_extended_reserved = -1;
+// the balance left by a legacy send, for the state block that follows it; the first pass is all that needs it
+static void nano_legacy_send_note (packet_info *pinfo, tvbuff_t *tvb, int offset, const guint8 *hash) {
+    guint8 own_hash[32];
 
-static int dissect_nano_bulk_pull_request (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, int offset, guint64 extensions) {
-    append_info_col(pinfo->cinfo, "Bulk Pull Request");
+    if (!nano_pref_state_subtypes || PINFO_FD_VISITED(pinfo) || nano_is_replay(pinfo)) {
+        return;
+    }
 
-    int total_body_size = 32 + 32;
-    int is_extended_param_present = extensions & 0x0001;
+    const guint8 *block = tvb_get_ptr(tvb, offset, NANO_BLOCK_SIZE_SEND);
 
-    if (is_extended_param_present) {
-        total_body_size += 1 + 4 + 3;
+    if (!hash) {
+        nano_block_hash(NANO_BLOCK_TYPE_SEND, block, own_hash);
+        hash = own_hash;
     }
 
-    proto_tree *bulk_pull_tree = proto_tree_add_subtree(tree, tvb, offset, total_body_size, ett_nano_bulk_pull, NULL, "Bulk Pull Request");
+    nano_legacy_send_store(block, hash);
+    nano_indexes_charge();
+}
 
-    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_start, tvb, offset, 32, ENC_NA);
+static int dissect_nano_send_block(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset) {
+    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_SEND, ett_nano_block, NULL, "Send Block");
+    guint8 hash[32];
+
+    proto_tree_add_item(block_tree, hf_nano_block_hash_previous, tvb, offset, 32, ENC_NA);
     offset += 32;
 
-    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_end, tvb, offset, 32, ENC_NA);
+    dissect_nano_account(block_tree, hf_nano_block_destination_account, tvb, offset);
     offset += 32;
 
-    // Check if extended param is present
-    if (is_extended_param_present) {
-        proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_extended_zero, tvb, offset, 1, ENC_NA);
-        offset += 1;
+    dissect_nano_balance(block_tree, tvb, offset);
+    offset += 16;
 
-        proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_extended_count, tvb, offset, 4, ENC_LITTLE_ENDIAN);
-        offset += 4;
+    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
+    offset += 64;
 
-        proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_extended_reserved, tvb, offset, 3, ENC_NA);
-        offset += 3;
-    }
+    dissect_nano_block_work(block_tree, tvb, NANO_BLOCK_TYPE_SEND, offset);
+    offset += 8;
+
+    gboolean have_hash = dissect_nano_block_hash(block_tree, pinfo, tvb, NANO_BLOCK_TYPE_SEND, offset - NANO_BLOCK_SIZE_SEND, hash);
+
+    nano_legacy_send_note(pinfo, tvb, offset - NANO_BLOCK_SIZE_SEND, have_hash ? hash : NULL);
 
     return offset;
 }
 
-//
-// Dissect Bulk Pull Account
-//
-static int hf_nano_bulk_pull_account_public_key = -1;
-static int hf_nano_bulk_pull_account_minimum_amount = -1;
-static int hf_nano_bulk_pull_account_flags = -1;
+static int dissect_nano_open_block(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset) {
+    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_OPEN, ett_nano_block, NULL, "Open Block");
+    guint8 hash[32];
 
-static int dissect_nano_bulk_pull_account_request (tvbuff_t* tvb, packet_info* pinfo _U_, proto_tree* tree, int offset, struct nano_session_state* session_state) {
-    append_info_col(pinfo->cinfo, "Bulk Pull Account Request");
+    proto_tree_add_item(block_tree, hf_nano_block_hash_source, tvb, offset, 32, ENC_NA);
+    offset += 32;
 
-    proto_tree *bulk_pull_tree = proto_tree_add_subtree(tree, tvb, offset, 32 + 16 + 1, ett_nano_bulk_pull_account, NULL, "Bulk Pull Account Request");
+    dissect_nano_account(block_tree, hf_nano_block_representative_account, tvb, offset);
+    offset += 32;
 
-    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_account_public_key, tvb, offset, 32, ENC_NA);
+    dissect_nano_account(block_tree, hf_nano_block_account, tvb, offset);
     offset += 32;
 
-    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_account_minimum_amount, tvb, offset, 16, ENC_NA);
-    offset += 16;
+    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
+    offset += 64;
 
-    session_state->bulk_pull_account_request_flags = tvb_get_guint8(tvb, offset);
+    dissect_nano_block_work(block_tree, tvb, NANO_BLOCK_TYPE_OPEN, offset);
+    offset += 8;
 
-    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_account_flags, tvb, offset, 1, ENC_NA);
-    offset += 1;
+    dissect_nano_block_hash(block_tree, pinfo, tvb, NANO_BLOCK_TYPE_OPEN, offset - NANO_BLOCK_SIZE_OPEN, hash);
 
     return offset;
 }
 
-static int hf_nano_bulk_pull_account_response_frontier_entry = -1;
-static int hf_nano_bulk_pull_account_response_balance = -1;
+static int dissect_nano_change_block(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset)
+{
+    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_CHANGE, ett_nano_block, NULL, "Change Block");
+    guint8 hash[32];
 
-static int hf_nano_bulk_pull_account_response_account_entry_hash = -1;
-static int hf_nano_bulk_pull_account_response_account_entry_amount = -1;
-static int hf_nano_bulk_pull_account_response_account_entry_source = -1;
+    proto_tree_add_item(block_tree, hf_nano_block_hash_previous, tvb, offset, 32, ENC_NA);
+    offset += 32;
 
-static int dissect_nano_headerless_bulk_pull_account_response (tvbuff_t* tvb, packet_info* pinfo, proto_tree* nano_tree, struct nano_session_state* session_state) {
-    int offset = 0;
-    int total_size = 32 + 16;
+    dissect_nano_account(block_tree, hf_nano_block_representative_account, tvb, offset);
+    offset += 32;
 
-    guint8 flags = session_state->bulk_pull_account_request_flags;
-    int pending_address_only = flags == 0x01;
-    int pending_include_address = flags == 0x02;
+    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
+    offset += 64;
 
-    if (!pending_address_only) {
-        total_size += 32 + 16;
-    }
+    dissect_nano_block_work(block_tree, tvb, NANO_BLOCK_TYPE_CHANGE, offset);
+    offset += 8;
 
-    if (pending_address_only || pending_include_address) {
-        total_size += 32;
-    }
+    dissect_nano_block_hash(block_tree, pinfo, tvb, NANO_BLOCK_TYPE_CHANGE, offset - NANO_BLOCK_SIZE_CHANGE, hash);
+
+    return offset;
+}
 
-    append_info_col(pinfo->cinfo, "Bulk Pull Account Response");
+static int dissect_nano_state(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset)
+{
+    proto_tree *block_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_BLOCK_SIZE_STATE, ett_nano_block, NULL, "State Block");
+    guint8 hash[32];
 
-    proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, 0, total_size, ett_nano_bulk_pull_account_response, NULL, "Bulk Pull Account Response");
+    dissect_nano_account(block_tree, hf_nano_block_account, tvb, offset);
+    offset += 32;
 
-    //
-    // frontier_balance_entry
-    //
-    proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_frontier_entry, tvb, offset, 32, ENC_NA);
+    proto_tree_add_item(block_tree, hf_nano_block_hash_previous, tvb, offset, 32, ENC_NA);
+    offset += 32;
+
+    dissect_nano_account(block_tree, hf_nano_block_representative_account, tvb, offset);
     offset += 32;
 
-    proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_balance, tvb, offset, 16, ENC_NA);
+    dissect_nano_balance(block_tree, tvb, offset);
     offset += 16;
 
-    //
-    // pending_entry
-    //
-    if (!pending_address_only) {
-        guint32 frontier_hash = tvb_get_guint32(tvb, offset, ENC_NA);
+    proto_tree_add_item(block_tree, hf_nano_block_link, tvb, offset, 32, ENC_NA);
+    offset += 32;
 
-        proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_account_entry_hash, tvb, offset, 32, ENC_NA);
-        offset += 32;
+    proto_tree_add_item(block_tree, hf_nano_block_signature, tvb, offset, 64, ENC_NA);
+    offset += 64;
 
-        proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_account_entry_amount, tvb, offset, 16, ENC_NA);
-        offset += 16;
+    dissect_nano_block_work(block_tree, tvb, NANO_BLOCK_TYPE_STATE, offset);
+    offset += 8;
 
-        // check if we're done with the responses
-        if (frontier_hash == 0) {
-            session_state->client_packet_type = NANO_PACKET_TYPE_INVALID;
-        }
+    gboolean have_hash = dissect_nano_block_hash(block_tree, pinfo, tvb, NANO_BLOCK_TYPE_STATE, offset - NANO_BLOCK_SIZE_STATE, hash);
+
+    dissect_nano_state_subtype(block_tree, pinfo, tvb, offset - NANO_BLOCK_SIZE_STATE, have_hash ? hash : NULL);
+
+    return offset;
+}
+
+static int dissect_nano_block (int block_type, tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, int offset) {
+    int ret = 0;
+
+    NANO_PROFILE_START(probe);
+
+    switch (block_type) {
+        case NANO_BLOCK_TYPE_RECEIVE:
+            ret = dissect_nano_receive_block(tvb, pinfo, tree, offset);
+            break;
+        case NANO_BLOCK_TYPE_OPEN:
+            ret = dissect_nano_open_block(tvb, pinfo, tree, offset);
+            break;
+        case NANO_BLOCK_TYPE_SEND:
+            ret = dissect_nano_send_block(tvb, pinfo, tree, offset);
+            break;
+        case NANO_BLOCK_TYPE_STATE:
+            ret = dissect_nano_state(tvb, pinfo, tree, offset);
+            break;
+        case NANO_BLOCK_TYPE_CHANGE:
+            ret = dissect_nano_change_block(tvb, pinfo, tree, offset);
+            break;
     }
 
-    if (pending_address_only || pending_include_address) {
-        proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_account_entry_source, tvb, offset, 32, ENC_NA);
-        offset += 32;
+    NANO_PROFILE_STOP(probe, NANO_PROFILE_BLOCK, nano_profile_packet_type);
+
+    return ret;
+}
+
+static int get_block_type_size (int block_type) {
+    switch (block_type) {
+        case NANO_BLOCK_TYPE_RECEIVE:
+            return NANO_BLOCK_SIZE_RECEIVE;
+        case NANO_BLOCK_TYPE_OPEN:
+            return NANO_BLOCK_SIZE_OPEN;
+        case NANO_BLOCK_TYPE_SEND:
+            return NANO_BLOCK_SIZE_SEND;
+        case NANO_BLOCK_TYPE_STATE:
+            return NANO_BLOCK_SIZE_STATE;
+        case NANO_BLOCK_TYPE_CHANGE:
+            return NANO_BLOCK_SIZE_CHANGE;
     }
 
-    return offset;
+    return 0;
 }
+
+
 //
-// Dissect Nano Message
+// Account chain index
+//
+// Blocks of bulk pull responses and asc_pull_acks are added to the index in
+// nano_chains.c on the first pass. What it finds wrong is remembered per frame
+// so revisiting a packet shows the same expert info.
 //
-static int hf_nano_frontier_req_start_account = -1;
-static int hf_nano_frontier_req_age = -1;
-static int hf_nano_frontier_req_count = -1;
 
-static int dissect_nano_frontier_req (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, int offset) {
-    append_info_col(pinfo->cinfo, "Frontier Req");
+#define NANO_PROTO_DATA_CHAIN_NOTES 1
 
-    proto_tree *frontier_req_tree = proto_tree_add_subtree(tree, tvb, offset, 32 + 4 + 4, ett_nano_frontier_req, NULL, "Frontier Req");
+#define NANO_CHAIN_NOTE_FLAGS (NANO_CHAIN_GAP | NANO_CHAIN_OUT_OF_ORDER | NANO_CHAIN_INCOMPLETE)
 
-    proto_tree_add_item(frontier_req_tree, hf_nano_frontier_req_start_account, tvb, offset, 32, ENC_BIG_ENDIAN);
-    offset += 32;
+struct nano_chain_note {
+    guint32 pdu;
+    guint32 offset;
+    guint8 flags;
+};
 
-    proto_tree_add_item(frontier_req_tree, hf_nano_frontier_req_age, tvb, offset, 4, ENC_LITTLE_ENDIAN);
-    offset += 4;
+// flags found on the first pass, or the ones stored for this spot when revisiting
+static guint8 nano_chain_note (packet_info *pinfo, tvbuff_t *tvb, int offset, guint8 flags) {
+    wmem_array_t *notes = (wmem_array_t *) p_get_proto_data(wmem_file_scope(), pinfo, proto_nano, NANO_PROTO_DATA_CHAIN_NOTES);
+    // a reassembled PDU has raw offset 0, no other PDU of its frame can start there
+    guint32 pdu = (guint32) tvb_raw_offset(tvb);
 
-    proto_tree_add_item(frontier_req_tree, hf_nano_frontier_req_count, tvb, offset, 4, ENC_LITTLE_ENDIAN);
-    offset += 4;
+    flags &= NANO_CHAIN_NOTE_FLAGS;
 
-    return offset;
+    if (!PINFO_FD_VISITED(pinfo)) {
+        // single pass live captures never come back to this packet
+        if (flags && !nano_memory_is_limited()) {
+            struct nano_chain_note note = { pdu, offset, flags };
+
+            if (!notes) {
+                notes = wmem_array_new(wmem_file_scope(), sizeof(struct nano_chain_note));
+                p_add_proto_data(wmem_file_scope(), pinfo, proto_nano, NANO_PROTO_DATA_CHAIN_NOTES, notes);
+            }
+            wmem_array_append_one(notes, note);
+        }
+        return flags;
+    }
+
+    for (guint i = 0; notes && i < wmem_array_get_count(notes); i++) {
+        struct nano_chain_note *note = (struct nano_chain_note *) wmem_array_index(notes, i);
+
+        if (note->pdu == pdu && note->offset == (guint32) offset) {
+            return note->flags;
+        }
+    }
+
+    return 0;
+}
+
+static void dissect_nano_chain_flags (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int offset, int length, guint8 flags) {
+    if (flags & NANO_CHAIN_GAP) {
+        proto_tree_add_expert(tree, pinfo, &ei_nano_chain_gap, tvb, offset, length);
+    }
+    if (flags & NANO_CHAIN_OUT_OF_ORDER) {
+        proto_tree_add_expert(tree, pinfo, &ei_nano_chain_out_of_order, tvb, offset, length);
+    }
+    if (flags & NANO_CHAIN_INCOMPLETE) {
+        proto_tree_add_expert(tree, pinfo, &ei_nano_chain_incomplete, tvb, offset, length);
+    }
 }
+
 //
-// Dissect headerless packets
+// Spam detection
+//
+// Realtime blocks that carry their account count for it in nano_spam.c on the
+// first pass. Blocks of accounts over the threshold are remembered per frame,
+// in packet scope when memory is limited since those captures are never
+// revisited; the tap picks them up in the same dissection either way.
 //
-static int hf_nano_frontier_response_account = -1;
-static int hf_nano_frontier_response_frontier_hash = -1;
 
-static int dissect_nano_headerless_frontier_response (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
-    append_info_col(pinfo->cinfo, "Frontier Response");
+#define NANO_PROTO_DATA_SPAM_NOTES 3
 
-    int offset = 0;
-    proto_tree *frontier_response_tree = proto_tree_add_subtree(tree, tvb, 0, 32 + 32, ett_nano_frontier_response, NULL, "Frontier Response");
+struct nano_spam_note {
+    guint32 pdu;
+    guint32 offset;
+    nano_spam_rates_t rates;
+};
 
-    guint32 account = tvb_get_guint32(tvb, offset, ENC_NA);
-    proto_tree_add_item(frontier_response_tree, hf_nano_frontier_response_account, tvb, offset, 32, ENC_NA);
-    offset += 32;
+static wmem_allocator_t *nano_spam_note_scope (void) {
+    return nano_memory_is_limited() ? wmem_packet_scope() : wmem_file_scope();
+}
 
-    guint32 frontier_hash = tvb_get_guint32(tvb, offset, ENC_NA);
-    proto_tree_add_item(frontier_response_tree, hf_nano_frontier_response_frontier_hash, tvb, offset, 32, ENC_NA);
-    offset += 32;
+// offset of the account in a block of the given type, -1 if the block does not say
+static int nano_block_account_offset (int block_type, int offset) {
+    switch (block_type) {
+        case NANO_BLOCK_TYPE_STATE:
+            return offset;
+        case NANO_BLOCK_TYPE_OPEN:
+            return offset + 32 + 32;
+    }
+
+    return -1;
+}
 
-    if (account == 0 && frontier_hash == 0) {
-        session_state->client_packet_type = NANO_PACKET_TYPE_INVALID;
+// rates of the account of the block at offset if it was flagged, NULL otherwise
+static const nano_spam_rates_t *nano_spam_note (packet_info *pinfo, tvbuff_t *tvb, int offset) {
+    wmem_array_t *notes = (wmem_array_t *) p_get_proto_data(nano_spam_note_scope(), pinfo, proto_nano, NANO_PROTO_DATA_SPAM_NOTES);
+    guint32 pdu = (guint32) tvb_raw_offset(tvb);
+
+    for (guint i = 0; notes && i < wmem_array_get_count(notes); i++) {
+        struct nano_spam_note *note = (struct nano_spam_note *) wmem_array_index(notes, i);
+
+        if (note->pdu == pdu && note->offset == (guint32) offset) {
+            return &note->rates;
+        }
     }
 
-    return offset;
+    return NULL;
 }
 
-static int hf_nano_bulk_pull_response_block_type = -1;
+static void dissect_nano_block_spam (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int block_type, int offset, guint packet_type) {
+    int account_offset = nano_block_account_offset(block_type, offset);
+    const nano_spam_rates_t *rates;
+    proto_item *ti;
 
-static int dissect_nano_headerless_bulk_pull_response (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
-    append_info_col(pinfo->cinfo, "Bulk Pull Response");
+    if (!nano_pref_spam_detection || account_offset < 0 || !tvb_bytes_exist(tvb, account_offset, 32)) {
+        return;
+    }
 
-    int block_type = tvb_get_guint8(tvb, 0);
+    if (!PINFO_FD_VISITED(pinfo)) {
+        struct nano_spam_note note = { (guint32) tvb_raw_offset(tvb), (guint32) offset, { 0, 0 } };
+        wmem_array_t *notes;
 
-    int total_size = 1;
-    if (block_type != NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        total_size += get_block_type_size(block_type);
+        if (!nano_spam_observe(tvb_get_ptr(tvb, account_offset, 32), packet_type == NANO_PACKET_TYPE_PUBLISH,
+                               nano_sample_weight(tvb, packet_type), &pinfo->abs_ts, &note.rates)) {
+            return;
+        }
+
+        notes = (wmem_array_t *) p_get_proto_data(nano_spam_note_scope(), pinfo, proto_nano, NANO_PROTO_DATA_SPAM_NOTES);
+        if (!notes) {
+            notes = wmem_array_new(nano_spam_note_scope(), sizeof(struct nano_spam_note));
+            p_add_proto_data(nano_spam_note_scope(), pinfo, proto_nano, NANO_PROTO_DATA_SPAM_NOTES, notes);
+        }
+        wmem_array_append_one(notes, note);
     }
 
-    int offset = 0;
-    proto_tree *bulk_pull_response_tree = proto_tree_add_subtree(tree, tvb, 0, total_size, ett_nano_bulk_pull_response, NULL, "Bulk Pull Response");
+    rates = nano_spam_note(pinfo, tvb, offset);
+    if (!rates) {
+        return;
+    }
 
-    proto_tree_add_item(bulk_pull_response_tree, hf_nano_bulk_pull_response_block_type, tvb, offset, 1, ENC_NA);
-    offset += 1;
+    ti = proto_tree_add_double(tree, hf_nano_block_publish_rate, tvb, account_offset, 32, rates->publishes);
+    proto_item_set_generated(ti);
+    expert_add_info(pinfo, ti, &ei_nano_spam);
 
-    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        col_append_fstr(pinfo->cinfo, COL_INFO, " [BULK PULL RESPONSE END]");
-        session_state->client_packet_type = NANO_PACKET_TYPE_NOT_A_TYPE;
+    ti = proto_tree_add_double(tree, hf_nano_block_block_rate, tvb, account_offset, 32, rates->blocks);
+    proto_item_set_generated(ti);
+}
+
+static void nano_chain_pull_start (packet_info *pinfo, tvbuff_t *tvb, int offset, guint32 count, struct nano_pending_request *request) {
+    if (PINFO_FD_VISITED(pinfo) || !request || !nano_pref_chain_index) {
+        return;
+    }
+
+    request->chain_pull = nano_chains_pull_start(tvb_get_ptr(tvb, offset, 32), tvb_get_ptr(tvb, offset + 32, 32), count, pinfo->abs_ts.secs);
+    nano_indexes_charge();
+}
+
+static void dissect_nano_chain_pull_block (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int offset, int block_type, const struct nano_pending_request *request) {
+    int block_size = get_block_type_size(block_type);
+    guint8 flags = 0;
+
+    if (!PINFO_FD_VISITED(pinfo) && request->chain_pull) {
+        flags = nano_chains_pull_block(request->chain_pull, block_type, tvb_get_ptr(tvb, offset, block_size), pinfo->abs_ts.secs);
+        nano_indexes_charge();
+    }
+
+    dissect_nano_chain_flags(tree, pinfo, tvb, offset, block_size, nano_chain_note(pinfo, tvb, offset, flags));
+}
+
+static void dissect_nano_chain_pull_end (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int offset, const struct nano_pending_request *request) {
+    guint8 flags = 0;
+
+    if (!PINFO_FD_VISITED(pinfo) && request->chain_pull) {
+        flags = nano_chains_pull_end(request->chain_pull);
+    }
+
+    dissect_nano_chain_flags(tree, pinfo, tvb, offset, 1, nano_chain_note(pinfo, tvb, offset, flags));
+}
+
+static void dissect_nano_chain_ascending_block (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int offset, int block_type, nano_chain_stream_t *stream) {
+    int block_size = get_block_type_size(block_type);
+    guint8 flags = 0;
+
+    if (!PINFO_FD_VISITED(pinfo) && nano_pref_chain_index) {
+        flags = nano_chains_ascending_block(stream, block_type, tvb_get_ptr(tvb, offset, block_size), pinfo->abs_ts.secs);
+        nano_indexes_charge();
+    }
+
+    dissect_nano_chain_flags(tree, pinfo, tvb, offset, block_size, nano_chain_note(pinfo, tvb, offset, flags));
+}
+
+// dissect the inside of a keepalive packet (that is, the neighbor nodes)
+static int dissect_nano_keepalive(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset)
+{
+    proto_item *ti;
+    proto_tree *peer_tree, *peer_entry_tree;
+    ws_in6_addr ip_addr;
+    guint32 port;
+    gchar buf[100];
+
+    peer_tree = proto_tree_add_subtree(nano_tree, tvb, offset, 8*(16+2), ett_nano_peers, NULL, "Peer List");
+
+    for (int i = 0; i < 8; i++) {
+        peer_entry_tree = proto_tree_add_subtree(peer_tree, tvb, offset, 16 + 2, ett_nano_peer_details, &ti, "Peer");
+
+        tvb_get_ipv6(tvb, offset, &ip_addr);
+        proto_tree_add_item(peer_entry_tree, hf_nano_keepalive_peer_ip, tvb, offset, 16, ENC_NA);
+        offset += 16;
+
+        proto_tree_add_item_ret_uint(peer_entry_tree, hf_nano_keepalive_peer_port, tvb, offset, 2, ENC_LITTLE_ENDIAN, &port);
+        offset += 2;
+
+        if (!memcmp(&ip_addr, "\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0", 16)) {
+            proto_item_append_text(ti, ": (none)");
+        } else if (!memcmp(&ip_addr, "\x0\x0\x0\x0\x0\x0\x0\x0\x0\x0\xff\xff", 12)) {
+            ip_to_str_buf((gchar *) &ip_addr + 12, buf, sizeof(buf));
+            proto_item_append_text(ti, ": %s:%d", buf, port);
+        } else {
+            ip6_to_str_buf(&ip_addr, buf, sizeof(buf));
+            proto_item_append_text(ti, ": [%s]:%d", buf, port);
+        }
+    }
+
+    nano_info_message(pinfo, "Keepalive");
+
+    return offset;
+}
+
+/*
+Each packet type has its own extensions field handler
+*/
+static int hf_nano_extensions_unused_label = -1;
+
+static int hf_nano_extensions_telemetry_size = -1;
+
+static void dissect_nano_header_extensions_unused (proto_tree* tree, tvbuff_t* tvb, int offset) {
+    proto_tree_add_item(tree, hf_nano_extensions_unused_label, tvb, offset, 2, ENC_LITTLE_ENDIAN);
+}
+
+static void dissect_nano_header_telemetry_ack (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
+    guint32 telemetry_size = extensions & 0x3ff;
+
+    proto_tree_add_uint64(tree, hf_nano_extensions_telemetry_size, tvb, offset, 2, telemetry_size);
+}
+
+static void dissect_nano_header_publish (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
+    proto_tree_add_uint(tree, hf_nano_extensions_block_type, tvb, offset, 2, (guint32) extensions);
+}
+
+static int hf_nano_extensions_confirm_v2 = -1;
+
+static void dissect_nano_header_confirm_items (proto_tree* tree, tvbuff_t* tvb, guint64 extensions, int offset, const struct nano_protocol_layout *layout) {
+    int block_type = (extensions & 0x0f00) >> 8;
+
+    proto_tree_add_uint(tree, hf_nano_extensions_block_type, tvb, offset, 2, (guint32) extensions);
+
+    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+        if (layout->confirm_v2_counts) {
+            proto_tree_add_boolean(tree, hf_nano_extensions_confirm_v2, tvb, offset, 2, (guint32) extensions);
+        }
+
+        proto_tree_add_uint(tree, hf_nano_extensions_item_count, tvb, offset, 2, nano_confirm_item_count(layout, (guint) extensions));
+    }
+}
+
+static int hf_nano_extensions_is_query = -1;
+static int hf_nano_extensions_is_response = -1;
+
+static void dissect_nano_header_node_id_handshake (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
+    proto_tree_add_boolean(tree, hf_nano_extensions_is_query, tvb, offset, 2, (guint32) extensions);
+    proto_tree_add_boolean(tree, hf_nano_extensions_is_response, tvb, offset, 2, (guint32) extensions);
+}
+
+static int hf_nano_extensions_confirmed_present = -1;
+
+static void dissect_nano_header_frontier_req (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
+    proto_tree_add_boolean(tree, hf_nano_extensions_confirmed_present, tvb, offset, 2, (guint32) extensions);
+}
+
+static int hf_nano_extensions_is_extended = -1;
+static void dissect_nano_header_bulk_pull (proto_tree* tree _U_, tvbuff_t* tvb _U_, guint64 extensions _U_, int offset _U_) {
+    guint32 is_extended_param_present = extensions & 0x0001;
+
+    proto_tree_add_boolean(tree, hf_nano_extensions_is_extended, tvb, offset, 2, is_extended_param_present);
+}
+
+static void dissect_nano_extensions (proto_tree* nano_tree _U_, tvbuff_t* tvb _U_, int offset _U_, guint nano_packet_type _U_, guint64* extensions _U_, const struct nano_protocol_layout *layout) {
+    proto_tree* tree = proto_tree_add_subtree(nano_tree, tvb, offset, 2, ett_nano_extensions, NULL, "Extensions");
+
+    *extensions = tvb_get_guint16(tvb, offset, ENC_LITTLE_ENDIAN);
+
+    switch (nano_packet_type) {
+        case NANO_PACKET_TYPE_TELEMETRY_ACK:
+            dissect_nano_header_telemetry_ack(tree, tvb, *extensions, offset);
+            break;
+        case NANO_PACKET_TYPE_PUBLISH:
+            dissect_nano_header_publish(tree, tvb, *extensions, offset);
+            break;
+        case NANO_PACKET_TYPE_CONFIRM_REQ:
+        case NANO_PACKET_TYPE_CONFIRM_ACK:
+            dissect_nano_header_confirm_items(tree, tvb, *extensions, offset, layout);
+            break;
+        case NANO_PACKET_TYPE_NODE_ID_HANDSHAKE:
+            dissect_nano_header_node_id_handshake(tree, tvb, *extensions, offset);
+            break;
+        case NANO_PACKET_TYPE_FRONTIER_REQ:
+            dissect_nano_header_frontier_req(tree, tvb, *extensions, offset);
+            break;
+        case NANO_PACKET_TYPE_BULK_PULL:
+            dissect_nano_header_bulk_pull(tree, tvb, *extensions, offset);
+            break;
+
+        // Packets that dont use extensions field
+        case NANO_PACKET_TYPE_KEEPALIVE:
+        case NANO_PACKET_TYPE_BULK_PUSH:
+        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
+        case NANO_PACKET_TYPE_TELEMETRY_REQ:
+            dissect_nano_header_extensions_unused(tree, tvb, offset);
+            break;
+    }
+}
+
+// Dissect message header
+//
+// Every field is an integer, looked up in its value_string only when the
+// item gets a label, so without a visible tree nothing is formatted or
+// allocated here.
+static int dissect_nano_header(tvbuff_t *tvb, proto_tree *nano_tree, int offset, guint *nano_packet_type, guint64* extensions, const struct nano_protocol_layout *layout)
+{
+    proto_tree *header_tree = proto_tree_add_subtree(nano_tree, tvb, offset, NANO_HEADER_LENGTH, ett_nano_header, NULL, "Nano Protocol Header");
+
+    proto_tree_add_item(header_tree, hf_nano_magic_number, tvb, offset, 2, ENC_BIG_ENDIAN);
+    offset += 2;
+
+    proto_tree_add_item(header_tree, hf_nano_version_max, tvb, offset, 1, ENC_NA);
+    offset += 1;
+
+    proto_tree_add_item(header_tree, hf_nano_version_using, tvb, offset, 1, ENC_NA);
+    offset += 1;
+
+    proto_tree_add_item(header_tree, hf_nano_version_min, tvb, offset, 1, ENC_NA);
+    offset += 1;
+
+    proto_tree_add_item_ret_uint(header_tree, hf_nano_packet_type, tvb, offset, 1, ENC_NA, nano_packet_type);
+    offset += 1;
+
+    dissect_nano_extensions(header_tree, tvb, offset, *nano_packet_type, extensions, layout);
+    offset += 2;
+
+    return offset;
+}
+
+//
+// Dissect Confirm Ack
+//
+static int hf_nano_confirm_ack_vote_common_account = -1;
+static int hf_nano_confirm_ack_vote_common_signature = -1;
+static int hf_nano_confirm_ack_vote_common_sequence = -1;
+
+static int dissect_nano_vote_common (tvbuff_t* tvb, packet_info* pinfo _U_, proto_tree* tree, int offset) {
+    proto_tree* vote_tree = proto_tree_add_subtree(tree, tvb, offset, 32 + 64 + 8, ett_nano_vote_common, NULL, "Vote Common");
+
+    dissect_nano_account(vote_tree, hf_nano_confirm_ack_vote_common_account, tvb, offset);
+    offset += 32;
+
+    proto_tree_add_item(vote_tree, hf_nano_confirm_ack_vote_common_signature, tvb, offset, 64, ENC_NA);
+    offset += 64;
+
+    proto_tree_add_item(vote_tree, hf_nano_confirm_ack_vote_common_sequence, tvb, offset, 8, ENC_LITTLE_ENDIAN);
+    offset += 8;
+
+    return offset;
+}
+
+static int hf_nano_confirm_ack_hashes = -1;
+static int hf_nano_confirm_ack_hash = -1;
+
+// A vote can carry 255 hashes. The list is one packed item with a subtree,
+// its entries are only added when somebody looks at them: the tree is visible
+// or a filter or column references an entry field. Trees built for taps and
+// filters on other fields get the packed item and an empty subtree.
+
+static int dissect_nano_confirm_ack (tvbuff_t* tvb, packet_info* pinfo, proto_tree* nano_tree, int offset, guint64 extensions, const struct nano_protocol_layout *layout) {
+    proto_item* pi;
+
+    int total_size = 32 + 64 + 8;
+    int block_type = (extensions & 0x0f00) >> 8;
+    guint item_count = nano_confirm_item_count(layout, (guint) extensions);
+
+    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+        total_size += item_count * 32;
+    } else {
+        total_size += get_block_type_size(block_type);
+    }
+
+    nano_info_message(pinfo, "Confirm Ack");
+
+    proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, total_size, ett_nano_confirm_ack, NULL, "Confirm Ack");
+
+    offset = dissect_nano_vote_common(tvb, pinfo, tree, offset);
+
+    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+        nano_info_detail_sum(pinfo, " (%u Blocks)", item_count);
+
+        pi = proto_tree_add_item(tree, hf_nano_confirm_ack_hashes, tvb, offset, item_count * 32, ENC_NA);
+        proto_item_set_text(pi, "Hashes List (%u)", item_count);
+
+        proto_tree* hashes_tree = proto_item_add_subtree(pi, ett_nano_confirm_ack_hashes);
+        if (proto_field_is_referenced(tree, hf_nano_confirm_ack_hash) ||
+                (nano_ledger_count() && proto_field_is_referenced(tree, hf_nano_ledger_status))) {
+            for (guint i = 0; i < item_count; i++) {
+                proto_tree_add_item(hashes_tree, hf_nano_confirm_ack_hash, tvb, offset + i * 32, 32, ENC_NA);
+                dissect_nano_ledger_status(hashes_tree, tvb, offset + i * 32, 32, tvb_get_ptr(tvb, offset + i * 32, 32));
+            }
+        }
+
+        return offset + item_count * 32;
+    } else {
+        nano_info_detail_string(pinfo, " (%s Block)", nano_block_type_name(block_type));
+
+        dissect_nano_block_spam(tree, pinfo, tvb, block_type, offset, NANO_PACKET_TYPE_CONFIRM_ACK);
+
+        return dissect_nano_block(block_type, tvb, pinfo, tree, offset);
+    }
+}
+
+//
+// Dissect Confirm Req
+//
+
+static int hf_nano_hash_pairs = -1;
+static int hf_nano_hash_pair_first = -1;
+static int hf_nano_hash_pair_second = -1;
+
+static gint ett_nano_confirm_req = -1;
+static gint ett_nano_hash_pairs = -1;
+
+// the pairs name a block and its root, so they reveal forks without carrying the block
+static void dissect_nano_hash_pair_forks (proto_tree *tree, packet_info *pinfo, tvbuff_t *tvb, int offset, guint item_count) {
+    if (!nano_pref_fork_detection || (PINFO_FD_VISITED(pinfo) && !proto_field_is_referenced(tree, hf_nano_block_fork_of))) {
+        return;
+    }
+
+    for (guint i = 0; i < item_count; i++) {
+        int pair_offset = offset + i * 64;
+        const guint8 *hash = tvb_get_ptr(tvb, pair_offset, 32);
+        const guint8 *root = tvb_get_ptr(tvb, pair_offset + 32, 32);
+        const guint8 *fork_of;
+
+        // the pairs carry their hashes, so a replay looks them up in the mapped roots instead of keeping notes
+        if (!PINFO_FD_VISITED(pinfo) && !nano_is_replay(pinfo)) {
+            fork_of = nano_forks_observe(root, hash, pinfo->num, pinfo->abs_ts.secs);
+            nano_indexes_charge();
+        } else {
+            fork_of = nano_forks_lookup(root, hash);
+        }
+
+        if (fork_of) {
+            proto_item *ti = proto_tree_add_bytes(tree, hf_nano_block_fork_of, tvb, pair_offset, 64, fork_of);
+            proto_item_set_generated(ti);
+            expert_add_info(pinfo, ti, &ei_nano_fork);
+        }
+    }
+}
+
+static int dissect_nano_confirm_req (tvbuff_t* tvb, packet_info* pinfo, proto_tree* nano_tree, int offset, guint64 extensions, const struct nano_protocol_layout *layout) {
+    proto_item *ti;
+    proto_tree* hash_pair_tree;
+
+    int block_type = (extensions & 0x0f00) >> 8;
+
+    nano_info_message(pinfo, "Confirm Req");
+    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+        nano_info_detail(pinfo, " (ReqByHash)");
+
+        // Req by hash
+        guint item_count = nano_confirm_item_count(layout, (guint) extensions);
+
+        proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, item_count * 64, ett_nano_confirm_req, NULL, "Confirm Req");
+        proto_tree_add_uint(tree, hf_nano_extensions_item_count, tvb, offset, 0, item_count);
+
+        ti = proto_tree_add_item(tree, hf_nano_hash_pairs, tvb, offset, item_count * 64, ENC_NA);
+        proto_item_set_text(ti, "Hash Pairs (%u)", item_count);
+
+        proto_tree *pairs_tree = proto_item_add_subtree(ti, ett_nano_hash_pairs);
+        if (proto_field_is_referenced(tree, hf_nano_hash_pair_first) ||
+                proto_field_is_referenced(tree, hf_nano_hash_pair_second) ||
+                (nano_ledger_count() && proto_field_is_referenced(tree, hf_nano_ledger_status))) {
+            for (guint i = 0; i < item_count; i++) {
+                int pair_offset = offset + i * 64;
+
+                hash_pair_tree = proto_tree_add_subtree(pairs_tree, tvb, pair_offset, 64, ett_nano_hash_pair, NULL, "Hash Pair");
+                proto_tree_add_item(hash_pair_tree, hf_nano_hash_pair_first, tvb, pair_offset, 32, ENC_BIG_ENDIAN);
+                dissect_nano_ledger_status(hash_pair_tree, tvb, pair_offset, 32, tvb_get_ptr(tvb, pair_offset, 32));
+                proto_tree_add_item(hash_pair_tree, hf_nano_hash_pair_second, tvb, pair_offset + 32, 32, ENC_BIG_ENDIAN);
+            }
+        }
+
+        dissect_nano_hash_pair_forks(tree, pinfo, tvb, offset, item_count);
+
+        offset += item_count * 64;
+    } else {
+        nano_info_detail_string(pinfo, " (%s Block)", nano_block_type_name(block_type));
+
+        int block_type_size = get_block_type_size(block_type);
+        proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, block_type_size, ett_nano_confirm_req, NULL, "Confirm Req");
+
+        dissect_nano_block_spam(tree, pinfo, tvb, block_type, offset, NANO_PACKET_TYPE_CONFIRM_REQ);
+
+        return dissect_nano_block(block_type, tvb, pinfo, tree, offset);
+    }
+
+    return offset;
+}
+
+//
+// Dissect Telemetry Req
+//
+static int dissect_nano_telemetry_req(packet_info *pinfo) {
+    nano_info_message(pinfo, "Telemetry Req");
+
+    return 0;
+}
+
+static int hf_nano_telemetry_ack_signature = -1;
+static int hf_nano_telemetry_ack_nodeid = -1;
+static int hf_nano_telemetry_ack_blockcount = -1;
+static int hf_nano_telemetry_ack_cementedcount = -1;
+static int hf_nano_telemetry_ack_uncheckedcount = -1;
+static int hf_nano_telemetry_ack_accountcount = -1;
+static int hf_nano_telemetry_ack_bandwidthcap = -1;
+static int hf_nano_telemetry_ack_uptime = -1;
+static int hf_nano_telemetry_ack_peercount = -1;
+static int hf_nano_telemetry_ack_protocolversion = -1;
+static int hf_nano_telemetry_ack_genesisblock = -1;
+static int hf_nano_telemetry_ack_majorversion = -1;
+static int hf_nano_telemetry_ack_minorversion = -1;
+static int hf_nano_telemetry_ack_patchversion = -1;
+static int hf_nano_telemetry_ack_prereleaseversion = -1;
+static int hf_nano_telemetry_ack_maker = -1;
+static int hf_nano_telemetry_ack_timestamp = -1;
+static int hf_nano_telemetry_ack_activedifficulty = -1;
+static int hf_nano_telemetry_ack_unknown_data = -1;
+
+static gint ett_nano_telemetry_ack = -1;
+
+// in payload order, a payload from an older node ends after any of them
+static const struct {
+    int *hf;
+    int length;
+    guint encoding;
+} nano_telemetry_ack_fields[] = {
+    { &hf_nano_telemetry_ack_signature, 64, ENC_BIG_ENDIAN },
+    { &hf_nano_telemetry_ack_nodeid, 32, ENC_BIG_ENDIAN },
+    { &hf_nano_telemetry_ack_blockcount, 8, ENC_NA },
+    { &hf_nano_telemetry_ack_cementedcount, 8, ENC_NA },
+    { &hf_nano_telemetry_ack_uncheckedcount, 8, ENC_NA },
+    { &hf_nano_telemetry_ack_accountcount, 8, ENC_NA },
+    { &hf_nano_telemetry_ack_bandwidthcap, 8, ENC_NA },
+    { &hf_nano_telemetry_ack_peercount, 4, ENC_NA },
+    { &hf_nano_telemetry_ack_protocolversion, 1, ENC_NA },
+    { &hf_nano_telemetry_ack_uptime, 8, ENC_NA },
+    { &hf_nano_telemetry_ack_genesisblock, 32, ENC_NA },
+    { &hf_nano_telemetry_ack_majorversion, 1, ENC_NA },
+    { &hf_nano_telemetry_ack_minorversion, 1, ENC_NA },
+    { &hf_nano_telemetry_ack_patchversion, 1, ENC_NA },
+    { &hf_nano_telemetry_ack_prereleaseversion, 1, ENC_NA },
+    { &hf_nano_telemetry_ack_maker, 1, ENC_NA },
+    { &hf_nano_telemetry_ack_timestamp, 8, ENC_TIME_MSECS },
+    { &hf_nano_telemetry_ack_activedifficulty, 8, ENC_NA },
+};
+
+static int dissect_nano_telemetry_ack(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset, guint64 extensions) {
+    nano_info_message(pinfo, "Telemetry Ack");
+
+    guint32 payload_size = extensions & 0x3ff;
+    int payload_end = offset + payload_size;
+
+    // a node without telemetry to share answers with an empty payload
+    if (payload_size == 0) {
+        proto_tree_add_subtree(nano_tree, tvb, offset, 0, ett_nano_telemetry_ack, NULL, "Telemetry Ack (empty)");
+        return offset;
+    }
+
+    proto_tree *telemetry_tree = proto_tree_add_subtree(nano_tree, tvb, offset, payload_size, ett_nano_telemetry_ack, NULL, "Telemetry Ack");
+
+    for (guint i = 0; i < G_N_ELEMENTS(nano_telemetry_ack_fields) && offset + nano_telemetry_ack_fields[i].length <= payload_end; i++) {
+        int hf = *nano_telemetry_ack_fields[i].hf;
+        proto_item *ti = proto_tree_add_item(telemetry_tree, hf, tvb, offset, nano_telemetry_ack_fields[i].length, nano_telemetry_ack_fields[i].encoding);
+
+        if (hf == hf_nano_telemetry_ack_nodeid) {
+            dissect_nano_account_alias(telemetry_tree, ti, tvb, offset);
+        }
+        offset += nano_telemetry_ack_fields[i].length;
+    }
+
+    // fields added by newer nodes, or one the payload cut short
+    if (offset < payload_end) {
+        proto_tree_add_item(telemetry_tree, hf_nano_telemetry_ack_unknown_data, tvb, offset, payload_end - offset, ENC_NA);
+        offset = payload_end;
+    }
+
+    return offset;
+}
+
+
+//
+// Dissect Asc Pull Ack / Req
+//
+static int hf_nano_asc_pull_type = -1;
+static int hf_nano_asc_pull_req_ack_id = -1;
+static int hf_nano_asc_pull_req_blocks_payload = -1;
+static int hf_nano_asc_pull_req_account_info_payload = -1;
+static int hf_nano_asc_pull_ack_blocks_payload = -1;
+static int hf_nano_asc_pull_ack_account_info_payload = -1;
+
+static gint ett_nano_asc_pull_req = -1;
+static gint ett_nano_asc_pull_ack = -1;
+
+static int
+dissect_nano_asc_pull_req(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, gint offset)
+{
+    nano_info_message(pinfo, "Asc Pull Req");
+
+    proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, -1, ett_nano_asc_pull_req, NULL, "Asc Pull Req");
+
+    // Dissect the asc_pull_type
+    proto_tree_add_item(tree, hf_nano_asc_pull_type, tvb, offset, 1, ENC_BIG_ENDIAN);
+    offset += 1;
+
+    // Dissect the req/ack ID
+    proto_tree_add_item(tree, hf_nano_asc_pull_req_ack_id, tvb, offset, 8, ENC_BIG_ENDIAN);
+    offset += 8;
+
+    // Dissect the payload based on the asc_pull_type
+    guint8 asc_pull_type = tvb_get_guint8(tvb, offset - 9);
+
+    switch (asc_pull_type) {
+        case 1: // blocks
+            proto_tree_add_item(tree, hf_nano_asc_pull_req_blocks_payload, tvb, offset, 33, ENC_NA);
+            break;
+        case 2: // account_info
+            proto_tree_add_item(tree, hf_nano_asc_pull_req_account_info_payload, tvb, offset, 32, ENC_NA);
+            break;
+    }
+    return offset;
+}
+
+// [block type][block] records, oldest first, up to a not_a_block type
+static int
+dissect_nano_asc_pull_ack_blocks_payload(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, gint offset)
+{
+    nano_chain_stream_t stream;
+
+    nano_chains_stream_init(&stream);
+
+    while (tvb_captured_length_remaining(tvb, offset) > 0) {
+        guint8 block_type = tvb_get_guint8(tvb, offset);
+        int block_size = get_block_type_size(block_type);
+        offset += 1;
+
+        if (block_size == 0) {
+            // not_a_block ends the list, an unknown type leaves us without a size
+            break;
+        }
+
+        dissect_nano_block(block_type, tvb, pinfo, tree, offset);
+        dissect_nano_chain_ascending_block(tree, pinfo, tvb, offset, block_type, &stream);
+        offset += block_size;
+    }
+
+    return offset;
+}
+
+static int
+dissect_nano_asc_pull_ack(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, gint offset)
+{
+    nano_info_message(pinfo, "Asc Pull Ack");
+
+    proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, -1, ett_nano_asc_pull_ack, NULL, "Asc Pull Ack");
+
+    // Dissect the asc_pull_type
+    proto_tree_add_item(tree, hf_nano_asc_pull_type, tvb, offset, 1, ENC_BIG_ENDIAN);
+    offset += 1;
+
+    // Dissect the req/ack ID
+    proto_tree_add_item(tree, hf_nano_asc_pull_req_ack_id, tvb, offset, 8, ENC_BIG_ENDIAN);
+    offset += 8;
+
+    // Dissect the payload based on the asc_pull_type
+    guint8 asc_pull_type = tvb_get_guint8(tvb, offset - 9);
+
+    switch (asc_pull_type) {
+        case 1: // blocks
+            offset = dissect_nano_asc_pull_ack_blocks_payload(tvb, pinfo, tree, offset);
+            break;
+        case 2: // account_info
+            proto_tree_add_item(tree, hf_nano_asc_pull_ack_account_info_payload, tvb, offset, 144, ENC_NA);
+            break;
+    }
+    return offset;
+}
+
+
+//
+// Dissect Node ID Handshake
+//
+
+static int hf_nano_node_id_handshake_is_query = -1;
+static int hf_nano_node_id_handshake_is_response = -1;
+static int hf_nano_node_id_handshake_is_v2 = -1;
+
+static int hf_nano_node_id_handshake_query_cookie = -1;
+
+static int hf_nano_node_id_handshake_response_account = -1;
+static int hf_nano_node_id_handshake_response_signature = -1;
+static int hf_nano_node_id_handshake_response_salt = -1;
+static int hf_nano_node_id_handshake_response_genesis = -1;
+
+static gint ett_nano_node_id_handshake = -1;
+
+static gboolean nano_identity_matches (const struct nano_peer_identity *identity, const address *addr, guint32 port) {
+    return identity->known && identity->port == port && addr->len == identity->address_len &&
+        memcmp(addr->data, identity->address, identity->address_len) == 0;
+}
+
+static const struct nano_peer_identity *nano_conversation_identity (const struct nano_conversation *nano_conv, const address *addr, guint32 port) {
+    for (int i = 0; i < 2; i++) {
+        if (nano_identity_matches(&nano_conv->identities[i], addr, port)) {
+            return &nano_conv->identities[i];
+        }
+    }
+
+    return NULL;
+}
+
+// first pass: the sender of a handshake response is the node with that ID, from now on and in the registry
+static void nano_learn_node_id (struct nano_conversation *nano_conv, packet_info *pinfo, const guint8 *node_id) {
+    struct nano_peer_identity *identity = NULL;
+
+    if (pinfo->src.len > (int) sizeof(identity->address)) {
+        return;
+    }
+
+    for (int i = 0; i < 2 && !identity; i++) {
+        if (!nano_conv->identities[i].known || nano_identity_matches(&nano_conv->identities[i], &pinfo->src, pinfo->srcport)) {
+            identity = &nano_conv->identities[i];
+        }
+    }
+    if (!identity) {
+        return;
+    }
+
+    identity->known = TRUE;
+    memcpy(identity->address, pinfo->src.data, pinfo->src.len);
+    identity->address_len = pinfo->src.len;
+    identity->port = pinfo->srcport;
+    memcpy(identity->node_id, node_id, 32);
+    identity->frame = pinfo->num;
+
+    // the connecting side comes from a new port every time, only its address says who it is
+    nano_nodeids_observe(&pinfo->src, pinfo->srcport == nano_conv->session_state.server_port ? pinfo->srcport : 0, node_id, &pinfo->abs_ts);
+}
+
+static void dissect_nano_endpoint_node_id (proto_tree *tree, int hf, tvbuff_t *tvb, const struct nano_conversation *nano_conv, const address *addr, guint32 port) {
+    const struct nano_peer_identity *identity = nano_conversation_identity(nano_conv, addr, port);
+    nano_nodeid_t registered;
+    proto_item *node_id_item, *ti;
+    proto_tree *node_id_tree;
+
+    if (identity) {
+        node_id_item = proto_tree_add_bytes(tree, hf, tvb, 0, 0, identity->node_id);
+        node_id_tree = proto_item_add_subtree(node_id_item, ett_nano_node_id);
+
+        ti = proto_tree_add_uint(node_id_tree, hf_nano_node_id_learned_in, tvb, 0, 0, identity->frame);
+        proto_item_set_generated(ti);
+    } else if (nano_nodeids_lookup(addr, port, &registered)) {
+        nstime_t last_seen = NSTIME_INIT_SECS_NSECS(registered.last_seen, 0);
+
+        node_id_item = proto_tree_add_bytes(tree, hf, tvb, 0, 0, registered.node_id);
+        node_id_tree = proto_item_add_subtree(node_id_item, ett_nano_node_id);
+
+        ti = proto_tree_add_time(node_id_tree, hf_nano_node_id_registry_last_seen, tvb, 0, 0, &last_seen);
+        proto_item_set_generated(ti);
+    } else {
+        return;
+    }
+    proto_item_set_generated(node_id_item);
+
+    // node IDs are accounts, the alias book may name them
+    const char *alias = nano_aliases_lookup(identity ? identity->node_id : registered.node_id);
+    if (alias) {
+        proto_item_append_text(node_id_item, " (%s)", alias);
+    }
+}
+
+// node IDs of both ends of the conversation, from its handshakes or the node registry
+static void dissect_nano_node_ids (tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, const struct nano_conversation *nano_conv) {
+    if (!nano_tree) {
+        return;
+    }
+
+    dissect_nano_endpoint_node_id(nano_tree, hf_nano_node_id, tvb, nano_conv, &pinfo->src, pinfo->srcport);
+    dissect_nano_endpoint_node_id(nano_tree, hf_nano_peer_node_id, tvb, nano_conv, &pinfo->dst, pinfo->destport);
+}
+
+static int dissect_nano_node_id_handshake(tvbuff_t *tvb, packet_info *pinfo, proto_tree *nano_tree, int offset, guint64 extensions, const struct nano_protocol_layout *layout, struct nano_conversation *nano_conv) {
+    guint total_body_size = 0;
+    guint32 is_query = extensions & NANO_NODE_ID_QUERY_FLAG;
+    guint32 is_response = extensions & NANO_NODE_ID_RESPONSE_FLAG;
+    guint32 is_v2 = layout->node_id_v2 && (extensions & NANO_NODE_ID_V2_FLAG);
+
+    nano_info_message(pinfo, "Node ID Handshake");
+
+    if (is_query && is_response) {
+        nano_info_detail(pinfo, " (Query) (Response)");
+    } else if (is_query) {
+        nano_info_detail(pinfo, " (Query)");
+    } else if (is_response) {
+        nano_info_detail(pinfo, " (Response)");
+    }
+
+    // Is query
+    if (is_query) {
+        total_body_size += 32;
+    }
+
+    // Is response
+    if (is_response) {
+        total_body_size += 32 + 64;
+
+        if (is_v2) {
+            total_body_size += 32 + 32;
+        }
+    }
+
+
+    proto_tree *handshake_tree = proto_tree_add_subtree(nano_tree, tvb, offset, total_body_size, ett_nano_node_id_handshake, NULL, "Node ID Handshake");
+    proto_tree_add_boolean(handshake_tree, hf_nano_node_id_handshake_is_query, tvb, offset, 0, is_query);
+    proto_tree_add_boolean(handshake_tree, hf_nano_node_id_handshake_is_response, tvb, offset, 0, is_response);
+    proto_tree_add_boolean(handshake_tree, hf_nano_node_id_handshake_is_v2, tvb, offset, 0, is_v2);
+
+    if (is_query) {
+        proto_tree_add_item(handshake_tree, hf_nano_node_id_handshake_query_cookie, tvb, offset, 32, ENC_NA);
+        offset += 32;
+    }
+
+    if (is_response) {
+        proto_item *ti = proto_tree_add_item(handshake_tree, hf_nano_node_id_handshake_response_account, tvb, offset, 32, ENC_NA);
+        dissect_nano_account_alias(handshake_tree, ti, tvb, offset);
+        if (!PINFO_FD_VISITED(pinfo) && tvb_bytes_exist(tvb, offset, 32)) {
+            nano_learn_node_id(nano_conv, pinfo, tvb_get_ptr(tvb, offset, 32));
+        }
+        offset += 32;
+
+        // v2 signs the cookie together with a salt and the genesis hash
+        if (is_v2) {
+            proto_tree_add_item(handshake_tree, hf_nano_node_id_handshake_response_salt, tvb, offset, 32, ENC_NA);
+            offset += 32;
+
+            proto_tree_add_item(handshake_tree, hf_nano_node_id_handshake_response_genesis, tvb, offset, 32, ENC_NA);
+            offset += 32;
+        }
+
+        proto_tree_add_item(handshake_tree, hf_nano_node_id_handshake_response_signature, tvb, offset, 64, ENC_NA);
+        offset += 64;
+    }
+
+    return offset;
+}
+
+//
+// Dissect Publish
+//
+static int dissect_nano_publish (tvbuff_t* tvb, packet_info* pinfo, proto_tree* nano_tree, int offset, guint64 extensions) {
+    int block_type = (extensions & 0x0f00) >> 8;
+
+    nano_info_message(pinfo, "Publish");
+    nano_info_detail_string(pinfo, " (%s)", nano_block_type_name(block_type));
+
+    int block_type_size = get_block_type_size(block_type);
+    proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, offset, block_type_size, ett_nano_confirm_req, NULL, "Publish");
+
+    dissect_nano_block_spam(tree, pinfo, tvb, block_type, offset, NANO_PACKET_TYPE_PUBLISH);
+
+    return dissect_nano_block(block_type, tvb, pinfo, tree, offset);
+}
+
+//
+// Dissect Bulk Pull
+//
+static int hf_nano_bulk_pull_start = -1;
+static int hf_nano_bulk_pull_end = -1;
+static int hf_nano_bulk_pull_extended_zero = -1;
+static int hf_nano_bulk_pull_extended_count = -1;
+static int hf_nano_bulk_pull_extended_reserved = -1;
+
+static int dissect_nano_bulk_pull_request (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, int offset, guint64 extensions, struct nano_pending_request* request) {
+    nano_info_message(pinfo, "Bulk Pull Request");
+
+    int total_body_size = 32 + 32;
+    int is_extended_param_present = extensions & 0x0001;
+    guint32 count = 0;
+
+    if (is_extended_param_present) {
+        total_body_size += 1 + 4 + 3;
+        count = tvb_get_guint32(tvb, offset + 32 + 32 + 1, ENC_LITTLE_ENDIAN);
+    }
+
+    nano_chain_pull_start(pinfo, tvb, offset, count, request);
+
+    proto_tree *bulk_pull_tree = proto_tree_add_subtree(tree, tvb, offset, total_body_size, ett_nano_bulk_pull, NULL, "Bulk Pull Request");
+
+    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_start, tvb, offset, 32, ENC_NA);
+    offset += 32;
+
+    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_end, tvb, offset, 32, ENC_NA);
+    offset += 32;
+
+    // Check if extended param is present
+    if (is_extended_param_present) {
+        proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_extended_zero, tvb, offset, 1, ENC_NA);
+        offset += 1;
+
+        proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_extended_count, tvb, offset, 4, ENC_LITTLE_ENDIAN);
+        offset += 4;
+
+        proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_extended_reserved, tvb, offset, 3, ENC_NA);
+        offset += 3;
+    }
+
+    return offset;
+}
+
+//
+// Bootstrap session state
+//
+static gboolean nano_is_from_client (const struct nano_session_state *session_state, const packet_info *pinfo) {
+    if (!session_state->client_known) {
+        return pinfo->destport == session_state->server_port;
+    }
+
+    return pinfo->srcport == session_state->client_port &&
+        pinfo->src.len == session_state->client_address_len &&
+        memcmp(pinfo->src.data, session_state->client_address, session_state->client_address_len) == 0;
+}
+
+static void nano_learn_client (struct nano_session_state *session_state, const packet_info *pinfo) {
+    if (session_state->client_known || pinfo->src.len > (int) sizeof(session_state->client_address)) {
+        return;
+    }
+
+    memcpy(session_state->client_address, pinfo->src.data, pinfo->src.len);
+    session_state->client_address_len = pinfo->src.len;
+    session_state->client_port = pinfo->srcport;
+    session_state->client_known = TRUE;
+}
+
+// type of the request a headerless message in this direction belongs to, NANO_PACKET_TYPE_INVALID when a header is expected
+static int nano_expected_headerless_type (const struct nano_session_state *session_state, gboolean from_client) {
+    if (from_client) {
+        return session_state->bulk_push_active ? NANO_PACKET_TYPE_BULK_PUSH : NANO_PACKET_TYPE_INVALID;
+    }
+
+    if (session_state->pending_count == 0) {
+        return NANO_PACKET_TYPE_INVALID;
+    }
+
+    return session_state->pending[session_state->pending_head].packet_type;
+}
+
+static struct nano_pending_request *nano_pending_request_current (struct nano_session_state *session_state) {
+    return &session_state->pending[session_state->pending_head];
+}
+
+// returns NULL when too many requests are outstanding
+static struct nano_pending_request *nano_pending_request_push (struct nano_session_state *session_state, int packet_type) {
+    if (session_state->pending_count == NANO_MAX_PENDING_REQUESTS) {
+        return NULL;
+    }
+
+    struct nano_pending_request *request = &session_state->pending[(session_state->pending_head + session_state->pending_count) % NANO_MAX_PENDING_REQUESTS];
+    memset(request, 0, sizeof(*request));
+    request->packet_type = packet_type;
+    session_state->pending_count++;
+
+    return request;
+}
+
+static void nano_pending_request_pop (struct nano_session_state *session_state) {
+    if (session_state->pending_count == 0) {
+        return;
+    }
+
+    session_state->pending_head = (session_state->pending_head + 1) % NANO_MAX_PENDING_REQUESTS;
+    session_state->pending_count--;
+}
+
+static gboolean nano_session_is_streaming (const struct nano_session_state *session_state) {
+    return session_state->bulk_push_active || session_state->pending_count > 0;
+}
+
+// forget the streams in progress but keep what we learned about the endpoints
+static void nano_session_reset_streams (struct nano_session_state *session_state) {
+    session_state->pending_head = 0;
+    session_state->pending_count = 0;
+    session_state->bulk_push_active = FALSE;
+    session_state->inferred_packet_type = FALSE;
+}
+
+// bootstrap requests open a headerless stream, from the client for bulk_push and from the server for the others
+static struct nano_pending_request *nano_session_track_request (struct nano_session_state *session_state, packet_info *pinfo, proto_item *ti, guint nano_packet_type) {
+    struct nano_pending_request *request = NULL;
+
+    switch (nano_packet_type) {
+        case NANO_PACKET_TYPE_BULK_PUSH:
+            nano_learn_client(session_state, pinfo);
+            session_state->bulk_push_active = TRUE;
+            break;
+        case NANO_PACKET_TYPE_BULK_PULL:
+        case NANO_PACKET_TYPE_FRONTIER_REQ:
+        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
+            nano_learn_client(session_state, pinfo);
+            request = nano_pending_request_push(session_state, nano_packet_type);
+            if (!request) {
+                expert_add_info(pinfo, ti, &ei_nano_pending_overflow);
+            }
+            break;
+    }
+
+    return request;
+}
+
+static gboolean nano_is_zero (tvbuff_t *tvb, int offset, int length) {
+    return tvb_skip_guint8(tvb, offset, length, 0) == offset + length;
+}
+
+// size of the next bulk_pull_account response entry
+static int nano_bulk_pull_account_entry_size (const struct nano_pending_request *request) {
+    // frontier hash and balance
+    if (!request->frontier_received) {
+        return 32 + 16;
+    }
+
+    switch (request->bulk_pull_account_flags) {
+        case NANO_BULK_PULL_ACCOUNT_PENDING_ADDRESS_ONLY:
+            return 32;
+        case NANO_BULK_PULL_ACCOUNT_PENDING_HASH_AMOUNT_AND_ADDRESS:
+            return 32 + 16 + 32;
+    }
+
+    return 32 + 16;
+}
+
+//
+// Dissect Bulk Pull Account
+//
+static int hf_nano_bulk_pull_account_public_key = -1;
+static int hf_nano_bulk_pull_account_minimum_amount = -1;
+static int hf_nano_bulk_pull_account_flags = -1;
+
+static int dissect_nano_bulk_pull_account_request (tvbuff_t* tvb, packet_info* pinfo _U_, proto_tree* tree, int offset, struct nano_pending_request* request) {
+    nano_info_message(pinfo, "Bulk Pull Account Request");
+
+    proto_tree *bulk_pull_tree = proto_tree_add_subtree(tree, tvb, offset, 32 + 16 + 1, ett_nano_bulk_pull_account, NULL, "Bulk Pull Account Request");
+
+    proto_item *ti = proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_account_public_key, tvb, offset, 32, ENC_NA);
+    dissect_nano_account_alias(bulk_pull_tree, ti, tvb, offset);
+    offset += 32;
+
+    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_account_minimum_amount, tvb, offset, 16, ENC_NA);
+    offset += 16;
+
+    if (request) {
+        request->bulk_pull_account_flags = tvb_get_guint8(tvb, offset);
+    }
+
+    proto_tree_add_item(bulk_pull_tree, hf_nano_bulk_pull_account_flags, tvb, offset, 1, ENC_NA);
+    offset += 1;
+
+    return offset;
+}
+
+static int hf_nano_bulk_pull_account_response_frontier_entry = -1;
+static int hf_nano_bulk_pull_account_response_balance = -1;
+
+static int hf_nano_bulk_pull_account_response_account_entry_hash = -1;
+static int hf_nano_bulk_pull_account_response_account_entry_amount = -1;
+static int hf_nano_bulk_pull_account_response_account_entry_source = -1;
+
+static int dissect_nano_headerless_bulk_pull_account_response (tvbuff_t* tvb, packet_info* pinfo, proto_tree* nano_tree, struct nano_session_state* session_state) {
+    struct nano_pending_request *request = nano_pending_request_current(session_state);
+    int entry_size = nano_bulk_pull_account_entry_size(request);
+    guint8 flags = request->bulk_pull_account_flags;
+    int offset = 0;
+
+    nano_info_message(pinfo, "Bulk Pull Account Response");
+
+    proto_tree *tree = proto_tree_add_subtree(nano_tree, tvb, 0, entry_size, ett_nano_bulk_pull_account_response, NULL, "Bulk Pull Account Response");
+
+    //
+    // frontier_balance_entry, once at the start of the response
+    //
+    if (!request->frontier_received) {
+        proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_frontier_entry, tvb, offset, 32, ENC_NA);
+        offset += 32;
+
+        proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_balance, tvb, offset, 16, ENC_NA);
+        offset += 16;
+
+        request->frontier_received = TRUE;
+        return offset;
+    }
+
+    //
+    // pending_entry, an all zero entry ends the response
+    //
+    if (nano_is_zero(tvb, 0, entry_size)) {
+        nano_info_detail(pinfo, " [BULK PULL ACCOUNT RESPONSE END]");
+        nano_pending_request_pop(session_state);
+    }
+
+    if (flags != NANO_BULK_PULL_ACCOUNT_PENDING_ADDRESS_ONLY) {
+        proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_account_entry_hash, tvb, offset, 32, ENC_NA);
+        offset += 32;
+
+        proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_account_entry_amount, tvb, offset, 16, ENC_NA);
+        offset += 16;
+    }
+
+    if (flags == NANO_BULK_PULL_ACCOUNT_PENDING_ADDRESS_ONLY || flags == NANO_BULK_PULL_ACCOUNT_PENDING_HASH_AMOUNT_AND_ADDRESS) {
+        proto_tree_add_item(tree, hf_nano_bulk_pull_account_response_account_entry_source, tvb, offset, 32, ENC_NA);
+        offset += 32;
+    }
+
+    return offset;
+}
+//
+// Dissect Nano Message
+//
+static int hf_nano_frontier_req_start_account = -1;
+static int hf_nano_frontier_req_age = -1;
+static int hf_nano_frontier_req_count = -1;
+
+static int dissect_nano_frontier_req (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, int offset) {
+    nano_info_message(pinfo, "Frontier Req");
+
+    proto_tree *frontier_req_tree = proto_tree_add_subtree(tree, tvb, offset, 32 + 4 + 4, ett_nano_frontier_req, NULL, "Frontier Req");
+
+    proto_item *ti = proto_tree_add_item(frontier_req_tree, hf_nano_frontier_req_start_account, tvb, offset, 32, ENC_BIG_ENDIAN);
+    dissect_nano_account_alias(frontier_req_tree, ti, tvb, offset);
+    offset += 32;
+
+    proto_tree_add_item(frontier_req_tree, hf_nano_frontier_req_age, tvb, offset, 4, ENC_LITTLE_ENDIAN);
+    offset += 4;
+
+    proto_tree_add_item(frontier_req_tree, hf_nano_frontier_req_count, tvb, offset, 4, ENC_LITTLE_ENDIAN);
+    offset += 4;
+
+    return offset;
+}
+//
+// Dissect headerless packets
+//
+static int hf_nano_frontier_response_account = -1;
+static int hf_nano_frontier_response_frontier_hash = -1;
+
+static int dissect_nano_headerless_frontier_response (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
+    nano_info_message(pinfo, "Frontier Response");
+
+    int offset = 0;
+    proto_tree *frontier_response_tree = proto_tree_add_subtree(tree, tvb, 0, 32 + 32, ett_nano_frontier_response, NULL, "Frontier Response");
+
+    proto_item *ti = proto_tree_add_item(frontier_response_tree, hf_nano_frontier_response_account, tvb, offset, 32, ENC_NA);
+    dissect_nano_account_alias(frontier_response_tree, ti, tvb, offset);
+    offset += 32;
+
+    proto_tree_add_item(frontier_response_tree, hf_nano_frontier_response_frontier_hash, tvb, offset, 32, ENC_NA);
+    offset += 32;
+
+    // a zero account and a zero frontier end the response
+    if (nano_is_zero(tvb, 0, 32 + 32)) {
+        nano_info_detail(pinfo, " [FRONTIER RESPONSE END]");
+        nano_pending_request_pop(session_state);
+    }
+
+    return offset;
+}
+
+static int hf_nano_bulk_pull_response_block_type = -1;
+
+static int dissect_nano_headerless_bulk_pull_response (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
+    nano_info_message(pinfo, "Bulk Pull Response");
+
+    int block_type = tvb_get_guint8(tvb, 0);
+
+    int total_size = 1;
+    if (block_type != NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+        total_size += get_block_type_size(block_type);
+    }
+
+    int offset = 0;
+    proto_tree *bulk_pull_response_tree = proto_tree_add_subtree(tree, tvb, 0, total_size, ett_nano_bulk_pull_response, NULL, "Bulk Pull Response");
+
+    proto_tree_add_item(bulk_pull_response_tree, hf_nano_bulk_pull_response_block_type, tvb, offset, 1, ENC_NA);
+    offset += 1;
+
+    struct nano_pending_request *request = nano_pending_request_current(session_state);
+
+    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+        nano_info_detail(pinfo, " [BULK PULL RESPONSE END]");
+        dissect_nano_chain_pull_end(bulk_pull_response_tree, pinfo, tvb, 0, request);
+        nano_pending_request_pop(session_state);
+    } else {
+        offset += dissect_nano_block(block_type, tvb, pinfo, bulk_pull_response_tree, offset);
+        dissect_nano_chain_pull_block(bulk_pull_response_tree, pinfo, tvb, 1, block_type, request);
+        nano_info_detail_string(pinfo, " (%s Block)", nano_block_type_name(block_type));
+    }
+
+    return offset;
+}
+
+static int dissect_nano_headerless_bulk_push_body (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
+    nano_info_message(pinfo, "Bulk Push Data");
+
+    int block_type = tvb_get_guint8(tvb, 0);
+
+    int total_size = 1;
+    if (block_type != NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+        total_size += get_block_type_size(block_type);
+    }
+
+    int offset = 0;
+    proto_tree *bulk_push_response_tree = proto_tree_add_subtree(tree, tvb, 0, total_size, ett_nano_bulk_pull_response, NULL, "Bulk Push Data");
+
+    proto_tree_add_item(bulk_push_response_tree, hf_nano_bulk_pull_response_block_type, tvb, offset, 1, ENC_NA);
+    offset += 1;
+
+    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+        nano_info_detail(pinfo, " [BULK PUSH END]");
+        session_state->bulk_push_active = FALSE;
+    } else {
+        offset += dissect_nano_block(block_type, tvb, pinfo, bulk_push_response_tree, offset);
+        nano_info_detail_string(pinfo, " (%s Block)", nano_block_type_name(block_type));
+    }
+
+    return offset;
+}
+
+static int dissect_headerless_packet_client (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
+    switch (nano_expected_headerless_type(session_state, TRUE)) {
+        case NANO_PACKET_TYPE_BULK_PUSH:
+            return dissect_nano_headerless_bulk_push_body(tvb, pinfo, tree, session_state);
+    }
+
+    nano_info_message(pinfo, "UNKNOWN HEADERLESS [CLIENT] Packet");
+    return 0;
+}
+
+static int dissect_headerless_packet_server (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
+    switch (nano_expected_headerless_type(session_state, FALSE)) {
+        case NANO_PACKET_TYPE_FRONTIER_REQ:
+            return dissect_nano_headerless_frontier_response(tvb, pinfo, tree, session_state);
+        case NANO_PACKET_TYPE_BULK_PULL:
+            return dissect_nano_headerless_bulk_pull_response(tvb, pinfo, tree, session_state);
+        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
+            return dissect_nano_headerless_bulk_pull_account_response(tvb, pinfo, tree, session_state);
+    }
+
+    nano_info_message(pinfo, "UNKNOWN HEADERLESS [SERVER] Packet");
+    return 0;
+}
+
+
+static int dissect_headerless_packet (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state, gboolean from_client) {
+    if (from_client) {
+        return dissect_headerless_packet_client(tvb, pinfo, tree, session_state);
+    } else {
+        return dissect_headerless_packet_server(tvb, pinfo, tree, session_state);
+    }
+}
+
+//
+// Message framing
+//
+
+// Protocol versions above this are treated as garbage while resynchronizing
+#define NANO_VERSION_PLAUSIBLE_MAX 0x40
+
+// Number of [block type][block] records checked before a payload is trusted to be a block stream
+#define NANO_RESYNC_BLOCK_PROBES 3
+
+static gboolean nano_is_known_network (guint8 network) {
+    switch (network) {
+        case 'A':
+        case 'B':
+        case 'C':
+        case 'X':
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+// check that offset points at something that looks like a Nano message header
+static gboolean nano_is_plausible_header (tvbuff_t *tvb, int offset) {
+    if (!tvb_bytes_exist(tvb, offset, NANO_HEADER_LENGTH)) {
+        return FALSE;
+    }
+
+    if (tvb_get_guint8(tvb, offset) != 'R' || !nano_is_known_network(tvb_get_guint8(tvb, offset + 1))) {
+        return FALSE;
+    }
+
+    guint8 version_max = tvb_get_guint8(tvb, offset + 2);
+    guint8 version_using = tvb_get_guint8(tvb, offset + 3);
+    guint8 version_min = tvb_get_guint8(tvb, offset + 4);
+
+    if (version_max >= NANO_VERSION_PLAUSIBLE_MAX || version_min > version_using || version_using > version_max) {
+        return FALSE;
+    }
+
+    guint8 nano_packet_type = tvb_get_guint8(tvb, offset + 5);
+
+    return nano_packet_type >= NANO_PACKET_TYPE_KEEPALIVE && nano_packet_type <= NANO_PACKET_TYPE_MAX;
+}
+
+static guint8 nano_protocol_layout_for_version (guint8 version_using) {
+    guint8 index = 0;
+
+    for (guint8 i = 0; i < G_N_ELEMENTS(nano_protocol_layouts); i++) {
+        if (version_using >= nano_protocol_layouts[i].version_using_min) {
+            index = i;
+        }
+    }
+
+    return index;
+}
+
+// the conversation's layout, picked the first time a header is seen at offset
+static const struct nano_protocol_layout *nano_session_layout (struct nano_session_state *session_state, tvbuff_t *tvb, int offset) {
+    if (!session_state->protocol_layout_selected) {
+        if (!nano_is_plausible_header(tvb, offset)) {
+            return &nano_protocol_layouts[NANO_PROTOCOL_LAYOUT_LATEST];
+        }
+
+        session_state->protocol_layout = nano_protocol_layout_for_version(tvb_get_guint8(tvb, offset + 3));
+        session_state->protocol_layout_selected = TRUE;
+    }
+
+    return &nano_protocol_layouts[session_state->protocol_layout];
+}
+
+// length of a message that starts with a Nano header at offset, 0 if it cannot be determined
+static guint get_nano_header_message_len (tvbuff_t *tvb, int offset, const struct nano_protocol_layout *layout) {
+    guint nano_packet_type = tvb_get_guint8(tvb, offset + 5);
+    guint extensions = tvb_get_guint16(tvb, offset + 6, ENC_LITTLE_ENDIAN);
+
+    if (nano_packet_type > NANO_PACKET_TYPE_MAX) {
+        return 0;
+    }
+
+    const struct nano_message_layout *message = &layout->messages[nano_packet_type];
+    guint size = message->fixed;
+
+    switch (message->rule) {
+        case NANO_SIZE_FIXED:
+            break;
+        case NANO_SIZE_EXTENSIONS:
+            size += extensions & message->extensions_mask;
+            break;
+        case NANO_SIZE_BLOCK:
+        case NANO_SIZE_CONFIRM:
+            {
+                int block_type = (extensions & 0x0f00) >> 8;
+
+                if (message->rule == NANO_SIZE_CONFIRM && block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+                    size += nano_confirm_item_count(layout, extensions) * message->item_size;
+                    break;
+                }
+
+                int block_size = get_block_type_size(block_type);
+                if (block_size == 0) {
+                    return 0;
+                }
+
+                size += block_size;
+                break;
+            }
+        case NANO_SIZE_FLAGS:
+            for (int i = 0; i < NANO_MAX_FLAG_SIZES; i++) {
+                if ((extensions & message->flag_sizes[i].flags) == message->flag_sizes[i].flags) {
+                    size += message->flag_sizes[i].size;
+                }
+            }
+            break;
+        default:
+            return 0;
+    }
+
+    return NANO_HEADER_LENGTH + size;
+}
+
+
+// check whether the data at offset looks like the [block type][block] records of a bulk pull / bulk push stream
+static gboolean nano_is_plausible_block_stream (tvbuff_t *tvb, int offset) {
+    int records = 0;
+
+    while (records < NANO_RESYNC_BLOCK_PROBES) {
+        if (!tvb_bytes_exist(tvb, offset, 1)) {
+            // captured data ends on a record boundary
+            return records > 0;
+        }
+
+        int block_type = tvb_get_guint8(tvb, offset);
+        if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+            // end of stream marker
+            return records > 0;
+        }
+
+        int block_size = get_block_type_size(block_type);
+        if (block_size == 0) {
+            return FALSE;
+        }
+
+        offset += 1 + block_size;
+        records++;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Search forward for the next plausible message header and return the number
+ * of bytes to skip to get there. Candidates are found with memchr on the first
+ * magic byte (vectorized by the C library) and must be followed by another
+ * plausible header or by the end of the captured data.
+ */
+static guint nano_resync_scan (tvbuff_t *tvb, int offset, const struct nano_protocol_layout *layout) {
+    gint remaining = tvb_captured_length_remaining(tvb, offset);
+    const guint8 *data = tvb_get_ptr(tvb, offset, remaining);
+    const guint8 *end = data + remaining;
+    const guint8 *cur = data + 1;
+
+    while (cur < end && (cur = (const guint8 *) memchr(cur, 'R', end - cur)) != NULL) {
+        int candidate = offset + (int) (cur - data);
+
+        if (!tvb_bytes_exist(tvb, candidate, NANO_HEADER_LENGTH)) {
+            // a header split across segments, the rest of it is still to come
+            if (cur + 1 == end || nano_is_known_network(cur[1])) {
+                return candidate - offset;
+            }
+        } else if (nano_is_plausible_header(tvb, candidate)) {
+            guint message_len = get_nano_header_message_len(tvb, candidate, layout);
+
+            if (message_len != 0 && (!tvb_bytes_exist(tvb, candidate + message_len, 1) || nano_is_plausible_header(tvb, candidate + message_len))) {
+                return candidate - offset;
+            }
+        }
+
+        cur++;
+    }
+
+    return remaining;
+}
+
+static guint nano_message_len (packet_info *pinfo, tvbuff_t *tvb, int offset, void *data) {
+    struct nano_session_state *session_state = &((struct nano_conversation *) data)->session_state;
+    gboolean from_client = nano_is_from_client(session_state, pinfo);
+    int expected_type = nano_expected_headerless_type(session_state, from_client);
+
+    // a capture that starts in the middle of a session has no request telling us what to expect
+    if (expected_type == NANO_PACKET_TYPE_INVALID && tvb_bytes_exist(tvb, offset, NANO_HEADER_LENGTH) && !nano_is_plausible_header(tvb, offset)) {
+        if (!nano_is_plausible_block_stream(tvb, offset)) {
+            return nano_resync_scan(tvb, offset, nano_session_layout(session_state, tvb, offset));
+        }
+
+        if (from_client) {
+            session_state->bulk_push_active = TRUE;
+            expected_type = NANO_PACKET_TYPE_BULK_PUSH;
+        } else {
+            nano_pending_request_push(session_state, NANO_PACKET_TYPE_BULK_PULL);
+            expected_type = NANO_PACKET_TYPE_BULK_PULL;
+        }
+        session_state->inferred_packet_type = TRUE;
+    }
+
+    switch (expected_type) {
+        case NANO_PACKET_TYPE_BULK_PULL:
+        case NANO_PACKET_TYPE_BULK_PUSH:
+            {
+                // a block type (uint8) and the block, or a lone not_a_block ending the stream
+                int nano_block_type = tvb_get_guint8(tvb, offset);
+                if (nano_block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+                    return 1;
+                }
+
+                int block_size = get_block_type_size(nano_block_type);
+                if (block_size == 0) {
+                    // this is invalid
+                    return tvb_captured_length(tvb) - offset;
+                }
+
+                return 1 + block_size;
+            }
+        case NANO_PACKET_TYPE_FRONTIER_REQ:
+            return 32 + 32;
+        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
+            return nano_bulk_pull_account_entry_size(nano_pending_request_current(session_state));
+    }
+
+    // we expect a client command, this starts with a full Nano header
+    if (tvb_captured_length(tvb) - offset < NANO_HEADER_LENGTH) {
+        // ask for the rest of the header
+        return NANO_HEADER_LENGTH;
+    }
+
+    guint message_len = get_nano_header_message_len(tvb, offset, nano_session_layout(session_state, tvb, offset));
+    if (message_len == 0) {
+        return tvb_captured_length(tvb) - offset;
+    }
+
+    return message_len;
+}
+
+// packet type of the message at offset: the request a headerless one answers, the header's, or invalid while resynchronizing
+static guint nano_message_type (tvbuff_t *tvb, int offset, int headerless_type) {
+    if (headerless_type != NANO_PACKET_TYPE_INVALID) {
+        return headerless_type;
+    }
+
+    if (!tvb_bytes_exist(tvb, offset, NANO_HEADER_LENGTH) || !nano_is_plausible_header(tvb, offset)) {
+        return NANO_PACKET_TYPE_INVALID;
+    }
+
+    return tvb_get_guint8(tvb, offset + 5);
+}
+
+static guint get_nano_message_len (packet_info *pinfo, tvbuff_t *tvb, int offset, void *data) {
+    struct nano_session_state *session_state = &((struct nano_conversation *) data)->session_state;
+
+    NANO_PROFILE_START(probe);
+
+    guint message_len = nano_message_len(pinfo, tvb, offset, data);
+
+    NANO_PROFILE_STOP(probe, NANO_PROFILE_GET_MESSAGE_LEN,
+                      nano_message_type(tvb, offset, nano_expected_headerless_type(session_state, nano_is_from_client(session_state, pinfo))));
+
+    return message_len;
+}
+
+static int dissect_nano_resync (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree) {
+    guint skipped = tvb_captured_length(tvb);
+
+    nano_info_message(pinfo, "Resync");
+    nano_info_detail_sum(pinfo, " (%u bytes skipped)", skipped);
+
+    proto_item *ti = proto_tree_add_uint(tree, hf_nano_resync_skipped, tvb, 0, skipped, skipped);
+    expert_add_info(pinfo, ti, &ei_nano_resync_skipped);
+
+    return skipped;
+}
+
+//
+// Sampling
+//
+// Votes and publishes make up nearly all of a busy peer's traffic. Their
+// headers are always read, so framing, bootstrap state and message counts stay
+// exact, but only 1 in N of them has its body dissected. The choice is made
+// from 8 bytes at a fixed offset inside a signature: the vote signature right
+// after the voting account, or the signature of the block, which sits in front
+// of its work. Signature bytes are uniform whatever the message carries, where
+// vote timestamps (all ones for final votes) or peer addresses are not. Block
+// hashes requested without a block stand in for a signature, and keepalives,
+// which have none, are keyed by a hash of their peers. The choice does not
+// change when a packet is revisited, and every capture of the same message
+// makes the same one.
+//
+static guint nano_sample_rate (guint packet_type) {
+    switch (packet_type) {
+        case NANO_PACKET_TYPE_CONFIRM_ACK:
+            return nano_pref_sample_confirm_ack;
+        case NANO_PACKET_TYPE_CONFIRM_REQ:
+            return nano_pref_sample_confirm_req;
+        case NANO_PACKET_TYPE_PUBLISH:
+            return nano_pref_sample_publish;
+        case NANO_PACKET_TYPE_KEEPALIVE:
+            return nano_pref_sample_keepalive;
+    }
+
+    return 1;
+}
+
+gboolean nano_sampling_enabled (void) {
+    return nano_pref_sample_confirm_ack > 1 || nano_pref_sample_confirm_req > 1 ||
+        nano_pref_sample_publish > 1 || nano_pref_sample_keepalive > 1;
+}
+
+// offset of the 8 bytes a message is sampled by, -1 if it has no signature or hash
+static int nano_sample_key_offset (tvbuff_t *tvb, guint packet_type) {
+    int block_type = (tvb_get_guint16(tvb, 6, ENC_LITTLE_ENDIAN) & 0x0f00) >> 8;
+    int block_size;
+
+    switch (packet_type) {
+        case NANO_PACKET_TYPE_CONFIRM_ACK:
+            // account, then signature, for votes by hash and votes with a block alike
+            return NANO_HEADER_LENGTH + 32;
+        case NANO_PACKET_TYPE_CONFIRM_REQ:
+            if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+                return NANO_HEADER_LENGTH;
+            }
+            // fall through
+        case NANO_PACKET_TYPE_PUBLISH:
+            block_size = get_block_type_size(block_type);
+            return block_size ? NANO_HEADER_LENGTH + block_size - 72 : -1;
+    }
+
+    return -1;
+}
+
+// FNV-1a with a final mix, so that the low bits taken modulo the rate depend on every byte
+static guint64 nano_sample_hash (tvbuff_t *tvb, int offset) {
+    guint64 hash = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+    int length = tvb_captured_length_remaining(tvb, offset);
+    const guint8 *bytes = tvb_get_ptr(tvb, offset, length);
+
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * G_GUINT64_CONSTANT(0x100000001b3);
+    }
+    hash ^= hash >> 33;
+    hash *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+// how many messages this one stands for, 0 if its body is skipped
+static guint nano_sample_weight (tvbuff_t *tvb, guint packet_type) {
+    guint rate = nano_sample_rate(packet_type);
+    int key_offset;
+    guint64 key;
+
+    if (rate <= 1) {
+        return 1;
+    }
+
+    key_offset = nano_sample_key_offset(tvb, packet_type);
+    if (key_offset < 0) {
+        key = nano_sample_hash(tvb, NANO_HEADER_LENGTH);
+    } else if (tvb_bytes_exist(tvb, key_offset, 8)) {
+        key = tvb_get_letoh64(tvb, key_offset);
+    } else {
+        return rate;
+    }
+
+    return key % rate == 0 ? rate : 0;
+}
+
+static int dissect_nano_message (tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, struct nano_conversation *nano_conv) {
+    struct nano_session_state *session_state = &nano_conv->session_state;
+
+    col_set_str(pinfo->cinfo, COL_PROTOCOL, "Nano");
+
+    proto_item *ti = proto_tree_add_item(tree, proto_nano, tvb, 0, -1, ENC_NA);
+    proto_tree *nano_tree = proto_item_add_subtree(ti, ett_nano);
+
+    dissect_nano_node_ids(tvb, pinfo, nano_tree, nano_conv);
+
+    if (session_state->network) {
+        proto_item *network_item = proto_tree_add_uint(nano_tree, hf_nano_network, tvb, 0, 0, session_state->network);
+        proto_item_set_generated(network_item);
+    }
+
+    gboolean from_client = nano_is_from_client(session_state, pinfo);
+
+    if (nano_expected_headerless_type(session_state, from_client) != NANO_PACKET_TYPE_INVALID) {
+        if (session_state->inferred_packet_type) {
+            expert_add_info(pinfo, ti, &ei_nano_resync_inferred);
+            session_state->inferred_packet_type = FALSE;
+        }
+
+        NANO_PROFILE_START(headerless_probe);
+
+        int ret = dissect_headerless_packet(tvb, pinfo, nano_tree, session_state, from_client);
+
+        NANO_PROFILE_STOP(headerless_probe, NANO_PROFILE_HEADERLESS, nano_profile_packet_type);
+
+        return ret;
+    }
+
+    // get_nano_message_len hands us the bytes it skipped while looking for the next header
+    if (!nano_is_plausible_header(tvb, 0)) {
+        NANO_PROFILE_START(resync_probe);
+
+        int ret = dissect_nano_resync(tvb, pinfo, nano_tree);
+
+        NANO_PROFILE_STOP(resync_probe, NANO_PROFILE_RESYNC, NANO_PACKET_TYPE_INVALID);
+
+        return ret;
+    }
+
+    const struct nano_protocol_layout *layout = nano_session_layout(session_state, tvb, 0);
+
+    if (!session_state->network) {
+        session_state->network = tvb_get_guint8(tvb, 1);
+    }
+
+    guint nano_packet_type;
+    guint64 extensions;
+
+    NANO_PROFILE_START(header_probe);
+
+    int offset = dissect_nano_header(tvb, nano_tree, 0, &nano_packet_type, &extensions, layout);
+
+    NANO_PROFILE_STOP(header_probe, NANO_PROFILE_HEADER, nano_packet_type);
+
+    struct nano_pending_request *request = nano_session_track_request(session_state, pinfo, ti, nano_packet_type);
+
+    if (nano_sample_rate(nano_packet_type) > 1) {
+        guint weight = nano_sample_weight(tvb, nano_packet_type);
+
+        proto_item *weight_item = proto_tree_add_uint(nano_tree, hf_nano_sample_weight, tvb, 0, 0, weight);
+        proto_item_set_generated(weight_item);
+
+        if (weight == 0) {
+            nano_info_message(pinfo, nano_packet_type_name(nano_packet_type));
+            nano_info_detail(pinfo, " [sampled out]");
+            return tvb_captured_length(tvb);
+        }
+    }
+
+    int ret = tvb_captured_length(tvb);
+
+    NANO_PROFILE_START(body_probe);
+
+    // call specific dissectors for specific packet types
+    switch (nano_packet_type) {
+        case NANO_PACKET_TYPE_TELEMETRY_ACK:
+            ret = dissect_nano_telemetry_ack(tvb, pinfo, nano_tree, offset, extensions);
+            break;
+        case NANO_PACKET_TYPE_TELEMETRY_REQ:
+            ret = dissect_nano_telemetry_req(pinfo);
+            break;
+        case NANO_PACKET_TYPE_NODE_ID_HANDSHAKE:
+            ret = dissect_nano_node_id_handshake(tvb, pinfo, nano_tree, offset, extensions, layout, nano_conv);
+            break;
+        case NANO_PACKET_TYPE_KEEPALIVE:
+            ret = dissect_nano_keepalive(tvb, pinfo, nano_tree, offset);
+            break;
+        case NANO_PACKET_TYPE_CONFIRM_REQ:
+            ret = dissect_nano_confirm_req(tvb, pinfo, nano_tree, offset, extensions, layout);
+            break;
+        case NANO_PACKET_TYPE_CONFIRM_ACK:
+            ret = dissect_nano_confirm_ack(tvb, pinfo, nano_tree, offset, extensions, layout);
+            break;
+        case NANO_PACKET_TYPE_PUBLISH:
+            ret = dissect_nano_publish(tvb, pinfo, nano_tree, offset, extensions);
+            break;
+        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
+            ret = dissect_nano_bulk_pull_account_request(tvb, pinfo, nano_tree, offset, request);
+            break;
+        case NANO_PACKET_TYPE_FRONTIER_REQ:
+            ret = dissect_nano_frontier_req(tvb, pinfo, nano_tree, offset);
+            break;
+        case NANO_PACKET_TYPE_BULK_PULL:
+            ret = dissect_nano_bulk_pull_request(tvb, pinfo, nano_tree, offset, extensions, request);
+            break;
+        case NANO_PACKET_TYPE_ASC_PULL_REQ:
+            ret = dissect_nano_asc_pull_req(tvb, pinfo, nano_tree, offset);
+            break;
+        case NANO_PACKET_TYPE_ASC_PULL_ACK:
+            ret = dissect_nano_asc_pull_ack(tvb, pinfo, nano_tree, offset);
+            break;
+        default:
+            nano_info_message(pinfo, nano_packet_type_name(nano_packet_type));
+    }
+
+    NANO_PROFILE_STOP(body_probe, nano_profile_body_function(nano_packet_type), nano_packet_type);
+
+    return ret;
+}
+
+// hand the message to "nano" tap listeners, headerless and request_type describe the state it was dissected in
+static void nano_tap_queue_message (tvbuff_t *tvb, packet_info *pinfo, struct nano_conversation *nano_conv, gboolean from_client, gboolean headerless, int request_type) {
+    nano_tap_info_t *tap_info = wmem_new0(wmem_packet_scope(), nano_tap_info_t);
+    int offset = 0;
+
+    tap_info->conversation = nano_conv->conversation->conv_index;
+    tap_info->from_server = !from_client;
+    tap_info->headerless = headerless;
+    tap_info->length = tvb_captured_length(tvb);
+    tap_info->sample_weight = 1;
+
+    if (G_UNLIKELY(nano_profile_on)) {
+        tap_info->profile = nano_profile_take(&tap_info->profile_count);
+    }
+
+    if (headerless) {
+        tap_info->packet_type = request_type;
+
+        if (request_type == NANO_PACKET_TYPE_BULK_PULL || request_type == NANO_PACKET_TYPE_BULK_PUSH) {
+            tap_info->block_type = tvb_get_guint8(tvb, 0);
+            offset = 1;
+        } else if (request_type == NANO_PACKET_TYPE_FRONTIER_REQ && !from_client && tvb_bytes_exist(tvb, 0, 32 + 32)) {
+            tap_info->frontier = tvb_get_ptr(tvb, 0, 32 + 32);
+        }
+    } else if (!nano_is_plausible_header(tvb, 0)) {
+        tap_info->packet_type = NANO_PACKET_TYPE_INVALID;
     } else {
-        offset += dissect_nano_block(block_type, tvb, bulk_pull_response_tree, offset);
-        col_append_fstr(pinfo->cinfo, COL_INFO, " (%s Block)", val_to_str(block_type, VALS(nano_block_type_strings), "Unknown (%d)"));
-    }
+        tap_info->packet_type = tvb_get_guint8(tvb, 5);
+        offset = NANO_HEADER_LENGTH;
+
+        // a sampled out message is counted but its body is not looked at
+        tap_info->sample_weight = nano_sample_weight(tvb, tap_info->packet_type);
+        if (tap_info->sample_weight == 0) {
+            tap_queue_packet(nano_tap, pinfo, tap_info);
+            return;
+        }
 
-    return offset;
-}
+        switch (tap_info->packet_type) {
+            case NANO_PACKET_TYPE_PUBLISH:
+                tap_info->block_type = (tvb_get_guint16(tvb, 6, ENC_LITTLE_ENDIAN) & 0x0f00) >> 8;
+                break;
+            case NANO_PACKET_TYPE_CONFIRM_REQ:
+                tap_info->block_type = (tvb_get_guint16(tvb, 6, ENC_LITTLE_ENDIAN) & 0x0f00) >> 8;
 
-static int dissect_nano_headerless_bulk_push_body (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
-    append_info_col(pinfo->cinfo, "Bulk Push Data");
+                if (tap_info->block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+                    guint32 pair_count = (tvb_captured_length(tvb) - offset) / 64;
 
-    int block_type = tvb_get_guint8(tvb, 0);
+                    tap_info->hash_pairs = pair_count ? tvb_get_ptr(tvb, offset, pair_count * 64) : NULL;
+                    tap_info->hash_pair_count = pair_count;
+                }
+                break;
+            case NANO_PACKET_TYPE_CONFIRM_ACK:
+                tap_info->block_type = (tvb_get_guint16(tvb, 6, ENC_LITTLE_ENDIAN) & 0x0f00) >> 8;
 
-    int total_size = 1;
-    if (block_type != NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        total_size += get_block_type_size(block_type);
-    }
+                if (!tvb_bytes_exist(tvb, offset, 32 + 64 + 8)) {
+                    break;
+                }
 
-    int offset = 0;
-    proto_tree *bulk_push_response_tree = proto_tree_add_subtree(tree, tvb, 0, total_size, ett_nano_bulk_pull_response, NULL, "Bulk Push Data");
+                tap_info->vote_account = tvb_get_ptr(tvb, offset, 32);
+                tap_info->vote_signature = tvb_get_ptr(tvb, offset + 32, 64);
+                tap_info->vote_sequence = tvb_get_guint64(tvb, offset + 32 + 64, ENC_LITTLE_ENDIAN);
+                offset += 32 + 64 + 8;
 
-    proto_tree_add_item(bulk_push_response_tree, hf_nano_bulk_pull_response_block_type, tvb, offset, 1, ENC_NA);
-    offset += 1;
+                if (tap_info->block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
+                    guint32 hash_count = (tvb_captured_length(tvb) - offset) / 32;
 
-    if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-        col_append_fstr(pinfo->cinfo, COL_INFO, " [BULK PUSH END]");
-        session_state->client_packet_type = NANO_PACKET_TYPE_NOT_A_TYPE;
-    } else {
-        offset += dissect_nano_block(block_type, tvb, bulk_push_response_tree, offset);
-        col_append_fstr(pinfo->cinfo, COL_INFO, " (%s Block)", val_to_str(block_type, VALS(nano_block_type_strings), "Unknown (%d)"));
+                    tap_info->vote_hashes = hash_count ? tvb_get_ptr(tvb, offset, hash_count * 32) : NULL;
+                    tap_info->vote_hash_count = hash_count;
+                }
+                break;
+        }
     }
 
-    return offset;
-}
+    int block_length = get_block_type_size(tap_info->block_type);
+    if (block_length != 0 && tvb_bytes_exist(tvb, offset, block_length)) {
+        tap_info->block = tvb_get_ptr(tvb, offset, block_length);
+        tap_info->block_length = block_length;
 
-static int dissect_headerless_packet_client (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
-    switch (session_state->client_packet_type) {
-        case NANO_PACKET_TYPE_BULK_PUSH:
-            return dissect_nano_headerless_bulk_push_body(tvb, pinfo, tree, session_state);
+        const nano_spam_rates_t *rates = nano_spam_note(pinfo, tvb, offset);
+        if (rates) {
+            tap_info->spam_account = tvb_get_ptr(tvb, nano_block_account_offset(tap_info->block_type, offset), 32);
+            tap_info->spam_rate = rates->publishes;
+        }
     }
 
-    append_info_col(pinfo->cinfo, "UNKNOWN HEADERLESS [CLIENT] Packet");
-    return 0;
+    tap_queue_packet(nano_tap, pinfo, tap_info);
 }
 
-static int dissect_headerless_packet_server (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
-    switch (session_state->client_packet_type) {
-        case NANO_PACKET_TYPE_FRONTIER_REQ:
-            return dissect_nano_headerless_frontier_response(tvb, pinfo, tree, session_state);
-        case NANO_PACKET_TYPE_BULK_PULL:
-            return dissect_nano_headerless_bulk_pull_response(tvb, pinfo, tree, session_state);
-        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
-            return dissect_nano_headerless_bulk_pull_account_response(tvb, pinfo, tree, session_state);
+static int dissect_nano (tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void *data) {
+    struct nano_conversation *nano_conv = (struct nano_conversation *) data;
+    struct nano_session_state *session_state = &nano_conv->session_state;
+
+    int request_type = nano_expected_headerless_type(session_state, nano_is_from_client(session_state, pinfo));
+    gboolean headerless = request_type != NANO_PACKET_TYPE_INVALID;
+
+    if (G_UNLIKELY(nano_profile_on)) {
+        nano_profile_packet_type = nano_message_type(tvb, 0, request_type);
     }
 
-    append_info_col(pinfo->cinfo, "UNKNOWN HEADERLESS [SERVER] Packet");
-    return 0;
-}
+    NANO_PROFILE_START(probe);
 
+    int ret = dissect_nano_message(tvb, pinfo, tree, nano_conv);
 
-static int dissect_headerless_packet (tvbuff_t* tvb, packet_info* pinfo, proto_tree* tree, struct nano_session_state* session_state) {
-    // is client
-    if (pinfo->destport == session_state->server_port) {
-        return dissect_headerless_packet_client(tvb, pinfo, tree, session_state);
-    } else {
-        return dissect_headerless_packet_server(tvb, pinfo, tree, session_state);
+    NANO_PROFILE_STOP(probe, NANO_PROFILE_MESSAGE, nano_profile_packet_type);
+
+    // the first request teaches us the direction, so ask again afterwards
+    if (have_tap_listener(nano_tap)) {
+        nano_tap_queue_message(tvb, pinfo, nano_conv, nano_is_from_client(session_state, pinfo), headerless, request_type);
+    } else if (G_UNLIKELY(nano_profile_on)) {
+        nano_profile_discard();
     }
+
+    return ret;
 }
 
 //
-// Dissect Nano Message
+// Bounded memory mode
 //
-static int does_prev_packet_expect_headerless_response (struct nano_session_state* session_state) {
-    switch (session_state->client_packet_type)  {
-        case NANO_PACKET_TYPE_BULK_PULL:
-        case NANO_PACKET_TYPE_BULK_PUSH:
-        case NANO_PACKET_TYPE_FRONTIER_REQ:
-        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
-            return 1;
-    }
+static gboolean nano_memory_is_limited (void) {
+    return nano_pref_memory_limit != 0;
+}
 
-    return 0;
+static gboolean nano_memory_over_limit (void) {
+    return nano_memory_is_limited() && nano_memory.bytes_in_use > (guint64) nano_pref_memory_limit * 1024;
 }
 
-static int dissect_nano (tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void *data _U_) {
-    struct nano_session_state *session_state = (struct nano_session_state *) data;
+// account for file scope bookkeeping, correlation tables call this for every entry they add or drop
+static void nano_memory_charge (gint64 bytes) {
+    nano_memory.bytes_in_use += bytes;
+}
 
-    col_set_str(pinfo->cinfo, COL_PROTOCOL, "Nano");
+// the chain index, the fork roots and the balance cache keep their own byte counts, charge what they grew or shrank by since last time
+static gsize nano_indexes_charged = 0;
 
-    proto_item *ti = proto_tree_add_item(tree, proto_nano, tvb, 0, -1, ENC_NA);
-    proto_tree *nano_tree = proto_item_add_subtree(ti, ett_nano);
+// file scope bytes accounted for, with what the indexes grew by since they were last charged
+static guint64 nano_profile_bytes (void) {
+    return nano_memory.bytes_in_use + nano_chains_memory() + nano_forks_memory() + nano_balance_bytes - nano_indexes_charged;
+}
+
+static void nano_indexes_charge (void) {
+    gsize in_use = nano_chains_memory() + nano_forks_memory() + nano_balance_bytes;
 
-    if (does_prev_packet_expect_headerless_response (session_state)) {
-        return dissect_headerless_packet(tvb, pinfo, nano_tree, session_state);
+    nano_memory_charge((gint64) in_use - (gint64) nano_indexes_charged);
+    nano_indexes_charged = in_use;
+}
+
+static void nano_lru_unlink (struct nano_conversation *nano_conv) {
+    if (nano_conv->lru_prev) {
+        nano_conv->lru_prev->lru_next = nano_conv->lru_next;
+    } else if (nano_lru_head == nano_conv) {
+        nano_lru_head = nano_conv->lru_next;
     }
 
-    // Check that the packet is long enough for it to belong to us.
-    if (tvb_reported_length (tvb) < NANO_HEADER_LENGTH) {
-        append_info_col(pinfo->cinfo, "[DEBUG] ENCOUNTERED SMALL HEADER SIZE IN PACKET");
-        return 0;
+    if (nano_conv->lru_next) {
+        nano_conv->lru_next->lru_prev = nano_conv->lru_prev;
+    } else if (nano_lru_tail == nano_conv) {
+        nano_lru_tail = nano_conv->lru_prev;
     }
 
-#ifdef NANO_STRICT_MAGIC_BYTE
-    // TODO: we should probably make this is a warning
-    char first_byte = tvb_get_gint8(tvb, 0);
-    if (first_byte != 'R') {
-        append_info_col(pinfo->cinfo, "ENCOUNTERED INVALID MAGIC NUMBER IN PACKET!");
-        return 0;
+    nano_conv->lru_prev = NULL;
+    nano_conv->lru_next = NULL;
+}
+
+static void nano_lru_touch (struct nano_conversation *nano_conv) {
+    if (nano_lru_head == nano_conv) {
+        return;
     }
-#endif
 
-    guint nano_packet_type;
-    guint64 extensions;
-    int offset = dissect_nano_header(tvb, nano_tree, 0, &nano_packet_type, &extensions);
+    nano_lru_unlink(nano_conv);
 
-    session_state->client_packet_type = nano_packet_type;
-    // call specific dissectors for specific packet types
-    switch (nano_packet_type) {
-        case NANO_PACKET_TYPE_TELEMETRY_ACK:
-            return dissect_nano_telemetry_ack(tvb, pinfo, nano_tree, offset, extensions);
-        case NANO_PACKET_TYPE_TELEMETRY_REQ:
-            return dissect_nano_telemetry_req(pinfo);
-        case NANO_PACKET_TYPE_NODE_ID_HANDSHAKE:
-            return dissect_nano_node_id_handshake(tvb, pinfo, nano_tree, offset, extensions);
-        case NANO_PACKET_TYPE_KEEPALIVE:
-            return dissect_nano_keepalive(tvb, pinfo, nano_tree, offset);
-        case NANO_PACKET_TYPE_CONFIRM_REQ:
-            return dissect_nano_confirm_req(tvb, pinfo, nano_tree, offset, extensions);
-        case NANO_PACKET_TYPE_CONFIRM_ACK:
-            return dissect_nano_confirm_ack(tvb, pinfo, nano_tree, offset, extensions);
-        case NANO_PACKET_TYPE_PUBLISH:
-            return dissect_nano_publish(tvb, pinfo, nano_tree, offset, extensions);
-        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
-            return dissect_nano_bulk_pull_account_request(tvb, pinfo, nano_tree, offset, session_state);
-        case NANO_PACKET_TYPE_FRONTIER_REQ:
-            return dissect_nano_frontier_req(tvb, pinfo, nano_tree, offset);
-        case NANO_PACKET_TYPE_BULK_PULL:
-            return dissect_nano_bulk_pull_request(tvb, pinfo, nano_tree, offset, extensions);
-        default:
-            append_info_col(pinfo->cinfo, val_to_str(nano_packet_type, VALS(nano_packet_type_strings), "Unknown (%d)"));
+    nano_conv->lru_next = nano_lru_head;
+    if (nano_lru_head) {
+        nano_lru_head->lru_prev = nano_conv;
     }
+    nano_lru_head = nano_conv;
 
-    return tvb_captured_length(tvb);
+    if (!nano_lru_tail) {
+        nano_lru_tail = nano_conv;
+    }
+}
+
+static gboolean nano_conversation_is_idle (struct nano_conversation *nano_conv, const nstime_t *now) {
+    return nano_pref_conversation_timeout != 0 && now->secs - nano_conv->last_seen.secs > (gint64) nano_pref_conversation_timeout;
 }
 
-static guint get_nano_message_len (packet_info *pinfo _U_, tvbuff_t *tvb, int offset, void *data _U_) {
-    struct nano_session_state *session_state = (struct nano_session_state*) data;
-    // check if we're expecting a headerless packet
-    if (session_state->client_packet_type == NANO_PACKET_TYPE_BULK_PULL) {
-        int nano_block_type = tvb_get_guint8(tvb, offset);
+// drop least recently used conversations until we are within the limit, never the one in use
+static void nano_evict_conversations (struct nano_conversation *current, const nstime_t *now) {
+    while (nano_lru_tail && nano_lru_tail != current) {
+        struct nano_conversation *oldest = nano_lru_tail;
 
-        if (nano_block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-            return 1;
+        if (!nano_memory_over_limit() && !nano_conversation_is_idle(oldest, now)) {
+            break;
         }
 
-        // 1 byte for block type and rest is the block itself
-        return 1 + get_block_type_size(nano_block_type); 
-    }
+        nano_lru_unlink(oldest);
+        conversation_delete_proto_data(oldest->conversation, proto_nano);
+        wmem_free(wmem_file_scope(), oldest);
 
-    if (session_state->client_packet_type == NANO_PACKET_TYPE_FRONTIER_REQ) {
-        return 32 + 32;
+        nano_memory_charge(-(gint64) sizeof(struct nano_conversation));
+        nano_memory.conversations--;
+        nano_memory.conversations_evicted++;
     }
+}
 
-    if (session_state->client_packet_type == NANO_PACKET_TYPE_BULK_PUSH) {
-        // we're in the middle of a bulk push, so we expect a block type (uint8) and a block
-        int nano_block_type = tvb_get_guint8(tvb, offset);
-        if (nano_block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-            return 1;
-        }
+// chains not extended within the correlation window, and the least recently used ones while over the limit
+static void nano_expire_chains (const nstime_t *now) {
+    gint64 last_seen;
 
-        int block_size = get_block_type_size(nano_block_type);
-        if (block_size == 0) {
-            // this is invalid
-            return tvb_captured_length(tvb) - offset;
+    while (nano_chains_oldest(&last_seen)) {
+        gboolean idle = nano_pref_correlation_window != 0 && now->secs - last_seen > (gint64) nano_pref_correlation_window;
+
+        if (!idle && !nano_memory_over_limit()) {
+            break;
         }
 
-        return 1 + block_size;
+        nano_chains_drop_oldest();
+        nano_indexes_charge();
+        nano_memory.correlation_expired++;
     }
+}
 
-    if (session_state->client_packet_type == NANO_PACKET_TYPE_BULK_PULL_ACCOUNT) {
-        int size = 32 + 16;
+// fork roots first seen before the correlation window, or the older half of them while over the limit
+static void nano_expire_forks (const nstime_t *now) {
+    guint32 dropped = nano_forks_expire(now->secs, nano_pref_correlation_window, nano_memory_over_limit());
 
-        guint8 flags = session_state->bulk_pull_account_request_flags;
-        int pending_address_only = flags == 0x01;
-        int pending_include_address = flags == 0x02;
+    if (dropped) {
+        nano_indexes_charge();
+        nano_memory.correlation_expired += dropped;
+    }
+}
 
-        if (!pending_address_only) {
-            size += 32 + 16;
-        }
+// balances cannot be aged one by one, the whole cache goes once memory runs short
+static void nano_expire_balances (void) {
+    if (!nano_memory_over_limit() || nano_balance_used == 0) {
+        return;
+    }
 
-        if (pending_address_only || pending_include_address) {
-            size += 32;
-        }
+    nano_memory.correlation_expired += nano_balance_used;
+    wmem_free(wmem_file_scope(), nano_balances);
+    nano_balances_reset();
+    nano_indexes_charge();
+}
 
-        return size;
-    }
+static void dissect_nano_memory_usage (tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree) {
+    proto_item *ti;
 
-    // we expect a client command, this starts with a full Nano header
-    if (tvb_captured_length(tvb) - offset < NANO_HEADER_LENGTH) {
-        return 0;
+    if (!tree || !nano_memory_is_limited() || nano_memory_tree_frame == pinfo->num) {
+        return;
     }
+    nano_memory_tree_frame = pinfo->num;
+
+    proto_tree *memory_tree = proto_tree_add_subtree(tree, tvb, 0, 0, ett_nano_memory, &ti, "Nano Memory Usage");
+    proto_item_set_generated(ti);
+
+    ti = proto_tree_add_uint64(memory_tree, hf_nano_memory_in_use, tvb, 0, 0, nano_memory.bytes_in_use);
+    proto_item_set_generated(ti);
+    ti = proto_tree_add_uint(memory_tree, hf_nano_memory_conversations, tvb, 0, 0, nano_memory.conversations);
+    proto_item_set_generated(ti);
+    ti = proto_tree_add_uint(memory_tree, hf_nano_memory_conversations_evicted, tvb, 0, 0, nano_memory.conversations_evicted);
+    proto_item_set_generated(ti);
+    ti = proto_tree_add_uint(memory_tree, hf_nano_memory_packet_states_dropped, tvb, 0, 0, nano_memory.packet_states_dropped);
+    proto_item_set_generated(ti);
+    ti = proto_tree_add_uint(memory_tree, hf_nano_memory_correlation_expired, tvb, 0, 0, nano_memory.correlation_expired);
+    proto_item_set_generated(ti);
+}
 
-    int nano_packet_type = tvb_get_guint8(tvb, offset + 5);
-    guint64 extensions = tvb_get_guint16(tvb, offset + 6, ENC_LITTLE_ENDIAN);
+// sidecar record of the session state a frame starts in
+struct nano_session_record {
+    guint32 frame;
+    guint32 reserved;
+    struct nano_session_state session_state;
+};
 
-    switch (nano_packet_type) {
-        case NANO_PACKET_TYPE_TELEMETRY_ACK:
-            return NANO_HEADER_LENGTH + 64 + 32 + 8 + 8 + 8 + 8 + 8 + 8 + 4 + 1 + 32 + 1 + 1 + 1 + 1 + 1 + 8 + 8;
-        case NANO_PACKET_TYPE_TELEMETRY_REQ:
-            return NANO_HEADER_LENGTH + 0;
-        case NANO_PACKET_TYPE_NODE_ID_HANDSHAKE:
-            {
-                guint32 is_query = extensions & 0x0001;
-                guint32 is_response = extensions & 0x0002;
-                guint message_len = 0;
+// what the sidecar checks a frame by, the capture file itself is out of sight
+static guint32 nano_frame_digest (tvbuff_t *tvb) {
+    guint length = MIN(tvb_captured_length(tvb), 64);
+    const guint8 *data = tvb_get_ptr(tvb, 0, length);
+    guint32 digest = 0x811c9dc5 ^ tvb_reported_length(tvb);
 
-                if (is_query) message_len += 32;
-                if (is_response) message_len += 32 + 64;
+    for (guint i = 0; i < length; i++) {
+        digest = (digest ^ data[i]) * 0x01000193;
+    }
 
-                return NANO_HEADER_LENGTH + message_len;
-            }
-        case NANO_PACKET_TYPE_KEEPALIVE:
-            return NANO_HEADER_LENGTH + (16 + 2) * 8;
-        case NANO_PACKET_TYPE_CONFIRM_REQ:
-            {
-                int block_type = (extensions & 0x0f00) >> 8;
-                if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-                    // req by hash
-                    int item_count = (extensions & 0xf000) >> 12;
-                    return NANO_HEADER_LENGTH + item_count * 64;
-                } else {
-                    switch (block_type) {
-                        case NANO_BLOCK_TYPE_SEND:
-                            return NANO_HEADER_LENGTH + NANO_BLOCK_SIZE_SEND;
-                        case NANO_BLOCK_TYPE_RECEIVE:
-                            return NANO_HEADER_LENGTH + NANO_BLOCK_SIZE_RECEIVE;
-                        case NANO_BLOCK_TYPE_OPEN:
-                            return NANO_HEADER_LENGTH + NANO_BLOCK_SIZE_OPEN;
-                        case NANO_BLOCK_TYPE_CHANGE:
-                            return NANO_HEADER_LENGTH + NANO_BLOCK_SIZE_CHANGE;
-                        case NANO_BLOCK_TYPE_STATE:
-                            return NANO_HEADER_LENGTH + NANO_BLOCK_SIZE_STATE;
-                        default:
-                            // TODO: we should display an error here
-                            return 0;
-                    }
-                }
-            }
-        case NANO_PACKET_TYPE_CONFIRM_ACK:
-            {
-                int total_size = 32 + 64 + 8;
-                int block_type = (extensions & 0x0f00) >> 8;
-                int item_count = (extensions & 0xf000) >> 12;
+    return digest;
+}
 
-                if (block_type == NANO_BLOCK_TYPE_NOT_A_BLOCK) {
-                    total_size += item_count * 32;
-                } else {
-                    total_size += get_block_type_size(block_type);
-                }
+static void nano_sidecar_frame (tvbuff_t *tvb, packet_info *pinfo) {
+    guint32 digest = nano_frame_digest(tvb);
 
-                return NANO_HEADER_LENGTH + total_size;
-            }
-        case NANO_PACKET_TYPE_PUBLISH:
-            {
-                int block_type = (extensions & 0x0f00) >> 8;
-                return NANO_HEADER_LENGTH + get_block_type_size(block_type);
-            }
-        case NANO_PACKET_TYPE_BULK_PULL_ACCOUNT:
-            return NANO_HEADER_LENGTH + 32 + 16 + 1;
+    if (nano_sidecar_active() && !nano_sidecar_check_frame(pinfo->num, tvb_reported_length(tvb), digest)) {
+        // the rest of the pass works it out again, the roots up to here are lost
+        nano_forks_reset();
+        nano_balances_reset();
+    }
+    nano_sidecar_add_frame(pinfo->num, tvb_reported_length(tvb), digest);
+}
+
+// a mapped session state is used as it is, its indexes have to be in range
+static gboolean nano_session_state_is_valid (const struct nano_session_state *session_state) {
+    return session_state->pending_head < NANO_MAX_PENDING_REQUESTS &&
+        session_state->pending_count <= NANO_MAX_PENDING_REQUESTS &&
+        session_state->client_address_len <= sizeof(session_state->client_address) &&
+        session_state->protocol_layout < G_N_ELEMENTS(nano_protocol_layouts);
+}
+
+static gboolean nano_sidecar_record_check (int section, const void *record) {
+    if (section == NANO_SIDECAR_SESSION_STATES) {
+        return nano_session_state_is_valid(&((const struct nano_session_record *) record)->session_state);
     }
 
-    return tvb_captured_length(tvb) - offset;
+    return TRUE;
+}
+
+static const struct nano_session_state *nano_sidecar_session_state (const packet_info *pinfo) {
+    guint32 count;
+    const struct nano_session_record *record = (const struct nano_session_record *) nano_sidecar_frame_records(NANO_SIDECAR_SESSION_STATES, pinfo->num, &count);
+
+    return record ? &record->session_state : NULL;
 }
 
 // dissect a Nano bootstrap packet (TCP)
 static int dissect_nano_tcp(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void *data _U_) {
     col_clear(pinfo->cinfo, COL_INFO);
+    nano_info_start();
 
     // Setup conversation stuff
+    struct nano_conversation *nano_conv;
     struct nano_session_state *session_state, *packet_session_state;
     conversation_t *conversation = find_or_create_conversation(pinfo);
 
     // try to find session state
-    session_state = (struct nano_session_state *) conversation_get_proto_data(conversation, proto_nano);
-    if (!session_state) {
+    nano_conv = (struct nano_conversation *) conversation_get_proto_data(conversation, proto_nano);
+    if (!nano_conv) {
         // create new session state
-        session_state = wmem_new0(wmem_file_scope(), struct nano_session_state);
-        session_state->client_packet_type = NANO_PACKET_TYPE_INVALID;
-        session_state->server_port = pinfo->match_uint;
-        conversation_add_proto_data(conversation, proto_nano, session_state);
+        nano_conv = wmem_new0(wmem_file_scope(), struct nano_conversation);
+        nano_conv->session_state.server_port = pinfo->match_uint;
+        nano_conv->conversation = conversation;
+        conversation_add_proto_data(conversation, proto_nano, nano_conv);
+
+        nano_memory_charge(sizeof(struct nano_conversation));
+        nano_memory.conversations++;
+    }
+    session_state = &nano_conv->session_state;
+    nano_conv->last_seen = pinfo->abs_ts;
+
+    if (nano_memory_is_limited()) {
+        nano_lru_touch(nano_conv);
+        nano_evict_conversations(nano_conv, &pinfo->abs_ts);
+        nano_expire_chains(&pinfo->abs_ts);
+        nano_expire_forks(&pinfo->abs_ts);
+        nano_expire_balances();
+    }
+
+    if (!PINFO_FD_VISITED(pinfo) && (nano_sidecar_active() || nano_sidecar_collecting())) {
+        nano_sidecar_frame(tvb, pinfo);
     }
 
     // check if we have a session state associated with the packet (start state for this packet)
     packet_session_state = (struct nano_session_state *)p_get_proto_data(wmem_file_scope(), pinfo, proto_nano, 0);
-    if (!packet_session_state) {
-        // this packet does not have a stored session state, get it from the conversation
-        packet_session_state = wmem_new0(wmem_file_scope(), struct nano_session_state);
-        memcpy(packet_session_state, session_state, sizeof(struct nano_session_state));
-        p_add_proto_data(wmem_file_scope(), pinfo, proto_nano, 0, packet_session_state);
-    } else {
+    if (packet_session_state) {
         // this packet has a stored session state, take this as a starting point
         memcpy(session_state, packet_session_state, sizeof(struct nano_session_state));
+    } else if (PINFO_FD_VISITED(pinfo)) {
+        // only start states in the middle of a bootstrap transfer are stored, all others expect a header
+        nano_session_reset_streams(session_state);
+    } else if (nano_session_is_streaming(session_state)) {
+        if (nano_memory_is_limited()) {
+            // single pass live captures never come back to this packet
+            nano_memory.packet_states_dropped++;
+        } else if (nano_is_replay(pinfo) && nano_sidecar_session_state(pinfo)) {
+            // only read, so the copy in the mapping will do
+            p_add_proto_data(wmem_file_scope(), pinfo, proto_nano, 0, (void *) nano_sidecar_session_state(pinfo));
+        } else {
+            packet_session_state = wmem_new0(wmem_file_scope(), struct nano_session_state);
+            memcpy(packet_session_state, session_state, sizeof(struct nano_session_state));
+            p_add_proto_data(wmem_file_scope(), pinfo, proto_nano, 0, packet_session_state);
+
+            if (nano_sidecar_collecting()) {
+                struct nano_session_record record;
+
+                memset(&record, 0, sizeof(record));
+                record.frame = pinfo->num;
+                memcpy(&record.session_state, session_state, sizeof(struct nano_session_state));
+                nano_sidecar_add(NANO_SIDECAR_SESSION_STATES, &record);
+            }
+        }
     }
 
-    tcp_dissect_pdus(tvb, pinfo, tree, TRUE, 1, get_nano_message_len, dissect_nano, session_state);
+    tcp_dissect_pdus(tvb, pinfo, tree, TRUE, 1, get_nano_message_len, dissect_nano, nano_conv);
+
+    // tcp_dissect_pdus catches what the messages throw, so the frame always gets here
+    nano_info_flush(pinfo);
+
+    dissect_nano_memory_usage(tvb, pinfo, tree);
 
     return tvb_captured_length(tvb);
 }
 
+// a sidecar written with other settings records different results
+static void nano_sidecar_init (void) {
+    const guint32 settings[NANO_SIDECAR_SETTINGS] = {
+        nano_pref_fork_detection, nano_pref_state_subtypes,
+        nano_pref_sample_confirm_ack, nano_pref_sample_confirm_req, nano_pref_sample_publish, nano_pref_sample_keepalive,
+        0, 0
+    };
+    const guint32 record_sizes[NANO_SIDECAR_SECTIONS] = {
+        sizeof(struct nano_session_record),
+        sizeof(struct nano_state_note),
+        sizeof(struct nano_fork_note),
+        nano_forks_root_record_size(),
+        sizeof(nano_fork_side_t)
+    };
+    const void *roots, *sides;
+    guint32 root_count, side_count;
+
+    nano_sidecar_open(nano_pref_sidecar_file, settings, record_sizes, nano_sidecar_record_check);
+    if (!nano_sidecar_active()) {
+        return;
+    }
+
+    roots = nano_sidecar_section(NANO_SIDECAR_FORK_ROOTS, &root_count);
+    sides = nano_sidecar_section(NANO_SIDECAR_FORK_SIDES, &side_count);
+    nano_forks_load(roots, root_count, sides, side_count);
+}
+
+static void nano_init (void) {
+    memset(&nano_memory, 0, sizeof(nano_memory));
+    nano_lru_head = NULL;
+    nano_lru_tail = NULL;
+    nano_memory_tree_frame = 0;
+    nano_indexes_charged = 0;
+
+    nano_chains_reset();
+    nano_forks_reset();
+    nano_balances_reset();
+    nano_spam_reset();
+    nano_nodeids_reset();
+
+    // single pass live captures have no use for one
+    if (!nano_memory_is_limited()) {
+        nano_sidecar_init();
+    }
+}
+
+static void nano_cleanup (void) {
+    nano_sidecar_close();
+}
+
+// the end of the first pass, when everything the sidecar holds is known
+static void nano_postseq_cleanup (void) {
+    GByteArray *roots, *sides;
+
+    if (nano_pref_node_registry_update) {
+        nano_nodeids_write();
+    }
+
+    if (!nano_sidecar_collecting()) {
+        return;
+    }
+
+    nano_forks_export(&roots, &sides);
+    nano_sidecar_set_section(NANO_SIDECAR_FORK_ROOTS, roots);
+    nano_sidecar_set_section(NANO_SIDECAR_FORK_SIDES, sides);
+    nano_sidecar_write();
+}
+
+static void nano_prefs_apply (void) {
+    nano_aliases_load(nano_pref_alias_book);
+    nano_nodeids_load(nano_pref_node_registry);
+    nano_ledger_load(nano_pref_ledger_snapshot);
+    nano_elections_load_weights(nano_pref_rep_weights);
+    nano_elections_set_window(nano_pref_election_window);
+    nano_elections_set_quorum(nano_pref_quorum_percent);
+    nano_spam_configure(nano_pref_spam_window, nano_pref_spam_threshold);
+    nano_profile_update();
+}
+
 void proto_register_nano(void)
 {
     static hf_register_info hf[] = {
         {
             &hf_nano_magic_number,
             { "Magic Number", "nano.magic_number",
-            FT_STRING, STR_ASCII, NULL, 0x00,
+            FT_UINT16, BASE_HEX, VALS(nano_magic_numbers), 0x00,
             "Nano Protocol Magic Number", HFILL }
         },
+        {
+            &hf_nano_network,
+            { "Network", "nano.network",
+            FT_CHAR, BASE_HEX, VALS(nano_network_strings), 0x00,
+            "Network of the conversation, from the magic number of its first header", HFILL }
+        },
         {
             &hf_nano_version_max,
             { "Maximum Version", "nano.version_max",
@@ -1410,8 +3792,14 @@ void proto_register_nano(void)
         {
             &hf_nano_extensions_unused_label,
             { "Unused", "nano.extensions.unused",
-            FT_STRING, STR_ASCII, NULL, 0x00,
-            "Unusued field", HFILL }
+            FT_UINT16, BASE_HEX, NULL, 0x00,
+            "Unused field", HFILL }
+        },
+        {
+            &hf_nano_extensions_confirm_v2,
+            { "Extended Item Count", "nano.extensions.confirm_v2",
+            FT_BOOLEAN, 16, NULL, NANO_CONFIRM_V2_FLAG,
+            "Item count continues in bits 4-7", HFILL }
         },
         {
             &hf_nano_extensions_item_count,
@@ -1428,7 +3816,7 @@ void proto_register_nano(void)
         {
             &hf_nano_extensions_confirmed_present,
             { "Confirmed Present", "nano.extensions.confirmed_present",
-            FT_STRING, STR_ASCII, NULL, 0x00,
+            FT_BOOLEAN, 16, NULL, 0x0002,
             "Confirmed Present", HFILL }
         },
         {
@@ -1443,6 +3831,12 @@ void proto_register_nano(void)
             FT_BOOLEAN, BASE_HEX, NULL, 0x00,
             NULL, HFILL }
         },
+        {
+            &hf_nano_node_id_handshake_is_v2,
+            { "Is V2", "nano.node_id_handshake.is_v2",
+            FT_BOOLEAN, BASE_HEX, NULL, 0x00,
+            NULL, HFILL }
+        },
         {
             &hf_nano_node_id_handshake_query_cookie,
             { "Cookie", "nano.node_id_handshake.cookie",
@@ -1461,22 +3855,34 @@ void proto_register_nano(void)
             FT_BYTES, BASE_NONE, NULL, 0x00,
             NULL, HFILL }
         },
+        {
+            &hf_nano_node_id_handshake_response_salt,
+            { "Response Salt", "nano.node_id_handshake.response_salt",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            NULL, HFILL }
+        },
+        {
+            &hf_nano_node_id_handshake_response_genesis,
+            { "Response Genesis", "nano.node_id_handshake.response_genesis",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            NULL, HFILL }
+        },
         {
             &hf_nano_extensions_block_type,
             { "Block Type", "nano.extensions.block_type",
-            FT_STRING, STR_ASCII, NULL, 0x00,
+            FT_UINT16, BASE_DEC, VALS(nano_block_type_strings), 0x0f00,
             "Block Type", HFILL }
         },
         {
             &hf_nano_extensions_is_query,
             { "Is Query", "nano.extensions.is_query",
-            FT_STRING, STR_ASCII, NULL, 0x00,
+            FT_BOOLEAN, 16, NULL, NANO_NODE_ID_QUERY_FLAG,
             "Is Query", HFILL }
         },
         {
             &hf_nano_extensions_is_response,
             { "Is Response", "nano.extensions.is_response",
-            FT_STRING, STR_ASCII, NULL, 0x00,
+            FT_BOOLEAN, 16, NULL, NANO_NODE_ID_RESPONSE_FLAG,
             "Is Response", HFILL }
         },
         {
@@ -1545,6 +3951,72 @@ void proto_register_nano(void)
             FT_BYTES, BASE_NONE, NULL, 0x00,
             NULL, HFILL }
         },
+        {
+            &hf_nano_block_hash,
+            { "Block Hash", "nano.block.hash",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            "BLAKE2b-256 of the block without its signature and work, the hash votes and links refer to", HFILL }
+        },
+        {
+            &hf_nano_ledger_status,
+            { "Ledger Status", "nano.ledger.status",
+            FT_UINT8, BASE_DEC, VALS(nano_ledger_status_strings), 0x00,
+            "Whether the block is in the ledger snapshot of our own node, and confirmed there", HFILL }
+        },
+        {
+            &hf_nano_block_balance_nano,
+            { "Balance (Nano)", "nano.block.balance_nano",
+            FT_DOUBLE, BASE_NONE, NULL, 0x00,
+            "Balance in Nano, 10^30 raw each", HFILL }
+        },
+        {
+            &hf_nano_block_work_difficulty,
+            { "Work Difficulty", "nano.block.work_difficulty",
+            FT_UINT64, BASE_HEX, NULL, 0x00,
+            "BLAKE2b-64 of the work nonce and the block root, the node compares it with the network threshold", HFILL }
+        },
+        {
+            &hf_nano_block_subtype,
+            { "Subtype", "nano.block.subtype",
+            FT_UINT8, BASE_DEC, VALS(nano_state_subtype_strings), 0x00,
+            "What a state block does, from the balance of the block before it", HFILL }
+        },
+        {
+            &hf_nano_block_amount,
+            { "Amount (Nano)", "nano.block.amount",
+            FT_DOUBLE, BASE_NONE, NULL, 0x00,
+            "Amount sent or received, computed only when displayed or referenced by a filter", HFILL }
+        },
+        {
+            &hf_nano_block_fork_of,
+            { "Fork Of", "nano.block.fork_of",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            "Hash of the block first seen on the same root", HFILL }
+        },
+        {
+            &hf_nano_block_publish_rate,
+            { "Account Publish Rate (/s)", "nano.block.publish_rate",
+            FT_DOUBLE, BASE_NONE, NULL, 0x00,
+            "Publishes per second of the block's account over the spam window, shown when above the threshold", HFILL }
+        },
+        {
+            &hf_nano_block_block_rate,
+            { "Account Block Rate (/s)", "nano.block.block_rate",
+            FT_DOUBLE, BASE_NONE, NULL, 0x00,
+            "Realtime blocks per second of the block's account over the spam window, publishes, confirm_reqs and confirm_acks alike", HFILL }
+        },
+        {
+            &hf_nano_account_address,
+            { "Address", "nano.address",
+            FT_STRING, BASE_NONE, NULL, 0x00,
+            "Account as a nano_ address, base32 of the public key and its BLAKE2b checksum", HFILL }
+        },
+        {
+            &hf_nano_account_alias,
+            { "Alias", "nano.alias",
+            FT_STRING, BASE_NONE, NULL, 0x00,
+            "Label of the account in the alias book", HFILL }
+        },
         {
             &hf_nano_vote_account,
             { "Account", "nano.vote.account",
@@ -1678,7 +4150,19 @@ void proto_register_nano(void)
             FT_UINT64, BASE_DEC_HEX, NULL, 0x00,
             NULL, HFILL }
         },
+        {
+            &hf_nano_telemetry_ack_unknown_data,
+            { "Unknown Data", "nano.telemetry_ack.unknown_data",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            "Fields added by newer node versions, or a field the payload cut short", HFILL }
+        },
         /* Confirm Req */
+        {
+            &hf_nano_hash_pairs,
+            { "Hash Pairs", "nano.confirm_req.hash_pairs",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            NULL, HFILL }
+        },
         {
             &hf_nano_hash_pair_first,
             { "Hash", "nano.confirm_req.hash_pair.first",
@@ -1832,6 +4316,12 @@ void proto_register_nano(void)
             NULL, HFILL }
         },
         /* + Vote By Hash */
+        {
+            &hf_nano_confirm_ack_hashes,
+            { "Hashes List", "nano.confirm_ack.vote_by_hash.hashes",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            NULL, HFILL }
+        },
         {
             &hf_nano_confirm_ack_hash,
             { "Hash", "nano.confirm_ack.vote_by_hash.hash",
@@ -1849,7 +4339,77 @@ void proto_register_nano(void)
         { &hf_nano_asc_pull_req_blocks_payload, { "Blocks Payload", "nano.asc_pull_req_blocks_payload", FT_BYTES, BASE_NONE, NULL, 0x0, NULL, HFILL } },
         { &hf_nano_asc_pull_req_account_info_payload, { "Account Info Payload", "nano.asc_pull_req_account_info_payload", FT_BYTES, BASE_NONE, NULL, 0x0, NULL, HFILL } },
         { &hf_nano_asc_pull_ack_blocks_payload, { "Blocks Payload", "nano.asc_pull_ack_blocks_payload", FT_BYTES, BASE_NONE, NULL, 0x0, NULL, HFILL } },
-        { &hf_nano_asc_pull_ack_account_info_payload, { "Account Info Payload", "nano.asc_pull_ack_account_info_payload", FT_BYTES, BASE_NONE, NULL, 0x0, NULL, HFILL } }
+        { &hf_nano_asc_pull_ack_account_info_payload, { "Account Info Payload", "nano.asc_pull_ack_account_info_payload", FT_BYTES, BASE_NONE, NULL, 0x0, NULL, HFILL } },
+        /* Resync */
+        {
+            &hf_nano_resync_skipped,
+            { "Skipped Bytes", "nano.resync.skipped",
+            FT_UINT32, BASE_DEC, NULL, 0x00,
+            "Bytes skipped while searching for the next message header", HFILL }
+        },
+        /* Sampling */
+        {
+            &hf_nano_sample_weight,
+            { "Sample Weight", "nano.sample_weight",
+            FT_UINT32, BASE_DEC, NULL, 0x00,
+            "Number of messages of this type this one stands for, 0 if its body was not dissected", HFILL }
+        },
+        /* Node IDs */
+        {
+            &hf_nano_node_id,
+            { "Node ID", "nano.node_id",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            "Node ID of the sender, from its handshake response in this conversation or the node registry", HFILL }
+        },
+        {
+            &hf_nano_peer_node_id,
+            { "Peer Node ID", "nano.peer_node_id",
+            FT_BYTES, BASE_NONE, NULL, 0x00,
+            "Node ID of the receiver, from its handshake response in this conversation or the node registry", HFILL }
+        },
+        {
+            &hf_nano_node_id_learned_in,
+            { "Learned In", "nano.node_id.learned_in",
+            FT_FRAMENUM, BASE_NONE, NULL, 0x00,
+            "Frame with the handshake response that gave the node ID", HFILL }
+        },
+        {
+            &hf_nano_node_id_registry_last_seen,
+            { "Registry Last Seen", "nano.node_id.registry_last_seen",
+            FT_ABSOLUTE_TIME, ABSOLUTE_TIME_LOCAL, NULL, 0x00,
+            "When the node registry last saw this node ID at the endpoint", HFILL }
+        },
+        /* Memory Usage */
+        {
+            &hf_nano_memory_in_use,
+            { "Bytes In Use", "nano.memory.in_use",
+            FT_UINT64, BASE_DEC, NULL, 0x00,
+            "Memory used for Nano conversation tracking", HFILL }
+        },
+        {
+            &hf_nano_memory_conversations,
+            { "Conversations Tracked", "nano.memory.conversations",
+            FT_UINT32, BASE_DEC, NULL, 0x00,
+            NULL, HFILL }
+        },
+        {
+            &hf_nano_memory_conversations_evicted,
+            { "Conversations Evicted", "nano.memory.conversations_evicted",
+            FT_UINT32, BASE_DEC, NULL, 0x00,
+            NULL, HFILL }
+        },
+        {
+            &hf_nano_memory_packet_states_dropped,
+            { "Packet States Dropped", "nano.memory.packet_states_dropped",
+            FT_UINT32, BASE_DEC, NULL, 0x00,
+            "Per packet session states not kept because of the memory limit", HFILL }
+        },
+        {
+            &hf_nano_memory_correlation_expired,
+            { "Correlation Entries Expired", "nano.memory.correlation_expired",
+            FT_UINT32, BASE_DEC, NULL, 0x00,
+            NULL, HFILL }
+        }
     };
 
     static gint *ett[] = {
@@ -1868,6 +4428,7 @@ void proto_register_nano(void)
         &ett_nano_peer_details,
 
         &ett_nano_hash_pair,
+        &ett_nano_hash_pairs,
 
         &ett_nano_block,
         &ett_nano_bulk_pull,
@@ -1885,19 +4446,192 @@ void proto_register_nano(void)
         &ett_nano_bulk_pull_account_response,
 
         &ett_nano_asc_pull_req,
-        &ett_nano_asc_pull_ack
+        &ett_nano_asc_pull_ack,
+
+        &ett_nano_memory,
+        &ett_nano_node_id
+    };
+
+    static ei_register_info ei[] = {
+        { &ei_nano_resync_skipped, { "nano.resync.skipped.expert", PI_SEQUENCE, PI_WARN, "Data does not start with a Nano header, skipped to the next plausible header", EXPFILL }},
+        { &ei_nano_resync_inferred, { "nano.resync.inferred", PI_SEQUENCE, PI_NOTE, "Bootstrap stream state inferred from block-shaped payload", EXPFILL }},
+        { &ei_nano_pending_overflow, { "nano.bootstrap.pending_overflow", PI_SEQUENCE, PI_WARN, "Too many outstanding bootstrap requests, response framing of this one is not tracked", EXPFILL }},
+        { &ei_nano_chain_gap, { "nano.chain.gap", PI_SEQUENCE, PI_WARN, "Block is not the one the stream had to send next, blocks of this account chain are missing", EXPFILL }},
+        { &ei_nano_chain_out_of_order, { "nano.chain.out_of_order", PI_SEQUENCE, PI_NOTE, "Block belongs before a block this stream already sent", EXPFILL }},
+        { &ei_nano_chain_incomplete, { "nano.chain.incomplete", PI_SEQUENCE, PI_WARN, "Bulk pull ended before reaching the requested end block or the open block", EXPFILL }},
+        { &ei_nano_fork, { "nano.block.fork", PI_PROTOCOL, PI_WARN, "Fork: a different block on this root was seen first", EXPFILL }},
+        { &ei_nano_spam, { "nano.block.spam", PI_SECURITY, PI_WARN, "Account publishes faster than the spam threshold", EXPFILL }}
     };
 
+    expert_module_t* expert_nano;
+    module_t *nano_module;
+
     proto_nano = proto_register_protocol("Nano Cryptocurrency Protocol", "Nano", "nano");
 
     proto_register_field_array(proto_nano, hf, array_length(hf));
     proto_register_subtree_array(ett, array_length(ett));
+
+    expert_nano = expert_register_protocol(proto_nano);
+    expert_register_field_array(expert_nano, ei, array_length(ei));
+
+    nano_module = prefs_register_protocol(proto_nano, nano_prefs_apply);
+
+    prefs_register_uint_preference(nano_module, "memory_limit",
+        "Memory limit (KiB)",
+        "Upper bound for the memory used to track Nano conversations, 0 for unlimited. "
+        "When set, idle conversations are evicted least recently used first and per packet "
+        "states are not kept, which suits long running single pass live captures.",
+        10, &nano_pref_memory_limit);
+
+    prefs_register_uint_preference(nano_module, "conversation_timeout",
+        "Idle conversation timeout (s)",
+        "With a memory limit, conversations without traffic for this long are evicted, 0 to only evict when over the limit",
+        10, &nano_pref_conversation_timeout);
+
+    prefs_register_uint_preference(nano_module, "correlation_window",
+        "Correlation window (s)",
+        "With a memory limit, correlation table entries not seen for this long are expired",
+        10, &nano_pref_correlation_window);
+
+    prefs_register_bool_preference(nano_module, "chain_index",
+        "Rebuild account chains",
+        "Index the blocks of bulk pull responses and asc_pull_acks by account on the first pass, "
+        "for the Nano/Account Chains statistics and -z nano,chains. Costs a block hash and about "
+        "64 bytes per block.",
+        &nano_pref_chain_index);
+
+    prefs_register_bool_preference(nano_module, "fork_detection",
+        "Detect forks",
+        "Remember the first block seen on every root and flag different blocks on the same root, "
+        "for nano.block.fork_of and -z nano,forks. Costs a block hash per block on the first pass "
+        "and 48 bytes per root.",
+        &nano_pref_fork_detection);
+
+    prefs_register_bool_preference(nano_module, "state_subtypes",
+        "Classify state blocks",
+        "Keep the last balance of every account to tell state block sends, receives, changes and "
+        "epoch upgrades apart. Costs 32 bytes per account.",
+        &nano_pref_state_subtypes);
+
+    prefs_register_uint_preference(nano_module, "sample_confirm_ack",
+        "Dissect 1 in N confirm_acks",
+        "Every confirm_ack is counted, but only 1 in N gets its votes dissected. "
+        "Statistics extrapolate from the sampled ones. 1 dissects all of them.",
+        10, &nano_pref_sample_confirm_ack);
+
+    prefs_register_uint_preference(nano_module, "sample_confirm_req",
+        "Dissect 1 in N confirm_reqs",
+        "Every confirm_req is counted, but only 1 in N gets its body dissected. 1 dissects all of them.",
+        10, &nano_pref_sample_confirm_req);
+
+    prefs_register_uint_preference(nano_module, "sample_publish",
+        "Dissect 1 in N publishes",
+        "Every publish is counted, but only 1 in N gets its block dissected, checked for forks and "
+        "classified. 1 dissects all of them.",
+        10, &nano_pref_sample_publish);
+
+    prefs_register_uint_preference(nano_module, "sample_keepalive",
+        "Dissect 1 in N keepalives",
+        "Every keepalive is counted, but only 1 in N gets its peers dissected. 1 dissects all of them.",
+        10, &nano_pref_sample_keepalive);
+
+    prefs_register_filename_preference(nano_module, "sidecar_file",
+        "Sidecar index file",
+        "Write the results of the first pass over a capture to this file, and reuse them when the "
+        "same capture is opened again instead of hashing and classifying its blocks. The file is "
+        "checked frame by frame and rewritten when it belongs to another capture. Not used with a "
+        "memory limit.",
+        &nano_pref_sidecar_file, TRUE);
+
+    prefs_register_filename_preference(nano_module, "alias_book",
+        "Account alias book",
+        "Label accounts, representatives and node IDs from this file: one address or hex account "
+        "and its label per line, or a book prebuilt with -z nano,aliases,<file> which loads "
+        "without parsing.",
+        &nano_pref_alias_book, FALSE);
+
+    prefs_register_filename_preference(nano_module, "ledger_snapshot",
+        "Ledger snapshot",
+        "Sorted block hashes exported from our own node, with a confirmed flag each. Block, vote "
+        "and confirm_req hashes get nano.ledger.status: unknown, known or confirmed. The file is "
+        "memory mapped, not read.",
+        &nano_pref_ledger_snapshot, FALSE);
+
+    prefs_register_filename_preference(nano_module, "node_registry",
+        "Node registry",
+        "Node IDs by endpoint, for nano.node_id on connections whose handshake was not captured. "
+        "Written by the next preference.",
+        &nano_pref_node_registry, TRUE);
+
+    prefs_register_bool_preference(nano_module, "node_registry_update",
+        "Update the node registry",
+        "Merge the node IDs of the handshakes in a capture into the node registry file once the "
+        "capture has been read, the node ID last seen at an endpoint wins.",
+        &nano_pref_node_registry_update);
+
+    prefs_register_filename_preference(nano_module, "rep_weights",
+        "Representative weights",
+        "One representative address and its voting weight in Nano per line. Their total stands in "
+        "for the online weight when Nano/Elections and -z nano,elections time elections to quorum.",
+        &nano_pref_rep_weights, FALSE);
+
+    prefs_register_uint_preference(nano_module, "quorum_percent",
+        "Quorum (%)",
+        "Share of the representative weight whose votes confirm a block",
+        10, &nano_pref_quorum_percent);
+
+    prefs_register_uint_preference(nano_module, "election_window",
+        "Election window (s)",
+        "Elections are followed for this long after their block was first seen, which bounds the "
+        "memory used by election timing. 0 follows them to the end of the capture.",
+        10, &nano_pref_election_window);
+
+    prefs_register_bool_preference(nano_module, "profile",
+        "Profile the dissector",
+        "Time the dissector functions per call and packet type and count the file scope memory they take, "
+        "for Nano/Profile and -z nano,profile, which profile while they are open whatever this says.",
+        &nano_profile_enabled);
+
+    prefs_register_bool_preference(nano_module, "spam_detection",
+        "Detect spam accounts",
+        "Count realtime state and open blocks by account over a sliding window and flag accounts "
+        "publishing faster than the threshold, for nano.block.spam and Nano/Spam Accounts. "
+        "Memory is fixed, the heaviest 1024 accounts are tracked.",
+        &nano_pref_spam_detection);
+
+    prefs_register_uint_preference(nano_module, "spam_window",
+        "Spam window (s)",
+        "Publish rates are averaged over this many seconds of packet time",
+        10, &nano_pref_spam_window);
+
+    prefs_register_uint_preference(nano_module, "spam_threshold",
+        "Spam threshold (publishes/s)",
+        "Accounts publishing more than this per second are flagged, 0 flags none",
+        10, &nano_pref_spam_threshold);
+
+    register_init_routine(nano_init);
+    register_cleanup_routine(nano_cleanup);
+    register_postseq_cleanup_routine(nano_postseq_cleanup);
+
+    nano_tap = register_tap("nano");
 }
 
 void proto_reg_handoff_nano(void)
 {
     nano_tcp_handle = register_dissector("nano-over-tcp", dissect_nano_tcp, proto_nano);
     dissector_add_uint_with_preference("tcp.port", NANO_TCP_PORT, nano_tcp_handle);
+
+    nano_register_export();
+    nano_register_aliases();
+    nano_register_chains();
+    nano_register_elections();
+    nano_register_forks();
+    nano_register_stats();
+    nano_register_frontiers();
+    nano_register_prometheus();
+    nano_register_heavyhitters();
+    nano_register_spam();
+    nano_register_profile();
 }
 
 /*
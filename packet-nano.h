@@ -0,0 +1,134 @@
+/* packet-nano.h
+* Definitions shared by the Nano dissector and its taps
+* Copyright 2018, Roland Haenel <roland@haenel.me>
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __PACKET_NANO_H__
+#define __PACKET_NANO_H__
+
+#include <glib.h>
+
+#define NANO_TCP_PORT 17075 /* Not IANA registered */
+
+#define NANO_PACKET_TYPE_INVALID 0
+#define NANO_PACKET_TYPE_NOT_A_TYPE 1
+#define NANO_PACKET_TYPE_KEEPALIVE 2
+#define NANO_PACKET_TYPE_PUBLISH 3
+#define NANO_PACKET_TYPE_CONFIRM_REQ 4
+#define NANO_PACKET_TYPE_CONFIRM_ACK 5
+#define NANO_PACKET_TYPE_BULK_PULL 6
+#define NANO_PACKET_TYPE_BULK_PUSH 7
+#define NANO_PACKET_TYPE_FRONTIER_REQ 8
+#define NANO_PACKET_TYPE_BULK_PULL_BLOCKS 9
+#define NANO_PACKET_TYPE_NODE_ID_HANDSHAKE 10
+#define NANO_PACKET_TYPE_BULK_PULL_ACCOUNT 11
+#define NANO_PACKET_TYPE_TELEMETRY_REQ 12
+#define NANO_PACKET_TYPE_TELEMETRY_ACK 13
+#define NANO_PACKET_TYPE_ASC_PULL_REQ 14
+#define NANO_PACKET_TYPE_ASC_PULL_ACK 15
+
+// Highest packet type we know how to frame
+#define NANO_PACKET_TYPE_MAX NANO_PACKET_TYPE_ASC_PULL_ACK
+
+#define NANO_BLOCK_TYPE_INVALID 0
+#define NANO_BLOCK_TYPE_NOT_A_BLOCK 1
+#define NANO_BLOCK_TYPE_SEND 2
+#define NANO_BLOCK_TYPE_RECEIVE 3
+#define NANO_BLOCK_TYPE_OPEN 4
+#define NANO_BLOCK_TYPE_CHANGE 5
+#define NANO_BLOCK_TYPE_STATE 6
+
+#define NANO_BLOCK_SIZE_SEND    (32+32+16+64+8)
+#define NANO_BLOCK_SIZE_RECEIVE (32+32+64+8)
+#define NANO_BLOCK_SIZE_OPEN    (32+32+32+64+8)
+#define NANO_BLOCK_SIZE_CHANGE  (32+32+64+8)
+#define NANO_BLOCK_SIZE_STATE   (32+32+32+16+32+64+8)
+
+// Nano header length
+#define NANO_HEADER_LENGTH 8
+
+// nano_ followed by 60 base32 characters
+#define NANO_ADDRESS_LENGTH (5 + 60)
+
+/*
+* Passed to "nano" tap listeners, once per message. Pointers reference the
+* packet data and are only valid while the tap listener runs.
+*/
+typedef struct _nano_tap_info {
+    guint32 conversation;
+    gboolean from_server;
+
+    // bootstrap payload without a header carries the type of the request it answers
+    gboolean headerless;
+    // NANO_PACKET_TYPE_INVALID for data skipped while resynchronizing
+    guint8 packet_type;
+    // messages this one stands for when realtime messages are sampled, 0 if only its header was read
+    guint32 sample_weight;
+    guint8 block_type;
+    guint32 length;
+
+    // the block carried by the message, block_length bytes or NULL
+    const guint8 *block;
+    guint32 block_length;
+
+    // confirm_ack vote, vote_account is NULL for other messages
+    const guint8 *vote_account;
+    const guint8 *vote_signature;
+    guint64 vote_sequence;
+    const guint8 *vote_hashes;
+    guint32 vote_hash_count;
+
+    // confirm_req by hash, [block hash][root] pairs
+    const guint8 *hash_pairs;
+    guint32 hash_pair_count;
+
+    // frontier response entry, [account][frontier hash], all zero at the end of the response
+    const guint8 *frontier;
+
+    // account of the block when it publishes faster than the spam threshold, and its publishes per second
+    const guint8 *spam_account;
+    gfloat spam_rate;
+
+    // calls timed since the previous message, this one's included, when nano.profile is on
+    const struct _nano_profile_sample *profile;
+    guint32 profile_count;
+} nano_tap_info_t;
+
+// address is NANO_ADDRESS_LENGTH + 1 bytes
+void nano_account_to_address(const guint8 *account, char *address);
+// the other way round, account is 32 bytes
+gboolean nano_address_to_account(const char *address, guint8 *account);
+// blake2b-256 block hash of a block of the given type, hash is 32 bytes
+void nano_block_hash(int block_type, const guint8 *block, guint8 *hash);
+
+const char *nano_packet_type_name(guint packet_type);
+const char *nano_block_type_name(guint block_type);
+// TRUE if any message type is only dissected 1 in N times
+gboolean nano_sampling_enabled(void);
+
+void nano_register_export(void);
+void nano_register_stats(void);
+void nano_register_frontiers(void);
+void nano_register_prometheus(void);
+void nano_register_heavyhitters(void);
+
+#endif /* __PACKET_NANO_H__ */
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,231 @@
+/* nano-bpf-test.c
+* Runs the compiled capture filters on synthetic segments and checks what they keep
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+ * Every selection below is compiled and run by nano_bpf_run on Ethernet
+ * frames of every message type, in both directions, over IPv4 with and
+ * without options and over IPv6, next to the segments the filter has to keep
+ * or drop whatever the selection says. Each verdict is compared with the one
+ * the selection implies, and any mismatch fails the test.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "packet-nano.h"
+#include "nano_bpf.h"
+
+#define TEST_PORT_OTHER 50000
+#define TEST_PAYLOAD 64
+#define TEST_FRAME (14 + 60 + 60 + TEST_PAYLOAD)
+
+typedef enum {
+    SEGMENT_IPV4,
+    SEGMENT_IPV4_OPTIONS,
+    SEGMENT_IPV4_FRAGMENT,
+    SEGMENT_IPV6,
+    SEGMENT_IPV6_EXTENSION,
+    SEGMENT_ARP
+} segment_kind_t;
+
+static const char * const segment_kind_names[] = {
+    "IPv4", "IPv4 with options", "IPv4 fragment", "IPv6", "IPv6 extension header", "ARP"
+};
+
+typedef struct _segment {
+    segment_kind_t kind;
+    guint16 src_port;
+    guint16 dst_port;
+    const guint8 *payload;
+    guint32 payload_length;
+} segment_t;
+
+static const char * const selections[] = {
+    "all",
+    "drop confirm_ack",
+    "drop confirm_ack, keep publish and bootstrap",
+    "keep publish and bootstrap",
+    "keep confirm_ack",
+    "drop all",
+    "drop realtime, keep keepalive",
+    "drop all, keep telemetry_ack asc_pull_ack",
+};
+
+static const guint16 ports[] = { NANO_TCP_PORT, 7075 };
+
+static int failures;
+static int checks;
+
+// Ethernet frame of one TCP segment, returns its length
+static guint32 build_frame (guint8 *frame, const segment_t *segment) {
+    gboolean ipv6 = segment->kind == SEGMENT_IPV6 || segment->kind == SEGMENT_IPV6_EXTENSION;
+    guint32 offset = 14;
+
+    memset(frame, 0, TEST_FRAME);
+    if (segment->kind == SEGMENT_ARP) {
+        frame[12] = 0x08;
+        frame[13] = 0x06;
+        return 14 + 28;
+    }
+    frame[12] = ipv6 ? 0x86 : 0x08;
+    frame[13] = ipv6 ? 0xdd : 0x00;
+
+    if (ipv6) {
+        // a hop-by-hop options header of 8 bytes in front of TCP
+        guint32 extension = segment->kind == SEGMENT_IPV6_EXTENSION ? 8 : 0;
+        guint32 length = extension + 20 + segment->payload_length;
+
+        frame[offset] = 0x60;
+        frame[offset + 4] = (guint8) (length >> 8);
+        frame[offset + 5] = (guint8) length;
+        frame[offset + 6] = extension ? 0 : 6;
+        frame[offset + 7] = 64;
+        offset += 40;
+        if (extension) {
+            frame[offset] = 6;
+            offset += extension;
+        }
+    } else {
+        guint32 ip_length = segment->kind == SEGMENT_IPV4_OPTIONS ? 24 : 20;
+        guint32 length = ip_length + 20 + segment->payload_length;
+
+        frame[offset] = (guint8) (0x40 | ip_length / 4);
+        frame[offset + 2] = (guint8) (length >> 8);
+        frame[offset + 3] = (guint8) length;
+        // a fragment at offset 8 bytes has no TCP header, its payload still looks like one here
+        frame[offset + 6] = segment->kind == SEGMENT_IPV4_FRAGMENT ? 0x00 : 0x40;
+        frame[offset + 7] = segment->kind == SEGMENT_IPV4_FRAGMENT ? 0x01 : 0x00;
+        frame[offset + 8] = 64;
+        frame[offset + 9] = 6;
+        offset += ip_length;
+    }
+
+    frame[offset] = (guint8) (segment->src_port >> 8);
+    frame[offset + 1] = (guint8) segment->src_port;
+    frame[offset + 2] = (guint8) (segment->dst_port >> 8);
+    frame[offset + 3] = (guint8) segment->dst_port;
+    frame[offset + 12] = 5 << 4;
+    frame[offset + 13] = 0x18;
+    offset += 20;
+
+    memcpy(frame + offset, segment->payload, segment->payload_length);
+
+    return offset + segment->payload_length;
+}
+
+static void check (const char *selection, GArray *program, const segment_t *segment, const char *what, gboolean expected) {
+    guint8 frame[TEST_FRAME];
+    guint32 length = build_frame(frame, segment);
+    guint32 snaplen = nano_bpf_run((const nano_bpf_insn_t *) program->data, program->len, frame, length);
+    gboolean kept = snaplen != 0;
+
+    checks++;
+    if (kept != expected || (kept && snaplen != NANO_BPF_SNAPLEN)) {
+        failures++;
+        fprintf(stderr, "FAIL \"%s\": %s over %s, %u -> %u: %s, expected %s\n", selection, what,
+                segment_kind_names[segment->kind], segment->src_port, segment->dst_port,
+                kept ? "kept" : "dropped", expected ? "kept" : "dropped");
+    }
+}
+
+static void check_selection (const char *text, guint16 port) {
+    static const segment_kind_t kinds[] = { SEGMENT_IPV4, SEGMENT_IPV4_OPTIONS, SEGMENT_IPV6 };
+    nano_bpf_selection_t selection;
+    gchar *error = NULL;
+    guint8 payload[TEST_PAYLOAD];
+
+    if (!nano_bpf_parse_selection(text, port, &selection, &error)) {
+        failures++;
+        fprintf(stderr, "FAIL \"%s\": %s\n", text, error);
+        g_free(error);
+        return;
+    }
+
+    GArray *program = nano_bpf_compile(&selection);
+
+    memset(payload, 0x5a, sizeof(payload));
+    payload[0] = 'R';
+    payload[1] = 'C';
+    payload[2] = 0x13;
+    payload[3] = 0x13;
+    payload[4] = 0x12;
+
+    for (guint k = 0; k < G_N_ELEMENTS(kinds); k++) {
+        for (int direction = 0; direction < 2; direction++) {
+            segment_t segment = { kinds[k], direction ? TEST_PORT_OTHER : port, direction ? port : TEST_PORT_OTHER, payload, sizeof(payload) };
+
+            // known types by the selection, anything else is not a header the filter can judge
+            for (int type = 0; type <= 0xff; type++) {
+                gboolean known = type >= NANO_PACKET_TYPE_KEEPALIVE && type <= NANO_PACKET_TYPE_MAX;
+                char what[32];
+
+                payload[5] = (guint8) type;
+                g_snprintf(what, sizeof(what), "type %d", type);
+                check(text, program, &segment, what, !known || (selection.keep & (1u << type)) != 0);
+            }
+            payload[5] = NANO_PACKET_TYPE_CONFIRM_ACK;
+
+            for (int network = 0; network <= 0xff; network++) {
+                gboolean nano = network == 'A' || network == 'B' || network == 'C' || network == 'X';
+
+                payload[1] = (guint8) network;
+                check(text, program, &segment, "network", !nano || (selection.keep & (1u << NANO_PACKET_TYPE_CONFIRM_ACK)) != 0);
+            }
+            payload[1] = 'C';
+
+            payload[0] = NANO_BLOCK_TYPE_STATE;
+            check(text, program, &segment, "continuation", TRUE);
+            payload[0] = 'R';
+
+            segment.payload_length = 0;
+            check(text, program, &segment, "pure ack", TRUE);
+            segment.payload_length = NANO_BPF_HEADER_BYTES - 1;
+            check(text, program, &segment, "short payload", TRUE);
+            segment.payload_length = sizeof(payload);
+
+            segment.src_port = segment.dst_port = TEST_PORT_OTHER;
+            check(text, program, &segment, "other port", FALSE);
+        }
+    }
+
+    segment_t fragment = { SEGMENT_IPV4_FRAGMENT, port, TEST_PORT_OTHER, payload, sizeof(payload) };
+    check(text, program, &fragment, "later fragment", FALSE);
+    segment_t extension = { SEGMENT_IPV6_EXTENSION, port, TEST_PORT_OTHER, payload, sizeof(payload) };
+    check(text, program, &extension, "extension header", FALSE);
+    segment_t arp = { SEGMENT_ARP, 0, 0, payload, 0 };
+    check(text, program, &arp, "not IP", FALSE);
+
+    g_array_free(program, TRUE);
+}
+
+int main (void) {
+    for (guint i = 0; i < G_N_ELEMENTS(selections); i++) {
+        for (guint p = 0; p < G_N_ELEMENTS(ports); p++) {
+            check_selection(selections[i], ports[p]);
+        }
+    }
+
+    printf("%d of %d checks failed\n", failures, checks);
+
+    return failures > 0;
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
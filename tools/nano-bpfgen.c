@@ -0,0 +1,206 @@
+/* nano-bpfgen.c
+* Turns a selection of Nano message types into a capture filter
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+ * nano-bpfgen [-p port] [-dd | -ddd | -t] selection...
+ *
+ *   nano-bpfgen drop confirm_ack, keep publish and bootstrap
+ *
+ * prints a libpcap filter expression for dumpcap -f or tcpdump. -dd prints the
+ * compiled program for Ethernet as a C array and -ddd in decimal, as tcpdump
+ * does, for setsockopt(SO_ATTACH_FILTER) or iptables -m bpf. -t runs the
+ * program on synthetic segments of every message type and prints what it
+ * keeps. See nano_bpf.c for the messages a capture filter cannot tell apart.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packet-nano.h"
+#include "nano_bpf.h"
+
+#define SEGMENT_PAYLOAD 64
+
+enum {
+    OUTPUT_EXPRESSION,
+    OUTPUT_C_ARRAY,
+    OUTPUT_DECIMAL,
+    OUTPUT_TABLE
+};
+
+static void usage (void) {
+    fprintf(stderr, "usage: nano-bpfgen [-p port] [-dd | -ddd | -t] selection...\n");
+    fprintf(stderr, "  selection: keep and drop followed by message types, realtime, bootstrap or all\n");
+    fprintf(stderr, "  e.g. nano-bpfgen drop confirm_ack, keep publish and bootstrap\n");
+    exit(1);
+}
+
+// Ethernet frame of one TCP segment from port to an ephemeral port, payload_length bytes of payload
+static guint32 build_segment (guint8 *frame, gboolean ipv6, guint16 port, const guint8 *payload, guint32 payload_length) {
+    guint32 ip_length = ipv6 ? 40 : 20;
+    guint32 offset = 14;
+
+    memset(frame, 0, 14 + 40 + 20 + payload_length);
+    frame[12] = ipv6 ? 0x86 : 0x08;
+    frame[13] = ipv6 ? 0xdd : 0x00;
+
+    if (ipv6) {
+        guint32 length = 20 + payload_length;
+
+        frame[offset] = 0x60;
+        frame[offset + 4] = (guint8) (length >> 8);
+        frame[offset + 5] = (guint8) length;
+        frame[offset + 6] = 6;
+        frame[offset + 7] = 64;
+    } else {
+        guint32 length = 20 + 20 + payload_length;
+
+        frame[offset] = 0x45;
+        frame[offset + 2] = (guint8) (length >> 8);
+        frame[offset + 3] = (guint8) length;
+        frame[offset + 6] = 0x40;
+        frame[offset + 8] = 64;
+        frame[offset + 9] = 6;
+    }
+    offset += ip_length;
+
+    frame[offset] = (guint8) (port >> 8);
+    frame[offset + 1] = (guint8) port;
+    frame[offset + 2] = 0xc3;
+    frame[offset + 3] = 0x50;
+    frame[offset + 12] = 5 << 4;
+    frame[offset + 13] = 0x18;
+    offset += 20;
+
+    memcpy(frame + offset, payload, payload_length);
+
+    return offset + payload_length;
+}
+
+static const char *run_segment (GArray *program, gboolean ipv6, guint16 port, const guint8 *payload, guint32 payload_length) {
+    guint8 frame[14 + 40 + 20 + SEGMENT_PAYLOAD];
+    guint32 length = build_segment(frame, ipv6, port, payload, payload_length);
+
+    return nano_bpf_run((const nano_bpf_insn_t *) program->data, program->len, frame, length) ? "keep" : "drop";
+}
+
+static void print_table (const nano_bpf_selection_t *selection, GArray *program) {
+    guint8 payload[SEGMENT_PAYLOAD];
+
+    memset(payload, 0x5a, sizeof(payload));
+    payload[0] = 'R';
+    payload[1] = 'C';
+    payload[2] = 0x13;
+    payload[3] = 0x13;
+    payload[4] = 0x12;
+
+    printf("%-20s %-5s %s\n", "segment", "IPv4", "IPv6");
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        payload[5] = (guint8) type;
+        printf("%-20s %-5s %s\n", nano_bpf_type_name(type),
+               run_segment(program, FALSE, selection->port, payload, sizeof(payload)),
+               run_segment(program, TRUE, selection->port, payload, sizeof(payload)));
+    }
+
+    // a bulk pull response or the tail of a message
+    payload[0] = NANO_BLOCK_TYPE_STATE;
+    printf("%-20s %-5s %s\n", "continuation",
+           run_segment(program, FALSE, selection->port, payload, sizeof(payload)),
+           run_segment(program, TRUE, selection->port, payload, sizeof(payload)));
+    printf("%-20s %-5s %s\n", "pure ack",
+           run_segment(program, FALSE, selection->port, payload, 0),
+           run_segment(program, TRUE, selection->port, payload, 0));
+    printf("%-20s %-5s %s\n", "other port",
+           run_segment(program, FALSE, selection->port + 1, payload, sizeof(payload)),
+           run_segment(program, TRUE, selection->port + 1, payload, sizeof(payload)));
+}
+
+int main (int argc, char **argv) {
+    guint16 port = NANO_TCP_PORT;
+    int output = OUTPUT_EXPRESSION;
+    GString *text = g_string_new(NULL);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            char *end;
+            unsigned long value = strtoul(argv[++i], &end, 10);
+
+            if (*end != '\0' || value == 0 || value > G_MAXUINT16) {
+                usage();
+            }
+            port = (guint16) value;
+        } else if (strcmp(argv[i], "-dd") == 0) {
+            output = OUTPUT_C_ARRAY;
+        } else if (strcmp(argv[i], "-ddd") == 0) {
+            output = OUTPUT_DECIMAL;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            output = OUTPUT_TABLE;
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            g_string_append_printf(text, "%s ", argv[i]);
+        }
+    }
+
+    nano_bpf_selection_t selection;
+    gchar *error = NULL;
+
+    if (!nano_bpf_parse_selection(text->str, port, &selection, &error)) {
+        fprintf(stderr, "nano-bpfgen: %s\n", error);
+        g_free(error);
+        return 1;
+    }
+    g_string_free(text, TRUE);
+
+    if (output == OUTPUT_EXPRESSION) {
+        gchar *expression = nano_bpf_expression(&selection);
+
+        printf("%s\n", expression);
+        g_free(expression);
+        return 0;
+    }
+
+    GArray *program = nano_bpf_compile(&selection);
+
+    if (output == OUTPUT_TABLE) {
+        print_table(&selection, program);
+    } else if (output == OUTPUT_C_ARRAY) {
+        for (guint i = 0; i < program->len; i++) {
+            nano_bpf_insn_t *insn = &g_array_index(program, nano_bpf_insn_t, i);
+
+            printf("{ 0x%x, %u, %u, 0x%08x },\n", insn->code, insn->jt, insn->jf, insn->k);
+        }
+    } else {
+        printf("%u\n", program->len);
+        for (guint i = 0; i < program->len; i++) {
+            nano_bpf_insn_t *insn = &g_array_index(program, nano_bpf_insn_t, i);
+
+            printf("%u %u %u %u\n", insn->code, insn->jt, insn->jf, insn->k);
+        }
+    }
+
+    g_array_free(program, TRUE);
+
+    return 0;
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,296 @@
+/* nano-dissector-test.c
+* Checks on the dissector internals that a capture cannot show
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+ * The dissector is compiled into this program, so its static functions can
+ * be called on hand made messages, and runs against libwireshark with every
+ * wmem allocator overridden to the strict one, which takes each allocation
+ * from the C heap. Each check prints what it found and the exit status is 1
+ * if any of them failed.
+ *
+ *  - header: dissect_nano_header without a tree allocates nothing. Every
+ *    message type is decoded many times and the bytes the heap holds, which
+ *    a packet scope allocation would grow until the scope is left, must not
+ *    change.
+ *  - derived fields: a state block is dissected without a tree, with a tree
+ *    that references nothing, with one that references a single derived
+ *    field and with a visible one, all with the default preferences, and the
+ *    BLAKE2b digests each one started are counted. Nothing may be hashed for
+ *    a field nobody asked for.
+ *  - info marker: a frame whose second message threw still shows the
+ *    malformed marker in the Info column next to the summary written at the
+ *    end of the frame.
+ */
+
+#include <config.h>
+
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <epan/column.h>
+#include <epan/column-utils.h>
+#include <epan/epan.h>
+#include <epan/exceptions.h>
+#include <epan/prefs.h>
+#include <wiretap/wtap.h>
+#include <wsutil/privileges.h>
+#include <wsutil/wslog.h>
+
+// every BLAKE2b the dissector starts goes through a counter on its way to the real function
+#define nano_blake2b_init nano_test_blake2b_init
+#define nano_blake2b nano_test_blake2b
+#include "../packet-nano.c"
+#undef nano_blake2b_init
+#undef nano_blake2b
+
+void nano_blake2b_init(nano_blake2b_state *state, gsize digest_length);
+void nano_blake2b(guint8 *digest, gsize digest_length, const guint8 *data, gsize length);
+
+#define TEST_HEADER_ROUNDS 100000
+
+static int failures;
+static guint blake2b_count;
+
+void nano_test_blake2b_init (nano_blake2b_state *state, gsize digest_length) {
+    blake2b_count++;
+    nano_blake2b_init(state, digest_length);
+}
+
+void nano_test_blake2b (guint8 *digest, gsize digest_length, const guint8 *data, gsize length) {
+    blake2b_count++;
+    nano_blake2b(digest, digest_length, data, length);
+}
+
+static void test_report (const char *check, gboolean passed, const char *format, ...) G_GNUC_PRINTF(3, 4);
+
+static void test_report (const char *check, gboolean passed, const char *format, ...) {
+    va_list args;
+
+    printf("%s %s: ", passed ? "ok" : "FAIL", check);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+
+    if (!passed) {
+        failures++;
+    }
+}
+
+static void test_header (void) {
+    const struct nano_protocol_layout *layout = &nano_protocol_layouts[NANO_PROTOCOL_LAYOUT_LATEST];
+    guint8 headers[NANO_PACKET_TYPE_MAX + 1][NANO_HEADER_LENGTH];
+    tvbuff_t *tvbs[NANO_PACKET_TYPE_MAX + 1];
+    guint packet_type;
+    guint64 extensions;
+    size_t before, after;
+
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        guint8 *header = headers[type];
+
+        header[0] = 'R';
+        header[1] = 'C';
+        header[2] = 0x13;
+        header[3] = 0x13;
+        header[4] = 0x12;
+        header[5] = (guint8) type;
+        // a state block and a count of 2, which the confirm types read
+        header[6] = 0x00;
+        header[7] = 0x26;
+
+        tvbs[type] = tvb_new_real_data(header, NANO_HEADER_LENGTH, NANO_HEADER_LENGTH);
+    }
+
+    wmem_enter_packet_scope();
+
+    // whatever is set up on first use is set up before counting
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        dissect_nano_header(tvbs[type], NULL, 0, &packet_type, &extensions, layout);
+    }
+
+    before = mallinfo2().uordblks;
+    for (int round = 0; round < TEST_HEADER_ROUNDS; round++) {
+        for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+            dissect_nano_header(tvbs[type], NULL, 0, &packet_type, &extensions, layout);
+        }
+    }
+    after = mallinfo2().uordblks;
+
+    wmem_leave_packet_scope();
+
+    test_report("header", before == after, "%d headers without a tree, heap in use %zu bytes before, %zu after",
+                TEST_HEADER_ROUNDS * (NANO_PACKET_TYPE_MAX + 1 - NANO_PACKET_TYPE_KEEPALIVE), before, after);
+
+    for (int type = NANO_PACKET_TYPE_KEEPALIVE; type <= NANO_PACKET_TYPE_MAX; type++) {
+        tvb_free(tvbs[type]);
+    }
+}
+
+typedef enum {
+    TREE_NONE,
+    TREE_FAKE,
+    TREE_VISIBLE
+} test_tree_t;
+
+// digests started while dissecting block, with the tree asked for and hf_referenced primed in it when not -1
+static guint test_block_digests (tvbuff_t *tvb, test_tree_t kind, int hf_referenced) {
+    frame_data fd;
+    packet_info pinfo;
+    proto_tree *tree = NULL;
+    guint count;
+
+    // a revisit, the first pass indexes would hash the block whatever the tree
+    memset(&fd, 0, sizeof(fd));
+    fd.visited = TRUE;
+    memset(&pinfo, 0, sizeof(pinfo));
+    pinfo.fd = &fd;
+    pinfo.num = 1;
+
+    wmem_enter_packet_scope();
+    pinfo.pool = wmem_packet_scope();
+
+    if (kind != TREE_NONE) {
+        tree = proto_tree_create_root(&pinfo);
+        proto_tree_set_visible(tree, kind == TREE_VISIBLE);
+        if (hf_referenced != -1) {
+            proto_tree_prime_with_hfid(tree, hf_referenced);
+        }
+    }
+
+    blake2b_count = 0;
+    dissect_nano_block(NANO_BLOCK_TYPE_STATE, tvb, &pinfo, tree, 0);
+    count = blake2b_count;
+
+    if (tree) {
+        proto_tree_free(tree);
+    }
+    wmem_leave_packet_scope();
+
+    return count;
+}
+
+static void test_derived_fields (void) {
+    guint8 block[NANO_BLOCK_SIZE_STATE];
+    tvbuff_t *tvb;
+    guint count;
+
+    // account, previous, representative, balance, link, signature, work
+    for (guint i = 0; i < sizeof(block); i++) {
+        block[i] = (guint8) (i * 7 + 1);
+    }
+    tvb = tvb_new_real_data(block, sizeof(block), sizeof(block));
+
+    count = test_block_digests(tvb, TREE_NONE, -1);
+    test_report("derived fields", count == 0, "no tree: %u BLAKE2b digests, expected 0", count);
+
+    count = test_block_digests(tvb, TREE_FAKE, -1);
+    test_report("derived fields", count == 0, "tree referencing nothing: %u BLAKE2b digests, expected 0", count);
+
+    count = test_block_digests(tvb, TREE_FAKE, hf_nano_block_balance_nano);
+    test_report("derived fields", count == 0, "nano.block.balance_nano referenced: %u BLAKE2b digests, expected 0", count);
+
+    count = test_block_digests(tvb, TREE_FAKE, hf_nano_block_hash);
+    test_report("derived fields", count == 1, "nano.block.hash referenced: %u BLAKE2b digests, expected 1", count);
+
+    count = test_block_digests(tvb, TREE_FAKE, hf_nano_block_work_difficulty);
+    test_report("derived fields", count == 1, "nano.block.work_difficulty referenced: %u BLAKE2b digests, expected 1", count);
+
+    count = test_block_digests(tvb, TREE_FAKE, hf_nano_account_address);
+    test_report("derived fields", count >= 1, "nano.address referenced: %u BLAKE2b digests, expected one per account", count);
+
+    count = test_block_digests(tvb, TREE_VISIBLE, -1);
+    test_report("derived fields", count >= 3, "visible tree: %u BLAKE2b digests, expected hash, work and addresses", count);
+
+    tvb_free(tvb);
+}
+
+static void test_info_marker (void) {
+    static const guint8 message[NANO_HEADER_LENGTH] = { 'R', 'C', 0x13, 0x13, 0x12, NANO_PACKET_TYPE_KEEPALIVE };
+    column_info cinfo;
+    frame_data fd;
+    packet_info pinfo;
+    tvbuff_t *tvb;
+    const gchar *info;
+
+    memset(&cinfo, 0, sizeof(cinfo));
+    col_setup(&cinfo, prefs.num_cols);
+    build_column_format_array(&cinfo, prefs.num_cols, TRUE);
+    col_init(&cinfo, NULL);
+
+    memset(&fd, 0, sizeof(fd));
+    memset(&pinfo, 0, sizeof(pinfo));
+    pinfo.fd = &fd;
+    pinfo.num = 1;
+    pinfo.cinfo = &cinfo;
+    pinfo.current_proto = "Nano";
+
+    tvb = tvb_new_real_data(message, sizeof(message), sizeof(message));
+
+    wmem_enter_packet_scope();
+    pinfo.pool = wmem_packet_scope();
+
+    // what dissect_nano_tcp does around tcp_dissect_pdus, which catches the second message's exception
+    col_clear(pinfo.cinfo, COL_INFO);
+    nano_info_start();
+    nano_info_message(&pinfo, "Keepalive");
+    nano_info_message(&pinfo, "Publish");
+    show_exception(tvb, &pinfo, NULL, ReportedBoundsError, NULL);
+    nano_info_flush(&pinfo);
+
+    info = col_get_text(pinfo.cinfo, COL_INFO);
+    test_report("info marker", info && strstr(info, "Keepalive, Publish") && strstr(info, "[Malformed Packet: Nano]"),
+                "Info is \"%s\"", info ? info : "(no column)");
+
+    wmem_leave_packet_scope();
+    tvb_free(tvb);
+    col_cleanup(&cinfo);
+}
+
+int main (void) {
+    static const proto_plugin nano_plugin = { proto_register_nano, proto_reg_handoff_nano };
+
+    g_setenv("WIRESHARK_DEBUG_WMEM_OVERRIDE", "strict", TRUE);
+
+    ws_log_init("nano-dissector-test", NULL);
+    init_process_policies();
+    wtap_init(FALSE);
+
+    proto_register_plugin(&nano_plugin);
+    if (!epan_init(NULL, NULL, FALSE)) {
+        fprintf(stderr, "nano-dissector-test: epan_init failed\n");
+        return 1;
+    }
+
+    // proto data and the indexes hang off the file scope, as if a capture were open
+    wmem_enter_file_scope();
+    test_header();
+    test_derived_fields();
+    test_info_marker();
+    wmem_leave_file_scope();
+
+    epan_cleanup();
+    wtap_cleanup();
+
+    return failures > 0;
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,149 @@
+/* nano-topk-test.c
+* Feeds the top-k sketches synthetic streams and checks the bounds nano_topk.h promises
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+ * Each stream below is added to a sketch while the exact count of every key
+ * is kept next to it. Afterwards every counter has to be at or above its
+ * key's exact count, by no more than its error and epsilon times the total,
+ * and every key whose exact count is above the smallest counter has to have
+ * a counter. Streams are drawn from a fixed seed, so a failure repeats.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "nano_topk.h"
+
+#define TEST_KEYS 50000
+#define TEST_EPSILON 0.01
+#define TEST_DELTA 0.01
+
+typedef enum {
+    STREAM_SKEWED,
+    STREAM_UNIFORM,
+    STREAM_HEAVY_THEN_LIGHT
+} stream_kind_t;
+
+static const char * const stream_kind_names[] = {
+    "skewed", "uniform", "heavy keys, then many light ones"
+};
+
+static int failures;
+static int checks;
+
+static void check (const char *stream, gboolean ok, const char *what, guint32 key, guint64 count, guint64 error, guint64 exact) {
+    checks++;
+    if (!ok) {
+        failures++;
+        fprintf(stderr, "FAIL %s stream: %s, key %u count %" G_GUINT64_FORMAT " error %" G_GUINT64_FORMAT " exact %" G_GUINT64_FORMAT "\n",
+                stream, what, key, count, error, exact);
+    }
+}
+
+static void fill (nano_topk_t *topk, guint64 *exact, stream_kind_t kind, GRand *rand) {
+    switch (kind) {
+        case STREAM_SKEWED:
+            // a few keys carry most of the weight, like the peers flooding votes
+            for (int i = 0; i < 200000; i++) {
+                guint32 key = (guint32) pow(g_rand_double_range(rand, 1e-9, 1.0), -1.2) % TEST_KEYS;
+                guint64 weight = (guint64) g_rand_int_range(rand, 1, 1500);
+
+                exact[key] += weight;
+                nano_topk_add(topk, &key, weight);
+            }
+            break;
+        case STREAM_UNIFORM:
+            for (int i = 0; i < 200000; i++) {
+                guint32 key = (guint32) g_rand_int_range(rand, 0, TEST_KEYS);
+                guint64 weight = (guint64) g_rand_int_range(rand, 1, 1500);
+
+                exact[key] += weight;
+                nano_topk_add(topk, &key, weight);
+            }
+            break;
+        case STREAM_HEAVY_THEN_LIGHT:
+            // fills every counter high, then new keys whose sketch cells are still low take them over
+            for (guint32 key = 0; key < (guint32) ceil(1 / TEST_EPSILON); key++) {
+                exact[key] += 1000;
+                nano_topk_add(topk, &key, 1000);
+            }
+            for (guint32 key = 1000; key < 3000; key++) {
+                exact[key] += 1;
+                nano_topk_add(topk, &key, 1);
+            }
+            break;
+    }
+}
+
+static void check_stream (stream_kind_t kind) {
+    const char *name = stream_kind_names[kind];
+    nano_topk_t *topk = nano_topk_new(sizeof(guint32), TEST_EPSILON, TEST_DELTA);
+    guint64 *exact = g_new0(guint64, TEST_KEYS);
+    GRand *rand = g_rand_new_with_seed(kind + 1);
+    guint capacity = (guint) ceil(1 / TEST_EPSILON);
+    nano_topk_entry_t *entries = g_new(nano_topk_entry_t, capacity);
+    guint64 total = 0;
+
+    fill(topk, exact, kind, rand);
+    for (guint32 key = 0; key < TEST_KEYS; key++) {
+        total += exact[key];
+    }
+    check(name, nano_topk_total(topk) == total, "total differs", 0, nano_topk_total(topk), 0, total);
+
+    guint count = nano_topk_top(topk, capacity, entries);
+    guint64 smallest = count == capacity ? entries[count - 1].count : 0;
+
+    for (guint i = 0; i < count; i++) {
+        guint32 key;
+
+        memcpy(&key, entries[i].key, sizeof(key));
+        check(name, entries[i].count >= exact[key], "count below the exact count", key, entries[i].count, entries[i].error, exact[key]);
+        check(name, entries[i].count - entries[i].error <= exact[key], "count over by more than its error", key, entries[i].count, entries[i].error, exact[key]);
+        check(name, entries[i].count - exact[key] <= (guint64) (TEST_EPSILON * total), "count over by more than epsilon times the total", key, entries[i].count, entries[i].error, exact[key]);
+        check(name, nano_topk_count(topk, &key) == entries[i].count, "counter not found by its key", key, nano_topk_count(topk, &key), entries[i].error, exact[key]);
+    }
+
+    for (guint32 key = 0; key < TEST_KEYS; key++) {
+        if (exact[key] > smallest) {
+            check(name, nano_topk_count(topk, &key) != 0, "key above the smallest counter has none", key, smallest, 0, exact[key]);
+        }
+    }
+
+    g_free(entries);
+    g_rand_free(rand);
+    g_free(exact);
+    nano_topk_free(topk);
+}
+
+int main (void) {
+    for (guint i = 0; i < G_N_ELEMENTS(stream_kind_names); i++) {
+        check_stream((stream_kind_t) i);
+    }
+
+    printf("%d of %d checks failed\n", failures, checks);
+
+    return failures > 0;
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/
@@ -0,0 +1,962 @@
+/* nano-vantage.c
+* Propagation delays between captures taken on several nodes at once
+*
+* Wireshark - Network traffic analyzer
+* By Gerald Combs <gerald@wireshark.org>
+* Copyright 1998 Gerald Combs
+*
+* SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+ * nano-vantage [-w seconds] [-r reference] [-S] [-o prefix] [name=]export...
+ *
+ *   tshark -r west.pcapng -q -z nano,export,csv,west
+ *   tshark -r east.pcapng -q -z nano,export,csv,east
+ *   nano-vantage -o delays west east
+ *
+ * reads the CSV exports (<export>.blocks.csv and <export>.votes.csv) of
+ * captures taken on several nodes at the same time and measures how long
+ * publishes, confirm_reqs, confirm_ack blocks and votes take to get from one
+ * node to another. A message is recognized at every node by the first 16
+ * bytes of its signature.
+ *
+ * The capture clocks do not agree. The first pass fits the clock difference
+ * of every pair of captures against time with Theil-Sen regression over a
+ * reservoir sample of their common messages: messages travel both ways, so
+ * the delays scatter around the clock difference and the medians ignore the
+ * slow ones. The pairwise fits are combined into an offset and a skew per
+ * capture, relative to the reference capture (the first one by default), by
+ * weighted least squares. -S fits offsets only, for short captures.
+ *
+ * The second pass corrects every timestamp and records, for every message,
+ * the delay from each node that saw it to each node that saw it later.
+ *
+ * Both passes stream the exports through a k-way merge on time. A message is
+ * settled once the merge is window seconds (30 by default) past its first
+ * sighting, so memory holds a window of messages rather than the captures;
+ * the window has to cover the clock offsets as well as the delays.
+ *
+ * Writes <prefix>.offsets.csv, <prefix>.delays.csv with the count, mean and
+ * quantiles for each message type and node pair, and <prefix>.histogram.csv
+ * with the distributions in ten logarithmic buckets per decade ("vantage" is
+ * the default prefix). Quantiles are the upper edges of their buckets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "packet-nano.h"
+
+#define FINGERPRINT_LENGTH 16
+
+#define NS_PER_SECOND G_GINT64_CONSTANT(1000000000)
+#define DEFAULT_WINDOW 30
+
+#define UNSEEN G_MININT64
+
+// common messages kept per pair of captures for the clock fit, and slopes tried at most
+#define RESERVOIR_SIZE 4096
+#define MAX_SLOPES 200000
+#define SOLVER_ROUNDS 1000
+
+// ten buckets per decade from 1 us to 100 s, the last one takes everything above
+#define HISTOGRAM_BUCKETS 82
+#define HISTOGRAM_FIRST_EDGE 1000.0
+#define HISTOGRAM_STEP 1.2589254117941673
+
+enum {
+    MESSAGE_PUBLISH,
+    MESSAGE_CONFIRM_REQ,
+    MESSAGE_CONFIRM_ACK,
+    MESSAGE_VOTE,
+    MESSAGES
+};
+
+static const char *message_names[MESSAGES] = { "publish", "confirm_req", "confirm_ack", "vote" };
+
+typedef struct {
+    gchar *name;
+    gchar *prefix;
+
+    // local = true + offset + skew * (local - epoch), nanoseconds
+    gdouble offset;
+    gdouble skew;
+    gboolean connected;
+} vantage_t;
+
+// one export table of one capture, at its current row
+typedef struct {
+    FILE *fh;
+    gchar *path;
+    guint vantage;
+    gboolean votes;
+    int time_column;
+    int type_column;
+    int signature_column;
+    GString *line;
+    guint64 malformed;
+
+    gint64 time;
+    int message;
+    guint8 fingerprint[FINGERPRINT_LENGTH];
+} stream_t;
+
+// a message and when each capture first saw it
+typedef struct {
+    int message;
+    guint8 fingerprint[FINGERPRINT_LENGTH];
+    gint64 first;
+    gint64 *seen;
+} sighting_t;
+
+// common messages of captures i < j: time at i since the epoch and the clock difference j - i
+typedef struct {
+    guint64 matches;
+    guint kept;
+    gdouble *times;
+    gdouble *differences;
+
+    gdouble offset;
+    gdouble skew;
+} pair_t;
+
+typedef struct {
+    guint64 count;
+    gdouble sum;
+    gint64 max;
+    guint64 buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+static vantage_t *vantages;
+static guint vantage_count;
+
+static gboolean correct_clocks;
+static gboolean epoch_set;
+static gint64 epoch;
+
+static pair_t *pairs;
+static GRand *reservoir_rand;
+
+static histogram_t *histograms;
+static gdouble histogram_edges[HISTOGRAM_BUCKETS];
+
+static void usage (void) {
+    fprintf(stderr, "usage: nano-vantage [-w seconds] [-r reference] [-S] [-o prefix] [name=]export...\n");
+    fprintf(stderr, "  export: prefix given to -z nano,export,csv for the capture of one node, two or more\n");
+    fprintf(stderr, "  -w: seconds a message may take to reach every node, clock offsets included (default %d)\n", DEFAULT_WINDOW);
+    fprintf(stderr, "  -r: capture whose clock the others are corrected to (default the first)\n");
+    fprintf(stderr, "  -S: fit clock offsets only, no skew\n");
+    fprintf(stderr, "  -o: output prefix (default vantage)\n");
+    exit(1);
+}
+
+//
+// Exports
+//
+
+static const char *csv_field (const char *line, int column, gsize *length) {
+    const char *start = line;
+
+    for (int i = 0; i < column; i++) {
+        start = strchr(start, ',');
+        if (!start) {
+            return NULL;
+        }
+        start++;
+    }
+
+    const char *end = strchr(start, ',');
+    *length = end ? (gsize) (end - start) : strlen(start);
+
+    return start;
+}
+
+// seconds.nanoseconds as written by the export
+static gboolean parse_time (const char *field, gsize length, gint64 *time) {
+    gint64 seconds = 0;
+    gint64 fraction = 0;
+    int digits = 0;
+    gsize i = 0;
+
+    for (; i < length && g_ascii_isdigit(field[i]); i++) {
+        seconds = seconds * 10 + (field[i] - '0');
+    }
+    if (i == 0) {
+        return FALSE;
+    }
+
+    if (i < length && field[i] == '.') {
+        for (i++; i < length && g_ascii_isdigit(field[i]); i++) {
+            if (digits < 9) {
+                fraction = fraction * 10 + (field[i] - '0');
+                digits++;
+            }
+        }
+    }
+    if (i != length) {
+        return FALSE;
+    }
+
+    for (; digits < 9; digits++) {
+        fraction *= 10;
+    }
+    *time = seconds * NS_PER_SECOND + fraction;
+
+    return TRUE;
+}
+
+static gboolean parse_fingerprint (const char *field, gsize length, guint8 *fingerprint) {
+    if (length < 2 * FINGERPRINT_LENGTH) {
+        return FALSE;
+    }
+
+    for (int i = 0; i < FINGERPRINT_LENGTH; i++) {
+        int high = g_ascii_xdigit_value(field[2 * i]);
+        int low = g_ascii_xdigit_value(field[2 * i + 1]);
+
+        if (high < 0 || low < 0) {
+            return FALSE;
+        }
+        fingerprint[i] = (guint8) (high << 4 | low);
+    }
+
+    return TRUE;
+}
+
+static int message_of_packet_type (int packet_type) {
+    switch (packet_type) {
+        case NANO_PACKET_TYPE_PUBLISH:
+            return MESSAGE_PUBLISH;
+        case NANO_PACKET_TYPE_CONFIRM_REQ:
+            return MESSAGE_CONFIRM_REQ;
+        case NANO_PACKET_TYPE_CONFIRM_ACK:
+            return MESSAGE_CONFIRM_ACK;
+    }
+
+    // bootstrap blocks do not propagate
+    return -1;
+}
+
+static gboolean read_line (stream_t *stream) {
+    char chunk[4096];
+
+    g_string_truncate(stream->line, 0);
+    while (fgets(chunk, sizeof(chunk), stream->fh)) {
+        g_string_append(stream->line, chunk);
+        if (stream->line->str[stream->line->len - 1] == '\n') {
+            break;
+        }
+    }
+
+    if (stream->line->len == 0) {
+        return FALSE;
+    }
+
+    while (stream->line->len && (stream->line->str[stream->line->len - 1] == '\n' || stream->line->str[stream->line->len - 1] == '\r')) {
+        g_string_truncate(stream->line, stream->line->len - 1);
+    }
+
+    return TRUE;
+}
+
+static int header_column (gchar **names, const char *name) {
+    for (int i = 0; names[i]; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// NULL if the capture has no such table
+static stream_t *stream_open (guint vantage, gboolean votes) {
+    stream_t *stream;
+    gchar *path = g_strdup_printf("%s.%s.csv", vantages[vantage].prefix, votes ? "votes" : "blocks");
+    FILE *fh = fopen(path, "r");
+
+    if (!fh) {
+        g_free(path);
+        return NULL;
+    }
+
+    stream = g_new0(stream_t, 1);
+    stream->fh = fh;
+    stream->path = path;
+    stream->vantage = vantage;
+    stream->votes = votes;
+    stream->line = g_string_new(NULL);
+
+    if (!read_line(stream)) {
+        stream->time_column = -1;
+    } else {
+        gchar **names = g_strsplit(stream->line->str, ",", -1);
+
+        stream->time_column = header_column(names, "time");
+        stream->type_column = votes ? 0 : header_column(names, "packet_type");
+        stream->signature_column = header_column(names, "signature");
+        g_strfreev(names);
+    }
+
+    if (stream->time_column < 0 || stream->type_column < 0 || stream->signature_column < 0) {
+        fprintf(stderr, "nano-vantage: %s is not a Nano %s export\n", path, votes ? "votes" : "blocks");
+        exit(1);
+    }
+
+    return stream;
+}
+
+static void stream_close (stream_t *stream) {
+    if (stream->malformed) {
+        fprintf(stderr, "nano-vantage: %s: skipped %" G_GUINT64_FORMAT " malformed rows\n", stream->path, stream->malformed);
+    }
+
+    fclose(stream->fh);
+    g_string_free(stream->line, TRUE);
+    g_free(stream->path);
+    g_free(stream);
+}
+
+static gint64 corrected_time (guint vantage, gint64 time) {
+    const vantage_t *v = &vantages[vantage];
+
+    if (!correct_clocks) {
+        return time;
+    }
+
+    return time - (gint64) (v->offset + v->skew * (gdouble) (time - epoch));
+}
+
+// moves to the next row that propagates, FALSE at the end of the table
+static gboolean stream_next (stream_t *stream) {
+    while (read_line(stream)) {
+        const char *field;
+        gsize length;
+
+        if (stream->votes) {
+            stream->message = MESSAGE_VOTE;
+        } else {
+            field = csv_field(stream->line->str, stream->type_column, &length);
+            if (!field || length == 0) {
+                stream->malformed++;
+                continue;
+            }
+            stream->message = message_of_packet_type(atoi(field));
+            if (stream->message < 0) {
+                continue;
+            }
+        }
+
+        field = csv_field(stream->line->str, stream->time_column, &length);
+        if (!field || !parse_time(field, length, &stream->time)) {
+            stream->malformed++;
+            continue;
+        }
+
+        field = csv_field(stream->line->str, stream->signature_column, &length);
+        if (!field || !parse_fingerprint(field, length, stream->fingerprint)) {
+            stream->malformed++;
+            continue;
+        }
+
+        stream->time = corrected_time(stream->vantage, stream->time);
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+//
+// k-way merge, a min-heap of streams on the time of their current row
+//
+
+typedef struct {
+    stream_t **heap;
+    guint count;
+} merge_t;
+
+static void merge_sift_down (merge_t *merge, guint position) {
+    stream_t *stream = merge->heap[position];
+
+    for (;;) {
+        guint child = 2 * position + 1;
+
+        if (child >= merge->count) {
+            break;
+        }
+        if (child + 1 < merge->count && merge->heap[child + 1]->time < merge->heap[child]->time) {
+            child++;
+        }
+        if (stream->time <= merge->heap[child]->time) {
+            break;
+        }
+
+        merge->heap[position] = merge->heap[child];
+        position = child;
+    }
+
+    merge->heap[position] = stream;
+}
+
+static void merge_open (merge_t *merge) {
+    merge->heap = g_new(stream_t *, 2 * vantage_count);
+    merge->count = 0;
+
+    for (guint vantage = 0; vantage < vantage_count; vantage++) {
+        guint tables = 0;
+
+        for (int votes = 0; votes < 2; votes++) {
+            stream_t *stream = stream_open(vantage, votes);
+
+            if (!stream) {
+                continue;
+            }
+            tables++;
+
+            if (stream_next(stream)) {
+                merge->heap[merge->count++] = stream;
+            } else {
+                stream_close(stream);
+            }
+        }
+
+        if (tables == 0) {
+            fprintf(stderr, "nano-vantage: no %s.blocks.csv or %s.votes.csv\n", vantages[vantage].prefix, vantages[vantage].prefix);
+            exit(1);
+        }
+    }
+
+    for (guint i = merge->count / 2; i-- > 0;) {
+        merge_sift_down(merge, i);
+    }
+}
+
+// the earliest row of all tables, the stream stays on it until merge_advance
+static stream_t *merge_peek (merge_t *merge) {
+    return merge->count ? merge->heap[0] : NULL;
+}
+
+static void merge_advance (merge_t *merge) {
+    stream_t *stream = merge->heap[0];
+
+    if (!stream_next(stream)) {
+        stream_close(stream);
+        merge->heap[0] = merge->heap[--merge->count];
+        if (merge->count == 0) {
+            return;
+        }
+    }
+
+    merge_sift_down(merge, 0);
+}
+
+static void merge_close (merge_t *merge) {
+    g_free(merge->heap);
+}
+
+//
+// Sightings of each message, settled a window after the first
+//
+
+static guint sighting_hash (gconstpointer key) {
+    const sighting_t *sighting = (const sighting_t *) key;
+    guint hash;
+
+    memcpy(&hash, sighting->fingerprint, sizeof(hash));
+
+    return hash ^ (guint) sighting->message;
+}
+
+static gboolean sighting_equal (gconstpointer a, gconstpointer b) {
+    const sighting_t *sighting_a = (const sighting_t *) a;
+    const sighting_t *sighting_b = (const sighting_t *) b;
+
+    return sighting_a->message == sighting_b->message && memcmp(sighting_a->fingerprint, sighting_b->fingerprint, FINGERPRINT_LENGTH) == 0;
+}
+
+// merges the exports on time and calls settle for every message seen by two captures or more
+static guint64 run_pass (gint64 window, void (*settle) (const sighting_t *sighting)) {
+    GHashTable *sightings = g_hash_table_new(sighting_hash, sighting_equal);
+    GQueue order = G_QUEUE_INIT;
+    guint64 settled = 0;
+    merge_t merge;
+    stream_t *stream;
+
+    merge_open(&merge);
+
+    for (;;) {
+        stream = merge_peek(&merge);
+
+        // settle messages whose window has passed, they are queued in the order they were first seen
+        while (!g_queue_is_empty(&order)) {
+            sighting_t *oldest = (sighting_t *) g_queue_peek_head(&order);
+            guint seen = 0;
+
+            if (stream && stream->time - oldest->first <= window) {
+                break;
+            }
+
+            for (guint vantage = 0; vantage < vantage_count; vantage++) {
+                seen += oldest->seen[vantage] != UNSEEN;
+            }
+            if (seen >= 2) {
+                settle(oldest);
+                settled++;
+            }
+
+            g_queue_pop_head(&order);
+            g_hash_table_remove(sightings, oldest);
+            g_free(oldest);
+        }
+
+        if (!stream) {
+            break;
+        }
+
+        if (!epoch_set) {
+            epoch = stream->time;
+            epoch_set = TRUE;
+        }
+
+        sighting_t key;
+        sighting_t *sighting;
+
+        key.message = stream->message;
+        memcpy(key.fingerprint, stream->fingerprint, FINGERPRINT_LENGTH);
+
+        sighting = (sighting_t *) g_hash_table_lookup(sightings, &key);
+        if (!sighting) {
+            sighting = (sighting_t *) g_malloc(sizeof(sighting_t) + vantage_count * sizeof(gint64));
+            sighting->message = key.message;
+            memcpy(sighting->fingerprint, key.fingerprint, FINGERPRINT_LENGTH);
+            sighting->first = stream->time;
+            sighting->seen = (gint64 *) (sighting + 1);
+            for (guint vantage = 0; vantage < vantage_count; vantage++) {
+                sighting->seen[vantage] = UNSEEN;
+            }
+
+            g_hash_table_add(sightings, sighting);
+            g_queue_push_tail(&order, sighting);
+        }
+
+        // a node relays a message more than once, the first time counts
+        if (sighting->seen[stream->vantage] == UNSEEN) {
+            sighting->seen[stream->vantage] = stream->time;
+        }
+
+        merge_advance(&merge);
+    }
+
+    merge_close(&merge);
+    g_hash_table_destroy(sightings);
+
+    return settled;
+}
+
+//
+// Clock offsets
+//
+
+static pair_t *pair_of (guint i, guint j) {
+    return &pairs[i * vantage_count + j];
+}
+
+static void settle_clocks (const sighting_t *sighting) {
+    for (guint i = 0; i < vantage_count; i++) {
+        if (sighting->seen[i] == UNSEEN) {
+            continue;
+        }
+
+        for (guint j = i + 1; j < vantage_count; j++) {
+            pair_t *pair = pair_of(i, j);
+            guint slot;
+
+            if (sighting->seen[j] == UNSEEN) {
+                continue;
+            }
+
+            // reservoir sampling keeps every match with the same chance
+            pair->matches++;
+            if (pair->kept < RESERVOIR_SIZE) {
+                slot = pair->kept++;
+            } else {
+                slot = (guint) (g_rand_double(reservoir_rand) * (gdouble) pair->matches);
+                if (slot >= RESERVOIR_SIZE) {
+                    continue;
+                }
+            }
+
+            pair->times[slot] = (gdouble) (sighting->seen[i] - epoch);
+            pair->differences[slot] = (gdouble) (sighting->seen[j] - sighting->seen[i]);
+        }
+    }
+}
+
+static gint compare_doubles (gconstpointer a, gconstpointer b) {
+    gdouble value_a = *(const gdouble *) a;
+    gdouble value_b = *(const gdouble *) b;
+
+    return value_a < value_b ? -1 : value_a > value_b;
+}
+
+static gdouble median (GArray *values) {
+    g_array_sort(values, compare_doubles);
+
+    if (values->len % 2) {
+        return g_array_index(values, gdouble, values->len / 2);
+    }
+
+    return (g_array_index(values, gdouble, values->len / 2 - 1) + g_array_index(values, gdouble, values->len / 2)) / 2;
+}
+
+static void add_slope (GArray *slopes, const pair_t *pair, guint a, guint b) {
+    if (pair->times[a] != pair->times[b]) {
+        gdouble slope = (pair->differences[b] - pair->differences[a]) / (pair->times[b] - pair->times[a]);
+
+        g_array_append_val(slopes, slope);
+    }
+}
+
+// Theil-Sen: the median of the slopes between samples, then the median of what is left
+static void pair_fit (pair_t *pair, gboolean fit_skew) {
+    GArray *values = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+    pair->skew = 0;
+
+    if (fit_skew && pair->kept >= 2) {
+        if ((guint64) pair->kept * (pair->kept - 1) / 2 <= MAX_SLOPES) {
+            for (guint b = 1; b < pair->kept; b++) {
+                for (guint a = 0; a < b; a++) {
+                    add_slope(values, pair, a, b);
+                }
+            }
+        } else {
+            for (guint n = 0; n < MAX_SLOPES; n++) {
+                add_slope(values, pair, (guint) g_rand_int_range(reservoir_rand, 0, (gint32) pair->kept),
+                          (guint) g_rand_int_range(reservoir_rand, 0, (gint32) pair->kept));
+            }
+        }
+
+        if (values->len) {
+            pair->skew = median(values);
+        }
+        g_array_set_size(values, 0);
+    }
+
+    for (guint k = 0; k < pair->kept; k++) {
+        gdouble residual = pair->differences[k] - pair->skew * pair->times[k];
+
+        g_array_append_val(values, residual);
+    }
+    pair->offset = values->len ? median(values) : 0;
+
+    g_array_free(values, TRUE);
+}
+
+static void mark_connected (guint vantage) {
+    vantages[vantage].connected = TRUE;
+
+    for (guint other = 0; other < vantage_count; other++) {
+        if (!vantages[other].connected && pair_of(MIN(vantage, other), MAX(vantage, other))->matches) {
+            mark_connected(other);
+        }
+    }
+}
+
+// every pair gives offset[j] - offset[i]; Gauss-Seidel settles on the least squares fit, weighted by sample size
+static void solve_clocks (guint reference) {
+    mark_connected(reference);
+
+    for (int round = 0; round < SOLVER_ROUNDS; round++) {
+        for (guint v = 0; v < vantage_count; v++) {
+            gdouble weights = 0, offset = 0, skew = 0;
+
+            if (v == reference || !vantages[v].connected) {
+                continue;
+            }
+
+            for (guint u = 0; u < vantage_count; u++) {
+                pair_t *pair = pair_of(MIN(u, v), MAX(u, v));
+                gdouble sign = u < v ? 1 : -1;
+
+                if (u == v || !pair->matches) {
+                    continue;
+                }
+
+                weights += pair->kept;
+                offset += pair->kept * (vantages[u].offset + sign * pair->offset);
+                skew += pair->kept * (vantages[u].skew + sign * pair->skew);
+            }
+
+            vantages[v].offset = offset / weights;
+            vantages[v].skew = skew / weights;
+        }
+    }
+}
+
+//
+// Delays
+//
+
+static histogram_t *histogram_of (int message, guint from, guint to) {
+    return &histograms[((gsize) message * vantage_count + from) * vantage_count + to];
+}
+
+static void histogram_add (histogram_t *histogram, gint64 delay) {
+    guint bucket = 0;
+
+    while (bucket + 1 < HISTOGRAM_BUCKETS && (gdouble) delay > histogram_edges[bucket]) {
+        bucket++;
+    }
+
+    histogram->count++;
+    histogram->sum += (gdouble) delay;
+    histogram->max = MAX(histogram->max, delay);
+    histogram->buckets[bucket]++;
+}
+
+// upper edge of the bucket holding the quantile, at most the largest delay
+static gdouble histogram_quantile (const histogram_t *histogram, gdouble quantile) {
+    guint64 rank = MAX((guint64) (quantile * (gdouble) histogram->count + 0.5), 1);
+    guint64 below = 0;
+
+    for (guint bucket = 0; bucket + 1 < HISTOGRAM_BUCKETS; bucket++) {
+        below += histogram->buckets[bucket];
+        if (below >= rank) {
+            return MIN(histogram_edges[bucket], (gdouble) histogram->max);
+        }
+    }
+
+    return (gdouble) histogram->max;
+}
+
+static void settle_delays (const sighting_t *sighting) {
+    for (guint from = 0; from < vantage_count; from++) {
+        if (sighting->seen[from] == UNSEEN) {
+            continue;
+        }
+
+        for (guint to = 0; to < vantage_count; to++) {
+            if (to == from || sighting->seen[to] == UNSEEN) {
+                continue;
+            }
+
+            // ties count once, from the lower capture
+            if (sighting->seen[to] > sighting->seen[from] || (sighting->seen[to] == sighting->seen[from] && from < to)) {
+                histogram_add(histogram_of(sighting->message, from, to), sighting->seen[to] - sighting->seen[from]);
+            }
+        }
+    }
+}
+
+//
+// Output
+//
+
+static FILE *open_output (const char *prefix, const char *name, const char *header) {
+    gchar *path = g_strdup_printf("%s.%s.csv", prefix, name);
+    FILE *fh = fopen(path, "w");
+
+    if (!fh) {
+        fprintf(stderr, "nano-vantage: cannot write %s\n", path);
+        exit(1);
+    }
+
+    fputs(header, fh);
+    g_free(path);
+
+    return fh;
+}
+
+static void write_offsets (const char *prefix, guint reference) {
+    FILE *fh = open_output(prefix, "offsets", "vantage,reference,offset_ms,skew_ppm,matches\n");
+
+    for (guint v = 0; v < vantage_count; v++) {
+        guint64 matches = 0;
+
+        for (guint u = 0; u < vantage_count; u++) {
+            if (u != v) {
+                matches += pair_of(MIN(u, v), MAX(u, v))->matches;
+            }
+        }
+
+        if (vantages[v].connected) {
+            fprintf(fh, "%s,%s,%.6f,%.3f,%" G_GUINT64_FORMAT "\n", vantages[v].name, vantages[reference].name,
+                    vantages[v].offset / 1e6, vantages[v].skew * 1e6, matches);
+        } else {
+            fprintf(fh, "%s,%s,,,%" G_GUINT64_FORMAT "\n", vantages[v].name, vantages[reference].name, matches);
+        }
+    }
+
+    fclose(fh);
+}
+
+static void write_delays (const char *prefix) {
+    FILE *delays = open_output(prefix, "delays", "type,from,to,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+    FILE *buckets = open_output(prefix, "histogram", "type,from,to,le_ms,count\n");
+
+    for (int message = 0; message < MESSAGES; message++) {
+        for (guint from = 0; from < vantage_count; from++) {
+            for (guint to = 0; to < vantage_count; to++) {
+                const histogram_t *histogram = histogram_of(message, from, to);
+
+                if (!histogram->count) {
+                    continue;
+                }
+
+                fprintf(delays, "%s,%s,%s,%" G_GUINT64_FORMAT ",%.6f,%.6f,%.6f,%.6f,%.6f\n",
+                        message_names[message], vantages[from].name, vantages[to].name, histogram->count,
+                        histogram->sum / (gdouble) histogram->count / 1e6,
+                        histogram_quantile(histogram, 0.5) / 1e6, histogram_quantile(histogram, 0.9) / 1e6,
+                        histogram_quantile(histogram, 0.99) / 1e6, (gdouble) histogram->max / 1e6);
+
+                for (guint bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+                    if (!histogram->buckets[bucket]) {
+                        continue;
+                    }
+
+                    if (bucket + 1 < HISTOGRAM_BUCKETS) {
+                        fprintf(buckets, "%s,%s,%s,%.6f,%" G_GUINT64_FORMAT "\n", message_names[message],
+                                vantages[from].name, vantages[to].name, histogram_edges[bucket] / 1e6, histogram->buckets[bucket]);
+                    } else {
+                        fprintf(buckets, "%s,%s,%s,+Inf,%" G_GUINT64_FORMAT "\n", message_names[message],
+                                vantages[from].name, vantages[to].name, histogram->buckets[bucket]);
+                    }
+                }
+            }
+        }
+    }
+
+    fclose(delays);
+    fclose(buckets);
+}
+
+int main (int argc, char **argv) {
+    const char *prefix = "vantage";
+    const char *reference_name = NULL;
+    guint reference = 0;
+    gboolean fit_skew = TRUE;
+    gint64 window = DEFAULT_WINDOW * NS_PER_SECOND;
+    GPtrArray *exports = g_ptr_array_new();
+    guint64 matched;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            window = (gint64) (g_ascii_strtod(argv[++i], NULL) * NS_PER_SECOND);
+            if (window <= 0) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reference_name = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            prefix = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0) {
+            fit_skew = FALSE;
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            g_ptr_array_add(exports, argv[i]);
+        }
+    }
+
+    if (exports->len < 2) {
+        usage();
+    }
+
+    vantage_count = exports->len;
+    vantages = g_new0(vantage_t, vantage_count);
+    for (guint v = 0; v < vantage_count; v++) {
+        const char *name = (const char *) g_ptr_array_index(exports, v);
+        const char *equals = strchr(name, '=');
+
+        if (equals) {
+            vantages[v].name = g_strndup(name, equals - name);
+            vantages[v].prefix = g_strdup(equals + 1);
+        } else {
+            vantages[v].name = g_path_get_basename(name);
+            vantages[v].prefix = g_strdup(name);
+        }
+
+        if (reference_name && strcmp(vantages[v].name, reference_name) == 0) {
+            reference = v;
+            reference_name = NULL;
+        }
+    }
+    g_ptr_array_free(exports, TRUE);
+
+    if (reference_name) {
+        fprintf(stderr, "nano-vantage: no capture named %s\n", reference_name);
+        return 1;
+    }
+
+    // fixed seed, the same exports give the same offsets
+    reservoir_rand = g_rand_new_with_seed(0x4e414e4f);
+    pairs = g_new0(pair_t, (gsize) vantage_count * vantage_count);
+    for (guint i = 0; i < vantage_count; i++) {
+        for (guint j = i + 1; j < vantage_count; j++) {
+            pair_of(i, j)->times = g_new(gdouble, RESERVOIR_SIZE);
+            pair_of(i, j)->differences = g_new(gdouble, RESERVOIR_SIZE);
+        }
+    }
+
+    matched = run_pass(window, settle_clocks);
+
+    for (guint i = 0; i < vantage_count; i++) {
+        for (guint j = i + 1; j < vantage_count; j++) {
+            pair_fit(pair_of(i, j), fit_skew);
+        }
+    }
+    solve_clocks(reference);
+
+    for (guint v = 0; v < vantage_count; v++) {
+        if (!vantages[v].connected) {
+            fprintf(stderr, "nano-vantage: %s shares no messages with %s, its delays are not corrected\n", vantages[v].name, vantages[reference].name);
+        }
+    }
+    write_offsets(prefix, reference);
+
+    histograms = g_new0(histogram_t, (gsize) MESSAGES * vantage_count * vantage_count);
+    histogram_edges[0] = HISTOGRAM_FIRST_EDGE;
+    for (guint bucket = 1; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        histogram_edges[bucket] = histogram_edges[bucket - 1] * HISTOGRAM_STEP;
+    }
+
+    correct_clocks = TRUE;
+    run_pass(window, settle_delays);
+    write_delays(prefix);
+
+    fprintf(stderr, "nano-vantage: %" G_GUINT64_FORMAT " messages seen by more than one capture\n", matched);
+
+    for (guint i = 0; i < vantage_count; i++) {
+        for (guint j = i + 1; j < vantage_count; j++) {
+            g_free(pair_of(i, j)->times);
+            g_free(pair_of(i, j)->differences);
+        }
+        g_free(vantages[i].name);
+        g_free(vantages[i].prefix);
+    }
+    g_free(pairs);
+    g_free(histograms);
+    g_free(vantages);
+    g_rand_free(reservoir_rand);
+
+    return 0;
+}
+
+/*
+* Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+*
+* Local variables:
+* c-basic-offset: 4
+* tab-width: 8
+* indent-tabs-mode: nil
+* End:
+*
+* vi: set shiftwidth=4 tabstop=8 expandtab:
+* :indentSize=4:tabSize=8:noTabs=true:
+*/